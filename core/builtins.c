@@ -0,0 +1,1026 @@
+#include "microphp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Script output goes through the VM's buffered sink
+static void write_output(void *user, const char *data, size_t len) {
+    microphp_output_write(user, data, len);
+}
+
+static zval_t native_echo(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_echo_write(args, count, write_output, vm);
+    return microphp_zval_null();
+}
+
+static zval_t native_print(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_print_write(args, count, write_output, vm);
+    return microphp_zval_null();
+}
+
+// sleep_ms suspends only the calling task; the others keep running
+static zval_t native_sleep_ms(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || args[0].type != ZVAL_INT || args[0].value.int_val < 0) {
+        return microphp_zval_null();
+    }
+    
+    int64_t ms = args[0].value.int_val;
+    microphp_task_sleep(vm, ms > UINT32_MAX / 2 ? UINT32_MAX / 2 : (uint32_t)ms);
+    return microphp_zval_null();
+}
+
+static zval_t native_millis(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)args;
+    (void)count;
+    return microphp_zval_int(microphp_vm_millis(vm));
+}
+
+// task_spawn("name", args...) runs name(args...) as a new task. Returns
+// its id, or false when no task slot is free.
+static zval_t native_task_spawn(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || args[0].type != ZVAL_STRING || !microphp_string_data(&args[0])) {
+        return microphp_zval_bool(false);
+    }
+    
+    int id = microphp_task_spawn(vm, microphp_string_data(&args[0]), args + 1, count - 1);
+    return id < 0 ? microphp_zval_bool(false) : microphp_zval_int(id);
+}
+
+static zval_t native_task_yield(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)args;
+    (void)count;
+    microphp_task_sleep(vm, 0);
+    return microphp_zval_null();
+}
+
+// gpio_on(pin, edges, "name") calls name(pin, level, time_us) on each
+// edge: 1 rising, 2 falling, 3 both. Returns false if it cannot be armed.
+static zval_t native_gpio_on(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 3 || args[0].type != ZVAL_INT || args[1].type != ZVAL_INT ||
+        args[2].type != ZVAL_STRING || !microphp_string_data(&args[2])) {
+        return microphp_zval_bool(false);
+    }
+    
+    int64_t pin = args[0].value.int_val;
+    int64_t edges = args[1].value.int_val;
+    if (pin < 0 || pin > INT32_MAX || edges < 0 || edges > INT32_MAX) return microphp_zval_bool(false);
+    return microphp_zval_bool(microphp_gpio_attach(vm, (int)pin, (int)edges, microphp_string_data(&args[2])) == 0);
+}
+
+static zval_t native_gpio_off(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || args[0].type != ZVAL_INT || args[0].value.int_val < 0 || args[0].value.int_val > INT32_MAX) {
+        return microphp_zval_bool(false);
+    }
+    return microphp_zval_bool(microphp_gpio_detach(vm, (int)args[0].value.int_val) == 0);
+}
+
+// timer_after(ms, "name") / timer_every(ms, "name") call name($id) once
+// or every ms. Return the timer id, or false when none is free.
+static zval_t timer_start(vm_context_t *vm, const zval_t *args, size_t count, bool periodic) {
+    if (count < 2 || args[0].type != ZVAL_INT || args[0].value.int_val < 0 ||
+        args[1].type != ZVAL_STRING || !microphp_string_data(&args[1])) {
+        return microphp_zval_bool(false);
+    }
+    
+    int64_t ms = args[0].value.int_val;
+    uint32_t delay = ms > UINT32_MAX / 2 ? UINT32_MAX / 2 : (uint32_t)ms;
+    if (periodic && delay == 0) return microphp_zval_bool(false);
+    
+    int id = microphp_timer_start(vm, delay, periodic ? delay : 0, microphp_string_data(&args[1]));
+    return id < 0 ? microphp_zval_bool(false) : microphp_zval_int(id);
+}
+
+static zval_t native_timer_after(vm_context_t *vm, const zval_t *args, size_t count) {
+    return timer_start(vm, args, count, false);
+}
+
+static zval_t native_timer_every(vm_context_t *vm, const zval_t *args, size_t count) {
+    return timer_start(vm, args, count, true);
+}
+
+static zval_t native_timer_cancel(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || args[0].type != ZVAL_INT || args[0].value.int_val < 0 || args[0].value.int_val > INT32_MAX) {
+        return microphp_zval_bool(false);
+    }
+    return microphp_zval_bool(microphp_timer_cancel(vm, (int)args[0].value.int_val) == 0);
+}
+
+// Asynchronous transfers: each *_async call returns a handle for
+// io_await (or io_done), or false when it cannot start. Writes take the
+// bytes as a string, reads a byte count.
+static bool small_int(const zval_t *arg) {
+    return arg->type == ZVAL_INT && arg->value.int_val >= 0 && arg->value.int_val <= INT32_MAX;
+}
+
+static zval_t io_start(vm_context_t *vm, int kind, int bus, int addr, const zval_t *data) {
+    microphp_io_request_t request = { kind, bus, addr, NULL, 0, NULL, 0, NULL, 0 };
+    if (data->type == ZVAL_STRING) {
+        request.tx = (const uint8_t*)microphp_string_data(data);
+        request.tx_len = microphp_string_data(data) ? microphp_string_len(data) : 0;
+    } else {
+        request.rx_len = (size_t)data->value.int_val;
+    }
+    
+    int handle = microphp_io_start(vm, &request);
+    return handle < 0 ? microphp_zval_bool(false) : microphp_zval_int(handle);
+}
+
+// spi_xfer_async(host, bytes): clocks bytes out, receiving as many
+static zval_t native_spi_xfer_async(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 2 || !small_int(&args[0]) || args[1].type != ZVAL_STRING) return microphp_zval_bool(false);
+    return io_start(vm, MICROPHP_IO_SPI, (int)args[0].value.int_val, 0, &args[1]);
+}
+
+static zval_t native_uart_write_async(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 2 || !small_int(&args[0]) || args[1].type != ZVAL_STRING) return microphp_zval_bool(false);
+    return io_start(vm, MICROPHP_IO_UART_WRITE, (int)args[0].value.int_val, 0, &args[1]);
+}
+
+static zval_t native_uart_read_async(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 2 || !small_int(&args[0]) || !small_int(&args[1])) return microphp_zval_bool(false);
+    return io_start(vm, MICROPHP_IO_UART_READ, (int)args[0].value.int_val, 0, &args[1]);
+}
+
+// i2c_write_async(port, addr, bytes) / i2c_read_async(port, addr, n)
+static zval_t native_i2c_write_async(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 3 || !small_int(&args[0]) || !small_int(&args[1]) || args[2].type != ZVAL_STRING) {
+        return microphp_zval_bool(false);
+    }
+    return io_start(vm, MICROPHP_IO_I2C_WRITE, (int)args[0].value.int_val, (int)args[1].value.int_val, &args[2]);
+}
+
+static zval_t native_i2c_read_async(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 3 || !small_int(&args[0]) || !small_int(&args[1]) || !small_int(&args[2])) {
+        return microphp_zval_bool(false);
+    }
+    return io_start(vm, MICROPHP_IO_I2C_READ, (int)args[0].value.int_val, (int)args[1].value.int_val, &args[2]);
+}
+
+// io_await(handle) suspends the calling task until the transfer is done,
+// then returns the bytes read (the count for writes), or false
+static zval_t native_io_await(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || !small_int(&args[0])) return microphp_zval_bool(false);
+    return microphp_io_await(vm, (int)args[0].value.int_val);
+}
+
+static zval_t native_io_done(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || !small_int(&args[0])) return microphp_zval_bool(false);
+    return microphp_zval_bool(microphp_io_done(vm, (int)args[0].value.int_val));
+}
+
+// Bytes for a write step: a string, or an array of ints 0-255
+static bool payload_len(const zval_t *data, size_t *len) {
+    if (data->type == ZVAL_STRING) {
+        *len = microphp_string_data(data) ? microphp_string_len(data) : 0;
+        return true;
+    }
+    if (data->type != ZVAL_ARRAY) return false;
+    
+    for (size_t i = 0; i < data->value.array_val.size; i++) {
+        zval_t byte = microphp_zval_null();
+        microphp_array_get(data, i, &byte);
+        bool valid = byte.type == ZVAL_INT && byte.value.int_val >= 0 && byte.value.int_val <= 255;
+        microphp_zval_destroy(&byte);
+        if (!valid) return false;
+    }
+    *len = data->value.array_val.size;
+    return true;
+}
+
+static void payload_copy(const zval_t *data, uint8_t *out) {
+    if (data->type == ZVAL_STRING) {
+        if (microphp_string_data(data)) memcpy(out, microphp_string_data(data), microphp_string_len(data));
+        return;
+    }
+    for (size_t i = 0; i < data->value.array_val.size; i++) {
+        zval_t byte = microphp_zval_null();
+        microphp_array_get(data, i, &byte);
+        out[i] = (uint8_t)byte.value.int_val;
+    }
+}
+
+// i2c_xfer(bus, [[0, addr, bytes], [1, addr, n], ...]) and
+// spi_xfer(host, [[0, bytes], [1, n], [2, bytes], ...]) run the steps
+// (0 write, 1 read, 2 full duplex) back to back as one transaction and
+// return everything read as one string, or false. Only the calling task
+// waits for the bus.
+static zval_t xfer_list(vm_context_t *vm, const zval_t *args, size_t count, int kind) {
+    if (count < 2 || !small_int(&args[0]) || args[1].type != ZVAL_ARRAY || args[1].value.array_val.size == 0 ||
+        microphp_array_kind(&args[1])) {
+        return microphp_zval_bool(false);
+    }
+    
+    bool i2c = kind == MICROPHP_IO_I2C_LIST;
+    const zval_t *steps = args[1].value.array_val.data;
+    size_t step_count = args[1].value.array_val.size;
+    
+    // Sizes first, so each buffer is allocated once
+    size_t tx_len = 0;
+    size_t rx_len = 0;
+    for (size_t i = 0; i < step_count; i++) {
+        if (steps[i].type != ZVAL_ARRAY || steps[i].value.array_val.size < (i2c ? 3u : 2u) ||
+            microphp_array_kind(&steps[i])) {
+            return microphp_zval_bool(false);
+        }
+        const zval_t *field = steps[i].value.array_val.data;
+        const zval_t *data = &field[i2c ? 2 : 1];
+        if (!small_int(&field[0]) || field[0].value.int_val > MICROPHP_IO_OP_XFER) return microphp_zval_bool(false);
+        if (i2c && (!small_int(&field[1]) || field[1].value.int_val > 127)) return microphp_zval_bool(false);
+        
+        size_t len;
+        if (field[0].value.int_val == MICROPHP_IO_OP_READ) {
+            if (!small_int(data)) return microphp_zval_bool(false);
+            rx_len += (size_t)data->value.int_val;
+        } else {
+            if (!payload_len(data, &len)) return microphp_zval_bool(false);
+            tx_len += len;
+            if (field[0].value.int_val == MICROPHP_IO_OP_XFER) rx_len += len;
+        }
+        if (tx_len > INT32_MAX || rx_len > INT32_MAX) return microphp_zval_bool(false);
+    }
+    
+    microphp_io_op_t *ops = malloc(step_count * sizeof(microphp_io_op_t));
+    uint8_t *tx = malloc(tx_len ? tx_len : 1);
+    if (!ops || !tx) {
+        free(ops);
+        free(tx);
+        return microphp_zval_bool(false);
+    }
+    
+    uint32_t tx_offset = 0;
+    uint32_t rx_offset = 0;
+    for (size_t i = 0; i < step_count; i++) {
+        const zval_t *field = steps[i].value.array_val.data;
+        const zval_t *data = &field[i2c ? 2 : 1];
+        microphp_io_op_t *op = &ops[i];
+        op->type = (uint8_t)field[0].value.int_val;
+        op->addr = i2c ? (uint8_t)field[1].value.int_val : 0;
+        op->tx_offset = tx_offset;
+        op->rx_offset = rx_offset;
+        
+        size_t len = 0;
+        if (op->type == MICROPHP_IO_OP_READ) {
+            len = (size_t)data->value.int_val;
+        } else {
+            payload_len(data, &len);
+            payload_copy(data, tx + tx_offset);
+            tx_offset += (uint32_t)len;
+        }
+        if (op->type != MICROPHP_IO_OP_WRITE) rx_offset += (uint32_t)len;
+        op->len = (uint32_t)len;
+    }
+    
+    microphp_io_request_t request = { kind, (int)args[0].value.int_val, 0, tx, tx_len, NULL, rx_len, ops, step_count };
+    zval_t result = microphp_io_run(vm, &request);
+    free(ops);
+    free(tx);
+    return result;
+}
+
+static zval_t native_i2c_xfer(vm_context_t *vm, const zval_t *args, size_t count) {
+    return xfer_list(vm, args, count, MICROPHP_IO_I2C_LIST);
+}
+
+static zval_t native_spi_xfer(vm_context_t *vm, const zval_t *args, size_t count) {
+    return xfer_list(vm, args, count, MICROPHP_IO_SPI_LIST);
+}
+
+// Pins, PWM and ADC through the port's HAL. gpio_mode, gpio_write,
+// pwm_set and pwm_close return whether they worked; pwm_open, i2c_open
+// and uart_open return a handle for the other calls (the channel or
+// port), or false.
+static bool hal_request(int op, const zval_t *args, size_t count, size_t ints, microphp_hal_request_t *request) {
+    memset(request, 0, sizeof(*request));
+    request->op = op;
+    if (count < ints) return false;
+    for (size_t i = 0; i < ints; i++) {
+        if (!small_int(&args[i])) return false;
+        request->args[i] = (int32_t)args[i].value.int_val;
+    }
+    return true;
+}
+
+static zval_t hal_status(vm_context_t *vm, const microphp_hal_request_t *request, zval_t handle) {
+    return microphp_hal_call(vm, request) < 0 ? microphp_zval_bool(false) : handle;
+}
+
+// gpio_mode(pin, mode): INPUT, OUTPUT, INPUT_PULLUP or INPUT_PULLDOWN
+static zval_t native_gpio_mode(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_GPIO_MODE, args, count, 2, &request)) return microphp_zval_bool(false);
+    return hal_status(vm, &request, microphp_zval_bool(true));
+}
+
+static zval_t native_gpio_write(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_GPIO_WRITE, args, count, 1, &request) || count < 2) return microphp_zval_bool(false);
+    request.args[1] = microphp_zval_to_bool(&args[1]);
+    return hal_status(vm, &request, microphp_zval_bool(true));
+}
+
+static zval_t native_gpio_read(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_GPIO_READ, args, count, 1, &request)) return microphp_zval_bool(false);
+    return microphp_zval_bool(microphp_hal_call(vm, &request) > 0);
+}
+
+// pwm_open(channel, pin, freq_hz[, duty])
+static zval_t native_pwm_open(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_PWM_OPEN, args, count, 3, &request)) return microphp_zval_bool(false);
+    request.duty = count >= 4 ? (float)microphp_zval_to_float(&args[3]) : 0.0f;
+    return hal_status(vm, &request, microphp_zval_int(request.args[0]));
+}
+
+static zval_t native_pwm_set(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_PWM_SET, args, count, 1, &request) || count < 2) return microphp_zval_bool(false);
+    request.duty = (float)microphp_zval_to_float(&args[1]);
+    return hal_status(vm, &request, microphp_zval_bool(true));
+}
+
+static zval_t native_pwm_close(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_PWM_CLOSE, args, count, 1, &request)) return microphp_zval_bool(false);
+    return hal_status(vm, &request, microphp_zval_bool(true));
+}
+
+// i2c_open(port, scl, sda[, freq_hz]), 100 kHz by default
+static zval_t native_i2c_open(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_I2C_OPEN, args, count, 3, &request)) return microphp_zval_bool(false);
+    if (count >= 4 && !small_int(&args[3])) return microphp_zval_bool(false);
+    request.args[3] = count >= 4 ? (int32_t)args[3].value.int_val : 100000;
+    return hal_status(vm, &request, microphp_zval_int(request.args[0]));
+}
+
+// uart_open(port, baud)
+static zval_t native_uart_open(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_UART_OPEN, args, count, 2, &request)) return microphp_zval_bool(false);
+    return hal_status(vm, &request, microphp_zval_int(request.args[0]));
+}
+
+// adc_read(channel): the raw reading, or false
+static zval_t native_adc_read(vm_context_t *vm, const zval_t *args, size_t count) {
+    microphp_hal_request_t request;
+    if (!hal_request(MICROPHP_HAL_ADC_READ, args, count, 1, &request)) return microphp_zval_bool(false);
+    int32_t value = microphp_hal_call(vm, &request);
+    return value < 0 ? microphp_zval_bool(false) : microphp_zval_int(value);
+}
+
+// Blocking bus calls are single transfers: only the calling task waits.
+// Writes take a string or an array of ints 0-255 and return the count,
+// reads a byte count and return the bytes; false on failure.
+static zval_t io_run(vm_context_t *vm, int kind, int bus, int addr, const zval_t *data) {
+    microphp_io_request_t request = { kind, bus, addr, NULL, 0, NULL, 0, NULL, 0 };
+    if (data->type == ZVAL_INT) {
+        request.rx_len = (size_t)data->value.int_val;
+        return microphp_io_run(vm, &request);
+    }
+    if (data->type == ZVAL_STRING) {
+        request.tx = (const uint8_t*)microphp_string_data(data);
+        request.tx_len = microphp_string_data(data) ? microphp_string_len(data) : 0;
+        return microphp_io_run(vm, &request);
+    }
+    
+    // The transfer keeps its own copy, so the array's bytes can go once it starts
+    size_t len;
+    if (!payload_len(data, &len)) return microphp_zval_bool(false);
+    uint8_t *tx = malloc(len ? len : 1);
+    if (!tx) return microphp_zval_bool(false);
+    payload_copy(data, tx);
+    request.tx = tx;
+    request.tx_len = len;
+    zval_t result = microphp_io_run(vm, &request);
+    free(tx);
+    return result;
+}
+
+// i2c_write(port, addr, bytes) / i2c_read(port, addr, n)
+static zval_t native_i2c_write(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 3 || !small_int(&args[0]) || !small_int(&args[1]) || args[2].type == ZVAL_INT) {
+        return microphp_zval_bool(false);
+    }
+    return io_run(vm, MICROPHP_IO_I2C_WRITE, (int)args[0].value.int_val, (int)args[1].value.int_val, &args[2]);
+}
+
+static zval_t native_i2c_read(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 3 || !small_int(&args[0]) || !small_int(&args[1]) || !small_int(&args[2])) {
+        return microphp_zval_bool(false);
+    }
+    return io_run(vm, MICROPHP_IO_I2C_READ, (int)args[0].value.int_val, (int)args[1].value.int_val, &args[2]);
+}
+
+static zval_t native_uart_write(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 2 || !small_int(&args[0]) || args[1].type == ZVAL_INT) return microphp_zval_bool(false);
+    return io_run(vm, MICROPHP_IO_UART_WRITE, (int)args[0].value.int_val, 0, &args[1]);
+}
+
+static zval_t native_uart_read(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 2 || !small_int(&args[0]) || !small_int(&args[1])) return microphp_zval_bool(false);
+    return io_run(vm, MICROPHP_IO_UART_READ, (int)args[0].value.int_val, 0, &args[1]);
+}
+
+// spi_txrx(host, bytes): clocks bytes out and returns as many received
+static zval_t native_spi_txrx(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 2 || !small_int(&args[0]) || args[1].type == ZVAL_INT) return microphp_zval_bool(false);
+    return io_run(vm, MICROPHP_IO_SPI, (int)args[0].value.int_val, 0, &args[1]);
+}
+
+// exit([status]) ends the script; the status is not reported
+static zval_t native_exit(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)args;
+    (void)count;
+    microphp_vm_exit(vm);
+    return microphp_zval_null();
+}
+
+// Byte buffers: binary strings whose indexes read and write bytes as
+// ints. bytes(n) is n zero bytes; bytes("...") or bytes([ints]) copies.
+static zval_t native_bytes(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 1) return microphp_zval_bool(false);
+    if (args[0].type == ZVAL_INT) {
+        if (args[0].value.int_val < 0 || args[0].value.int_val > INT32_MAX) return microphp_zval_bool(false);
+        return microphp_zval_bytes(NULL, (size_t)args[0].value.int_val);
+    }
+    
+    size_t len;
+    if (!payload_len(&args[0], &len)) return microphp_zval_bool(false);
+    zval_t buffer = microphp_zval_bytes(NULL, len);
+    if (buffer.type == ZVAL_STRING && len > 0) payload_copy(&args[0], (uint8_t*)microphp_string_buffer(&buffer));
+    return buffer;
+}
+
+static zval_t native_bytes_len(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 1 || args[0].type != ZVAL_STRING) return microphp_zval_bool(false);
+    return microphp_zval_int((int64_t)microphp_string_len(&args[0]));
+}
+
+// bytes_slice(buf, offset[, len]) like substr, as a byte buffer
+static zval_t native_bytes_slice(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 2 || args[0].type != ZVAL_STRING || args[1].type != ZVAL_INT) return microphp_zval_bool(false);
+    
+    int64_t size = (int64_t)microphp_string_len(&args[0]);
+    int64_t start = args[1].value.int_val;
+    if (start < 0) start = start + size < 0 ? 0 : start + size;
+    if (start > size) start = size;
+    
+    int64_t len = size - start;
+    if (count >= 3 && args[2].type == ZVAL_INT) {
+        len = args[2].value.int_val;
+        if (len < 0) len = size - start + len;
+        if (len < 0) len = 0;
+        if (len > size - start) len = size - start;
+    }
+    return microphp_zval_bytes(len > 0 ? microphp_string_data(&args[0]) + start : "", (size_t)len);
+}
+
+// Typed field layouts for bytes_unpack / bytes_pack: u8 i8, then
+// u16 i16 u32 i32 f32 f64 with an le or be suffix ("float" is f32le)
+typedef struct {
+    size_t size;
+    bool is_signed;
+    bool is_float;
+    bool big_endian;
+} byte_format_t;
+
+static bool byte_format(const zval_t *arg, byte_format_t *format) {
+    if (arg->type != ZVAL_STRING || !microphp_string_data(arg)) return false;
+    const char *text = microphp_string_data(arg);
+    
+    static const struct { const char *name; size_t size; bool is_signed; bool is_float; } kinds[] = {
+        { "u8",  1, false, false }, { "i8",  1, true,  false },
+        { "u16", 2, false, false }, { "i16", 2, true,  false },
+        { "u32", 4, false, false }, { "i32", 4, true,  false },
+        { "f32", 4, true,  true  }, { "f64", 8, true,  true  },
+    };
+    if (strcmp(text, "float") == 0) text = "f32le";
+    if (strcmp(text, "double") == 0) text = "f64le";
+    
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        size_t n = strlen(kinds[i].name);
+        if (strncmp(text, kinds[i].name, n) != 0) continue;
+        
+        const char *order = text + n;
+        if (kinds[i].size == 1 ? *order != '\0' : strcmp(order, "le") != 0 && strcmp(order, "be") != 0) return false;
+        format->size = kinds[i].size;
+        format->is_signed = kinds[i].is_signed;
+        format->is_float = kinds[i].is_float;
+        format->big_endian = order[0] == 'b';
+        return true;
+    }
+    return false;
+}
+
+// bytes_unpack(buf, format[, offset]): the field at offset, or false
+static zval_t native_bytes_unpack(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    byte_format_t format;
+    if (count < 2 || args[0].type != ZVAL_STRING || !byte_format(&args[1], &format)) return microphp_zval_bool(false);
+    
+    int64_t offset = count >= 3 && args[2].type == ZVAL_INT ? args[2].value.int_val : 0;
+    if (offset < 0 || (uint64_t)offset + format.size > microphp_string_len(&args[0])) return microphp_zval_bool(false);
+    
+    const uint8_t *p = (const uint8_t*)microphp_string_data(&args[0]) + offset;
+    uint64_t raw = 0;
+    for (size_t i = 0; i < format.size; i++) {
+        raw |= (uint64_t)p[format.big_endian ? format.size - 1 - i : i] << (8 * i);
+    }
+    
+    if (format.is_float && format.size == 4) {
+        uint32_t bits = (uint32_t)raw;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return microphp_zval_float(f);
+    }
+    if (format.is_float) {
+        double d;
+        memcpy(&d, &raw, sizeof(d));
+        return microphp_zval_float(d);
+    }
+    if (format.is_signed && format.size < 8) {
+        uint64_t sign = (uint64_t)1 << (8 * format.size - 1);
+        return microphp_zval_int((int64_t)((raw ^ sign) - sign));
+    }
+    return microphp_zval_int((int64_t)raw);
+}
+
+// bytes_pack(format, value): value encoded as a byte buffer, to append
+static zval_t native_bytes_pack(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    byte_format_t format;
+    if (count < 2 || !byte_format(&args[0], &format) ||
+        (args[1].type != ZVAL_INT && args[1].type != ZVAL_FLOAT)) {
+        return microphp_zval_bool(false);
+    }
+    
+    uint64_t raw;
+    if (format.is_float) {
+        double d = args[1].type == ZVAL_FLOAT ? args[1].value.float_val : (double)args[1].value.int_val;
+        if (format.size == 4) {
+            float f = (float)d;
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            raw = bits;
+        } else {
+            memcpy(&raw, &d, sizeof(raw));
+        }
+    } else {
+        raw = args[1].type == ZVAL_INT ? (uint64_t)args[1].value.int_val : (uint64_t)(int64_t)args[1].value.float_val;
+    }
+    
+    uint8_t out[8];
+    for (size_t i = 0; i < format.size; i++) {
+        out[format.big_endian ? format.size - 1 - i : i] = (uint8_t)(raw >> (8 * i));
+    }
+    return microphp_zval_bytes(out, format.size);
+}
+
+// Packed arrays: array_packed(kind, n) is n zeros of kind "i16", "i32",
+// "f32" or "f64"; array_pack(array, kind) converts a copy of an array of
+// numbers (false if any element is not one). Either way the result is
+// still indexed, assigned and pushed like any array.
+static int packed_kind(const zval_t *arg) {
+    if (arg->type != ZVAL_STRING || !microphp_string_data(arg)) return 0;
+    static const struct { const char *name; int kind; } kinds[] = {
+        { "i16", MICROPHP_PACKED_I16 }, { "i32", MICROPHP_PACKED_I32 },
+        { "f32", MICROPHP_PACKED_F32 }, { "f64", MICROPHP_PACKED_F64 },
+    };
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(microphp_string_data(arg), kinds[i].name) == 0) return kinds[i].kind;
+    }
+    return 0;
+}
+
+static zval_t native_array_packed(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    int kind = count >= 2 ? packed_kind(&args[0]) : 0;
+    if (!kind || !small_int(&args[1])) return microphp_zval_bool(false);
+    zval_t array = microphp_array_packed(kind, (size_t)args[1].value.int_val);
+    return array.type == ZVAL_ARRAY ? array : microphp_zval_bool(false);
+}
+
+static zval_t native_array_pack(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    int kind = count >= 2 ? packed_kind(&args[1]) : 0;
+    if (!kind || args[0].type != ZVAL_ARRAY) return microphp_zval_bool(false);
+    
+    zval_t array = microphp_zval_null();
+    microphp_zval_copy(&array, &args[0]);
+    if (microphp_array_pack(&array, kind) != 0) {
+        microphp_zval_destroy(&array);
+        return microphp_zval_bool(false);
+    }
+    return array;
+}
+
+// array_sum/min/max/avg(array[, offset[, len]]) over a window of an
+// array of numbers; false when the window is empty or holds anything
+// else. Packed arrays reduce over the raw buffer.
+static zval_t array_reduce(const zval_t *args, size_t count, int op) {
+    if (count < 1 || args[0].type != ZVAL_ARRAY) return microphp_zval_bool(false);
+    
+    size_t start = 0;
+    size_t len = SIZE_MAX;
+    if (count >= 2) {
+        if (!small_int(&args[1])) return microphp_zval_bool(false);
+        start = (size_t)args[1].value.int_val;
+    }
+    if (count >= 3) {
+        if (!small_int(&args[2])) return microphp_zval_bool(false);
+        len = (size_t)args[2].value.int_val;
+    }
+    
+    zval_t result = microphp_array_reduce(&args[0], start, len, op);
+    return result.type == ZVAL_NULL ? microphp_zval_bool(false) : result;
+}
+
+static zval_t native_array_sum(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    return array_reduce(args, count, MICROPHP_REDUCE_SUM);
+}
+
+static zval_t native_array_min(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    return array_reduce(args, count, MICROPHP_REDUCE_MIN);
+}
+
+static zval_t native_array_max(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    return array_reduce(args, count, MICROPHP_REDUCE_MAX);
+}
+
+static zval_t native_array_avg(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    zval_t sum = array_reduce(args, count, MICROPHP_REDUCE_SUM);
+    if (sum.type == ZVAL_BOOL) return sum;
+    
+    // The window as array_reduce clamped it
+    size_t size = microphp_array_size(&args[0]);
+    size_t start = count >= 2 ? (size_t)args[1].value.int_val : 0;
+    size_t len = size - start;
+    if (count >= 3 && (size_t)args[2].value.int_val < len) len = (size_t)args[2].value.int_val;
+    double total = sum.type == ZVAL_FLOAT ? sum.value.float_val : (double)sum.value.int_val;
+    return microphp_zval_float(total / (double)len);
+}
+
+// array_scale(array, mul[, add]): every element times mul plus add, in a
+// new array of the same packed kind (f64 for plain arrays)
+static zval_t native_array_scale(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 2 || args[0].type != ZVAL_ARRAY) return microphp_zval_bool(false);
+    
+    double factor[2] = { 1.0, 0.0 };
+    for (size_t i = 1; i < count && i < 3; i++) {
+        if (args[i].type == ZVAL_INT) factor[i - 1] = (double)args[i].value.int_val;
+        else if (args[i].type == ZVAL_FLOAT) factor[i - 1] = args[i].value.float_val;
+        else return microphp_zval_bool(false);
+    }
+    zval_t result = microphp_array_scale(&args[0], factor[0], factor[1]);
+    return result.type == ZVAL_NULL ? microphp_zval_bool(false) : result;
+}
+
+// Q16.16 fixed point: fixed(x) converts an int, float or numeric string
+// (saturating), fixed_raw(x) is the raw int32 for registers and
+// fixed_from_raw(n) turns one back into a fixed value
+static zval_t native_fixed(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 1) return microphp_zval_bool(false);
+    switch (args[0].type) {
+        case ZVAL_FIXED:
+            return args[0];
+        case ZVAL_INT:
+            return microphp_zval_fixed(microphp_fixed_from_int(args[0].value.int_val));
+        case ZVAL_BOOL:
+            return microphp_zval_fixed(args[0].value.bool_val ? MICROPHP_FIXED_ONE : 0);
+        case ZVAL_NULL:
+            return microphp_zval_fixed(0);
+        case ZVAL_FLOAT:
+            return microphp_zval_fixed(microphp_fixed_from_double(args[0].value.float_val));
+        case ZVAL_STRING:
+            return microphp_zval_fixed(microphp_fixed_from_double(microphp_string_data(&args[0]) ?
+                                                                  strtod(microphp_string_data(&args[0]), NULL) : 0.0));
+        default:
+            return microphp_zval_bool(false);
+    }
+}
+
+static zval_t native_fixed_raw(vm_context_t *vm, const zval_t *args, size_t count) {
+    zval_t value = native_fixed(vm, args, count);
+    return value.type == ZVAL_FIXED ? microphp_zval_int(value.value.int_val) : value;
+}
+
+static zval_t native_fixed_from_raw(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 1 || args[0].type != ZVAL_INT) return microphp_zval_bool(false);
+    int64_t raw = args[0].value.int_val;
+    return microphp_zval_fixed(raw > INT32_MAX ? INT32_MAX : raw < INT32_MIN ? INT32_MIN : (int32_t)raw);
+}
+
+// Appends to a string; the first failed append sticks in flags
+static void write_string(void *user, const char *data, size_t len) {
+    zval_t *string = user;
+    if (string->type == ZVAL_STRING && microphp_string_append_bytes(string, data, len) != 0) {
+        microphp_zval_destroy(string);
+        *string = microphp_zval_null();
+    }
+}
+
+// printf(format, args...) writes and returns the length; sprintf returns
+// the text. Both return false for a malformed format or missing arguments.
+static zval_t native_printf(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || args[0].type != ZVAL_STRING) return microphp_zval_bool(false);
+    int len = microphp_format(microphp_string_data(&args[0]), microphp_string_len(&args[0]),
+                              args + 1, count - 1, write_output, vm);
+    return len < 0 ? microphp_zval_bool(false) : microphp_zval_int(len);
+}
+
+static zval_t native_sprintf(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 1 || args[0].type != ZVAL_STRING) return microphp_zval_bool(false);
+    zval_t text = microphp_zval_string(NULL, 0);
+    int len = microphp_format(microphp_string_data(&args[0]), microphp_string_len(&args[0]),
+                              args + 1, count - 1, write_string, &text);
+    if (len < 0 || text.type != ZVAL_STRING) {
+        microphp_zval_destroy(&text);
+        return microphp_zval_bool(false);
+    }
+    return text;
+}
+
+// number_format(num[, decimals[, point[, separator]]]), by default with
+// no decimals, "." and ","
+static zval_t native_number_format(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    if (count < 1 || (count >= 3 && args[2].type != ZVAL_STRING) || (count >= 4 && args[3].type != ZVAL_STRING)) {
+        return microphp_zval_bool(false);
+    }
+    
+    int64_t decimals = count >= 2 ? microphp_zval_to_int(&args[1]) : 0;
+    const char *point = count >= 3 ? microphp_string_data(&args[2]) : ".";
+    size_t point_len = count >= 3 ? microphp_string_len(&args[2]) : 1;
+    const char *sep = count >= 4 ? microphp_string_data(&args[3]) : ",";
+    size_t sep_len = count >= 4 ? microphp_string_len(&args[3]) : 1;
+    
+    zval_t text = microphp_zval_string(NULL, 0);
+    microphp_number_format(microphp_zval_to_float(&args[0]), decimals > INT32_MAX ? INT32_MAX : (int)(decimals < 0 ? 0 : decimals),
+                           point, point_len, sep, sep_len, write_string, &text);
+    if (text.type != ZVAL_STRING) return microphp_zval_bool(false);
+    return text;
+}
+
+#ifdef MICROPHP_DSP
+// DSP: sample blocks are arrays of numbers, results packed f32 arrays.
+// Filters keep their state between blocks:
+//   dsp_biquad([b0, b1, b2, a1, a2, ...]) cascades one section per five
+//   coefficients, dsp_biquad("lowpass"|"highpass"|"bandpass"|"notch",
+//   freq / sample_rate, q) designs one; dsp_fir(taps). Both return a
+//   handle (or false) for dsp_filter(h, samples) and dsp_free(h).
+static bool samples_f32(const zval_t *arg, zval_t *out) {
+    if (arg->type != ZVAL_ARRAY) return false;
+    *out = microphp_zval_null();
+    microphp_zval_copy(out, arg);
+    if (microphp_array_pack(out, MICROPHP_PACKED_F32) != 0) {
+        microphp_zval_destroy(out);
+        return false;
+    }
+    return true;
+}
+
+static float* samples_data(zval_t *samples) {
+    return (float*)samples->value.array_val.data;
+}
+
+static zval_t native_dsp_biquad(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1) return microphp_zval_bool(false);
+    
+    int handle = -1;
+    if (args[0].type == ZVAL_STRING && microphp_string_data(&args[0]) && count >= 3) {
+        static const char *types[] = { "lowpass", "highpass", "bandpass", "notch" };
+        int type = -1;
+        for (int i = 0; i < 4; i++) {
+            if (strcmp(microphp_string_data(&args[0]), types[i]) == 0) type = i;
+        }
+        double param[2];
+        for (size_t i = 0; i < 2; i++) {
+            const zval_t *arg = &args[i + 1];
+            if (arg->type != ZVAL_INT && arg->type != ZVAL_FLOAT) return microphp_zval_bool(false);
+            param[i] = arg->type == ZVAL_FLOAT ? arg->value.float_val : (double)arg->value.int_val;
+        }
+        float coeffs[5];
+        if (microphp_dsp_design(type, param[0], param[1], coeffs) == 0) handle = microphp_dsp_biquad(vm, coeffs, 1);
+    } else {
+        zval_t coeffs;
+        if (!samples_f32(&args[0], &coeffs)) return microphp_zval_bool(false);
+        size_t n = microphp_array_size(&coeffs);
+        if (n > 0 && n % 5 == 0) handle = microphp_dsp_biquad(vm, samples_data(&coeffs), n / 5);
+        microphp_zval_destroy(&coeffs);
+    }
+    return handle < 0 ? microphp_zval_bool(false) : microphp_zval_int(handle);
+}
+
+static zval_t native_dsp_fir(vm_context_t *vm, const zval_t *args, size_t count) {
+    zval_t taps;
+    if (count < 1 || !samples_f32(&args[0], &taps)) return microphp_zval_bool(false);
+    int handle = microphp_dsp_fir(vm, samples_data(&taps), microphp_array_size(&taps));
+    microphp_zval_destroy(&taps);
+    return handle < 0 ? microphp_zval_bool(false) : microphp_zval_int(handle);
+}
+
+static zval_t native_dsp_filter(vm_context_t *vm, const zval_t *args, size_t count) {
+    zval_t samples;
+    if (count < 2 || !small_int(&args[0]) || !samples_f32(&args[1], &samples)) return microphp_zval_bool(false);
+    
+    // In place: the kernels read each sample before writing it
+    float *data = samples_data(&samples);
+    if (microphp_dsp_filter(vm, (int)args[0].value.int_val, data, data, microphp_array_size(&samples)) != 0) {
+        microphp_zval_destroy(&samples);
+        return microphp_zval_bool(false);
+    }
+    return samples;
+}
+
+static zval_t native_dsp_free(vm_context_t *vm, const zval_t *args, size_t count) {
+    if (count < 1 || !small_int(&args[0])) return microphp_zval_bool(false);
+    return microphp_zval_bool(microphp_dsp_free(vm, (int)args[0].value.int_val) == 0);
+}
+
+// dsp_decimate(samples, factor[, h]): every factor-th output of filter h,
+// or without one the mean of each block of factor samples
+static zval_t native_dsp_decimate(vm_context_t *vm, const zval_t *args, size_t count) {
+    zval_t samples;
+    if (count < 2 || !small_int(&args[1]) || args[1].value.int_val == 0 || !samples_f32(&args[0], &samples)) {
+        return microphp_zval_bool(false);
+    }
+    
+    size_t factor = (size_t)args[1].value.int_val;
+    size_t n = microphp_array_size(&samples);
+    float *data = samples_data(&samples);
+    if (count >= 3 && (!small_int(&args[2]) || microphp_dsp_filter(vm, (int)args[2].value.int_val, data, data, n) != 0)) {
+        microphp_zval_destroy(&samples);
+        return microphp_zval_bool(false);
+    }
+    
+    zval_t result = microphp_array_packed(MICROPHP_PACKED_F32, n / factor);
+    if (result.type != ZVAL_ARRAY) {
+        microphp_zval_destroy(&samples);
+        return microphp_zval_bool(false);
+    }
+    float *out = samples_data(&result);
+    for (size_t i = 0; i < n / factor; i++) {
+        if (count >= 3) {
+            out[i] = data[i * factor + factor - 1];
+            continue;
+        }
+        float sum = 0.0f;
+        for (size_t j = 0; j < factor; j++) sum += data[i * factor + j];
+        out[i] = sum / (float)factor;
+    }
+    microphp_zval_destroy(&samples);
+    return result;
+}
+
+// dsp_fft(samples[, complex]): magnitudes of the n / 2 + 1 bins of a
+// power-of-two block, or the bins as re, im pairs when complex is true
+static zval_t native_dsp_fft(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    zval_t samples;
+    if (count < 1 || !samples_f32(&args[0], &samples)) return microphp_zval_bool(false);
+    
+    size_t n = microphp_array_size(&samples);
+    zval_t bins = microphp_array_packed(MICROPHP_PACKED_F32, n + 2);
+    if (bins.type != ZVAL_ARRAY || microphp_dsp_rfft(samples_data(&samples), samples_data(&bins), n) != 0) {
+        microphp_zval_destroy(&samples);
+        microphp_zval_destroy(&bins);
+        return microphp_zval_bool(false);
+    }
+    microphp_zval_destroy(&samples);
+    if (count >= 2 && microphp_zval_to_bool(&args[1])) return bins;
+    
+    // Magnitudes packed into the front half
+    float *out = samples_data(&bins);
+    for (size_t k = 0; k <= n / 2; k++) {
+        out[k] = sqrtf(out[2 * k] * out[2 * k] + out[2 * k + 1] * out[2 * k + 1]);
+    }
+    bins.value.array_val.size = n / 2 + 1;
+    return bins;
+}
+
+static zval_t native_dsp_rms(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    zval_t samples;
+    if (count < 1 || !samples_f32(&args[0], &samples)) return microphp_zval_bool(false);
+    float rms = microphp_dsp_rms(samples_data(&samples), microphp_array_size(&samples));
+    microphp_zval_destroy(&samples);
+    return microphp_zval_float(rms);
+}
+
+static zval_t native_dsp_peak(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    zval_t samples;
+    if (count < 1 || !samples_f32(&args[0], &samples)) return microphp_zval_bool(false);
+    float peak = microphp_dsp_peak(samples_data(&samples), microphp_array_size(&samples));
+    microphp_zval_destroy(&samples);
+    return microphp_zval_float(peak);
+}
+#else
+// Built without MICROPHP_DSP: the names stay in the table, so built-in
+// indexes in bytecode do not depend on the build, but every call fails
+static zval_t native_dsp_disabled(vm_context_t *vm, const zval_t *args, size_t count) {
+    (void)vm;
+    (void)args;
+    (void)count;
+    return microphp_zval_bool(false);
+}
+
+#define native_dsp_biquad   native_dsp_disabled
+#define native_dsp_fir      native_dsp_disabled
+#define native_dsp_filter   native_dsp_disabled
+#define native_dsp_free     native_dsp_disabled
+#define native_dsp_decimate native_dsp_disabled
+#define native_dsp_fft      native_dsp_disabled
+#define native_dsp_rms      native_dsp_disabled
+#define native_dsp_peak     native_dsp_disabled
+#endif
+
+// Built-in table (index == OP_CALL_BUILTIN operand1)
+const microphp_builtin_t microphp_builtins[] = {
+    { "echo",             native_echo,             0 },
+    { "print",            native_print,            0 },
+    { "sleep_ms",         native_sleep_ms,         0 },
+    { "millis",           native_millis,           0 },
+    { "task_spawn",       native_task_spawn,       0 },
+    { "task_yield",       native_task_yield,       0 },
+    { "gpio_on",          native_gpio_on,          0 },
+    { "gpio_off",         native_gpio_off,         0 },
+    { "timer_after",      native_timer_after,      0 },
+    { "timer_every",      native_timer_every,      0 },
+    { "timer_cancel",     native_timer_cancel,     0 },
+    { "spi_xfer_async",   native_spi_xfer_async,   0 },
+    { "uart_write_async", native_uart_write_async, 0 },
+    { "uart_read_async",  native_uart_read_async,  0 },
+    { "i2c_write_async",  native_i2c_write_async,  0 },
+    { "i2c_read_async",   native_i2c_read_async,   0 },
+    { "io_await",         native_io_await,         0 },
+    { "io_done",          native_io_done,          0 },
+    { "i2c_xfer",         native_i2c_xfer,         0 },
+    { "spi_xfer",         native_spi_xfer,         0 },
+    { "bytes",            native_bytes,            MICROPHP_BUILTIN_PURE },
+    { "bytes_len",        native_bytes_len,        MICROPHP_BUILTIN_PURE },
+    { "bytes_slice",      native_bytes_slice,      MICROPHP_BUILTIN_PURE },
+    { "bytes_unpack",     native_bytes_unpack,     MICROPHP_BUILTIN_PURE },
+    { "bytes_pack",       native_bytes_pack,       MICROPHP_BUILTIN_PURE },
+    { "array_packed",     native_array_packed,     MICROPHP_BUILTIN_PURE },
+    { "array_pack",       native_array_pack,       MICROPHP_BUILTIN_PURE },
+    { "array_sum",        native_array_sum,        MICROPHP_BUILTIN_PURE },
+    { "array_min",        native_array_min,        MICROPHP_BUILTIN_PURE },
+    { "array_max",        native_array_max,        MICROPHP_BUILTIN_PURE },
+    { "array_avg",        native_array_avg,        MICROPHP_BUILTIN_PURE },
+    { "array_scale",      native_array_scale,      MICROPHP_BUILTIN_PURE },
+    { "dsp_biquad",       native_dsp_biquad,       0 },
+    { "dsp_fir",          native_dsp_fir,          0 },
+    { "dsp_filter",       native_dsp_filter,       0 },
+    { "dsp_free",         native_dsp_free,         0 },
+    { "dsp_decimate",     native_dsp_decimate,     0 },
+    { "dsp_fft",          native_dsp_fft,          MICROPHP_BUILTIN_PURE },
+    { "dsp_rms",          native_dsp_rms,          MICROPHP_BUILTIN_PURE },
+    { "dsp_peak",         native_dsp_peak,         MICROPHP_BUILTIN_PURE },
+    { "fixed",            native_fixed,            MICROPHP_BUILTIN_PURE },
+    { "fixed_raw",        native_fixed_raw,        MICROPHP_BUILTIN_PURE },
+    { "fixed_from_raw",   native_fixed_from_raw,   MICROPHP_BUILTIN_PURE },
+    { "printf",           native_printf,           0 },
+    { "sprintf",          native_sprintf,          MICROPHP_BUILTIN_PURE },
+    { "number_format",    native_number_format,    MICROPHP_BUILTIN_PURE },
+    { "gpio_mode",        native_gpio_mode,        0 },
+    { "gpio_write",       native_gpio_write,       0 },
+    { "gpio_read",        native_gpio_read,        0 },
+    { "pwm_open",         native_pwm_open,         0 },
+    { "pwm_set",          native_pwm_set,          0 },
+    { "pwm_close",        native_pwm_close,        0 },
+    { "i2c_open",         native_i2c_open,         0 },
+    { "i2c_write",        native_i2c_write,        0 },
+    { "i2c_read",         native_i2c_read,         0 },
+    { "uart_open",        native_uart_open,        0 },
+    { "uart_write",       native_uart_write,       0 },
+    { "uart_read",        native_uart_read,        0 },
+    { "spi_txrx",         native_spi_txrx,         0 },
+    { "adc_read",         native_adc_read,         0 },
+    { "exit",             native_exit,             0 },
+};
+
+const size_t microphp_builtin_count = sizeof(microphp_builtins) / sizeof(microphp_builtins[0]);
+
+int microphp_builtin_lookup(const char *name) {
+    if (!name) return -1;
+    
+    for (size_t i = 0; i < microphp_builtin_count; i++) {
+        if (strcmp(microphp_builtins[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
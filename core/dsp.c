@@ -0,0 +1,315 @@
+#include "microphp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Filters alive at once per VM
+#ifndef MICROPHP_DSP_FILTERS_MAX
+#define MICROPHP_DSP_FILTERS_MAX 8
+#endif
+
+// ESP-DSP's optimized kernels, when the ESP-IDF build has the component
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include("esp_dsp.h")
+#include "esp_dsp.h"
+#define MICROPHP_DSP_ESP 1
+#endif
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FILTER_FREE   0
+#define FILTER_BIQUAD 1
+#define FILTER_FIR    2
+
+typedef struct {
+    int kind;
+    size_t length;           // Sections or taps
+    float *coeffs;           // 5 per section, or the taps reversed
+    float *state;            // 2 per section, or the delay line twice over
+    size_t pos;              // FIR: slot of the newest sample
+} dsp_filter_t;
+
+struct microphp_dsp {
+    dsp_filter_t filters[MICROPHP_DSP_FILTERS_MAX];
+};
+
+static void* dsp_alloc(vm_context_t *vm, size_t size) {
+    return vm->allocator.alloc(vm->allocator.user, size ? size : 1);
+}
+
+static void dsp_free(vm_context_t *vm, void *ptr) {
+    if (ptr) vm->allocator.free(vm->allocator.user, ptr);
+}
+
+// Free slot for a new filter, or NULL
+static dsp_filter_t* filter_slot(vm_context_t *vm, int *handle) {
+    if (!vm->dsp) {
+        vm->dsp = dsp_alloc(vm, sizeof(microphp_dsp_t));
+        if (!vm->dsp) return NULL;
+        memset(vm->dsp, 0, sizeof(microphp_dsp_t));
+    }
+    for (int i = 0; i < MICROPHP_DSP_FILTERS_MAX; i++) {
+        if (vm->dsp->filters[i].kind == FILTER_FREE) {
+            *handle = i;
+            return &vm->dsp->filters[i];
+        }
+    }
+    return NULL;
+}
+
+static dsp_filter_t* filter_get(vm_context_t *vm, int handle) {
+    if (!vm || !vm->dsp || handle < 0 || handle >= MICROPHP_DSP_FILTERS_MAX) return NULL;
+    dsp_filter_t *filter = &vm->dsp->filters[handle];
+    return filter->kind == FILTER_FREE ? NULL : filter;
+}
+
+static int filter_make(vm_context_t *vm, int kind, size_t length, size_t coeff_count, size_t state_count) {
+    int handle;
+    dsp_filter_t *filter = filter_slot(vm, &handle);
+    if (!filter) return -1;
+    
+    filter->coeffs = dsp_alloc(vm, coeff_count * sizeof(float));
+    filter->state = dsp_alloc(vm, state_count * sizeof(float));
+    if (!filter->coeffs || !filter->state) {
+        dsp_free(vm, filter->coeffs);
+        dsp_free(vm, filter->state);
+        filter->coeffs = filter->state = NULL;
+        return -1;
+    }
+    memset(filter->state, 0, state_count * sizeof(float));
+    filter->kind = kind;
+    filter->length = length;
+    filter->pos = 0;
+    return handle;
+}
+
+// RBJ audio EQ cookbook biquads
+int microphp_dsp_design(int type, double freq, double q, float coeffs[5]) {
+    if (!(freq > 0.0 && freq < 0.5) || !(q > 0.0)) return -1;
+    
+    double w = 2.0 * M_PI * freq;
+    double alpha = sin(w) / (2.0 * q);
+    double c = cos(w);
+    double b0, b1, b2;
+    switch (type) {
+        case MICROPHP_DSP_LOWPASS:  b0 = (1.0 - c) / 2.0; b1 = 1.0 - c;    b2 = b0;  break;
+        case MICROPHP_DSP_HIGHPASS: b0 = (1.0 + c) / 2.0; b1 = -(1.0 + c); b2 = b0;  break;
+        case MICROPHP_DSP_BANDPASS: b0 = alpha;           b1 = 0.0;        b2 = -b0; break;
+        case MICROPHP_DSP_NOTCH:    b0 = 1.0;             b1 = -2.0 * c;   b2 = 1.0; break;
+        default: return -1;
+    }
+    
+    double a0 = 1.0 + alpha;
+    coeffs[0] = (float)(b0 / a0);
+    coeffs[1] = (float)(b1 / a0);
+    coeffs[2] = (float)(b2 / a0);
+    coeffs[3] = (float)(-2.0 * c / a0);
+    coeffs[4] = (float)((1.0 - alpha) / a0);
+    return 0;
+}
+
+int microphp_dsp_biquad(vm_context_t *vm, const float *coeffs, size_t sections) {
+    if (!vm || !coeffs || sections == 0) return -1;
+    
+    int handle = filter_make(vm, FILTER_BIQUAD, sections, sections * 5, sections * 2);
+    if (handle >= 0) memcpy(vm->dsp->filters[handle].coeffs, coeffs, sections * 5 * sizeof(float));
+    return handle;
+}
+
+int microphp_dsp_fir(vm_context_t *vm, const float *taps, size_t count) {
+    if (!vm || !taps || count == 0) return -1;
+    
+    int handle = filter_make(vm, FILTER_FIR, count, count, count * 2);
+    if (handle >= 0) {
+        float *reversed = vm->dsp->filters[handle].coeffs;
+        for (size_t i = 0; i < count; i++) reversed[i] = taps[count - 1 - i];
+    }
+    return handle;
+}
+
+// Direct form II, the state layout ESP-DSP uses: w[0], w[1] per section
+static void biquad_run(const float *coef, float *w, const float *in, float *out, size_t count) {
+#if MICROPHP_DSP_ESP
+    dsps_biquad_f32((float*)in, out, (int)count, (float*)coef, w);
+#else
+    float w1 = w[0];
+    float w2 = w[1];
+    for (size_t i = 0; i < count; i++) {
+        float w0 = in[i] - coef[3] * w1 - coef[4] * w2;
+        out[i] = coef[0] * w0 + coef[1] * w1 + coef[2] * w2;
+        w2 = w1;
+        w1 = w0;
+    }
+    w[0] = w1;
+    w[1] = w2;
+#endif
+}
+
+// The delay line is stored twice over, so the newest `length` samples
+// are always contiguous and each output is one straight dot product
+static void fir_run(dsp_filter_t *filter, const float *in, float *out, size_t count) {
+    size_t n = filter->length;
+    const float *taps = filter->coeffs;
+    float *delay = filter->state;
+    for (size_t i = 0; i < count; i++) {
+        size_t pos = filter->pos;
+        delay[pos] = delay[pos + n] = in[i];
+        
+        const float *window = delay + pos + 1;
+        float y = 0.0f;
+        for (size_t j = 0; j < n; j++) y += taps[j] * window[j];
+        out[i] = y;
+        filter->pos = pos + 1 == n ? 0 : pos + 1;
+    }
+}
+
+int microphp_dsp_filter(vm_context_t *vm, int handle, const float *in, float *out, size_t count) {
+    dsp_filter_t *filter = filter_get(vm, handle);
+    if (!filter || (!in && count > 0) || (!out && count > 0)) return -1;
+    
+    if (filter->kind == FILTER_FIR) {
+        fir_run(filter, in, out, count);
+        return 0;
+    }
+    for (size_t s = 0; s < filter->length; s++) {
+        biquad_run(filter->coeffs + s * 5, filter->state + s * 2, s == 0 ? in : out, out, count);
+    }
+    return 0;
+}
+
+int microphp_dsp_free(vm_context_t *vm, int handle) {
+    dsp_filter_t *filter = filter_get(vm, handle);
+    if (!filter) return -1;
+    
+    dsp_free(vm, filter->coeffs);
+    dsp_free(vm, filter->state);
+    memset(filter, 0, sizeof(*filter));
+    return 0;
+}
+
+void microphp_dsp_clear(vm_context_t *vm) {
+    if (!vm || !vm->dsp) return;
+    
+    for (int i = 0; i < MICROPHP_DSP_FILTERS_MAX; i++) {
+        microphp_dsp_free(vm, i);
+    }
+    dsp_free(vm, vm->dsp);
+    vm->dsp = NULL;
+}
+
+// In-place radix-2 complex FFT over m interleaved (re, im) pairs
+static void fft_portable(float *data, size_t m) {
+    for (size_t i = 1, j = 0; i < m; i++) {
+        size_t bit = m >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j |= bit;
+        if (i < j) {
+            float re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+    
+    for (size_t len = 2; len <= m; len <<= 1) {
+        double angle = -2.0 * M_PI / (double)len;
+        double step_re = cos(angle), step_im = sin(angle);
+        for (size_t start = 0; start < m; start += len) {
+            double w_re = 1.0, w_im = 0.0;
+            for (size_t k = 0; k < len / 2; k++) {
+                float *a = data + 2 * (start + k);
+                float *b = data + 2 * (start + k + len / 2);
+                float t_re = (float)(b[0] * w_re - b[1] * w_im);
+                float t_im = (float)(b[0] * w_im + b[1] * w_re);
+                b[0] = a[0] - t_re;
+                b[1] = a[1] - t_im;
+                a[0] += t_re;
+                a[1] += t_im;
+    
+                double next = w_re * step_re - w_im * step_im;
+                w_im = w_re * step_im + w_im * step_re;
+                w_re = next;
+            }
+        }
+    }
+}
+
+static void fft_complex(float *data, size_t m) {
+#if MICROPHP_DSP_ESP
+    static bool ready;
+    if (!ready) ready = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE) == ESP_OK;
+    if (ready && m >= 2 && m <= CONFIG_DSP_MAX_FFT_SIZE) {
+        dsps_fft2r_fc32(data, (int)m);
+        dsps_bit_rev_fc32(data, (int)m);
+        return;
+    }
+#endif
+    fft_portable(data, m);
+}
+
+// Real FFT as an n / 2 point complex FFT of the even and odd samples,
+// then split into the n / 2 + 1 bins of the real spectrum
+int microphp_dsp_rfft(const float *in, float *out, size_t n) {
+    if (!in || !out || n < 2 || (n & (n - 1)) != 0) return -1;
+    
+    size_t m = n / 2;
+    if (out != in) memcpy(out, in, n * sizeof(float));
+    fft_complex(out, m);
+    
+    // Bins k and m - k both come from Z[k] and Z[m - k]
+    float z0_re = out[0], z0_im = out[1];
+    out[0] = z0_re + z0_im;
+    out[1] = 0.0f;
+    out[2 * m] = z0_re - z0_im;
+    out[2 * m + 1] = 0.0f;
+    for (size_t k = 1; k <= m / 2; k++) {
+        size_t j = m - k;
+        double a_re = out[2 * k], a_im = out[2 * k + 1];
+        double b_re = out[2 * j], b_im = out[2 * j + 1];
+    
+        // X[k] = E + W^k O, E = (Z[k] + conj Z[m-k]) / 2, O = (Z[k] - conj Z[m-k]) / 2i
+        double e_re = (a_re + b_re) / 2, e_im = (a_im - b_im) / 2;
+        double o_re = (a_im + b_im) / 2, o_im = -(a_re - b_re) / 2;
+        double angle = -2.0 * M_PI * (double)k / (double)n;
+        double w_re = cos(angle), w_im = sin(angle);
+        out[2 * k] = (float)(e_re + w_re * o_re - w_im * o_im);
+        out[2 * k + 1] = (float)(e_im + w_re * o_im + w_im * o_re);
+    
+        // Same for m - k: E is conjugated, O is conjugated, W^(m-k) = -conj W^k
+        if (j != k) {
+            out[2 * j] = (float)(e_re - (w_re * o_re - w_im * o_im));
+            out[2 * j + 1] = (float)(-e_im + (w_re * o_im + w_im * o_re));
+        }
+    }
+    return 0;
+}
+
+// Double accumulators in four lanes, so long blocks neither lose
+// precision nor serialize on one dependency chain
+float microphp_dsp_rms(const float *samples, size_t count) {
+    if (!samples || count == 0) return 0.0f;
+    
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        s0 += (double)samples[i] * samples[i];
+        s1 += (double)samples[i + 1] * samples[i + 1];
+        s2 += (double)samples[i + 2] * samples[i + 2];
+        s3 += (double)samples[i + 3] * samples[i + 3];
+    }
+    for (; i < count; i++) s0 += (double)samples[i] * samples[i];
+    return (float)sqrt(((s0 + s1) + (s2 + s3)) / (double)count);
+}
+
+float microphp_dsp_peak(const float *samples, size_t count) {
+    float peak = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        float x = fabsf(samples[i]);
+        peak = x > peak ? x : peak;
+    }
+    return peak;
+}
@@ -0,0 +1,435 @@
+#include "microphp.h"
+#include <string.h>
+
+// printf/sprintf/number_format as PHP defines them, without libc stdio.
+// The format is walked once: each literal run goes out in a single write
+// and each directive is converted straight from its argument into a
+// stack buffer, so nothing is allocated on the way.
+
+typedef struct {
+    microphp_write_fn write;
+    void *user;
+    size_t len;
+} format_out_t;
+
+typedef struct {
+    int argnum;              // 0-based; -1 takes the next argument
+    bool left;               // '-': pad on the right
+    bool plus;               // '+': sign positive numbers too
+    char pad;                // ' ', '0' or 'c
+    int width;
+    int precision;           // -1 when absent
+    char spec;
+} directive_t;
+
+// Longest converted field: %f of 1.8e308 with the maximum decimals
+#define FORMAT_FIELD_MAX (1 + 309 + 1 + MICROPHP_FIXED_DECIMALS_MAX)
+
+static void out_write(format_out_t *out, const char *data, size_t len) {
+    if (len == 0) return;
+    out->write(out->user, data, len);
+    out->len += len;
+}
+
+static void out_repeat(format_out_t *out, char c, int count) {
+    char run[16];
+    memset(run, c, sizeof(run));
+    while (count > 0) {
+        int n = count < (int)sizeof(run) ? count : (int)sizeof(run);
+        out_write(out, run, (size_t)n);
+        count -= n;
+    }
+}
+
+// Digits up to INT32_MAX; false on overflow
+static bool parse_count(const char *format, size_t len, size_t *pos, int *value) {
+    int64_t n = 0;
+    while (*pos < len && format[*pos] >= '0' && format[*pos] <= '9') {
+        n = n * 10 + (format[*pos] - '0');
+        if (n > INT32_MAX) return false;
+        (*pos)++;
+    }
+    *value = (int)n;
+    return true;
+}
+
+// Parses the directive after a '%' at *pos; false if it is malformed
+static bool parse_directive(const char *format, size_t len, size_t *pos, directive_t *d) {
+    d->argnum = -1;
+    d->left = false;
+    d->plus = false;
+    d->pad = ' ';
+    d->width = 0;
+    d->precision = -1;
+    
+    // An argument number is digits ending in '$'
+    size_t start = *pos;
+    int n;
+    if (!parse_count(format, len, pos, &n)) return false;
+    if (*pos < len && format[*pos] == '$' && *pos > start) {
+        if (n == 0) return false;
+        d->argnum = n - 1;
+        (*pos)++;
+    } else {
+        *pos = start;
+    }
+    
+    for (; *pos < len; (*pos)++) {
+        char c = format[*pos];
+        if (c == '-') {
+            d->left = true;
+        } else if (c == '+') {
+            d->plus = true;
+        } else if (c == '0' || c == ' ') {
+            d->pad = c;
+        } else if (c == '\'') {
+            if (++(*pos) >= len) return false;
+            d->pad = format[*pos];
+        } else {
+            break;
+        }
+    }
+    
+    if (!parse_count(format, len, pos, &d->width)) return false;
+    if (*pos < len && format[*pos] == '.') {
+        (*pos)++;
+        if (!parse_count(format, len, pos, &d->precision)) return false;
+    }
+    if (*pos < len && format[*pos] == 'l') (*pos)++;
+    if (*pos >= len) return false;
+    
+    d->spec = format[(*pos)++];
+    return strchr("bcdeEfFgGosuxX", d->spec) != NULL && d->spec != '\0';
+}
+
+// Pads text to the width. With zero padding on the right, a sign goes
+// ahead of the zeros.
+static void put_field(format_out_t *out, const directive_t *d, const char *text, size_t len) {
+    int pad = d->width > (int)len ? d->width - (int)len : 0;
+    if (d->left) {
+        out_write(out, text, len);
+        out_repeat(out, d->pad, pad);
+        return;
+    }
+    if (d->pad == '0' && len > 0 && (text[0] == '-' || text[0] == '+')) {
+        out_write(out, text, 1);
+        text++;
+        len--;
+    }
+    out_repeat(out, d->pad, pad);
+    out_write(out, text, len);
+}
+
+// Unsigned digits in base 2^shift
+static size_t format_radix(uint64_t value, int shift, bool upper, char *buf) {
+    const char *symbols = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[64];
+    size_t n = 0;
+    do {
+        tmp[n++] = symbols[value & ((1u << shift) - 1)];
+        value >>= shift;
+    } while (value);
+    for (size_t i = 0; i < n; i++) buf[i] = tmp[n - 1 - i];
+    return n;
+}
+
+// %e: d.ddde+X with the exponent unpadded, as PHP writes it
+static size_t format_exp(double value, int precision, char spec, char *buf) {
+    char digits[MICROPHP_FIXED_DECIMALS_MAX + 2];
+    int point = 1;
+    int len = 0;
+    if (value != 0) len = microphp_dtoa_digits(value, precision + 1, digits, &point);
+    
+    size_t n = 0;
+    if (value < 0) buf[n++] = '-';
+    buf[n++] = len > 0 ? digits[0] : '0';
+    if (precision > 0) {
+        buf[n++] = '.';
+        for (int i = 1; i <= precision; i++) buf[n++] = i < len ? digits[i] : '0';
+    }
+    buf[n++] = spec;
+    int exponent = point - 1;
+    buf[n++] = exponent < 0 ? '-' : '+';
+    n += microphp_utoa((uint64_t)(exponent < 0 ? -exponent : exponent), buf + n);
+    return n;
+}
+
+// %g: precision significant digits, exponential form (always with a
+// decimal point) below 1e-4 or beyond precision digits
+static size_t format_general(double value, int precision, char spec, char *buf) {
+    if (precision == 0) precision = 1;
+    if (value == 0) {
+        buf[0] = '0';
+        return 1;
+    }
+    
+    char digits[MICROPHP_FIXED_DECIMALS_MAX + 2];
+    int point;
+    int len = microphp_dtoa_digits(value, precision, digits, &point);
+    size_t n = 0;
+    if (value < 0) buf[n++] = '-';
+    
+    if (point < -3 || point > precision) {
+        buf[n++] = digits[0];
+        buf[n++] = '.';
+        if (len == 1) buf[n++] = '0';
+        for (int i = 1; i < len; i++) buf[n++] = digits[i];
+        buf[n++] = spec == 'G' ? 'E' : 'e';
+        int exponent = point - 1;
+        buf[n++] = exponent < 0 ? '-' : '+';
+        n += microphp_utoa((uint64_t)(exponent < 0 ? -exponent : exponent), buf + n);
+    } else if (point <= 0) {
+        buf[n++] = '0';
+        buf[n++] = '.';
+        for (int i = point; i < 0; i++) buf[n++] = '0';
+        for (int i = 0; i < len; i++) buf[n++] = digits[i];
+    } else {
+        for (int i = 0; i < point; i++) buf[n++] = i < len ? digits[i] : '0';
+        if (len > point) {
+            buf[n++] = '.';
+            for (int i = point; i < len; i++) buf[n++] = digits[i];
+        }
+    }
+    return n;
+}
+
+static void put_string_arg(format_out_t *out, const directive_t *d, const zval_t *arg) {
+    char num[MICROPHP_NUM_BUF];
+    const char *text;
+    size_t len;
+    if (arg->type == ZVAL_STRING) {
+        text = microphp_string_data(arg);
+        len = microphp_string_len(arg);
+    } else if (arg->type == ZVAL_ARRAY) {
+        text = "Array";
+        len = 5;
+    } else {
+        len = microphp_scalar_format(arg, num);
+        text = num;
+    }
+    if (d->precision >= 0 && (size_t)d->precision < len) len = (size_t)d->precision;
+    put_field(out, d, text, len);
+}
+
+static void put_float_arg(format_out_t *out, const directive_t *d, double value) {
+    char text[FORMAT_FIELD_MAX + 1];
+    size_t len = 0;
+    if (d->plus && value >= 0) text[len++] = '+';
+    
+    if (value != value) {
+        memcpy(text, "NaN", 3);
+        len = 3;
+    } else if (value > 1.7976931348623157e308 || value < -1.7976931348623157e308) {
+        const char *inf = value < 0 ? "-Inf" : "Inf";
+        memcpy(text + len, inf, strlen(inf));
+        len += strlen(inf);
+    } else {
+        int precision = d->precision < 0 ? 6 : d->precision;
+        if (precision > MICROPHP_FIXED_DECIMALS_MAX) precision = MICROPHP_FIXED_DECIMALS_MAX;
+        switch (d->spec) {
+            case 'e':
+            case 'E':
+                len += format_exp(value, precision, d->spec, text + len);
+                break;
+            case 'g':
+            case 'G':
+                len += format_general(value, precision, d->spec, text + len);
+                break;
+            default:
+                len += microphp_dtoa_fixed(value, precision, text + len, sizeof(text) - len);
+                break;
+        }
+    }
+    put_field(out, d, text, len);
+}
+
+static void put_int_arg(format_out_t *out, const directive_t *d, int64_t value) {
+    char text[72];
+    size_t len = 0;
+    switch (d->spec) {
+        case 'd':
+            if (d->plus && value >= 0) text[len++] = '+';
+            len += microphp_itoa(value, text + len);
+            break;
+        case 'u':
+            len = microphp_utoa((uint64_t)value, text);
+            break;
+        case 'b':
+            len = format_radix((uint64_t)value, 1, false, text);
+            break;
+        case 'o':
+            len = format_radix((uint64_t)value, 3, false, text);
+            break;
+        default:
+            len = format_radix((uint64_t)value, 4, d->spec == 'X', text);
+            break;
+    }
+    put_field(out, d, text, len);
+}
+
+static int format_run(const char *format, size_t len, const zval_t *args, size_t count, format_out_t *out) {
+    size_t next = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        // Literal run up to the next directive
+        const char *percent = memchr(format + pos, '%', len - pos);
+        size_t end = percent ? (size_t)(percent - format) : len;
+        if (out) out_write(out, format + pos, end - pos);
+        if (!percent) break;
+        pos = end + 1;
+        
+        if (pos < len && format[pos] == '%') {
+            if (out) out_write(out, "%", 1);
+            pos++;
+            continue;
+        }
+        
+        directive_t d;
+        if (!parse_directive(format, len, &pos, &d)) return -1;
+        size_t index = d.argnum >= 0 ? (size_t)d.argnum : next++;
+        if (!out) {
+            // Counting only: the highest argument referenced
+            if (index + 1 > count) count = index + 1;
+            continue;
+        }
+        if (index >= count) return -1;
+        
+        const zval_t *arg = &args[index];
+        switch (d.spec) {
+            case 's':
+                put_string_arg(out, &d, arg);
+                break;
+            case 'c': {
+                // A single byte; width and padding do not apply
+                char c = (char)microphp_zval_to_int(arg);
+                out_write(out, &c, 1);
+                break;
+            }
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+                put_float_arg(out, &d, microphp_zval_to_float(arg));
+                break;
+            default:
+                put_int_arg(out, &d, microphp_zval_to_int(arg));
+                break;
+        }
+    }
+    return out ? (int)out->len : (int)count;
+}
+
+int microphp_format(const char *format, size_t len, const zval_t *args, size_t count,
+                    microphp_write_fn write, void *user) {
+    if ((!format && len) || !write) return -1;
+    
+    // Validate first so a bad format writes nothing
+    int needed = format_run(format, len, NULL, 0, NULL);
+    if (needed < 0 || (size_t)needed > count) return -1;
+    
+    format_out_t out = { write, user, 0 };
+    return format_run(format, len, args, count, &out);
+}
+
+int microphp_format_arity(const char *format, size_t len) {
+    if (!format && len) return -1;
+    return format_run(format, len, NULL, 0, NULL);
+}
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} buffer_out_t;
+
+static void buffer_write(void *user, const char *data, size_t len) {
+    buffer_out_t *out = user;
+    if (out->len + 1 < out->size) {
+        size_t room = out->size - 1 - out->len;
+        memcpy(out->buf + out->len, data, len < room ? len : room);
+    }
+    out->len += len;
+}
+
+int microphp_format_buffer(char *buf, size_t size, const char *format, size_t len,
+                           const zval_t *args, size_t count) {
+    buffer_out_t out = { buf, size, 0 };
+    int written = microphp_format(format, len, args, count, buffer_write, &out);
+    if (size > 0) buf[out.len < size ? out.len : size - 1] = '\0';
+    return written;
+}
+
+// Rounds half away from zero on the value's first 15 significant digits,
+// as PHP's round() does. When the decimals reach past those, PHP leaves
+// the value alone and so does this: it prints exactly.
+int microphp_number_format(double value, int decimals, const char *point_text, size_t point_len,
+                           const char *sep, size_t sep_len, microphp_write_fn write, void *user) {
+    if (!write) return -1;
+    if (decimals < 0) decimals = 0;
+    if (decimals > MICROPHP_FIXED_DECIMALS_MAX) decimals = MICROPHP_FIXED_DECIMALS_MAX;
+    format_out_t out = { write, user, 0 };
+    
+    if (value != value || value > 1.7976931348623157e308 || value < -1.7976931348623157e308) {
+        const char *text = value != value ? "nan" : value < 0 ? "-inf" : "inf";
+        out_write(&out, text, strlen(text));
+        return (int)out.len;
+    }
+    
+    char text[FORMAT_FIELD_MAX + 1];
+    size_t len = 0;
+    bool negative = value < 0;
+    if (negative) value = -value;
+    
+    char digits[MICROPHP_FIXED_DECIMALS_MAX + 2];
+    int point = 1;
+    int count = 0;
+    if (value != 0) count = microphp_dtoa_digits(value, 15, digits, &point);
+    int keep = point + decimals;
+    if (value != 0 && keep >= 15) {
+        len = microphp_dtoa_fixed(value, decimals, text, sizeof(text));
+    } else {
+        if (keep < 0) {
+            count = 0;
+        } else if (count > keep) {
+            bool up = digits[keep] >= '5';
+            count = keep;
+            if (up) {
+                while (count > 0 && digits[count - 1] == '9') count--;
+                if (count == 0) {
+                    digits[count++] = '1';
+                    point++;
+                } else {
+                    digits[count - 1]++;
+                }
+            }
+        }
+        if (point <= 0) {
+            text[len++] = '0';
+        } else {
+            for (int i = 0; i < point; i++) text[len++] = i < count ? digits[i] : '0';
+        }
+        if (decimals > 0) {
+            text[len++] = '.';
+            for (int i = point; i < point + decimals; i++) text[len++] = i >= 0 && i < count ? digits[i] : '0';
+        }
+        if (count == 0) negative = false;
+    }
+    
+    // Thousands separators between groups of three whole digits
+    size_t whole = 0;
+    while (whole < len && text[whole] != '.') whole++;
+    if (negative) out_write(&out, "-", 1);
+    size_t lead = whole % 3 ? whole % 3 : 3;
+    out_write(&out, text, lead);
+    for (size_t i = lead; i < whole; i += 3) {
+        out_write(&out, sep, sep_len);
+        out_write(&out, text + i, 3);
+    }
+    if (decimals > 0) {
+        out_write(&out, point_text, point_len);
+        out_write(&out, text + whole + 1, len - whole - 1);
+    }
+    return (int)out.len;
+}
@@ -15,6 +15,30 @@ extern "C" {
 #define MICROPHP_MAX_CONSTANTS 1024
 #define MICROPHP_MAX_FUNCTIONS 64
 #define MICROPHP_MAX_LOCALS 128
+#define MICROPHP_MAX_GLOBALS 256
+#define MICROPHP_MBC_VERSION 2
+
+// Integer width. PHP ints are 64-bit on 64-bit builds and 32-bit on
+// 32-bit ones; MICROPHP_INT32_FAST selects the latter so arithmetic runs
+// at native width on 32-bit cores (the default there with GCC/Clang).
+// Either way an int result that does not fit becomes a float, as in PHP.
+#ifndef MICROPHP_INT32_FAST
+#if defined(__GNUC__) && UINTPTR_MAX == 0xFFFFFFFFu
+#define MICROPHP_INT32_FAST 1
+#else
+#define MICROPHP_INT32_FAST 0
+#endif
+#endif
+
+#if MICROPHP_INT32_FAST
+typedef int32_t microphp_int_t;
+#define MICROPHP_INT_MAX INT32_MAX
+#define MICROPHP_INT_MIN INT32_MIN
+#else
+typedef int64_t microphp_int_t;
+#define MICROPHP_INT_MAX INT64_MAX
+#define MICROPHP_INT_MIN INT64_MIN
+#endif
 
 // Zval types (PHP value types)
 typedef enum {
@@ -26,19 +50,33 @@ typedef enum {
     ZVAL_ARRAY,
     ZVAL_OBJECT,
     ZVAL_CLOSURE,
-    ZVAL_RESOURCE
+    ZVAL_RESOURCE,
+    ZVAL_FIXED               // Q16.16 fixed point in int_val (microphp_fixed_*)
 } zval_type_t;
 
+// Zval flags
+#define ZVAL_FLAG_BORROWED 0x1   // Payload owned elsewhere (a program constant); never freed through this zval
+#define ZVAL_FLAG_BYTES    0x2   // Binary string (byte buffer): indexing reads and writes bytes as ints
+#define ZVAL_FLAG_PACKED   0x1C  // Array stored as a raw buffer of one numeric kind (MICROPHP_PACKED_*)
+#define ZVAL_FLAG_INLINE   0x20  // Short string stored in the zval itself (value.small)
+
+// Inline string storage: the whole payload, last byte holding the length.
+// 24 bytes on 64-bit hosts, 16 on 32-bit targets; no larger than the union.
+#define MICROPHP_SSO_SIZE ((sizeof(void*) + 2 * sizeof(size_t) + 7) & ~(size_t)7)
+#define MICROPHP_SSO_MAX  (MICROPHP_SSO_SIZE - 2)
+
 // Zval structure (PHP value)
 typedef struct zval {
     zval_type_t type;
+    uint8_t flags;
     union {
         bool bool_val;
-        int64_t int_val;
+        microphp_int_t int_val;
         double float_val;
         struct {
             char *str;
             size_t len;
+            size_t capacity;     // Bytes allocated for str, excluding the terminator
         } string_val;
         struct {
             struct zval *data;
@@ -49,6 +87,7 @@ typedef struct zval {
             void *ptr;
             int type;
         } resource_val;
+        char small[MICROPHP_SSO_SIZE];
     } value;
 } zval_t;
 
@@ -97,9 +136,80 @@ typedef enum {
     OP_CAST_INT,
     OP_CAST_FLOAT,
     OP_CAST_STRING,
-    OP_CAST_BOOL
+    OP_CAST_BOOL,
+    OP_CALL_BUILTIN,
+    OP_IDENTICAL,
+    OP_NOT_IDENTICAL,
+    OP_NEG,
+    OP_BIT_AND,
+    OP_BIT_OR,
+    OP_BIT_XOR,
+    OP_BIT_NOT,
+    OP_SHL,
+    OP_SHR,
+    
+    // Type-specialized forms emitted when the compiler infers both
+    // operands are int (_I) or float (_F). An int result that overflows,
+    // or an operand whose tag does not match, takes the generic path.
+    OP_ADD_I,
+    OP_SUB_I,
+    OP_MUL_I,
+    OP_LT_I,
+    OP_LTE_I,
+    OP_GT_I,
+    OP_GTE_I,
+    OP_EQ_I,
+    OP_NEQ_I,
+    OP_INC_I,
+    OP_DEC_I,
+    OP_ADD_F,
+    OP_SUB_F,
+    OP_MUL_F,
+    OP_DIV_F,
+    OP_LT_F,
+    OP_LTE_F,
+    OP_GT_F,
+    OP_GTE_F,
+    
+    // Counted-loop back-edge: increments the int in slot operand1, pops an
+    // int bound and jumps to operand2 while the slot is below it
+    OP_INC_JLT_LOCAL,
+    OP_INC_JLT_GLOBAL,
+    
+    // switch/match dispatch, see MICROPHP_SWITCH_*
+    OP_SWITCH_TABLE,
+    OP_MATCH_ERROR,
+    
+    // $var .= a . b ...: pops operand2 values and appends them in order to
+    // the string in slot operand1, in place
+    OP_APPEND_LOCAL,
+    OP_APPEND_GLOBAL
 } opcode_t;
 
+// OP_SWITCH_TABLE pops the subject and looks it up in the table stored as
+// a string constant (operand1). The operand2 instructions that follow are
+// OP_JMPs, one per case plus a final one for keys missing from the table;
+// the VM jumps straight to the selected entry's target. A subject of a
+// different type than the table's keys continues after the entries.
+//
+// Table layout (little-endian), first byte is the kind:
+//   DENSE:       i64 min; entry = subject - min
+//   INT_HASH:    hash header, size x { i64 key, u16 entry }
+//   STRING_HASH: hash header, size x { u16 key constant, u16 entry }
+// The hash header is u32 seed, u16 size, u16 buckets (both powers of two)
+// and a u16 seed per bucket. A key's bucket is hash(key, seed) &
+// (buckets - 1) and its slot hash(key, bucket seed) & (size - 1), where
+// hash is microphp_hash_bytes and int keys hash as their 8 little-endian
+// bytes. Empty slots hold entry 0xFFFF.
+#define MICROPHP_SWITCH_DENSE       0
+#define MICROPHP_SWITCH_INT_HASH    1
+#define MICROPHP_SWITCH_STRING_HASH 2
+#define MICROPHP_SWITCH_EMPTY       0xFFFF
+
+// OP_ARRAY_SET operand2 flags (operand1 is the variable slot)
+#define MICROPHP_ARRAY_SET_GLOBAL 0x1
+#define MICROPHP_ARRAY_SET_APPEND 0x2
+
 // Instruction structure
 typedef struct {
     opcode_t opcode;
@@ -117,7 +227,18 @@ typedef struct {
     size_t param_count;
 } function_t;
 
-// Bytecode structure (MBC - Micro-PHP Bytecode)
+// Allocator for everything a VM instance or program allocates itself.
+// Functions are called with user as their first argument and may return
+// NULL, which is reported as "Out of memory". zval payloads use the C heap.
+typedef struct {
+    void *(*alloc)(void *user, size_t size);
+    void *(*realloc)(void *user, void *ptr, size_t size);
+    void (*free)(void *user, void *ptr);
+    void *user;
+} microphp_allocator_t;
+
+// Bytecode structure (MBC - Micro-PHP Bytecode). Once loaded a program
+// is never modified, so one program can back VMs on several threads.
 typedef struct {
     char magic[4];           // "MBC\0"
     uint32_t version;        // Bytecode version
@@ -126,41 +247,428 @@ typedef struct {
     uint32_t function_count;
     function_t *functions;
     uint32_t main_offset;    // Main function offset
+    uint32_t global_count;   // Global slots resolved by the compiler
+    char **global_names;     // Slot -> name map (diagnostics and host access)
+    microphp_allocator_t allocator;
 } bytecode_t;
 
-// VM context
+// Call frame
 typedef struct {
-    bytecode_t *bytecode;
+    const function_t *function;
+    instruction_t *return_pc;
+    size_t locals_base;      // First local slot of this frame in vm->locals
+} call_frame_t;
+
+// Cooperative task. The running task's stack, locals, frames and pc live
+// in vm_context_t; the scheduler swaps them with these fields on a switch.
+// Globals, constants and the heap are shared by all tasks.
+typedef enum {
+    MICROPHP_TASK_FREE = 0,
+    MICROPHP_TASK_READY,
+    MICROPHP_TASK_SLEEPING,
+    MICROPHP_TASK_RUNNING
+} microphp_task_state_t;
+
+typedef struct {
+    microphp_task_state_t state;
+    uint32_t wake_ms;            // When a sleeping task becomes ready
+    int io_handle;               // Transfer a retried built-in waits on, -1 if none
+    const function_t *entry;     // Function still to be entered, or NULL
+    size_t entry_argc;           // ... with its arguments on the stack
     zval_t *stack;
     size_t stack_size;
     size_t stack_top;
     zval_t *locals;
     size_t local_count;
+    size_t locals_top;
+    call_frame_t *frames;
+    size_t frame_count;
+    size_t frame_capacity;
+    instruction_t *pc;
+} microphp_task_t;
+
+// Platform hooks: a millisecond clock, and a way to wait for ms while all
+// tasks sleep (returning early on an interrupt is fine). Without a clock
+// the VM keeps a virtual one: each used-up slice counts as 1 ms and idle
+// time passes instantly.
+typedef uint32_t (*microphp_clock_fn)(void *user);
+typedef void (*microphp_idle_fn)(void *user, uint32_t ms);
+
+// Where the time went since the run started: inside the VM, or in the
+// idle hook (skipped time on the virtual clock)
+typedef struct {
+    uint64_t running_ms;
+    uint64_t asleep_ms;
+    uint32_t wakeups;        // Idle periods entered
+} microphp_idle_stats_t;
+
+// Arms (edges != 0) or disarms a pin's interrupt; nonzero on failure
+typedef int (*microphp_gpio_irq_fn)(void *user, int pin, int edges);
+
+// Tells the port the earliest script timer deadline, to program its one
+// hardware timer for (armed false: nothing pending)
+typedef void (*microphp_timer_arm_fn)(void *user, bool armed, uint32_t deadline_ms);
+
+// Ring of GPIO edges posted from interrupt context (opaque)
+typedef struct microphp_events microphp_events_t;
+
+// Asynchronous bus transfer, DMA-driven on ports
+#define MICROPHP_IO_SPI         1   // Full duplex: tx_len bytes out, as many into rx
+#define MICROPHP_IO_UART_WRITE  2
+#define MICROPHP_IO_UART_READ   3
+#define MICROPHP_IO_I2C_WRITE   4
+#define MICROPHP_IO_I2C_READ    5
+#define MICROPHP_IO_I2C_LIST    6   // ops back to back, repeated start between them
+#define MICROPHP_IO_SPI_LIST    7   // ops back to back, chip select held
+
+// One step of a transaction list: writes send len bytes from tx at
+// tx_offset, reads receive len bytes into rx at rx_offset, and a
+// full-duplex SPI step does both
+#define MICROPHP_IO_OP_WRITE  0
+#define MICROPHP_IO_OP_READ   1
+#define MICROPHP_IO_OP_XFER   2
+
+typedef struct {
+    uint8_t type;            // MICROPHP_IO_OP_*
+    uint8_t addr;            // I2C device address
+    uint32_t tx_offset;
+    uint32_t rx_offset;
+    uint32_t len;
+} microphp_io_op_t;
+
+typedef struct {
+    int kind;                // MICROPHP_IO_*
+    int bus;                 // SPI host, UART or I2C port
+    int addr;                // I2C device address (single transfers)
+    const uint8_t *tx;       // Bytes to send
+    size_t tx_len;
+    uint8_t *rx;             // Room for received bytes
+    size_t rx_len;
+    const microphp_io_op_t *ops;  // Transaction lists only
+    size_t op_count;
+} microphp_io_request_t;
+
+// Starts a transfer (request != NULL) or aborts one in flight (NULL);
+// nonzero on failure. The buffers stay valid until the port reports
+// completion or the abort returns.
+typedef int (*microphp_io_fn)(void *user, int handle, const microphp_io_request_t *request);
+
+// Transfer slots (opaque)
+typedef struct microphp_io microphp_io_t;
+
+// Pin and peripheral calls that complete at once (gpio_mode, pwm_set,
+// adc_read, ...). The port carries out op on its hardware and returns the
+// result: a level, a reading or 0, negative on failure.
+#define MICROPHP_HAL_GPIO_MODE   1   // pin, mode (0 input, 1 output, 2 pull-up, 3 pull-down)
+#define MICROPHP_HAL_GPIO_WRITE  2   // pin, level
+#define MICROPHP_HAL_GPIO_READ   3   // pin
+#define MICROPHP_HAL_PWM_OPEN    4   // channel, pin, freq_hz; duty
+#define MICROPHP_HAL_PWM_SET     5   // channel; duty
+#define MICROPHP_HAL_PWM_CLOSE   6   // channel
+#define MICROPHP_HAL_I2C_OPEN    7   // port, scl, sda, freq_hz
+#define MICROPHP_HAL_UART_OPEN   8   // port, baud
+#define MICROPHP_HAL_ADC_READ    9   // channel
+
+typedef struct {
+    int op;                  // MICROPHP_HAL_*
+    int32_t args[4];
+    float duty;              // 0.0 to 1.0
+} microphp_hal_request_t;
+
+typedef int32_t (*microphp_hal_fn)(void *user, const microphp_hal_request_t *request);
+
+// Output sink: takes up to len bytes without blocking (into a UART or USB
+// CDC driver's transmit buffer, a DMA descriptor, a file) and returns how
+// many it took
+typedef size_t (*microphp_output_fn)(void *user, const char *data, size_t len);
+
+// When buffered output goes to the sink, and what a write does when the
+// buffer is full
+#define MICROPHP_OUTPUT_DROP  0   // Discard what does not fit and count it
+#define MICROPHP_OUTPUT_BLOCK 1   // Wait, in the idle hook if any, up to wait_ms for the sink to make room
+
+typedef struct {
+    size_t flush_size;       // Buffered bytes that trigger a flush (0: only when full)
+    bool flush_newline;      // Flush after a write that ends a line
+    uint32_t flush_ms;       // Flush once the oldest byte is this old (0: never)
+    int full;                // MICROPHP_OUTPUT_DROP or MICROPHP_OUTPUT_BLOCK
+    uint32_t wait_ms;        // BLOCK: longest a write waits before dropping (0: MICROPHP_OUTPUT_WAIT_MS)
+} microphp_output_policy_t;
+
+// Memory sink for tests: keeps the first size bytes and counts all of them
+typedef struct {
+    char *data;
+    size_t size;
+    size_t len;              // Bytes offered, which may exceed size
+} microphp_output_memory_t;
+
+// Output ring (opaque)
+typedef struct microphp_output microphp_output_t;
+
+// DSP filter slots (opaque, MICROPHP_DSP builds)
+typedef struct microphp_dsp microphp_dsp_t;
+
+// Script timer (timer_every / timer_after)
+typedef struct {
+    const function_t *handler;   // NULL when the slot is free
+    uint32_t deadline_ms;
+    uint32_t period_ms;          // 0 for one-shot
+    int task;                    // Task running the handler, -1 if none
+} microphp_timer_t;
+
+// VM context. Instances share nothing but an attached program, so each
+// can run on its own thread.
+typedef struct {
+    const bytecode_t *bytecode;
+    bytecode_t *owned_bytecode;  // Set when loaded by microphp_vm_load_bytecode
+    microphp_allocator_t allocator;
+    zval_t *stack;
+    size_t stack_size;
+    size_t stack_top;
+    zval_t *locals;          // Frame locals, stacked per call
+    size_t local_count;      // Allocated local slots
+    size_t locals_top;       // Slots in use by active frames
     zval_t *globals;
     size_t global_count;
+    call_frame_t *frames;
+    size_t frame_count;
+    size_t frame_capacity;
     instruction_t *pc;       // Program counter
     bool running;
+    bool suspended;          // Stopped by microphp_vm_run_slice; resumes at pc
+    uint32_t budget;         // Instructions per slice, 0 = unbounded
+    int64_t fuel;            // Instructions left in this slice (negative after an overrun)
+    instruction_t *block;    // First instruction of the basic block being executed
     char *error_msg;
+    
+    // Cooperative scheduling
+    microphp_task_t *tasks;  // MICROPHP_TASKS_MAX slots
+    size_t task_capacity;
+    size_t current_task;
+    uint8_t *ready;          // FIFO ring of ready task ids
+    size_t ready_head;
+    size_t ready_count;
+    uint8_t *timers;         // Min-heap of sleeping task ids by wake_ms
+    size_t timer_count;
+    uint32_t slice_left;     // Safepoints before the running task is preempted
+    int yield;               // Switch requested by a built-in (MICROPHP_YIELD_*)
+    
+    microphp_clock_fn clock;
+    microphp_idle_fn idle;
+    void *platform;
+    uint32_t virtual_ms;
+    uint32_t idle_slack_ms;  // Wakeups this close to the earliest share its idle period
+    uint32_t idle_mark_ms;   // Clock when running time was last counted
+    microphp_idle_stats_t idle_stats;
+    
+    // Pins and peripherals
+    microphp_hal_fn hal;
+    uint8_t *gpio_levels;    // Simulated pins, MICROPHP_GPIO_PINS of them
+    
+    // GPIO interrupt events
+    microphp_events_t *events;
+    const function_t **gpio_handlers;  // Per pin, NULL when not armed
+    microphp_gpio_irq_fn gpio_irq;
+    int handler_task;        // Task running a handler, -1 if none
+    
+    // Script timers
+    microphp_timer_t *script_timers;  // MICROPHP_TIMERS_MAX slots
+    uint8_t *deadlines;      // Min-heap of active timer ids by deadline
+    size_t deadline_count;
+    microphp_timer_arm_fn timer_arm;
+    
+    // Asynchronous transfers
+    microphp_io_t *io;       // MICROPHP_IO_MAX slots
+    microphp_io_fn io_start;
+    
+    // Buffered output
+    microphp_output_t *output;
+    
+    // DSP filters
+    microphp_dsp_t *dsp;     // NULL until the first filter is made
 } vm_context_t;
 
-// Core VM functions
+// Programs: parsed and validated MBC, shareable read-only between VMs.
+// On failure *error (if given) points at a static message.
+bytecode_t* microphp_program_load(const uint8_t *data, size_t size, const microphp_allocator_t *allocator,
+                                  const char **error);
+void microphp_program_free(bytecode_t *program);
+
+// Core VM functions. allocator may be NULL for the C heap. An attached
+// program must outlive the VM, or its next attach/load. When the allocator
+// fails, create returns NULL, attach and load return -1 with the error
+// set, and a running script stops with "Out of memory".
 vm_context_t* microphp_vm_create(void);
+vm_context_t* microphp_vm_create_with(const microphp_allocator_t *allocator);
 void microphp_vm_destroy(vm_context_t *vm);
+int microphp_vm_attach(vm_context_t *vm, const bytecode_t *program);
 int microphp_vm_load_bytecode(vm_context_t *vm, const uint8_t *data, size_t size);
 int microphp_vm_run(vm_context_t *vm);
 void microphp_vm_reset(vm_context_t *vm);
 
+// Runs about budget instructions (0 = to completion), starting the
+// program or resuming where the last slice stopped. Fuel is charged per
+// basic block, so a slice overruns by at most one block. Returns
+// MICROPHP_RUN_DONE, MICROPHP_RUN_YIELDED, or -1 on error.
+#define MICROPHP_RUN_DONE    0
+#define MICROPHP_RUN_YIELDED 1
+int microphp_vm_run_slice(vm_context_t *vm, uint32_t budget);
+int microphp_vm_global_slot(vm_context_t *vm, const char *name);
+void microphp_vm_set_platform(vm_context_t *vm, microphp_clock_fn clock, microphp_idle_fn idle, void *user);
+uint32_t microphp_vm_millis(vm_context_t *vm);
+
+// Idle. When every task sleeps the VM calls the idle hook once for the
+// time until the latest wakeup within slack ms of the earliest, so
+// wakeups that close together cost one sleep; each may run up to slack
+// ms late. Default MICROPHP_IDLE_SLACK_MS.
+void microphp_vm_set_idle_slack(vm_context_t *vm, uint32_t ms);
+void microphp_vm_idle_stats(vm_context_t *vm, microphp_idle_stats_t *stats);
+
+// Tasks. microphp_vm_run enters the script's main code as a task and
+// returns once every task has finished. A task is preempted after
+// MICROPHP_TASK_SLICE safepoints (loop back-edges and calls).
+int microphp_task_spawn(vm_context_t *vm, const char *function, const zval_t *args, size_t argc);
+
+// For built-ins: suspend the calling task once the call returns, for ms
+// (0 just yields). microphp_task_wait instead runs the call again after
+// ms, for built-ins waiting on I/O that is not ready. microphp_vm_exit
+// ends the whole run, every task with it, as exit does.
+#define MICROPHP_YIELD_NONE  0
+#define MICROPHP_YIELD_SLEEP 1
+#define MICROPHP_YIELD_RETRY 2
+#define MICROPHP_YIELD_EXIT  3
+void microphp_task_sleep(vm_context_t *vm, uint32_t ms);
+void microphp_task_wait(vm_context_t *vm, uint32_t ms);
+void microphp_vm_exit(vm_context_t *vm);
+
+// HAL. Built-ins for pins, PWM, ADC and opening buses call the hal hook;
+// bus reads and writes are transfers (below). Without the hook the VM
+// simulates a board: outputs read back the level last written, inputs
+// read low, opens succeed and ADC channels read 0.
+int32_t microphp_hal_call(vm_context_t *vm, const microphp_hal_request_t *request);
+void microphp_vm_set_hal(vm_context_t *vm, microphp_hal_fn hal);
+
+// GPIO interrupts. A script attaches handler(pin, level, time_us) to a
+// pin's edges; the port arms the pin through the gpio_irq hook and its
+// ISR reports each edge with microphp_gpio_post, the only call here that
+// is safe in interrupt context. Posts form a single-producer queue: call
+// it from ISRs that cannot preempt one another. The VM drains the queue
+// at safepoints and while idle, running one handler at a time as a task
+// ahead of the others. Returns false (and counts a drop) when full, and
+// false for a pin outside 0..MICROPHP_GPIO_PINS-1.
+#define MICROPHP_GPIO_RISING  1
+#define MICROPHP_GPIO_FALLING 2
+#define MICROPHP_GPIO_BOTH    3
+void microphp_vm_set_gpio_irq(vm_context_t *vm, microphp_gpio_irq_fn arm);
+int microphp_gpio_attach(vm_context_t *vm, int pin, int edges, const char *handler);
+int microphp_gpio_detach(vm_context_t *vm, int pin);
+bool microphp_gpio_post(vm_context_t *vm, int pin, bool level, uint32_t time_us);
+uint32_t microphp_gpio_dropped(vm_context_t *vm);
+
+// Script timers: handler(id) runs as a task after ms, then every
+// period_ms unless that is 0. Periodic deadlines advance by the period,
+// not from when the handler ran, so they do not drift; a firing is
+// skipped while the previous run is still going. Active timers keep
+// microphp_vm_run going. With the timer_arm hook the port programs one
+// hardware timer for the earliest deadline and calls
+// microphp_timer_expired from its ISR; without it the VM checks
+// deadlines whenever it schedules or preempts.
+int microphp_timer_start(vm_context_t *vm, uint32_t ms, uint32_t period_ms, const char *handler);
+int microphp_timer_cancel(vm_context_t *vm, int id);
+void microphp_vm_set_timer(vm_context_t *vm, microphp_timer_arm_fn arm);
+void microphp_timer_expired(vm_context_t *vm);
+
+// Asynchronous transfers. microphp_io_start copies the request's tx bytes
+// and returns a handle (or -1 when no slot is free or the port refuses);
+// the port's DMA completion ISR calls microphp_io_complete with the bytes
+// received (sent, for writes), or a negative error. microphp_io_await
+// suspends the calling task until then, letting the others run, and its
+// result, once the transfer is done, is the received bytes as a string
+// (the count for writes) or false on error; that frees the handle.
+// microphp_io_run does both for built-ins that return the result
+// directly; the retried call passes the same request. Without an io hook
+// transfers are simulated, taking as long as they would on the wire.
+int microphp_io_start(vm_context_t *vm, const microphp_io_request_t *request);
+bool microphp_io_done(vm_context_t *vm, int handle);
+zval_t microphp_io_await(vm_context_t *vm, int handle);
+zval_t microphp_io_run(vm_context_t *vm, const microphp_io_request_t *request);
+void microphp_io_complete(vm_context_t *vm, int handle, int result);
+void microphp_vm_set_io(vm_context_t *vm, microphp_io_fn start);
+
+// Output. echo, print and printf append to a ring of MICROPHP_OUTPUT_BUF
+// bytes that is handed to the sink as the policy says, and also when the
+// running task is preempted, before the VM idles and at the end of each
+// slice, so a script logging over a slow UART pays for a copy, not the
+// wire time. Bytes the sink does not take stay buffered for the next
+// flush. By default output goes to stdout and is flushed at newlines,
+// half full or after MICROPHP_OUTPUT_FLUSH_MS, and a full ring drops. A
+// blocking policy stalls the VM while the sink refuses bytes, as a
+// blocking write would, but for at most the policy's wait_ms at a time
+// (on the virtual clock without a platform); what still does not fit
+// after that is dropped and counted in microphp_output_dropped().
+void microphp_vm_set_output(vm_context_t *vm, microphp_output_fn sink, void *user);  // NULL sink: stdout
+void microphp_vm_set_output_policy(vm_context_t *vm, const microphp_output_policy_t *policy);
+void microphp_output_write(vm_context_t *vm, const char *data, size_t len);
+size_t microphp_output_flush(vm_context_t *vm);  // Bytes still buffered
+uint32_t microphp_output_dropped(vm_context_t *vm);
+size_t microphp_output_stdout(void *user, const char *data, size_t len);
+size_t microphp_output_memory(void *user, const char *data, size_t len);  // user: microphp_output_memory_t
+
+// DSP (MICROPHP_DSP builds). Filters are biquad cascades (b0 b1 b2 a1 a2
+// per section, a0 normalized to 1) or FIR filters whose state carries
+// over from one block of samples to the next; each VM has
+// MICROPHP_DSP_FILTERS_MAX of them, and creation returns a handle or -1.
+// Kernels work on float samples and use ESP-DSP where the port has it.
+// microphp_dsp_rfft takes n real samples, n a power of two, and writes
+// the n / 2 + 1 complex bins as (re, im) pairs.
+#define MICROPHP_DSP_LOWPASS  0
+#define MICROPHP_DSP_HIGHPASS 1
+#define MICROPHP_DSP_BANDPASS 2
+#define MICROPHP_DSP_NOTCH    3
+
+int microphp_dsp_design(int type, double freq, double q, float coeffs[5]);  // freq as a fraction of the sample rate
+int microphp_dsp_biquad(vm_context_t *vm, const float *coeffs, size_t sections);
+int microphp_dsp_fir(vm_context_t *vm, const float *taps, size_t count);
+int microphp_dsp_filter(vm_context_t *vm, int handle, const float *in, float *out, size_t count);
+int microphp_dsp_free(vm_context_t *vm, int handle);
+void microphp_dsp_clear(vm_context_t *vm);
+int microphp_dsp_rfft(const float *in, float *out, size_t n);
+float microphp_dsp_rms(const float *samples, size_t count);
+float microphp_dsp_peak(const float *samples, size_t count);
+
 // Zval operations
 zval_t microphp_zval_null(void);
 zval_t microphp_zval_bool(bool value);
-zval_t microphp_zval_int(int64_t value);
+zval_t microphp_zval_int(int64_t value);  // A float when value is outside MICROPHP_INT_MIN..MAX
 zval_t microphp_zval_float(double value);
 zval_t microphp_zval_string(const char *str, size_t len);
+zval_t microphp_zval_bytes(const void *data, size_t len);  // data NULL: len zero bytes
 zval_t microphp_zval_array(size_t initial_capacity);
 
 void microphp_zval_destroy(zval_t *zval);
 void microphp_zval_copy(zval_t *dest, const zval_t *src);
 bool microphp_zval_equals(const zval_t *a, const zval_t *b);
+bool microphp_zval_to_bool(const zval_t *zval);
+int64_t microphp_zval_to_int(const zval_t *zval);    // As the (int) cast
+double microphp_zval_to_float(const zval_t *zval);   // As the (float) cast
+
+// Q16.16 fixed point, for targets without an FPU. Raw values are int32
+// (stored in int_val) and every operation saturates instead of wrapping.
+// Arithmetic on two fixed values, or on a fixed value and an int, stays
+// fixed; a float operand makes it a float operation. microphpc --fixed
+// compiles float literals and (float) casts to fixed.
+#define MICROPHP_FIXED_FRAC_BITS 16
+#define MICROPHP_FIXED_ONE       (1 << MICROPHP_FIXED_FRAC_BITS)
+
+zval_t microphp_zval_fixed(int32_t raw);
+int32_t microphp_fixed_from_int(int64_t value);
+int32_t microphp_fixed_from_double(double value);
+double microphp_fixed_to_double(int32_t raw);
+int32_t microphp_fixed_add(int32_t a, int32_t b);
+int32_t microphp_fixed_sub(int32_t a, int32_t b);
+int32_t microphp_fixed_mul(int32_t a, int32_t b);
+int32_t microphp_fixed_div(int32_t a, int32_t b);  // b != 0
+int microphp_fixed_format(int32_t raw, char *buf, size_t size);  // Up to 4 decimals, integer math only
 
 // Array operations
 int microphp_array_push(zval_t *array, const zval_t *value);
@@ -168,14 +676,116 @@ int microphp_array_get(const zval_t *array, size_t index, zval_t *result);
 int microphp_array_set(zval_t *array, size_t index, const zval_t *value);
 size_t microphp_array_size(const zval_t *array);
 
+// Packed numeric arrays: used like arrays of ints or floats, stored as a
+// raw buffer of one element kind. Stored values are converted to the
+// kind (ints saturate, floats truncate); storing anything non-numeric
+// turns the array back into a plain one. Reductions and scaling run over
+// the raw buffer, and over plain arrays of ints and floats too.
+#define MICROPHP_PACKED_I16 0x04
+#define MICROPHP_PACKED_I32 0x08
+#define MICROPHP_PACKED_F32 0x0C
+#define MICROPHP_PACKED_F64 0x10
+
+#define MICROPHP_REDUCE_SUM 0
+#define MICROPHP_REDUCE_MIN 1
+#define MICROPHP_REDUCE_MAX 2
+
+zval_t microphp_array_packed(int kind, size_t size);  // size zeros
+int microphp_array_pack(zval_t *array, int kind);      // -1 if a value is not numeric
+int microphp_array_kind(const zval_t *array);          // 0 for plain arrays
+zval_t microphp_array_reduce(const zval_t *array, size_t start, size_t count, int op);  // null if empty or not numeric
+zval_t microphp_array_scale(const zval_t *array, double mul, double add);
+
+// Number formatting without stdio (numfmt.c). MICROPHP_NUM_BUF bytes
+// hold any itoa/dtoa result and its terminator.
+#define MICROPHP_NUM_BUF 32
+#define MICROPHP_FIXED_DECIMALS_MAX 53  // Decimals beyond this are not produced, as in PHP's printf
+#ifndef MICROPHP_FLOAT_PRECISION
+#define MICROPHP_FLOAT_PRECISION 14  // Significant digits when a float becomes a string, as PHP's precision
+#endif
+
+size_t microphp_itoa(int64_t value, char *buf);
+size_t microphp_utoa(uint64_t value, char *buf);
+size_t microphp_dtoa(double value, int precision, char *buf);  // As %.<precision>G; 0: shortest that reads back exactly
+size_t microphp_ftoa(float value, int precision, char *buf);   // The same for float32
+size_t microphp_dtoa_fixed(double value, int decimals, char *buf, size_t size);  // As %.<decimals>f, snprintf-style length
+// Significant digits of a finite, nonzero |value|, rounded to precision (up
+// to 54) as printf rounds, or the shortest that read back for 0:
+// |value| = 0.DIGITS * 10^point. digits needs room for 20 and for
+// precision + 1; trailing zeros are dropped from the returned count.
+int microphp_dtoa_digits(double value, int precision, char *digits, int *point);
+size_t microphp_float_format(double value, char *buf);         // Float to string as scripts see it: %G digits, PHP's 1.0E+15 layout
+size_t microphp_scalar_format(const zval_t *value, char *buf); // Bool, int, float or fixed as echo shows it; other types give ""
+
+// Formatted output as PHP's printf family (format.c). Directives are
+// %[argnum$][flags][width][.precision]specifier with flags - + 0 space
+// 'c and specifiers b c d e E f F g G o s u x X, plus %%. Output goes to
+// write in pieces as the format is walked; nothing is allocated.
+typedef void (*microphp_write_fn)(void *user, const char *data, size_t len);
+
+int microphp_format(const char *format, size_t len, const zval_t *args, size_t count,
+                    microphp_write_fn write, void *user);  // Length written; -1 if malformed or short of arguments
+int microphp_format_buffer(char *buf, size_t size, const char *format, size_t len,
+                           const zval_t *args, size_t count);  // snprintf-style
+int microphp_format_arity(const char *format, size_t len);    // Arguments the format consumes; -1 if malformed
+int microphp_number_format(double value, int decimals, const char *point, size_t point_len,
+                           const char *sep, size_t sep_len, microphp_write_fn write, void *user);
+
 // String operations
 zval_t microphp_string_concat(const zval_t *a, const zval_t *b);
+
+// In-place $string .= value. Owned strings grow geometrically, so a run
+// of appends copies each byte a constant number of times; anything else
+// becomes the concatenation. -1 if out of memory.
+int microphp_string_append(zval_t *string, const zval_t *value);
+int microphp_string_append_bytes(zval_t *string, const char *data, size_t len);
 int microphp_string_length(const zval_t *string);
+// A NUL-terminated string that is a number as a whole, give or take
+// surrounding whitespace ("10", " 1e1 "), so == compares it numerically
+bool microphp_numeric_string(const char *s, size_t len);
+
+// String payload of either representation; may be NULL for an empty heap string
+static inline const char* microphp_string_data(const zval_t *string) {
+    return (string->flags & ZVAL_FLAG_INLINE) ? string->value.small : string->value.string_val.str;
+}
+
+static inline char* microphp_string_buffer(zval_t *string) {
+    return (string->flags & ZVAL_FLAG_INLINE) ? string->value.small : string->value.string_val.str;
+}
+
+static inline size_t microphp_string_len(const zval_t *string) {
+    return (string->flags & ZVAL_FLAG_INLINE) ? (uint8_t)string->value.small[MICROPHP_SSO_SIZE - 1]
+                                              : string->value.string_val.len;
+}
+uint32_t microphp_hash_bytes(const void *data, size_t len, uint32_t seed);
 
 // Built-in functions
 zval_t microphp_builtin_print(const zval_t *args, size_t count);
 zval_t microphp_builtin_sleep_ms(const zval_t *args, size_t count);
 zval_t microphp_builtin_millis(const zval_t *args, size_t count);
+zval_t microphp_builtin_echo(const zval_t *args, size_t count);
+
+// echo and print through a writer; the built-ins above write to stdout
+void microphp_echo_write(const zval_t *args, size_t count, microphp_write_fn write, void *user);
+void microphp_print_write(const zval_t *args, size_t count, microphp_write_fn write, void *user);
+
+// Built-in registry. The compiler resolves calls to an index into this
+// table, so entries are append-only and never conditional on build options.
+typedef zval_t (*microphp_native_fn)(vm_context_t *vm, const zval_t *args, size_t count);
+
+// Flags for microphp_builtin_t. A pure built-in has no side effects and
+// depends only on its arguments; the compiler may hoist or share calls.
+#define MICROPHP_BUILTIN_PURE 0x1
+
+typedef struct {
+    const char *name;
+    microphp_native_fn fn;
+    uint8_t flags;
+} microphp_builtin_t;
+
+extern const microphp_builtin_t microphp_builtins[];
+extern const size_t microphp_builtin_count;
+int microphp_builtin_lookup(const char *name);
 
 // Error handling
 const char* microphp_get_error(vm_context_t *vm);
@@ -0,0 +1,621 @@
+#include "microphp.h"
+#include <string.h>
+#include <math.h>
+
+// Number to text without stdio. Integers go two digits per step, on
+// 32-bit arithmetic wherever the value allows. Floats use Grisu2 (Loitsch,
+// "Printing Floating-Point Numbers Quickly and Accurately with Integers"):
+// the digits always read back as the same value and are the shortest
+// such in all but rare cases, where one more digit comes out. Fixed
+// precision and fixed decimals round those digits when that is provably
+// the same as rounding the exact value, and fall back to an exact
+// bignum expansion otherwise, so results match printf digit for digit.
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t pow10_u64[20] = {
+    1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u,
+    10000000000u, 100000000000u, 1000000000000u, 10000000000000u, 100000000000000u,
+    1000000000000000u, 10000000000000000u, 100000000000000000u, 1000000000000000000u,
+    10000000000000000000u
+};
+
+// Writes v backwards ending at end; returns the first digit
+static char* write_u32(uint32_t v, char *end) {
+    while (v >= 100) {
+        uint32_t q = v / 100;
+        const char *pair = &digit_pairs[(v - q * 100) * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+        v = q;
+    }
+    if (v >= 10) {
+        *--end = digit_pairs[v * 2 + 1];
+        *--end = digit_pairs[v * 2];
+    } else {
+        *--end = (char)('0' + v);
+    }
+    return end;
+}
+
+size_t microphp_utoa(uint64_t value, char *buf) {
+    char tmp[20];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    
+    // Peel 8-digit groups until the rest fits 32 bits
+    while (value > UINT32_MAX) {
+        uint64_t q = value / 100000000u;
+        char *group = p - 8;
+        char *s = write_u32((uint32_t)(value - q * 100000000u), p);
+        while (s > group) *--s = '0';
+        p = group;
+        value = q;
+    }
+    p = write_u32((uint32_t)value, p);
+    
+    size_t len = (size_t)(end - p);
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return len;
+}
+
+size_t microphp_itoa(int64_t value, char *buf) {
+    if (value >= 0) return microphp_utoa((uint64_t)value, buf);
+    buf[0] = '-';
+    return 1 + microphp_utoa(0u - (uint64_t)value, buf + 1);
+}
+
+// Grisu2
+typedef struct {
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+// 10^k for k = -348, -340, ..., 340, normalized to 64 bits
+static const struct {
+    uint64_t f;
+    int16_t e;
+} cached_powers[87] = {
+    { 0xfa8fd5a0081c0288u, -1220 }, { 0xbaaee17fa23ebf76u, -1193 }, { 0x8b16fb203055ac76u, -1166 },
+    { 0xcf42894a5dce35eau, -1140 }, { 0x9a6bb0aa55653b2du, -1113 }, { 0xe61acf033d1a45dfu, -1087 },
+    { 0xab70fe17c79ac6cau, -1060 }, { 0xff77b1fcbebcdc4fu, -1034 }, { 0xbe5691ef416bd60cu, -1007 },
+    { 0x8dd01fad907ffc3cu, -980 }, { 0xd3515c2831559a83u, -954 }, { 0x9d71ac8fada6c9b5u, -927 },
+    { 0xea9c227723ee8bcbu, -901 }, { 0xaecc49914078536du, -874 }, { 0x823c12795db6ce57u, -847 },
+    { 0xc21094364dfb5637u, -821 }, { 0x9096ea6f3848984fu, -794 }, { 0xd77485cb25823ac7u, -768 },
+    { 0xa086cfcd97bf97f4u, -741 }, { 0xef340a98172aace5u, -715 }, { 0xb23867fb2a35b28eu, -688 },
+    { 0x84c8d4dfd2c63f3bu, -661 }, { 0xc5dd44271ad3cdbau, -635 }, { 0x936b9fcebb25c996u, -608 },
+    { 0xdbac6c247d62a584u, -582 }, { 0xa3ab66580d5fdaf6u, -555 }, { 0xf3e2f893dec3f126u, -529 },
+    { 0xb5b5ada8aaff80b8u, -502 }, { 0x87625f056c7c4a8bu, -475 }, { 0xc9bcff6034c13053u, -449 },
+    { 0x964e858c91ba2655u, -422 }, { 0xdff9772470297ebdu, -396 }, { 0xa6dfbd9fb8e5b88fu, -369 },
+    { 0xf8a95fcf88747d94u, -343 }, { 0xb94470938fa89bcfu, -316 }, { 0x8a08f0f8bf0f156bu, -289 },
+    { 0xcdb02555653131b6u, -263 }, { 0x993fe2c6d07b7facu, -236 }, { 0xe45c10c42a2b3b06u, -210 },
+    { 0xaa242499697392d3u, -183 }, { 0xfd87b5f28300ca0eu, -157 }, { 0xbce5086492111aebu, -130 },
+    { 0x8cbccc096f5088ccu, -103 }, { 0xd1b71758e219652cu, -77 }, { 0x9c40000000000000u, -50 },
+    { 0xe8d4a51000000000u, -24 }, { 0xad78ebc5ac620000u, 3 }, { 0x813f3978f8940984u, 30 },
+    { 0xc097ce7bc90715b3u, 56 }, { 0x8f7e32ce7bea5c70u, 83 }, { 0xd5d238a4abe98068u, 109 },
+    { 0x9f4f2726179a2245u, 136 }, { 0xed63a231d4c4fb27u, 162 }, { 0xb0de65388cc8ada8u, 189 },
+    { 0x83c7088e1aab65dbu, 216 }, { 0xc45d1df942711d9au, 242 }, { 0x924d692ca61be758u, 269 },
+    { 0xda01ee641a708deau, 295 }, { 0xa26da3999aef774au, 322 }, { 0xf209787bb47d6b85u, 348 },
+    { 0xb454e4a179dd1877u, 375 }, { 0x865b86925b9bc5c2u, 402 }, { 0xc83553c5c8965d3du, 428 },
+    { 0x952ab45cfa97a0b3u, 455 }, { 0xde469fbd99a05fe3u, 481 }, { 0xa59bc234db398c25u, 508 },
+    { 0xf6c69a72a3989f5cu, 534 }, { 0xb7dcbf5354e9beceu, 561 }, { 0x88fcf317f22241e2u, 588 },
+    { 0xcc20ce9bd35c78a5u, 614 }, { 0x98165af37b2153dfu, 641 }, { 0xe2a0b5dc971f303au, 667 },
+    { 0xa8d9d1535ce3b396u, 694 }, { 0xfb9b7cd9a4a7443cu, 720 }, { 0xbb764c4ca7a44410u, 747 },
+    { 0x8bab8eefb6409c1au, 774 }, { 0xd01fef10a657842cu, 800 }, { 0x9b10a4e5e9913129u, 827 },
+    { 0xe7109bfba19c0c9du, 853 }, { 0xac2820d9623bf429u, 880 }, { 0x80444b5e7aa7cf85u, 907 },
+    { 0xbf21e44003acdd2du, 933 }, { 0x8e679c2f5e44ff8fu, 960 }, { 0xd433179d9c8cb841u, 986 },
+    { 0x9e19db92b4e31ba9u, 1013 }, { 0xeb96bf6ebadf77d9u, 1039 }, { 0xaf87023b9bf0ee6bu, 1066 }
+};
+
+static diy_fp_t fp_mul(diy_fp_t x, diy_fp_t y) {
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFu;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu) + ((uint64_t)1 << 31);
+    return (diy_fp_t){ ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64 };
+}
+
+static diy_fp_t fp_normalize(diy_fp_t x) {
+#if defined(__GNUC__)
+    int shift = __builtin_clzll(x.f);
+    x.f <<= shift;
+    x.e -= shift;
+#else
+    while (!(x.f & ((uint64_t)1 << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+#endif
+    return x;
+}
+
+static void grisu_round(char *digits, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta, char *digits, int *K) {
+    int shift = -mp.e;
+    uint64_t one = (uint64_t)1 << shift;
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> shift);
+    uint64_t p2 = mp.f & (one - 1);
+    
+    int kappa = 1;
+    while (kappa < 10 && p1 >= pow10_u64[kappa]) kappa++;
+    
+    int len = 0;
+    while (kappa > 0) {
+        uint32_t unit = (uint32_t)pow10_u64[kappa - 1];
+        uint32_t d = p1 / unit;
+        p1 -= d * unit;
+        if (d || len) digits[len++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisu_round(digits, len, delta, rest, pow10_u64[kappa] << shift, wp_w);
+            return len;
+        }
+    }
+    
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        uint32_t d = (uint32_t)(p2 >> shift);
+        if (d || len) digits[len++] = (char)('0' + d);
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            grisu_round(digits, len, delta, p2, one, -kappa < 20 ? wp_w * pow10_u64[-kappa] : 0);
+            return len;
+        }
+    }
+}
+
+// floor(x / 2^18) without relying on signed right shifts
+static int floor_shift18(int x) {
+    return x >= 0 ? x >> 18 : -((-x + (1 << 18) - 1) >> 18);
+}
+
+// Digits of f * 2^e (f > 0) with value = digits * 10^K. lower_closer: f
+// is a power of two, so the next value down is half as far as the next up.
+static int grisu2(uint64_t f, int e, bool lower_closer, char *digits, int *K) {
+    diy_fp_t plus = fp_normalize((diy_fp_t){ (f << 1) + 1, e - 1 });
+    diy_fp_t minus = lower_closer ? (diy_fp_t){ (f << 2) - 1, e - 2 } : (diy_fp_t){ (f << 1) - 1, e - 1 };
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    
+    // Cached power bringing the upper boundary's exponent into [-60, -32]:
+    // k = ceil((-61 - e) * log10(2)), with log10(2) ~ 78913 / 2^18
+    int k = 347 - floor_shift18((61 + plus.e) * 78913);
+    int index = (k >> 3) + 1;
+    *K = 348 - index * 8;
+    diy_fp_t c = { cached_powers[index].f, cached_powers[index].e };
+    
+    diy_fp_t w = fp_mul(fp_normalize((diy_fp_t){ f, e }), c);
+    diy_fp_t wp = fp_mul(plus, c);
+    diy_fp_t wm = fp_mul(minus, c);
+    wm.f++;
+    wp.f--;
+    return digit_gen(w, wp, wp.f - wm.f, digits, K);
+}
+
+// Shortest digits of a finite, nonzero |value| and the decimal point
+// position: |value| = 0.DIGITS * 10^point
+static int shortest_digits(double value, bool single, char *digits, int *point) {
+    uint64_t f;
+    int e;
+    bool lower_closer;
+    
+    if (single) {
+        float narrow = (float)value;
+        uint32_t bits;
+        memcpy(&bits, &narrow, sizeof(bits));
+        uint32_t biased = (bits >> 23) & 0xFF;
+        f = bits & 0x7FFFFFu;
+        lower_closer = f == 0 && biased > 1;
+        if (biased) {
+            f |= 0x800000u;
+            e = (int)biased - 150;
+        } else {
+            e = -149;
+        }
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t biased = (uint32_t)(bits >> 52) & 0x7FF;
+        f = bits & 0xFFFFFFFFFFFFFu;
+        lower_closer = f == 0 && biased > 1;
+        if (biased) {
+            f |= (uint64_t)1 << 52;
+            e = (int)biased - 1075;
+        } else {
+            e = -1074;
+        }
+    }
+    
+    int K;
+    int len = grisu2(f, e, lower_closer, digits, &K);
+    while (len > 1 && digits[len - 1] == '0') {
+        len--;
+        K++;
+    }
+    *point = len + K;
+    return len;
+}
+
+// Exact decimal expansion, for the rare cases where shortest digits
+// cannot decide the rounding. A double is f * 2^e: a whole number of at
+// most 1024 bits, or a fraction over 2^-e of at most 1078 bits.
+typedef struct {
+    uint32_t w[36];
+    int n;                   // Words in use
+} bignum_t;
+
+static uint32_t bn_div_small(bignum_t *b, uint32_t d) {
+    uint64_t rem = 0;
+    for (int i = b->n - 1; i >= 0; i--) {
+        uint64_t cur = (rem << 32) | b->w[i];
+        b->w[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    while (b->n > 0 && b->w[b->n - 1] == 0) b->n--;
+    return (uint32_t)rem;
+}
+
+static bool bn_is_zero(const bignum_t *b) {
+    for (int i = 0; i < b->n; i++) {
+        if (b->w[i]) return false;
+    }
+    return true;
+}
+
+// The first max digits of the exact expansion of a finite |value| > 0,
+// as in shortest_digits. inexact reports nonzero digits beyond them.
+static int exact_digits(double value, char *digits, int max, int *point, bool *inexact) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t biased = (uint32_t)(bits >> 52) & 0x7FF;
+    uint64_t f = bits & 0xFFFFFFFFFFFFFu;
+    int e = -1074;
+    if (biased) {
+        f |= (uint64_t)1 << 52;
+        e = (int)biased - 1075;
+    }
+    
+    bignum_t b;
+    memset(&b, 0, sizeof(b));
+    int len = 0;
+    *inexact = false;
+    
+    if (e >= 0) {
+        // Whole number: f << e, converted nine digits at a time
+        int words = e / 32, shift = e % 32;
+        uint64_t low = f << shift;
+        b.w[words] = (uint32_t)low;
+        b.w[words + 1] = (uint32_t)(low >> 32);
+        b.w[words + 2] = shift ? (uint32_t)(f >> (64 - shift)) : 0;
+        b.n = words + 3;
+        
+        uint32_t chunks[36];
+        int count = 0;
+        while (b.n > 0) chunks[count++] = bn_div_small(&b, 1000000000u);
+        
+        char group[10];
+        int total = (int)microphp_utoa(chunks[count - 1], group);
+        for (int i = 0; i < total; i++) {
+            if (len < max) digits[len++] = group[i];
+            else if (group[i] != '0') *inexact = true;
+        }
+        for (int c = count - 2; c >= 0; c--) {
+            uint32_t chunk = chunks[c];
+            for (int i = 8; i >= 0; i--) {
+                group[i] = (char)('0' + chunk % 10);
+                chunk /= 10;
+            }
+            for (int i = 0; i < 9; i++) {
+                if (len < max) digits[len++] = group[i];
+                else if (group[i] != '0') *inexact = true;
+            }
+            total += 9;
+        }
+        *point = total;
+        return len;
+    }
+    
+    // Whole part, then the fraction's digits: multiply by ten and take
+    // what crosses bit s
+    int s = -e;
+    uint64_t whole = s < 64 ? f >> s : 0;
+    uint64_t frac = s < 64 ? f & (((uint64_t)1 << s) - 1) : f;
+    b.w[0] = (uint32_t)frac;
+    b.w[1] = (uint32_t)(frac >> 32);
+    int top = s / 32, shift = s % 32;
+    b.n = top + 2;
+    
+    *point = 0;
+    if (whole) {
+        char text[MICROPHP_NUM_BUF];
+        int total = (int)microphp_utoa(whole, text);
+        for (int i = 0; i < total; i++) {
+            if (len < max) digits[len++] = text[i];
+            else if (text[i] != '0') *inexact = true;
+        }
+        *point = total;
+    }
+    
+    while (len < max && !bn_is_zero(&b)) {
+        uint64_t carry = 0;
+        for (int i = 0; i < b.n; i++) {
+            uint64_t cur = (uint64_t)b.w[i] * 10 + carry;
+            b.w[i] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        uint32_t d = (uint32_t)((((uint64_t)b.w[top + 1] << 32) | b.w[top]) >> shift);
+        b.w[top] &= shift ? (1u << shift) - 1 : 0;
+        b.w[top + 1] = 0;
+        if (len == 0 && d == 0) {
+            (*point)--;
+        } else {
+            digits[len++] = (char)('0' + d);
+        }
+    }
+    if (!bn_is_zero(&b)) *inexact = true;
+    return len;
+}
+
+// Keeps the first max digits, rounding up when asked; a carry out of the
+// first digit moves the point. Trailing zeros are dropped.
+static int round_digits(char *digits, int len, int max, bool up, int *point) {
+    if (len > max) {
+        len = max;
+        if (up) {
+            while (len > 0 && digits[len - 1] == '9') len--;
+            if (len == 0) {
+                digits[len++] = '1';
+                (*point)++;
+            } else {
+                digits[len - 1]++;
+            }
+        }
+    }
+    while (len > 0 && digits[len - 1] == '0') len--;
+    return len;
+}
+
+// Rounds shortest digits to max. They round as the exact value would
+// unless they stop right on a 5, a tie only the exact value breaks, or
+// more digits are kept than the format reliably carries (safe); then the
+// exact expansion decides, ties to even as printf does. digits must have
+// room for max + 1.
+static int round_to(double value, char *digits, int len, int max, int safe, int *point) {
+    if (max < 0) return 0;
+    if (max > safe || (len == max + 1 && digits[max] == '5')) {
+        bool inexact;
+        len = exact_digits(value, digits, max + 1, point, &inexact);
+        if (len <= max) return round_digits(digits, len, max, false, point);
+        char next = digits[max];
+        bool odd = max > 0 && ((digits[max - 1] - '0') & 1);
+        return round_digits(digits, len, max, next > '5' || (next == '5' && (inexact || odd)), point);
+    }
+    return round_digits(digits, len, max, len > max && digits[max] >= '5', point);
+}
+
+// %G, or with php set the layout PHP's echo uses: a one-digit mantissa
+// keeps ".0" and the exponent is not padded (1.0E+15, 1.0E-5). Scientific
+// notation starts at 10^limit, or with limit 0 at 10^precision as in %G.
+static size_t format_general(double value, bool single, int precision, int limit, bool php, char *buf) {
+    char *p = buf;
+    if (value != value) {
+        memcpy(buf, "NAN", 4);
+        return 3;
+    }
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (single) value = (float)value;
+    if (value > 1.7976931348623157e308) {
+        memcpy(p, "INF", 4);
+        return (size_t)(p - buf) + 3;
+    }
+    if (value == 0) {
+        memcpy(p, "0", 2);
+        return (size_t)(p - buf) + 1;
+    }
+    
+    char digits[20];
+    int point;
+    int len = shortest_digits(value, single, digits, &point);
+    if (precision > 0) {
+        // Subnormals carry fewer digits than the format's usual guarantee
+        int safe = single ? (value < 1.17549435e-38 ? 0 : 6) : (value < 2.2250738585072014e-308 ? 0 : 15);
+        len = round_to(value, digits, len, precision, safe, &point);
+    } else {
+        precision = 17;
+    }
+    if (limit == 0) limit = precision;
+    
+    // Scientific below 1e-4 or from 10^limit up
+    int exponent = point - 1;
+    if (exponent < -4 || exponent >= limit) {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)len - 1);
+            p += len - 1;
+        } else if (php) {
+            *p++ = '.';
+            *p++ = '0';
+        }
+        *p++ = 'E';
+        *p++ = exponent < 0 ? '-' : '+';
+        int magnitude = exponent < 0 ? -exponent : exponent;
+        if (magnitude < 10 && !php) *p++ = '0';
+        char tmp[8];
+        size_t n = microphp_utoa((uint64_t)magnitude, tmp);
+        memcpy(p, tmp, n);
+        p += n;
+    } else if (point <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', (size_t)-point);
+        p += -point;
+        memcpy(p, digits, (size_t)len);
+        p += len;
+    } else if (point >= len) {
+        memcpy(p, digits, (size_t)len);
+        p += len;
+        memset(p, '0', (size_t)(point - len));
+        p += point - len;
+    } else {
+        memcpy(p, digits, (size_t)point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, (size_t)(len - point));
+        p += len - point;
+    }
+    
+    *p = '\0';
+    return (size_t)(p - buf);
+}
+
+int microphp_dtoa_digits(double value, int precision, char *digits, int *point) {
+    if (value < 0) value = -value;
+    int len = shortest_digits(value, false, digits, point);
+    if (precision <= 0) return len;
+    if (precision > MICROPHP_FIXED_DECIMALS_MAX + 1) precision = MICROPHP_FIXED_DECIMALS_MAX + 1;
+    return round_to(value, digits, len, precision, value < 2.2250738585072014e-308 ? 0 : 15, point);
+}
+
+size_t microphp_dtoa(double value, int precision, char *buf) {
+    if (precision < 0) precision = 0;
+    if (precision > 17) precision = 17;
+    return format_general(value, false, precision, 0, false, buf);
+}
+
+size_t microphp_ftoa(float value, int precision, char *buf) {
+    if (precision < 0) precision = 0;
+    if (precision > 9) precision = 9;
+    return format_general(value, true, precision, 0, false, buf);
+}
+
+// Without MICROPHP_FLOAT64 scripts treat floats as float32, which carry
+// at most 9 significant digits: beyond that the shortest digits that
+// read back are all there is to print, but the switch to an exponent
+// still comes at 10^MICROPHP_FLOAT_PRECISION
+size_t microphp_float_format(double value, char *buf) {
+#ifdef MICROPHP_FLOAT64
+    int precision = MICROPHP_FLOAT_PRECISION > 17 ? 17 : MICROPHP_FLOAT_PRECISION;
+    return format_general(value, false, precision, 0, true, buf);
+#else
+    return format_general((float)value, true, MICROPHP_FLOAT_PRECISION < 9 ? MICROPHP_FLOAT_PRECISION : 0,
+                          MICROPHP_FLOAT_PRECISION, true, buf);
+#endif
+}
+
+size_t microphp_scalar_format(const zval_t *value, char *buf) {
+    switch (value->type) {
+        case ZVAL_BOOL:
+            buf[0] = value->value.bool_val ? '1' : '\0';
+            buf[1] = '\0';
+            return value->value.bool_val ? 1 : 0;
+        case ZVAL_INT:
+            return microphp_itoa(value->value.int_val, buf);
+        case ZVAL_FLOAT:
+            return microphp_float_format(value->value.float_val, buf);
+        case ZVAL_FIXED:
+            return (size_t)microphp_fixed_format((int32_t)value->value.int_val, buf, MICROPHP_NUM_BUF);
+        default:
+            buf[0] = '\0';
+            return 0;
+    }
+}
+
+// Bounded writer for the fixed-decimals form, which can run long
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} text_out_t;
+
+static void out_char(text_out_t *out, char c) {
+    if (out->len + 1 < out->size) out->buf[out->len] = c;
+    out->len++;
+}
+
+static void out_text(text_out_t *out, const char *text) {
+    while (*text) out_char(out, *text++);
+}
+
+// %f layout of digits (0.DIGITS * 10^point)
+static void out_fixed(text_out_t *out, const char *digits, int len, int point, int decimals) {
+    if (point <= 0) {
+        out_char(out, '0');
+    } else {
+        for (int i = 0; i < point; i++) out_char(out, i < len ? digits[i] : '0');
+    }
+    if (decimals > 0) {
+        out_char(out, '.');
+        for (int i = point; i < point + decimals; i++) out_char(out, i >= 0 && i < len ? digits[i] : '0');
+    }
+}
+
+// The exact path needs every whole digit of up to 1.8e308 and the
+// decimals, so it keeps its buffer off the common path's stack
+static void fixed_exact(text_out_t *out, double value, int decimals) {
+    char digits[309 + MICROPHP_FIXED_DECIMALS_MAX + 1];
+    int point;
+    bool inexact;
+    exact_digits(value, digits, 1, &point, &inexact);
+    int len = round_to(value, digits, 0, point + decimals, 0, &point);
+    out_fixed(out, digits, len, point, decimals);
+}
+
+size_t microphp_dtoa_fixed(double value, int decimals, char *buf, size_t size) {
+    text_out_t out = { buf, size, 0 };
+    if (decimals < 0) decimals = 0;
+    if (decimals > MICROPHP_FIXED_DECIMALS_MAX) decimals = MICROPHP_FIXED_DECIMALS_MAX;
+    
+    if (value != value) {
+        out_text(&out, "nan");
+    } else if (value > 1.7976931348623157e308 || value < -1.7976931348623157e308) {
+        out_text(&out, value < 0 ? "-inf" : "inf");
+    } else {
+        if (signbit(value)) {
+            out_char(&out, '-');
+            value = -value;
+        }
+        
+        char digits[20];
+        int point = 1;
+        int len = 0;
+        if (value != 0) len = shortest_digits(value, false, digits, &point);
+        int keep = point + decimals;
+        if (value != 0 && keep > 15) {
+            fixed_exact(&out, value, decimals);
+        } else {
+            if (value != 0) len = round_to(value, digits, len, keep, 15, &point);
+            out_fixed(&out, digits, len, point, decimals);
+        }
+    }
+    
+    if (size > 0) buf[out.len < size ? out.len : size - 1] = '\0';
+    return out.len;
+}
@@ -2,139 +2,380 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <math.h>
 #include <assert.h>
+#include <stdatomic.h>
 
-// Memory management
-static void* microphp_malloc(size_t size) {
-    void *ptr = malloc(size);
-    if (!ptr) {
-        fprintf(stderr, "micro-PHP: memory allocation failed\n");
-        abort();
-    }
-    return ptr;
+#ifndef MICROPHP_TASKS_MAX
+#define MICROPHP_TASKS_MAX 4
+#endif
+
+// Safepoints a task runs before others get a turn
+#ifndef MICROPHP_TASK_SLICE
+#define MICROPHP_TASK_SLICE 1024
+#endif
+
+// Spawned tasks start small and grow like the main stack
+#define TASK_STACK_INITIAL  32
+#define TASK_FRAMES_INITIAL 4
+
+_Static_assert(MICROPHP_TASKS_MAX >= 1 && MICROPHP_TASKS_MAX <= 255, "task ids are stored in a uint8_t");
+
+// GPIO edges buffered between the ISR and the VM
+#ifndef MICROPHP_EVENTS_MAX
+#define MICROPHP_EVENTS_MAX 32
+#endif
+
+#ifndef MICROPHP_GPIO_PINS
+#define MICROPHP_GPIO_PINS 48
+#endif
+
+_Static_assert((MICROPHP_EVENTS_MAX & (MICROPHP_EVENTS_MAX - 1)) == 0, "event ring size must be a power of two");
+_Static_assert(MICROPHP_GPIO_PINS <= 256, "event pins are stored in a uint8_t");
+
+#ifndef MICROPHP_TIMERS_MAX
+#define MICROPHP_TIMERS_MAX 8
+#endif
+
+// How late a wakeup may run so it can share an earlier one's idle period
+#ifndef MICROPHP_IDLE_SLACK_MS
+#define MICROPHP_IDLE_SLACK_MS 0
+#endif
+
+_Static_assert(MICROPHP_TIMERS_MAX >= 1 && MICROPHP_TIMERS_MAX <= 255, "timer ids are stored in a uint8_t");
+
+// Asynchronous transfers in flight at once
+#ifndef MICROPHP_IO_MAX
+#define MICROPHP_IO_MAX 4
+#endif
+
+// Bus speeds simulated transfers run at
+#ifndef MICROPHP_SIM_SPI_HZ
+#define MICROPHP_SIM_SPI_HZ    10000000
+#endif
+
+#ifndef MICROPHP_SIM_I2C_HZ
+#define MICROPHP_SIM_I2C_HZ    400000
+#endif
+
+#ifndef MICROPHP_SIM_UART_BAUD
+#define MICROPHP_SIM_UART_BAUD 115200
+#endif
+
+// Script output buffered ahead of the sink
+#ifndef MICROPHP_OUTPUT_BUF
+#define MICROPHP_OUTPUT_BUF 256
+#endif
+
+// Longest a partial line waits for the sink by default
+#ifndef MICROPHP_OUTPUT_FLUSH_MS
+#define MICROPHP_OUTPUT_FLUSH_MS 20
+#endif
+
+// Longest a blocking write waits for a sink that takes nothing
+#ifndef MICROPHP_OUTPUT_WAIT_MS
+#define MICROPHP_OUTPUT_WAIT_MS 100
+#endif
+
+_Static_assert(MICROPHP_OUTPUT_BUF >= 2 && (MICROPHP_OUTPUT_BUF & (MICROPHP_OUTPUT_BUF - 1)) == 0,
+               "output ring size must be a power of two");
+
+// An await the port will wake early sleeps this long between checks
+#define IO_WAIT_MS (UINT32_MAX / 4)
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t pin;
+    uint8_t level;
+} gpio_event_t;
+
+// Single-producer/single-consumer ring: the ISR only writes head, the VM
+// only writes tail. The hardware timer and transfer completion ISRs just
+// raise their flag.
+struct microphp_events {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t dropped;
+    _Atomic bool timer_fired;
+    _Atomic bool io_fired;
+    gpio_event_t slots[MICROPHP_EVENTS_MAX];
+};
+
+#define IO_FREE    0
+#define IO_PENDING 1
+#define IO_DONE    2
+
+// Transfer slot. The completion ISR writes result, then state.
+struct microphp_io {
+    _Atomic int state;
+    _Atomic int result;      // Bytes moved, or negative on error
+    microphp_io_request_t request;
+    uint8_t *buffer;         // Copy of tx, then room for rx
+    int waiter;              // Task blocked in microphp_io_await, -1 if none
+    bool simulated;          // No port: completes at done_ms
+    uint32_t done_ms;
+};
+
+// Output ring, written and drained by the VM only
+struct microphp_output {
+    microphp_output_fn sink;
+    void *user;
+    microphp_output_policy_t policy;
+    uint32_t dropped;
+    uint32_t since_ms;       // When the oldest buffered byte was written
+    size_t tail;             // Oldest buffered byte
+    size_t count;
+    char data[MICROPHP_OUTPUT_BUF];
+};
+
+// Memory management. VMs and programs allocate through their own
+// allocator so instances never contend on shared allocator state.
+static void* heap_alloc(void *user, size_t size) {
+    (void)user;
+    return malloc(size);
 }
 
-static void* microphp_realloc(void *ptr, size_t size) {
-    void *new_ptr = realloc(ptr, size);
-    if (!new_ptr && size > 0) {
-        fprintf(stderr, "micro-PHP: memory reallocation failed\n");
-        abort();
-    }
-    return new_ptr;
+static void* heap_realloc(void *user, void *ptr, size_t size) {
+    (void)user;
+    return realloc(ptr, size);
+}
+
+static void heap_free(void *user, void *ptr) {
+    (void)user;
+    free(ptr);
+}
+
+static const microphp_allocator_t heap_allocator = { heap_alloc, heap_realloc, heap_free, NULL };
+
+// Both return NULL when the allocator fails (realloc leaving ptr as it
+// was); callers fail the VM or the load rather than abort
+static void* mem_alloc(const microphp_allocator_t *allocator, size_t size) {
+    return allocator->alloc(allocator->user, size ? size : 1);
+}
+
+static void* mem_realloc(const microphp_allocator_t *allocator, void *ptr, size_t size) {
+    return allocator->realloc(allocator->user, ptr, size ? size : 1);
+}
+
+static void mem_free(const microphp_allocator_t *allocator, void *ptr) {
+    if (ptr) allocator->free(allocator->user, ptr);
+}
+
+static void* vm_alloc(vm_context_t *vm, size_t size) {
+    return mem_alloc(&vm->allocator, size);
+}
+
+static void* vm_realloc(vm_context_t *vm, void *ptr, size_t size) {
+    return mem_realloc(&vm->allocator, ptr, size);
+}
+
+static void vm_free(vm_context_t *vm, void *ptr) {
+    mem_free(&vm->allocator, ptr);
+}
+
+// Stands in for the message when there is no memory to copy it
+static char out_of_memory[] = "Out of memory";
+
+static void error_clear(vm_context_t *vm) {
+    if (vm->error_msg != out_of_memory) vm_free(vm, vm->error_msg);
+    vm->error_msg = NULL;
 }
 
 // VM context management
 vm_context_t* microphp_vm_create(void) {
-    vm_context_t *vm = microphp_malloc(sizeof(vm_context_t));
+    return microphp_vm_create_with(NULL);
+}
+
+// Frees the fixed buffers create allocates; any of them may be NULL
+static void vm_free_buffers(vm_context_t *vm) {
+    vm_free(vm, vm->stack);
+    vm_free(vm, vm->frames);
+    vm_free(vm, vm->tasks);
+    vm_free(vm, vm->ready);
+    vm_free(vm, vm->timers);
+    vm_free(vm, vm->events);
+    vm_free(vm, vm->gpio_handlers);
+    vm_free(vm, vm->gpio_levels);
+    vm_free(vm, vm->script_timers);
+    vm_free(vm, vm->deadlines);
+    vm_free(vm, vm->io);
+    vm_free(vm, vm->output);
+}
+
+vm_context_t* microphp_vm_create_with(const microphp_allocator_t *allocator) {
+    if (!allocator) allocator = &heap_allocator;
+    
+    vm_context_t *vm = mem_alloc(allocator, sizeof(vm_context_t));
+    if (!vm) return NULL;
     memset(vm, 0, sizeof(vm_context_t));
+    vm->allocator = *allocator;
     
-    // Initialize stack
+    // Stack and call frames; locals and globals are sized from the loaded
+    // bytecode
     vm->stack_size = 1024;
-    vm->stack = microphp_malloc(vm->stack_size * sizeof(zval_t));
-    vm->stack_top = 0;
+    vm->stack = vm_alloc(vm, vm->stack_size * sizeof(zval_t));
+    vm->frame_capacity = 8;
+    vm->frames = vm_alloc(vm, vm->frame_capacity * sizeof(call_frame_t));
     
-    // Initialize locals and globals
-    vm->local_count = MICROPHP_MAX_LOCALS;
-    vm->locals = microphp_malloc(vm->local_count * sizeof(zval_t));
-    vm->global_count = 256;
-    vm->globals = microphp_malloc(vm->global_count * sizeof(zval_t));
+    // Task slots and scheduler queues, the GPIO event ring and handler
+    // table, script timers, transfer slots and the output ring
+    vm->task_capacity = MICROPHP_TASKS_MAX;
+    vm->tasks = vm_alloc(vm, vm->task_capacity * sizeof(microphp_task_t));
+    vm->ready = vm_alloc(vm, vm->task_capacity);
+    vm->timers = vm_alloc(vm, vm->task_capacity);
+    vm->events = vm_alloc(vm, sizeof(microphp_events_t));
+    vm->gpio_handlers = vm_alloc(vm, MICROPHP_GPIO_PINS * sizeof(*vm->gpio_handlers));
+    vm->gpio_levels = vm_alloc(vm, MICROPHP_GPIO_PINS);
+    vm->script_timers = vm_alloc(vm, MICROPHP_TIMERS_MAX * sizeof(microphp_timer_t));
+    vm->deadlines = vm_alloc(vm, MICROPHP_TIMERS_MAX);
+    vm->io = vm_alloc(vm, MICROPHP_IO_MAX * sizeof(microphp_io_t));
+    vm->output = vm_alloc(vm, sizeof(microphp_output_t));
     
-    // Initialize all zvals to null
-    for (size_t i = 0; i < vm->local_count; i++) {
-        vm->locals[i] = microphp_zval_null();
+    if (!vm->stack || !vm->frames || !vm->tasks || !vm->ready || !vm->timers || !vm->events ||
+        !vm->gpio_handlers || !vm->gpio_levels || !vm->script_timers || !vm->deadlines || !vm->io ||
+        !vm->output) {
+        vm_free_buffers(vm);
+        mem_free(allocator, vm);
+        return NULL;
     }
-    for (size_t i = 0; i < vm->global_count; i++) {
-        vm->globals[i] = microphp_zval_null();
+    
+    memset(vm->tasks, 0, vm->task_capacity * sizeof(microphp_task_t));
+    vm->slice_left = MICROPHP_TASK_SLICE;
+    vm->idle_slack_ms = MICROPHP_IDLE_SLACK_MS;
+    
+    atomic_init(&vm->events->head, 0);
+    atomic_init(&vm->events->tail, 0);
+    atomic_init(&vm->events->dropped, 0);
+    atomic_init(&vm->events->timer_fired, false);
+    atomic_init(&vm->events->io_fired, false);
+    memset(vm->gpio_handlers, 0, MICROPHP_GPIO_PINS * sizeof(*vm->gpio_handlers));
+    vm->handler_task = -1;
+    memset(vm->gpio_levels, 0, MICROPHP_GPIO_PINS);
+    
+    memset(vm->script_timers, 0, MICROPHP_TIMERS_MAX * sizeof(microphp_timer_t));
+    
+    for (size_t i = 0; i < MICROPHP_IO_MAX; i++) {
+        atomic_init(&vm->io[i].state, IO_FREE);
+        atomic_init(&vm->io[i].result, 0);
+        vm->io[i].buffer = NULL;
+        vm->io[i].waiter = -1;
     }
     
-    vm->running = false;
-    vm->error_msg = NULL;
+    // Output is flushed to stdout until the host picks a sink
+    memset(vm->output, 0, sizeof(microphp_output_t));
+    vm->output->sink = microphp_output_stdout;
+    vm->output->policy.flush_size = MICROPHP_OUTPUT_BUF / 2;
+    vm->output->policy.flush_newline = true;
+    vm->output->policy.flush_ms = MICROPHP_OUTPUT_FLUSH_MS;
+    vm->output->policy.full = MICROPHP_OUTPUT_DROP;
+    vm->output->policy.wait_ms = MICROPHP_OUTPUT_WAIT_MS;
     
     return vm;
 }
 
+static void tasks_clear(vm_context_t *vm);
+static void gpio_clear(vm_context_t *vm);
+static void timers_clear(vm_context_t *vm);
+static void io_clear(vm_context_t *vm);
+
 void microphp_vm_destroy(vm_context_t *vm) {
     if (!vm) return;
     
-    // Clean up bytecode
-    if (vm->bytecode) {
-        // Free constants
-        if (vm->bytecode->constants) {
-            for (uint32_t i = 0; i < vm->bytecode->constant_count; i++) {
-                microphp_zval_destroy(&vm->bytecode->constants[i]);
-            }
-            free(vm->bytecode->constants);
-        }
-        
-        // Free functions
-        if (vm->bytecode->functions) {
-            for (uint32_t i = 0; i < vm->bytecode->function_count; i++) {
-                if (vm->bytecode->functions[i].name) {
-                    free(vm->bytecode->functions[i].name);
-                }
-                if (vm->bytecode->functions[i].code) {
-                    free(vm->bytecode->functions[i].code);
-                }
-            }
-            free(vm->bytecode->functions);
-        }
-        
-        free(vm->bytecode);
-    }
+    // Hand over what is left of the output, then clean up suspended tasks,
+    // armed pins, timers, transfers and filters
+    microphp_output_flush(vm);
+    tasks_clear(vm);
+    gpio_clear(vm);
+    timers_clear(vm);
+    io_clear(vm);
+#ifdef MICROPHP_DSP
+    microphp_dsp_clear(vm);
+#endif
     
     // Clean up stack
-    if (vm->stack) {
-        for (size_t i = 0; i < vm->stack_top; i++) {
-            microphp_zval_destroy(&vm->stack[i]);
-        }
-        free(vm->stack);
+    for (size_t i = 0; i < vm->stack_top; i++) {
+        microphp_zval_destroy(&vm->stack[i]);
     }
     
     // Clean up locals and globals
     if (vm->locals) {
-        for (size_t i = 0; i < vm->local_count; i++) {
+        for (size_t i = 0; i < vm->locals_top; i++) {
             microphp_zval_destroy(&vm->locals[i]);
         }
-        free(vm->locals);
+        vm_free(vm, vm->locals);
     }
     
     if (vm->globals) {
         for (size_t i = 0; i < vm->global_count; i++) {
             microphp_zval_destroy(&vm->globals[i]);
         }
-        free(vm->globals);
+        vm_free(vm, vm->globals);
     }
     
+    // Clean up the program once nothing refers to its constants
+    microphp_program_free(vm->owned_bytecode);
+    
+    vm_free_buffers(vm);
+    error_clear(vm);
+    
+    microphp_allocator_t allocator = vm->allocator;
+    mem_free(&allocator, vm);
+}
+
+static void vm_fail(vm_context_t *vm, const char *msg) {
+    size_t len = strlen(msg);
+    error_clear(vm);
+    vm->error_msg = vm_alloc(vm, len + 1);
     if (vm->error_msg) {
-        free(vm->error_msg);
+        memcpy(vm->error_msg, msg, len + 1);
+    } else {
+        vm->error_msg = out_of_memory;
     }
-    
-    free(vm);
+    vm->running = false;
 }
 
 // Stack operations
-static int stack_push(vm_context_t *vm, const zval_t *value) {
-    if (vm->stack_top >= vm->stack_size) {
-        // Grow stack
-        size_t new_size = vm->stack_size * 2;
-        zval_t *new_stack = microphp_realloc(vm->stack, new_size * sizeof(zval_t));
-        if (!new_stack) return -1;
-        
-        vm->stack = new_stack;
-        vm->stack_size = new_size;
+static int stack_grow(vm_context_t *vm) {
+    size_t new_size = vm->stack_size * 2;
+    zval_t *new_stack = vm_realloc(vm, vm->stack, new_size * sizeof(zval_t));
+    if (!new_stack) {
+        vm_fail(vm, "Out of memory");
+        return -1;
     }
     
+    vm->stack = new_stack;
+    vm->stack_size = new_size;
+    return 0;
+}
+
+// Push a copy of value
+static int stack_push(vm_context_t *vm, const zval_t *value) {
+    if (vm->stack_top >= vm->stack_size && stack_grow(vm) != 0) return -1;
+    
+    vm->stack[vm->stack_top] = microphp_zval_null();
     microphp_zval_copy(&vm->stack[vm->stack_top], value);
     vm->stack_top++;
     return 0;
 }
 
+// Push value, taking ownership of its payload
+static int stack_push_value(vm_context_t *vm, zval_t value) {
+    if (vm->stack_top >= vm->stack_size && stack_grow(vm) != 0) {
+        microphp_zval_destroy(&value);
+        return -1;
+    }
+    
+    vm->stack[vm->stack_top++] = value;
+    return 0;
+}
+
+// Pop into result; the caller owns the popped value
 static int stack_pop(vm_context_t *vm, zval_t *result) {
     if (vm->stack_top == 0) return -1;
     
     vm->stack_top--;
-    microphp_zval_copy(result, &vm->stack[vm->stack_top]);
-    microphp_zval_destroy(&vm->stack[vm->stack_top]);
+    *result = vm->stack[vm->stack_top];
     return 0;
 }
 
@@ -143,152 +384,2889 @@ static zval_t* stack_peek(vm_context_t *vm, size_t offset) {
     return &vm->stack[vm->stack_top - 1 - offset];
 }
 
-// Bytecode loading
-int microphp_vm_load_bytecode(vm_context_t *vm, const uint8_t *data, size_t size) {
-    if (!vm || !data || size < sizeof(bytecode_t)) return -1;
-    
-    // Parse bytecode header
-    const bytecode_t *header = (const bytecode_t*)data;
-    
-    // Verify magic
-    if (memcmp(header->magic, "MBC\0", 4) != 0) {
-        vm->error_msg = strdup("Invalid bytecode magic");
-        return -1;
-    }
-    
-    // Verify version
-    if (header->version != 1) {
-        vm->error_msg = strdup("Unsupported bytecode version");
-        return -1;
+// Bytecode reader (MBC is little-endian)
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    bool failed;
+    bool out_of_memory;
+} mbc_reader_t;
+
+static const uint8_t* mbc_read_bytes(mbc_reader_t *r, size_t len) {
+    if (r->failed || len > r->size - r->pos) {
+        r->failed = true;
+        return NULL;
     }
+    const uint8_t *p = r->data + r->pos;
+    r->pos += len;
+    return p;
+}
+
+static uint8_t mbc_read_u8(mbc_reader_t *r) {
+    const uint8_t *p = mbc_read_bytes(r, 1);
+    return p ? p[0] : 0;
+}
+
+static uint16_t mbc_read_u16(mbc_reader_t *r) {
+    const uint8_t *p = mbc_read_bytes(r, 2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+}
+
+static uint32_t mbc_read_u32(mbc_reader_t *r) {
+    const uint8_t *p = mbc_read_bytes(r, 4);
+    if (!p) return 0;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t mbc_read_u64(mbc_reader_t *r) {
+    uint64_t lo = mbc_read_u32(r);
+    uint64_t hi = mbc_read_u32(r);
+    return lo | (hi << 32);
+}
+
+static char* mbc_read_name(mbc_reader_t *r, const microphp_allocator_t *allocator) {
+    uint32_t len = mbc_read_u32(r);
+    const uint8_t *p = mbc_read_bytes(r, len);
+    if (!p) return NULL;
     
-    // Allocate bytecode structure
-    vm->bytecode = microphp_malloc(sizeof(bytecode_t));
-    memcpy(vm->bytecode, header, sizeof(bytecode_t));
-    
-    // Load constants
-    if (header->constant_count > 0) {
-        vm->bytecode->constants = microphp_malloc(header->constant_count * sizeof(zval_t));
-        // TODO: Parse constants from data
+    char *name = mem_alloc(allocator, len + 1);
+    if (!name) {
+        r->out_of_memory = true;
+        return NULL;
     }
+    memcpy(name, p, len);
+    name[len] = '\0';
+    return name;
+}
+
+static int mbc_read_constant(mbc_reader_t *r, zval_t *out) {
+    uint8_t type = mbc_read_u8(r);
     
-    // Load functions
-    if (header->function_count > 0) {
-        vm->bytecode->functions = microphp_malloc(header->function_count * sizeof(function_t));
-        // TODO: Parse functions from data
+    switch (type) {
+        case ZVAL_NULL:
+            *out = microphp_zval_null();
+            break;
+        case ZVAL_BOOL:
+            *out = microphp_zval_bool(mbc_read_u8(r) != 0);
+            break;
+        case ZVAL_INT:
+            *out = microphp_zval_int((int64_t)mbc_read_u64(r));
+            break;
+        case ZVAL_FLOAT: {
+            uint64_t bits = mbc_read_u64(r);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            *out = microphp_zval_float(value);
+            break;
+        }
+        case ZVAL_FIXED:
+            *out = microphp_zval_fixed((int32_t)mbc_read_u32(r));
+            break;
+        case ZVAL_STRING: {
+            uint32_t len = mbc_read_u32(r);
+            const uint8_t *p = mbc_read_bytes(r, len);
+            *out = microphp_zval_string(p ? (const char*)p : NULL, p ? len : 0);
+            break;
+        }
+        default:
+            *out = microphp_zval_null();
+            return -1;
     }
     
-    return 0;
+    return r->failed ? -1 : 0;
 }
 
-// VM execution
-int microphp_vm_run(vm_context_t *vm) {
-    if (!vm || !vm->bytecode) return -1;
+// Switch tables are checked like code: every entry index and key
+// constant must be in range so dispatch needs no checks
+static int validate_switch_table(const bytecode_t *bc, const function_t *fn, size_t index) {
+    const instruction_t *instr = &fn->code[index];
+    size_t entries = instr->operand2;
     
-    vm->running = true;
+    if (instr->operand1 >= bc->constant_count || entries == 0) return -1;
+    if (index + entries + 1 >= fn->code_size) return -1;
+    for (size_t i = 1; i <= entries; i++) {
+        if (fn->code[index + i].opcode != OP_JMP) return -1;
+    }
     
-    // Set program counter to main function
-    if (vm->bytecode->main_offset < vm->bytecode->function_count) {
-        vm->pc = vm->bytecode->functions[vm->bytecode->main_offset].code;
+    const zval_t *table = &bc->constants[instr->operand1];
+    if (table->type != ZVAL_STRING) return -1;
+    mbc_reader_t reader = { .data = (const uint8_t*)microphp_string_data(table), .size = microphp_string_len(table) };
+    mbc_reader_t *r = &reader;
+    
+    uint8_t kind = mbc_read_u8(r);
+    if (kind == MICROPHP_SWITCH_DENSE) {
+        mbc_read_u64(r);
+    } else if (kind == MICROPHP_SWITCH_INT_HASH || kind == MICROPHP_SWITCH_STRING_HASH) {
+        mbc_read_u32(r);
+        uint16_t size = mbc_read_u16(r);
+        uint16_t buckets = mbc_read_u16(r);
+        if (size == 0 || (size & (size - 1)) != 0) return -1;
+        if (buckets == 0 || (buckets & (buckets - 1)) != 0) return -1;
+        for (size_t b = 0; b < buckets; b++) mbc_read_u16(r);
+        
+        for (size_t slot = 0; slot < size && !r->failed; slot++) {
+            uint16_t key = 0;
+            if (kind == MICROPHP_SWITCH_INT_HASH) {
+                mbc_read_u64(r);
+            } else {
+                key = mbc_read_u16(r);
+            }
+            uint16_t entry = mbc_read_u16(r);
+            if (entry == MICROPHP_SWITCH_EMPTY || r->failed) continue;
+            if (entry >= entries - 1) return -1;
+            if (kind == MICROPHP_SWITCH_STRING_HASH &&
+                (key >= bc->constant_count || bc->constants[key].type != ZVAL_STRING)) {
+                return -1;
+            }
+        }
     } else {
-        vm->error_msg = strdup("Invalid main function offset");
-        vm->running = false;
         return -1;
     }
     
-    // Main execution loop
-    while (vm->running && vm->pc) {
-        instruction_t *instr = vm->pc;
+    return (r->failed || r->pos != r->size) ? -1 : 0;
+}
+
+// Check every operand once at load time so the interpreter can index
+// constants, slots and functions without bounds checks.
+static int validate_function(const bytecode_t *bc, const function_t *fn) {
+    if (fn->param_count > fn->local_count) return -1;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        const instruction_t *instr = &fn->code[i];
         
         switch (instr->opcode) {
-            case OP_NOP:
-                vm->pc++;
-                break;
-                
             case OP_CONST:
-                if (instr->operand1 < vm->bytecode->constant_count) {
-                    stack_push(vm, &vm->bytecode->constants[instr->operand1]);
-                }
-                vm->pc++;
+                if (instr->operand1 >= bc->constant_count) return -1;
                 break;
-                
-            case OP_ADD: {
-                zval_t b, a, result;
-                if (stack_pop(vm, &b) != 0 || stack_pop(vm, &a) != 0) {
-                    vm->error_msg = strdup("Stack underflow in ADD");
-                    vm->running = false;
-                    break;
-                }
-                
-                if (a.type == ZVAL_INT && b.type == ZVAL_INT) {
-                    result = microphp_zval_int(a.value.int_val + b.value.int_val);
-                } else if (a.type == ZVAL_FLOAT || b.type == ZVAL_FLOAT) {
-                    double a_val = (a.type == ZVAL_INT) ? (double)a.value.int_val : a.value.float_val;
-                    double b_val = (b.type == ZVAL_INT) ? (double)b.value.int_val : b.value.float_val;
-                    result = microphp_zval_float(a_val + b_val);
-                } else {
-                    vm->error_msg = strdup("Invalid types for ADD operation");
-                    vm->running = false;
-                    break;
+            case OP_JMP:
+            case OP_JMPZ:
+            case OP_JMPNZ:
+                if (instr->operand1 >= fn->code_size) return -1;
+                break;
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                if (instr->operand1 >= fn->local_count) return -1;
+                break;
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+                if (instr->operand1 >= bc->global_count) return -1;
+                break;
+            case OP_ARRAY_SET:
+                if (instr->operand2 & MICROPHP_ARRAY_SET_GLOBAL) {
+                    if (instr->operand1 >= bc->global_count) return -1;
+                } else if (instr->operand1 >= fn->local_count) {
+                    return -1;
                 }
-                
-                stack_push(vm, &result);
-                vm->pc++;
                 break;
-            }
-            
-            case OP_RETURN:
-                vm->running = false;
+            case OP_INC_JLT_LOCAL:
+                if (instr->operand1 >= fn->local_count || instr->operand2 >= fn->code_size) return -1;
+                break;
+            case OP_INC_JLT_GLOBAL:
+                if (instr->operand1 >= bc->global_count || instr->operand2 >= fn->code_size) return -1;
+                break;
+            case OP_APPEND_LOCAL:
+                if (instr->operand1 >= fn->local_count) return -1;
+                break;
+            case OP_APPEND_GLOBAL:
+                if (instr->operand1 >= bc->global_count) return -1;
+                break;
+            case OP_SWITCH_TABLE:
+                if (validate_switch_table(bc, fn, i) != 0) return -1;
+                break;
+            case OP_CALL:
+                if (instr->operand1 >= bc->function_count) return -1;
+                break;
+            case OP_CALL_BUILTIN:
+                if (instr->operand1 >= microphp_builtin_count) return -1;
                 break;
-                
             default:
-                vm->error_msg = strdup("Unimplemented opcode");
-                vm->running = false;
+                if (instr->opcode > OP_APPEND_GLOBAL) return -1;
                 break;
         }
     }
     
-    return vm->running ? 0 : -1;
+    // Code must not run off the end
+    if (fn->code_size == 0) return -1;
+    
+    return 0;
 }
 
-void microphp_vm_reset(vm_context_t *vm) {
-    if (!vm) return;
+void microphp_program_free(bytecode_t *bytecode) {
+    if (!bytecode) return;
+    const microphp_allocator_t *allocator = &bytecode->allocator;
     
-    // Reset stack
-    for (size_t i = 0; i < vm->stack_top; i++) {
-        microphp_zval_destroy(&vm->stack[i]);
+    // Free constants
+    if (bytecode->constants) {
+        for (uint32_t i = 0; i < bytecode->constant_count; i++) {
+            microphp_zval_destroy(&bytecode->constants[i]);
+        }
+        mem_free(allocator, bytecode->constants);
     }
-    vm->stack_top = 0;
     
-    // Reset locals
-    for (size_t i = 0; i < vm->local_count; i++) {
-        microphp_zval_destroy(&vm->locals[i]);
-        vm->locals[i] = microphp_zval_null();
+    // Free functions
+    if (bytecode->functions) {
+        for (uint32_t i = 0; i < bytecode->function_count; i++) {
+            if (bytecode->functions[i].name) {
+                mem_free(allocator, bytecode->functions[i].name);
+            }
+            if (bytecode->functions[i].code) {
+                mem_free(allocator, bytecode->functions[i].code);
+            }
+        }
+        mem_free(allocator, bytecode->functions);
     }
     
-    // Reset globals
+    // Free global slot map
+    if (bytecode->global_names) {
+        for (uint32_t i = 0; i < bytecode->global_count; i++) {
+            mem_free(allocator, bytecode->global_names[i]);
+        }
+        mem_free(allocator, bytecode->global_names);
+    }
+    
+    microphp_allocator_t copy = *allocator;
+    mem_free(&copy, bytecode);
+}
+
+// Bytecode loading
+#define PROGRAM_FAIL(msg) do { if (error) *error = (msg); return NULL; } while (0)
+
+bytecode_t* microphp_program_load(const uint8_t *data, size_t size, const microphp_allocator_t *allocator,
+                                  const char **error) {
+    if (!allocator) allocator = &heap_allocator;
+    if (!data) PROGRAM_FAIL("No bytecode");
+    
+    mbc_reader_t reader = { .data = data, .size = size };
+    mbc_reader_t *r = &reader;
+    
+    // Verify magic
+    const uint8_t *magic = mbc_read_bytes(r, 4);
+    if (!magic || memcmp(magic, "MBC\0", 4) != 0) {
+        PROGRAM_FAIL("Invalid bytecode magic");
+    }
+    
+    // Verify version
+    if (mbc_read_u32(r) != MICROPHP_MBC_VERSION) {
+        PROGRAM_FAIL("Unsupported bytecode version");
+    }
+    
+    // Allocate bytecode structure
+    bytecode_t *bc = mem_alloc(allocator, sizeof(bytecode_t));
+    if (!bc) PROGRAM_FAIL("Out of memory");
+    memset(bc, 0, sizeof(bytecode_t));
+    bc->allocator = *allocator;
+    memcpy(bc->magic, "MBC\0", 4);
+    bc->version = MICROPHP_MBC_VERSION;
+    
+    uint32_t constant_count = mbc_read_u32(r);
+    uint32_t function_count = mbc_read_u32(r);
+    bc->main_offset = mbc_read_u32(r);
+    uint32_t global_count = mbc_read_u32(r);
+    
+    if (r->failed ||
+        constant_count > MICROPHP_MAX_CONSTANTS ||
+        function_count > MICROPHP_MAX_FUNCTIONS ||
+        global_count > MICROPHP_MAX_GLOBALS) {
+        microphp_program_free(bc);
+        PROGRAM_FAIL("Invalid bytecode header");
+    }
+    
+    // Load constants
+    if (constant_count > 0) {
+        bc->constants = mem_alloc(allocator, constant_count * sizeof(zval_t));
+        if (!bc->constants) {
+            microphp_program_free(bc);
+            PROGRAM_FAIL("Out of memory");
+        }
+        for (uint32_t i = 0; i < constant_count; i++) {
+            bc->constant_count = i + 1;
+            if (mbc_read_constant(r, &bc->constants[i]) != 0) {
+                microphp_program_free(bc);
+                PROGRAM_FAIL("Invalid bytecode constant");
+            }
+        }
+    }
+    
+    // Load functions
+    if (function_count > 0) {
+        bc->functions = mem_alloc(allocator, function_count * sizeof(function_t));
+        if (!bc->functions) {
+            microphp_program_free(bc);
+            PROGRAM_FAIL("Out of memory");
+        }
+        memset(bc->functions, 0, function_count * sizeof(function_t));
+        bc->function_count = function_count;
+        
+        for (uint32_t i = 0; i < function_count; i++) {
+            function_t *fn = &bc->functions[i];
+            fn->name = mbc_read_name(r, allocator);
+            fn->name_len = fn->name ? strlen(fn->name) : 0;
+            fn->code_size = mbc_read_u32(r);
+            fn->local_count = mbc_read_u32(r);
+            fn->param_count = mbc_read_u32(r);
+            
+            if (r->failed || fn->code_size > r->size - r->pos ||
+                fn->local_count > MICROPHP_MAX_LOCALS) {
+                microphp_program_free(bc);
+                PROGRAM_FAIL("Invalid bytecode function");
+            }
+            
+            fn->code = mem_alloc(allocator, (fn->code_size ? fn->code_size : 1) * sizeof(instruction_t));
+            if (!fn->code || r->out_of_memory) {
+                microphp_program_free(bc);
+                PROGRAM_FAIL("Out of memory");
+            }
+            for (size_t j = 0; j < fn->code_size; j++) {
+                fn->code[j].opcode = (opcode_t)mbc_read_u16(r);
+                fn->code[j].operand1 = mbc_read_u16(r);
+                fn->code[j].operand2 = mbc_read_u16(r);
+            }
+        }
+    }
+    
+    // Load global slot map
+    bc->global_count = global_count;
+    if (global_count > 0) {
+        bc->global_names = mem_alloc(allocator, global_count * sizeof(char*));
+        if (!bc->global_names) {
+            microphp_program_free(bc);
+            PROGRAM_FAIL("Out of memory");
+        }
+        memset(bc->global_names, 0, global_count * sizeof(char*));
+        for (uint32_t i = 0; i < global_count; i++) {
+            bc->global_names[i] = mbc_read_name(r, allocator);
+        }
+    }
+    
+    if (r->out_of_memory) {
+        microphp_program_free(bc);
+        PROGRAM_FAIL("Out of memory");
+    }
+    if (r->failed || bc->main_offset >= bc->function_count) {
+        microphp_program_free(bc);
+        PROGRAM_FAIL("Truncated bytecode");
+    }
+    
+    for (uint32_t i = 0; i < bc->function_count; i++) {
+        if (validate_function(bc, &bc->functions[i]) != 0) {
+            microphp_program_free(bc);
+            PROGRAM_FAIL("Invalid bytecode operand");
+        }
+    }
+    
+    return bc;
+}
+
+#undef PROGRAM_FAIL
+
+static int vm_set_program(vm_context_t *vm, const bytecode_t *program, bytecode_t *owned) {
+    // Values may borrow constants of the old program: drop them first
+    microphp_vm_reset(vm);
+    microphp_program_free(vm->owned_bytecode);
+    vm->bytecode = program;
+    vm->owned_bytecode = owned;
+    
+    // Size globals exactly from the compiler's slot map
+    vm_free(vm, vm->globals);
+    vm->global_count = program->global_count;
+    vm->globals = vm->global_count ? vm_alloc(vm, vm->global_count * sizeof(zval_t)) : NULL;
+    if (vm->global_count && !vm->globals) {
+        vm->global_count = 0;
+        vm_fail(vm, "Out of memory");
+        return -1;
+    }
     for (size_t i = 0; i < vm->global_count; i++) {
-        microphp_zval_destroy(&vm->globals[i]);
         vm->globals[i] = microphp_zval_null();
     }
+    return 0;
+}
+
+int microphp_vm_attach(vm_context_t *vm, const bytecode_t *program) {
+    if (!vm || !program) return -1;
+    return vm_set_program(vm, program, NULL);
+}
+
+int microphp_vm_load_bytecode(vm_context_t *vm, const uint8_t *data, size_t size) {
+    if (!vm) return -1;
     
-    vm->pc = NULL;
-    vm->running = false;
-    
-    if (vm->error_msg) {
-        free(vm->error_msg);
-        vm->error_msg = NULL;
+    const char *error = NULL;
+    bytecode_t *bc = microphp_program_load(data, size, &vm->allocator, &error);
+    if (!bc) {
+        vm_fail(vm, error);
+        return -1;
     }
+    
+    return vm_set_program(vm, bc, bc);
 }
 
-// Error handling
-const char* microphp_get_error(vm_context_t *vm) {
-    return vm ? vm->error_msg : NULL;
+int microphp_vm_global_slot(vm_context_t *vm, const char *name) {
+    if (!vm || !vm->bytecode || !name) return -1;
+    
+    for (uint32_t i = 0; i < vm->bytecode->global_count; i++) {
+        if (vm->bytecode->global_names[i] && strcmp(vm->bytecode->global_names[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
 }
 
-void microphp_clear_error(vm_context_t *vm) {
-    if (vm && vm->error_msg) {
-        free(vm->error_msg);
-        vm->error_msg = NULL;
+// Call frames
+static int push_frame(vm_context_t *vm, const function_t *fn, instruction_t *return_pc, size_t argc) {
+    if (vm->frame_count >= vm->frame_capacity) {
+        call_frame_t *frames = vm_realloc(vm, vm->frames, vm->frame_capacity * 2 * sizeof(call_frame_t));
+        if (!frames) return -1;
+        vm->frames = frames;
+        vm->frame_capacity *= 2;
     }
+    
+    // Grow the locals stack to fit this frame
+    size_t needed = vm->locals_top + fn->local_count;
+    if (needed > vm->local_count) {
+        size_t new_count = vm->local_count ? vm->local_count : fn->local_count;
+        while (new_count < needed) new_count *= 2;
+        zval_t *locals = vm_realloc(vm, vm->locals, new_count * sizeof(zval_t));
+        if (!locals) return -1;
+        vm->locals = locals;
+        vm->local_count = new_count;
+    }
+    
+    call_frame_t *frame = &vm->frames[vm->frame_count++];
+    frame->function = fn;
+    frame->return_pc = return_pc;
+    frame->locals_base = vm->locals_top;
+    
+    zval_t *locals = &vm->locals[frame->locals_base];
+    for (size_t i = 0; i < fn->local_count; i++) {
+        locals[i] = microphp_zval_null();
+    }
+    vm->locals_top = needed;
+    
+    // Move arguments into parameter slots; extra arguments are dropped
+    zval_t *args = &vm->stack[vm->stack_top - argc];
+    for (size_t i = 0; i < argc; i++) {
+        if (i < fn->param_count) {
+            locals[i] = args[i];
+        } else {
+            microphp_zval_destroy(&args[i]);
+        }
+    }
+    vm->stack_top -= argc;
+    
+    return 0;
+}
+
+static void pop_frame(vm_context_t *vm) {
+    call_frame_t *frame = &vm->frames[--vm->frame_count];
+    
+    for (size_t i = frame->locals_base; i < vm->locals_top; i++) {
+        microphp_zval_destroy(&vm->locals[i]);
+    }
+    vm->locals_top = frame->locals_base;
+}
+
+// Tasks
+//
+// The running task's state lives in the VM fields the interpreter uses;
+// switching copies it out to the task's slot and the next task's in. A
+// task leaves the CPU when a built-in asks it to (sleep_ms, I/O waits) or
+// at a safepoint once its slice is used up. Sleeping tasks sit in a
+// min-heap keyed by wake time, ready ones in a FIFO ring.
+void microphp_vm_set_platform(vm_context_t *vm, microphp_clock_fn clock, microphp_idle_fn idle, void *user) {
+    if (!vm) return;
+    vm->clock = clock;
+    vm->idle = idle;
+    vm->platform = user;
+}
+
+uint32_t microphp_vm_millis(vm_context_t *vm) {
+    return vm->clock ? vm->clock(vm->platform) : vm->virtual_ms;
+}
+
+void microphp_vm_set_idle_slack(vm_context_t *vm, uint32_t ms) {
+    if (vm) vm->idle_slack_ms = ms;
+}
+
+// Counts the time since the last mark as running
+static void idle_stats_mark(vm_context_t *vm) {
+    uint32_t now = microphp_vm_millis(vm);
+    vm->idle_stats.running_ms += now - vm->idle_mark_ms;
+    vm->idle_mark_ms = now;
+}
+
+void microphp_vm_idle_stats(vm_context_t *vm, microphp_idle_stats_t *stats) {
+    if (!vm || !stats) return;
+    if (vm->running) idle_stats_mark(vm);
+    *stats = vm->idle_stats;
+}
+
+// Buffered output
+void microphp_vm_set_output(vm_context_t *vm, microphp_output_fn sink, void *user) {
+    if (!vm) return;
+    vm->output->sink = sink ? sink : microphp_output_stdout;
+    vm->output->user = user;
+}
+
+void microphp_vm_set_output_policy(vm_context_t *vm, const microphp_output_policy_t *policy) {
+    if (vm && policy) vm->output->policy = *policy;
+}
+
+// Offers the buffered bytes to the sink, oldest first, until it takes
+// less than it was given
+static void output_drain(vm_context_t *vm) {
+    microphp_output_t *out = vm->output;
+    while (out->count > 0) {
+        size_t run = MICROPHP_OUTPUT_BUF - out->tail;
+        if (run > out->count) run = out->count;
+        size_t taken = out->sink(out->user, &out->data[out->tail], run);
+        if (taken > run) taken = run;
+        out->tail = (out->tail + taken) & (MICROPHP_OUTPUT_BUF - 1);
+        out->count -= taken;
+        if (taken < run) break;
+    }
+    if (out->count == 0) out->tail = 0;
+}
+
+// Time-based flush, checked whenever the scheduler runs
+static void output_poll(vm_context_t *vm, uint32_t now) {
+    microphp_output_t *out = vm->output;
+    if (out->count > 0 && out->policy.flush_ms && now - out->since_ms >= out->policy.flush_ms) output_drain(vm);
+}
+
+// Waits for the sink to take bytes from a full ring; false if the policy
+// drops instead or the sink is still refusing after wait_ms, so a stuck
+// sink cannot hang the VM
+static bool output_wait(vm_context_t *vm) {
+    microphp_output_t *out = vm->output;
+    if (out->policy.full != MICROPHP_OUTPUT_BLOCK) return false;
+    
+    uint32_t limit = out->policy.wait_ms ? out->policy.wait_ms : MICROPHP_OUTPUT_WAIT_MS;
+    uint32_t start = microphp_vm_millis(vm);
+    while (out->count == MICROPHP_OUTPUT_BUF) {
+        if (microphp_vm_millis(vm) - start >= limit) return false;
+        if (!vm->clock) {
+            vm->virtual_ms++;
+        } else if (vm->idle) {
+            vm->idle(vm->platform, 1);
+        }
+        output_drain(vm);
+    }
+    return true;
+}
+
+void microphp_output_write(vm_context_t *vm, const char *data, size_t len) {
+    microphp_output_t *out = vm->output;
+    bool line = false;
+    while (len > 0) {
+        if (out->count == MICROPHP_OUTPUT_BUF) {
+            output_drain(vm);
+            if (out->count == MICROPHP_OUTPUT_BUF && !output_wait(vm)) {
+                out->dropped += (uint32_t)len;
+                return;
+            }
+        }
+        
+        size_t head = (out->tail + out->count) & (MICROPHP_OUTPUT_BUF - 1);
+        size_t n = head < out->tail ? out->tail - head : MICROPHP_OUTPUT_BUF - head;
+        if (n > len) n = len;
+        if (out->count == 0 && out->policy.flush_ms) out->since_ms = microphp_vm_millis(vm);
+        memcpy(&out->data[head], data, n);
+        out->count += n;
+        data += n;
+        len -= n;
+        line = n > 0 && data[-1] == '\n';
+    }
+    
+    if (line && out->policy.flush_newline) {
+        output_drain(vm);
+    } else if (out->policy.flush_size && out->count >= out->policy.flush_size) {
+        output_drain(vm);
+    }
+}
+
+size_t microphp_output_flush(vm_context_t *vm) {
+    if (!vm) return 0;
+    output_drain(vm);
+    return vm->output->count;
+}
+
+uint32_t microphp_output_dropped(vm_context_t *vm) {
+    return vm ? vm->output->dropped : 0;
+}
+
+size_t microphp_output_stdout(void *user, const char *data, size_t len) {
+    (void)user;
+    return fwrite(data, 1, len, stdout);
+}
+
+size_t microphp_output_memory(void *user, const char *data, size_t len) {
+    microphp_output_memory_t *mem = user;
+    if (mem->len < mem->size) {
+        size_t n = mem->size - mem->len < len ? mem->size - mem->len : len;
+        memcpy(mem->data + mem->len, data, n);
+    }
+    mem->len += len;
+    return len;
+}
+
+// Wrap-safe ordering of millisecond timestamps
+static bool time_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static void ready_push(vm_context_t *vm, size_t id) {
+    vm->ready[(vm->ready_head + vm->ready_count++) % vm->task_capacity] = (uint8_t)id;
+}
+
+// Handlers jump the queue
+static void ready_push_front(vm_context_t *vm, size_t id) {
+    vm->ready_head = (vm->ready_head + vm->task_capacity - 1) % vm->task_capacity;
+    vm->ready[vm->ready_head] = (uint8_t)id;
+    vm->ready_count++;
+}
+
+static size_t ready_pop(vm_context_t *vm) {
+    size_t id = vm->ready[vm->ready_head];
+    vm->ready_head = (vm->ready_head + 1) % vm->task_capacity;
+    vm->ready_count--;
+    return id;
+}
+
+// Min-heaps of ids ordered by a time: sleeping tasks by wake_ms, script
+// timers by deadline
+typedef bool (*heap_less_fn)(vm_context_t *vm, uint8_t a, uint8_t b);
+
+static void heap_swap(uint8_t *heap, size_t a, size_t b) {
+    uint8_t id = heap[a];
+    heap[a] = heap[b];
+    heap[b] = id;
+}
+
+static void heap_sift_up(vm_context_t *vm, uint8_t *heap, size_t i, heap_less_fn less) {
+    while (i > 0 && less(vm, heap[i], heap[(i - 1) / 2])) {
+        heap_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_sift_down(vm_context_t *vm, uint8_t *heap, size_t count, size_t i, heap_less_fn less) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < count && less(vm, heap[left], heap[smallest])) smallest = left;
+        if (right < count && less(vm, heap[right], heap[smallest])) smallest = right;
+        if (smallest == i) break;
+        heap_swap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_push(vm_context_t *vm, uint8_t *heap, size_t *count, size_t id, heap_less_fn less) {
+    heap[*count] = (uint8_t)id;
+    heap_sift_up(vm, heap, (*count)++, less);
+}
+
+// Removes the entry at index i and returns its id
+static size_t heap_remove(vm_context_t *vm, uint8_t *heap, size_t *count, size_t i, heap_less_fn less) {
+    size_t id = heap[i];
+    heap[i] = heap[--*count];
+    if (i < *count) {
+        heap_sift_down(vm, heap, *count, i, less);
+        heap_sift_up(vm, heap, i, less);
+    }
+    return id;
+}
+
+static bool task_wakes_before(vm_context_t *vm, uint8_t a, uint8_t b) {
+    return time_before(vm->tasks[a].wake_ms, vm->tasks[b].wake_ms);
+}
+
+static void timer_push(vm_context_t *vm, size_t id) {
+    heap_push(vm, vm->timers, &vm->timer_count, id, task_wakes_before);
+}
+
+static size_t timer_pop(vm_context_t *vm) {
+    return heap_remove(vm, vm->timers, &vm->timer_count, 0, task_wakes_before);
+}
+
+static void task_save(vm_context_t *vm, microphp_task_t *task) {
+    task->stack = vm->stack;
+    task->stack_size = vm->stack_size;
+    task->stack_top = vm->stack_top;
+    task->locals = vm->locals;
+    task->local_count = vm->local_count;
+    task->locals_top = vm->locals_top;
+    task->frames = vm->frames;
+    task->frame_count = vm->frame_count;
+    task->frame_capacity = vm->frame_capacity;
+    task->pc = vm->pc;
+}
+
+static void task_load(vm_context_t *vm, microphp_task_t *task) {
+    vm->stack = task->stack;
+    vm->stack_size = task->stack_size;
+    vm->stack_top = task->stack_top;
+    vm->locals = task->locals;
+    vm->local_count = task->local_count;
+    vm->locals_top = task->locals_top;
+    vm->frames = task->frames;
+    vm->frame_count = task->frame_count;
+    vm->frame_capacity = task->frame_capacity;
+    vm->pc = task->pc;
+    
+    // The VM owns the arrays while the task runs
+    task->stack = NULL;
+    task->locals = NULL;
+    task->frames = NULL;
+    
+    if (task->entry) {
+        if (push_frame(vm, task->entry, NULL, task->entry_argc) != 0) vm_fail(vm, "Out of memory");
+        vm->pc = task->entry->code;
+        task->entry = NULL;
+    }
+}
+
+// Frees a task that is not running
+static void task_free(vm_context_t *vm, microphp_task_t *task) {
+    for (size_t i = 0; i < task->stack_top; i++) {
+        microphp_zval_destroy(&task->stack[i]);
+    }
+    for (size_t i = 0; i < task->locals_top; i++) {
+        microphp_zval_destroy(&task->locals[i]);
+    }
+    vm_free(vm, task->stack);
+    vm_free(vm, task->locals);
+    vm_free(vm, task->frames);
+    memset(task, 0, sizeof(*task));
+}
+
+static void tasks_clear(vm_context_t *vm) {
+    for (size_t i = 0; i < vm->task_capacity; i++) {
+        if (vm->tasks[i].state == MICROPHP_TASK_READY || vm->tasks[i].state == MICROPHP_TASK_SLEEPING) {
+            task_free(vm, &vm->tasks[i]);
+        }
+        vm->tasks[i].state = MICROPHP_TASK_FREE;
+    }
+    vm->ready_head = 0;
+    vm->ready_count = 0;
+    vm->timer_count = 0;
+    vm->yield = MICROPHP_YIELD_NONE;
+    vm->handler_task = -1;
+    for (size_t i = 0; i < MICROPHP_TIMERS_MAX; i++) {
+        vm->script_timers[i].task = -1;
+    }
+    for (size_t i = 0; i < MICROPHP_IO_MAX; i++) {
+        vm->io[i].waiter = -1;
+    }
+}
+
+// Takes the running task off the CPU, onto the ready ring or timer heap
+static void task_suspend(vm_context_t *vm, microphp_task_state_t state) {
+    microphp_task_t *task = &vm->tasks[vm->current_task];
+    task_save(vm, task);
+    task->state = state;
+    if (state == MICROPHP_TASK_READY) {
+        ready_push(vm, vm->current_task);
+    } else {
+        timer_push(vm, vm->current_task);
+    }
+}
+
+static bool timer_due(vm_context_t *vm, uint32_t now) {
+    return vm->timer_count > 0 && !time_before(now, vm->tasks[vm->timers[0]].wake_ms);
+}
+
+static int task_start(vm_context_t *vm, const function_t *fn, const zval_t *args, size_t argc);
+
+// An edge is queued and no handler is running
+static bool events_ready(vm_context_t *vm) {
+    return vm->handler_task < 0 &&
+           atomic_load_explicit(&vm->events->head, memory_order_acquire) !=
+           atomic_load_explicit(&vm->events->tail, memory_order_relaxed);
+}
+
+// Starts the handler for the oldest queued edge at the front of the ready
+// ring, skipping edges on pins nobody handles. Returns false if none
+// started; without a free task slot the edge stays queued.
+static bool events_start(vm_context_t *vm) {
+    microphp_events_t *ev = vm->events;
+    uint32_t tail = atomic_load_explicit(&ev->tail, memory_order_relaxed);
+    
+    while (tail != atomic_load_explicit(&ev->head, memory_order_acquire)) {
+        gpio_event_t event = ev->slots[tail & (MICROPHP_EVENTS_MAX - 1)];
+        const function_t *fn = event.pin < MICROPHP_GPIO_PINS ? vm->gpio_handlers[event.pin] : NULL;
+        if (fn) {
+            zval_t args[3] = {
+                microphp_zval_int(event.pin),
+                microphp_zval_bool(event.level),
+                microphp_zval_int(event.time_us),
+            };
+            int id = task_start(vm, fn, args, 3);
+            if (id < 0) break;
+            vm->handler_task = id;
+            ready_push_front(vm, (size_t)id);
+        }
+        atomic_store_explicit(&ev->tail, ++tail, memory_order_release);
+        if (fn) return true;
+    }
+    return false;
+}
+
+static bool deadline_before(vm_context_t *vm, uint8_t a, uint8_t b) {
+    return time_before(vm->script_timers[a].deadline_ms, vm->script_timers[b].deadline_ms);
+}
+
+static bool deadline_due(vm_context_t *vm, uint32_t now) {
+    return vm->deadline_count > 0 && !time_before(now, vm->script_timers[vm->deadlines[0]].deadline_ms);
+}
+
+// Programs the port's hardware timer for the earliest deadline
+static void timers_rearm(vm_context_t *vm) {
+    if (!vm->timer_arm) return;
+    if (vm->deadline_count == 0) {
+        vm->timer_arm(vm->platform, false, 0);
+    } else {
+        vm->timer_arm(vm->platform, true, vm->script_timers[vm->deadlines[0]].deadline_ms);
+    }
+}
+
+// Starts the handlers of timers due by now at the front of the ready
+// ring. Returns true if any started.
+static bool timers_fire(vm_context_t *vm, uint32_t now) {
+    bool started = false;
+    bool changed = false;
+    
+    while (deadline_due(vm, now)) {
+        size_t id = heap_remove(vm, vm->deadlines, &vm->deadline_count, 0, deadline_before);
+        microphp_timer_t *timer = &vm->script_timers[id];
+        changed = true;
+        
+        // Skip this firing if the last one is still running
+        if (timer->task < 0) {
+            zval_t arg = microphp_zval_int((int64_t)id);
+            int task = task_start(vm, timer->handler, &arg, 1);
+            if (task >= 0) {
+                timer->task = task;
+                ready_push_front(vm, (size_t)task);
+                started = true;
+            }
+        }
+        
+        if (timer->period_ms == 0) {
+            timer->handler = NULL;
+            continue;
+        }
+        
+        // Stay on the original grid: periods already missed are skipped,
+        // not replayed
+        uint32_t late = now - timer->deadline_ms;
+        timer->deadline_ms += (late / timer->period_ms + 1) * timer->period_ms;
+        heap_push(vm, vm->deadlines, &vm->deadline_count, id, deadline_before);
+    }
+    
+    if (changed) timers_rearm(vm);
+    return started;
+}
+
+// Wakes the tasks awaiting transfers the port has completed
+static void io_wake(vm_context_t *vm) {
+    for (size_t i = 0; i < MICROPHP_IO_MAX; i++) {
+        microphp_io_t *io = &vm->io[i];
+        if (io->waiter < 0 || atomic_load_explicit(&io->state, memory_order_acquire) != IO_DONE) continue;
+        
+        for (size_t j = 0; j < vm->timer_count; j++) {
+            if (vm->timers[j] == io->waiter) {
+                heap_remove(vm, vm->timers, &vm->timer_count, j, task_wakes_before);
+                vm->tasks[io->waiter].state = MICROPHP_TASK_READY;
+                ready_push(vm, (size_t)io->waiter);
+                break;
+            }
+        }
+        io->waiter = -1;
+    }
+}
+
+// Time until the next wakeup, stretched to the latest one within the
+// idle slack so they are all served by one idle period
+static uint32_t idle_wait(vm_context_t *vm, uint32_t now) {
+    uint32_t wait = UINT32_MAX;
+    if (vm->timer_count > 0) wait = vm->tasks[vm->timers[0]].wake_ms - now;
+    if (vm->deadline_count > 0 && vm->script_timers[vm->deadlines[0]].deadline_ms - now < wait) {
+        wait = vm->script_timers[vm->deadlines[0]].deadline_ms - now;
+    }
+    if (vm->idle_slack_ms == 0) return wait;
+    
+    uint32_t limit = wait + vm->idle_slack_ms < wait ? UINT32_MAX : wait + vm->idle_slack_ms;
+    for (size_t i = 1; i < vm->timer_count; i++) {
+        uint32_t d = vm->tasks[vm->timers[i]].wake_ms - now;
+        if (d > wait && d <= limit) wait = d;
+    }
+    for (size_t i = 1; i < vm->deadline_count; i++) {
+        uint32_t d = vm->script_timers[vm->deadlines[i]].deadline_ms - now;
+        if (d > wait && d <= limit) wait = d;
+    }
+    return wait;
+}
+
+// Runs the next ready task, waiting for the earliest timer if none is.
+// Returns false when no task or script timer is left.
+static bool schedule(vm_context_t *vm) {
+    for (;;) {
+        if (events_ready(vm)) events_start(vm);
+        if (atomic_exchange_explicit(&vm->events->io_fired, false, memory_order_acquire)) io_wake(vm);
+        
+        uint32_t now = microphp_vm_millis(vm);
+        atomic_store_explicit(&vm->events->timer_fired, false, memory_order_relaxed);
+        timers_fire(vm, now);
+        while (timer_due(vm, now)) {
+            size_t id = timer_pop(vm);
+            vm->tasks[id].state = MICROPHP_TASK_READY;
+            ready_push(vm, id);
+        }
+        
+        if (vm->ready_count > 0) {
+            vm->current_task = ready_pop(vm);
+            vm->tasks[vm->current_task].state = MICROPHP_TASK_RUNNING;
+            task_load(vm, &vm->tasks[vm->current_task]);
+            vm->slice_left = MICROPHP_TASK_SLICE;
+            return true;
+        }
+        if (vm->timer_count == 0 && vm->deadline_count == 0) return false;
+        
+        // Everything sleeps; without an idle hook, poll the clock. Output
+        // goes out first rather than wait out the sleep.
+        output_drain(vm);
+        if (!vm->clock || vm->idle) {
+            uint32_t wait = idle_wait(vm, now);
+            vm->idle_stats.running_ms += now - vm->idle_mark_ms;
+            vm->idle_stats.wakeups++;
+            if (!vm->clock) {
+                vm->virtual_ms += wait;
+            } else {
+                vm->idle(vm->platform, wait);
+            }
+            vm->idle_mark_ms = microphp_vm_millis(vm);
+            vm->idle_stats.asleep_ms += vm->idle_mark_ms - now;
+        }
+    }
+}
+
+// A GPIO edge nobody handles yet, the hardware timer went off, or a
+// transfer finished
+static bool interrupt_pending(vm_context_t *vm) {
+    return atomic_load_explicit(&vm->events->timer_fired, memory_order_relaxed) ||
+           atomic_load_explicit(&vm->events->io_fired, memory_order_relaxed) || events_ready(vm);
+}
+
+// Runs the handlers interrupts asked for before the current task goes on
+static void interrupt_dispatch(vm_context_t *vm) {
+    bool started = false;
+    if (atomic_exchange_explicit(&vm->events->io_fired, false, memory_order_acquire)) io_wake(vm);
+    if (atomic_exchange_explicit(&vm->events->timer_fired, false, memory_order_acquire)) {
+        started = timers_fire(vm, microphp_vm_millis(vm));
+        timers_rearm(vm);
+    }
+    if (events_ready(vm) && events_start(vm)) started = true;
+    if (!started) return;
+    
+    task_suspend(vm, MICROPHP_TASK_READY);
+    schedule(vm);
+}
+
+// The running task's slice ran out
+static void task_preempt(vm_context_t *vm) {
+    vm->slice_left = MICROPHP_TASK_SLICE;
+    if (!vm->clock) vm->virtual_ms++;
+    
+    uint32_t now = microphp_vm_millis(vm);
+    output_poll(vm, now);
+    if (vm->ready_count == 0 && !timer_due(vm, now) && !deadline_due(vm, now)) return;
+    
+    task_suspend(vm, MICROPHP_TASK_READY);
+    schedule(vm);
+}
+
+// The running task returned from its entry function. Returns false when
+// it was the last one; its (empty) arrays then stay with the VM.
+static bool task_exit(vm_context_t *vm) {
+    vm->tasks[vm->current_task].state = MICROPHP_TASK_FREE;
+    if (vm->handler_task == (int)vm->current_task) vm->handler_task = -1;
+    for (size_t i = 0; i < MICROPHP_TIMERS_MAX; i++) {
+        if (vm->script_timers[i].task == (int)vm->current_task) vm->script_timers[i].task = -1;
+    }
+    if (vm->ready_count == 0 && vm->timer_count == 0 && vm->deadline_count == 0) return false;
+    
+    for (size_t i = 0; i < vm->stack_top; i++) {
+        microphp_zval_destroy(&vm->stack[i]);
+    }
+    vm_free(vm, vm->stack);
+    vm_free(vm, vm->locals);
+    vm_free(vm, vm->frames);
+    return schedule(vm);
+}
+
+// A function tasks and handlers can start with (not main)
+static const function_t* function_named(vm_context_t *vm, const char *function) {
+    for (uint32_t i = 0; i < vm->bytecode->function_count; i++) {
+        const char *name = vm->bytecode->functions[i].name;
+        if (name && i != vm->bytecode->main_offset && strcmp(name, function) == 0) {
+            return &vm->bytecode->functions[i];
+        }
+    }
+    return NULL;
+}
+
+// Host or built-in: queue fn(args...) to run as a new task
+int microphp_task_spawn(vm_context_t *vm, const char *function, const zval_t *args, size_t argc) {
+    if (!vm || !vm->bytecode || !function) return -1;
+    
+    const function_t *fn = function_named(vm, function);
+    if (!fn) return -1;
+    
+    int id = task_start(vm, fn, args, argc);
+    if (id >= 0) ready_push(vm, (size_t)id);
+    return id;
+}
+
+// Sets up fn(args...) as a new task; the caller queues it. -1 when every
+// slot is taken, or when memory runs out, which also fails the VM.
+static int task_start(vm_context_t *vm, const function_t *fn, const zval_t *args, size_t argc) {
+    size_t id = 0;
+    while (id < vm->task_capacity && vm->tasks[id].state != MICROPHP_TASK_FREE) id++;
+    if (id == vm->task_capacity) return -1;
+    
+    microphp_task_t *task = &vm->tasks[id];
+    memset(task, 0, sizeof(*task));
+    task->stack_size = argc > TASK_STACK_INITIAL ? argc : TASK_STACK_INITIAL;
+    task->stack = vm_alloc(vm, task->stack_size * sizeof(zval_t));
+    task->frame_capacity = TASK_FRAMES_INITIAL;
+    task->frames = vm_alloc(vm, task->frame_capacity * sizeof(call_frame_t));
+    if (!task->stack || !task->frames) {
+        vm_free(vm, task->stack);
+        vm_free(vm, task->frames);
+        memset(task, 0, sizeof(*task));
+        vm_fail(vm, "Out of memory");
+        return -1;
+    }
+    for (size_t i = 0; i < argc; i++) {
+        task->stack[i] = microphp_zval_null();
+        microphp_zval_copy(&task->stack[i], &args[i]);
+    }
+    task->stack_top = argc;
+    task->entry = fn;
+    task->entry_argc = argc;
+    task->io_handle = -1;
+    task->state = MICROPHP_TASK_READY;
+    return (int)id;
+}
+
+void microphp_task_sleep(vm_context_t *vm, uint32_t ms) {
+    if (!vm || !vm->running) return;
+    vm->tasks[vm->current_task].wake_ms = microphp_vm_millis(vm) + ms;
+    vm->yield = MICROPHP_YIELD_SLEEP;
+}
+
+void microphp_task_wait(vm_context_t *vm, uint32_t ms) {
+    if (!vm || !vm->running) return;
+    vm->tasks[vm->current_task].wake_ms = microphp_vm_millis(vm) + ms;
+    vm->yield = MICROPHP_YIELD_RETRY;
+}
+
+void microphp_vm_exit(vm_context_t *vm) {
+    if (vm && vm->running) vm->yield = MICROPHP_YIELD_EXIT;
+}
+
+// Pins and peripherals
+#define SIM_LEVEL  0x1
+#define SIM_OUTPUT 0x2
+#define SIM_PULLUP 0x4
+
+void microphp_vm_set_hal(vm_context_t *vm, microphp_hal_fn hal) {
+    if (vm) vm->hal = hal;
+}
+
+int32_t microphp_hal_call(vm_context_t *vm, const microphp_hal_request_t *request) {
+    if (!vm || !request) return -1;
+    if (vm->hal) return vm->hal(vm->platform, request);
+    
+    // Simulated board
+    int32_t pin = request->args[0];
+    bool pin_valid = pin >= 0 && pin < MICROPHP_GPIO_PINS;
+    switch (request->op) {
+        case MICROPHP_HAL_GPIO_MODE:
+            if (!pin_valid || request->args[1] < 0 || request->args[1] > 3) return -1;
+            vm->gpio_levels[pin] = (uint8_t)(request->args[1] == 1 ? SIM_OUTPUT | (vm->gpio_levels[pin] & SIM_LEVEL)
+                                             : request->args[1] == 2 ? SIM_PULLUP : 0);
+            return 0;
+        case MICROPHP_HAL_GPIO_WRITE:
+            if (!pin_valid) return -1;
+            vm->gpio_levels[pin] = (uint8_t)((vm->gpio_levels[pin] & ~SIM_LEVEL) | (request->args[1] ? SIM_LEVEL : 0));
+            return 0;
+        case MICROPHP_HAL_GPIO_READ:
+            if (!pin_valid) return -1;
+            if (vm->gpio_levels[pin] & SIM_OUTPUT) return vm->gpio_levels[pin] & SIM_LEVEL;
+            return (vm->gpio_levels[pin] & SIM_PULLUP) ? 1 : 0;
+        case MICROPHP_HAL_PWM_OPEN:
+        case MICROPHP_HAL_PWM_SET:
+            return request->duty >= 0.0f && request->duty <= 1.0f ? 0 : -1;
+        case MICROPHP_HAL_PWM_CLOSE:
+        case MICROPHP_HAL_I2C_OPEN:
+        case MICROPHP_HAL_UART_OPEN:
+        case MICROPHP_HAL_ADC_READ:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// GPIO interrupts
+void microphp_vm_set_gpio_irq(vm_context_t *vm, microphp_gpio_irq_fn arm) {
+    if (vm) vm->gpio_irq = arm;
+}
+
+int microphp_gpio_attach(vm_context_t *vm, int pin, int edges, const char *handler) {
+    if (!vm || !vm->bytecode || !handler || pin < 0 || pin >= MICROPHP_GPIO_PINS ||
+        edges < MICROPHP_GPIO_RISING || edges > MICROPHP_GPIO_BOTH) {
+        return -1;
+    }
+    
+    const function_t *fn = function_named(vm, handler);
+    if (!fn) return -1;
+    
+    if (vm->gpio_irq && vm->gpio_irq(vm->platform, pin, edges) != 0) return -1;
+    vm->gpio_handlers[pin] = fn;
+    return 0;
+}
+
+int microphp_gpio_detach(vm_context_t *vm, int pin) {
+    if (!vm || pin < 0 || pin >= MICROPHP_GPIO_PINS) return -1;
+    
+    if (vm->gpio_handlers[pin] && vm->gpio_irq) vm->gpio_irq(vm->platform, pin, 0);
+    vm->gpio_handlers[pin] = NULL;
+    return 0;
+}
+
+// Interrupt context: no allocation, no locks, no VM state but the ring
+bool microphp_gpio_post(vm_context_t *vm, int pin, bool level, uint32_t time_us) {
+    // A pin the VM has no handler slot for would alias another in the
+    // uint8_t field; it is refused, not counted as a drop
+    if (pin < 0 || pin >= MICROPHP_GPIO_PINS) return false;
+    
+    microphp_events_t *ev = vm->events;
+    uint32_t head = atomic_load_explicit(&ev->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ev->tail, memory_order_acquire);
+    if (head - tail == MICROPHP_EVENTS_MAX) {
+        atomic_fetch_add_explicit(&ev->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    
+    gpio_event_t *event = &ev->slots[head & (MICROPHP_EVENTS_MAX - 1)];
+    event->time_us = time_us;
+    event->pin = (uint8_t)pin;
+    event->level = level;
+    atomic_store_explicit(&ev->head, head + 1, memory_order_release);
+    return true;
+}
+
+// Handlers belong to the program: disarm them and drop queued edges
+static void gpio_clear(vm_context_t *vm) {
+    for (int pin = 0; pin < MICROPHP_GPIO_PINS; pin++) {
+        microphp_gpio_detach(vm, pin);
+    }
+    atomic_store_explicit(&vm->events->tail, atomic_load_explicit(&vm->events->head, memory_order_acquire),
+                          memory_order_release);
+}
+
+uint32_t microphp_gpio_dropped(vm_context_t *vm) {
+    return vm ? atomic_load_explicit(&vm->events->dropped, memory_order_relaxed) : 0;
+}
+
+// Script timers
+void microphp_vm_set_timer(vm_context_t *vm, microphp_timer_arm_fn arm) {
+    if (!vm) return;
+    vm->timer_arm = arm;
+    timers_rearm(vm);
+}
+
+int microphp_timer_start(vm_context_t *vm, uint32_t ms, uint32_t period_ms, const char *handler) {
+    if (!vm || !vm->bytecode || !handler) return -1;
+    
+    const function_t *fn = function_named(vm, handler);
+    if (!fn) return -1;
+    
+    size_t id = 0;
+    while (id < MICROPHP_TIMERS_MAX && vm->script_timers[id].handler) id++;
+    if (id == MICROPHP_TIMERS_MAX) return -1;
+    
+    microphp_timer_t *timer = &vm->script_timers[id];
+    timer->handler = fn;
+    timer->deadline_ms = microphp_vm_millis(vm) + ms;
+    timer->period_ms = period_ms;
+    timer->task = -1;
+    heap_push(vm, vm->deadlines, &vm->deadline_count, id, deadline_before);
+    timers_rearm(vm);
+    return (int)id;
+}
+
+// A handler already running finishes; the timer just never fires again
+int microphp_timer_cancel(vm_context_t *vm, int id) {
+    if (!vm || id < 0 || id >= MICROPHP_TIMERS_MAX || !vm->script_timers[id].handler) return -1;
+    
+    for (size_t i = 0; i < vm->deadline_count; i++) {
+        if (vm->deadlines[i] == id) {
+            heap_remove(vm, vm->deadlines, &vm->deadline_count, i, deadline_before);
+            break;
+        }
+    }
+    vm->script_timers[id].handler = NULL;
+    timers_rearm(vm);
+    return 0;
+}
+
+// Interrupt context
+void microphp_timer_expired(vm_context_t *vm) {
+    atomic_store_explicit(&vm->events->timer_fired, true, memory_order_release);
+}
+
+static void timers_clear(vm_context_t *vm) {
+    for (size_t i = 0; i < MICROPHP_TIMERS_MAX; i++) {
+        vm->script_timers[i].handler = NULL;
+        vm->script_timers[i].task = -1;
+    }
+    vm->deadline_count = 0;
+    timers_rearm(vm);
+}
+
+// Asynchronous transfers
+void microphp_vm_set_io(vm_context_t *vm, microphp_io_fn start) {
+    if (vm) vm->io_start = start;
+}
+
+// How long a transfer takes on the wire, for the simulation
+static uint32_t io_wire_ms(const microphp_io_request_t *request) {
+    uint64_t bits;
+    uint64_t hz;
+    switch (request->kind) {
+        case MICROPHP_IO_UART_WRITE:
+        case MICROPHP_IO_UART_READ:
+            bits = 10 * (uint64_t)(request->tx_len + request->rx_len);  // Start and stop bits
+            hz = MICROPHP_SIM_UART_BAUD;
+            break;
+        case MICROPHP_IO_I2C_WRITE:
+        case MICROPHP_IO_I2C_READ:
+            bits = 9 * (uint64_t)(request->tx_len + request->rx_len + 1);  // Address byte, ACK bits
+            hz = MICROPHP_SIM_I2C_HZ;
+            break;
+        case MICROPHP_IO_I2C_LIST:
+            bits = 0;
+            for (size_t i = 0; i < request->op_count; i++) {
+                bits += 9 * ((uint64_t)request->ops[i].len + 1);
+            }
+            hz = MICROPHP_SIM_I2C_HZ;
+            break;
+        case MICROPHP_IO_SPI_LIST:
+            bits = 0;
+            for (size_t i = 0; i < request->op_count; i++) {
+                bits += 8 * (uint64_t)request->ops[i].len;
+            }
+            hz = MICROPHP_SIM_SPI_HZ;
+            break;
+        default:
+            bits = 8 * (uint64_t)request->tx_len;
+            hz = MICROPHP_SIM_SPI_HZ;
+            break;
+    }
+    uint64_t ms = (bits * 1000 + hz - 1) / hz;
+    return ms > UINT32_MAX / 2 ? UINT32_MAX / 2 : (uint32_t)ms;
+}
+
+// Simulated wire: full-duplex SPI reads back what it sent, other reads
+// see zeros. Returns the bytes received (sent, for writes).
+static size_t io_simulate(microphp_io_request_t *request) {
+    if (request->rx_len > 0) memset(request->rx, 0, request->rx_len);
+    
+    if (request->kind == MICROPHP_IO_SPI && request->tx_len > 0) {
+        memcpy(request->rx, request->tx, request->tx_len);
+    } else if (request->kind == MICROPHP_IO_SPI_LIST) {
+        for (size_t i = 0; i < request->op_count; i++) {
+            const microphp_io_op_t *op = &request->ops[i];
+            if (op->type == MICROPHP_IO_OP_XFER) memcpy(request->rx + op->rx_offset, request->tx + op->tx_offset, op->len);
+        }
+    }
+    return request->rx ? request->rx_len : request->tx_len;
+}
+
+// Each step must stay inside the request's buffers
+static bool io_ops_valid(const microphp_io_request_t *request) {
+    if (request->op_count == 0 || !request->ops || request->op_count > UINT32_MAX / sizeof(microphp_io_op_t)) return false;
+    
+    for (size_t i = 0; i < request->op_count; i++) {
+        const microphp_io_op_t *op = &request->ops[i];
+        bool sends = op->type == MICROPHP_IO_OP_WRITE || op->type == MICROPHP_IO_OP_XFER;
+        bool receives = op->type == MICROPHP_IO_OP_READ || op->type == MICROPHP_IO_OP_XFER;
+        if (op->type > MICROPHP_IO_OP_XFER) return false;
+        if (op->type == MICROPHP_IO_OP_XFER && request->kind != MICROPHP_IO_SPI_LIST) return false;
+        if (sends && (uint64_t)op->tx_offset + op->len > request->tx_len) return false;
+        if (receives && (uint64_t)op->rx_offset + op->len > request->rx_len) return false;
+    }
+    return true;
+}
+
+static void io_release(vm_context_t *vm, microphp_io_t *io) {
+    vm_free(vm, io->buffer);
+    io->buffer = NULL;
+    io->waiter = -1;
+    atomic_store_explicit(&io->state, IO_FREE, memory_order_relaxed);
+}
+
+int microphp_io_start(vm_context_t *vm, const microphp_io_request_t *request) {
+    if (!vm || !request || request->kind < MICROPHP_IO_SPI || request->kind > MICROPHP_IO_SPI_LIST) return -1;
+    
+    // Simple transfers move bytes one way, except full-duplex SPI
+    microphp_io_request_t copy = *request;
+    bool list = copy.kind == MICROPHP_IO_I2C_LIST || copy.kind == MICROPHP_IO_SPI_LIST;
+    if (list) {
+        if (!io_ops_valid(&copy)) return -1;
+    } else {
+        copy.ops = NULL;
+        copy.op_count = 0;
+        if (copy.kind == MICROPHP_IO_SPI) copy.rx_len = copy.tx_len;
+        if (copy.kind == MICROPHP_IO_UART_READ || copy.kind == MICROPHP_IO_I2C_READ) copy.tx_len = 0;
+        if (copy.kind == MICROPHP_IO_UART_WRITE || copy.kind == MICROPHP_IO_I2C_WRITE) copy.rx_len = 0;
+    }
+    if (copy.tx_len > 0 && !copy.tx) return -1;
+    if (copy.tx_len > INT32_MAX || copy.rx_len > INT32_MAX) return -1;
+    bool receives = list || copy.kind == MICROPHP_IO_SPI || copy.kind == MICROPHP_IO_UART_READ ||
+                    copy.kind == MICROPHP_IO_I2C_READ;
+    
+    size_t id = 0;
+    while (id < MICROPHP_IO_MAX && atomic_load_explicit(&vm->io[id].state, memory_order_relaxed) != IO_FREE) id++;
+    if (id == MICROPHP_IO_MAX) return -1;
+    
+    // The slot owns the steps and both buffers, so the script's values
+    // may go away: [ops][tx][rx]
+    microphp_io_t *io = &vm->io[id];
+    size_t ops_size = copy.op_count * sizeof(microphp_io_op_t);
+    io->buffer = vm_alloc(vm, ops_size + copy.tx_len + copy.rx_len);
+    if (!io->buffer) return -1;
+    if (ops_size > 0) {
+        memcpy(io->buffer, copy.ops, ops_size);
+        copy.ops = (const microphp_io_op_t*)io->buffer;
+    }
+    if (copy.tx_len > 0) memcpy(io->buffer + ops_size, copy.tx, copy.tx_len);
+    copy.tx = copy.tx_len > 0 ? io->buffer + ops_size : NULL;
+    copy.rx = receives ? io->buffer + ops_size + copy.tx_len : NULL;
+    io->request = copy;
+    io->waiter = -1;
+    io->simulated = vm->io_start == NULL;
+    io->done_ms = microphp_vm_millis(vm) + io_wire_ms(&copy);
+    atomic_store_explicit(&io->result, 0, memory_order_relaxed);
+    atomic_store_explicit(&io->state, IO_PENDING, memory_order_release);
+    
+    if (!io->simulated && vm->io_start(vm->platform, (int)id, &io->request) != 0) {
+        io_release(vm, io);
+        return -1;
+    }
+    return (int)id;
+}
+
+// Interrupt context
+void microphp_io_complete(vm_context_t *vm, int handle, int result) {
+    if (!vm || handle < 0 || handle >= MICROPHP_IO_MAX) return;
+    
+    microphp_io_t *io = &vm->io[handle];
+    int pending = IO_PENDING;
+    atomic_store_explicit(&io->result, result, memory_order_relaxed);
+    if (atomic_compare_exchange_strong_explicit(&io->state, &pending, IO_DONE,
+                                                memory_order_release, memory_order_relaxed)) {
+        atomic_store_explicit(&vm->events->io_fired, true, memory_order_release);
+    }
+}
+
+bool microphp_io_done(vm_context_t *vm, int handle) {
+    if (!vm || handle < 0 || handle >= MICROPHP_IO_MAX) return false;
+    
+    microphp_io_t *io = &vm->io[handle];
+    int state = atomic_load_explicit(&io->state, memory_order_acquire);
+    if (state != IO_PENDING || !io->simulated) return state == IO_DONE;
+    if (time_before(microphp_vm_millis(vm), io->done_ms)) return false;
+    
+    atomic_store_explicit(&io->result, (int)io_simulate(&io->request), memory_order_relaxed);
+    atomic_store_explicit(&io->state, IO_DONE, memory_order_relaxed);
+    return true;
+}
+
+zval_t microphp_io_await(vm_context_t *vm, int handle) {
+    if (!vm || handle < 0 || handle >= MICROPHP_IO_MAX ||
+        atomic_load_explicit(&vm->io[handle].state, memory_order_relaxed) == IO_FREE) {
+        return microphp_zval_bool(false);
+    }
+    
+    microphp_io_t *io = &vm->io[handle];
+    if (!microphp_io_done(vm, handle)) {
+        // Runs again once done; the port's completion wakes the task early
+        if (vm->running) {
+            io->waiter = (int)vm->current_task;
+            microphp_task_wait(vm, io->simulated ? io->done_ms - microphp_vm_millis(vm) : IO_WAIT_MS);
+        }
+        return microphp_zval_null();
+    }
+    
+    int result = atomic_load_explicit(&io->result, memory_order_relaxed);
+    zval_t value;
+    if (result < 0) {
+        value = microphp_zval_bool(false);
+    } else if (io->request.rx) {
+        size_t len = (size_t)result < io->request.rx_len ? (size_t)result : io->request.rx_len;
+        value = microphp_zval_bytes(io->request.rx, len);
+    } else {
+        value = microphp_zval_int(result);
+    }
+    io_release(vm, io);
+    return value;
+}
+
+zval_t microphp_io_run(vm_context_t *vm, const microphp_io_request_t *request) {
+    if (!vm || !vm->running) return microphp_zval_bool(false);
+    
+    microphp_task_t *task = &vm->tasks[vm->current_task];
+    int handle = task->io_handle;
+    if (handle < 0) {
+        handle = microphp_io_start(vm, request);
+        if (handle < 0) return microphp_zval_bool(false);
+    }
+    
+    zval_t value = microphp_io_await(vm, handle);
+    task->io_handle = vm->yield == MICROPHP_YIELD_RETRY ? handle : -1;
+    return value;
+}
+
+// Aborts transfers still in flight before their buffers go
+static void io_clear(vm_context_t *vm) {
+    for (size_t i = 0; i < MICROPHP_IO_MAX; i++) {
+        microphp_io_t *io = &vm->io[i];
+        int state = atomic_load_explicit(&io->state, memory_order_acquire);
+        if (state == IO_FREE) continue;
+        if (state == IO_PENDING && !io->simulated && vm->io_start) vm->io_start(vm->platform, (int)i, NULL);
+        io_release(vm, io);
+    }
+    atomic_store_explicit(&vm->events->io_fired, false, memory_order_relaxed);
+}
+
+static bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Length of the number at the start of s as PHP reads it, leading
+// whitespace included ("  -1.5e3abc" gives 9), or 0 if there is none.
+// Hex, "inf" and "nan" are not numbers here though strtod takes them.
+static size_t numeric_prefix(const char *s, bool *is_float) {
+    const char *p = s;
+    while (is_space(*p)) p++;
+    if (*p == '+' || *p == '-') p++;
+    
+    const char *digits = p;
+    while (*p >= '0' && *p <= '9') p++;
+    bool mantissa = p > digits;
+    *is_float = false;
+    if (*p == '.') {
+        const char *fraction = ++p;
+        while (*p >= '0' && *p <= '9') p++;
+        if (p > fraction) mantissa = true;
+        *is_float = true;
+    }
+    if (!mantissa) return 0;
+    
+    if (*p == 'e' || *p == 'E') {
+        const char *q = p + 1;
+        if (*q == '+' || *q == '-') q++;
+        if (*q >= '0' && *q <= '9') {
+            while (*q >= '0' && *q <= '9') q++;
+            p = q;
+            *is_float = true;
+        }
+    }
+    return (size_t)(p - s);
+}
+
+// A string that is a number as a whole, give or take surrounding
+// whitespace: "10", " 1e1 ", but not "10 apples"
+bool microphp_numeric_string(const char *s, size_t len) {
+    bool is_float;
+    size_t n = s ? numeric_prefix(s, &is_float) : 0;
+    if (n == 0) return false;
+    
+    while (n < len && is_space(s[n])) n++;
+    return n == len;
+}
+
+static bool numeric_string(const zval_t *v) {
+    return microphp_numeric_string(microphp_string_data(v), microphp_string_len(v));
+}
+
+// Numeric coercion: returns ZVAL_INT or ZVAL_FLOAT, or -1 for non-numeric
+// types. Fixed point comes back as a float; the arithmetic and comparison
+// paths that keep it fixed check for it first. Strings read their leading
+// number, and an integer too big for int_val reads as a float.
+static int to_number(const zval_t *v, microphp_int_t *i, double *f) {
+    switch (v->type) {
+        case ZVAL_NULL:
+            *i = 0;
+            return ZVAL_INT;
+        case ZVAL_BOOL:
+            *i = v->value.bool_val ? 1 : 0;
+            return ZVAL_INT;
+        case ZVAL_INT:
+            *i = v->value.int_val;
+            return ZVAL_INT;
+        case ZVAL_FLOAT:
+            *f = v->value.float_val;
+            return ZVAL_FLOAT;
+        case ZVAL_FIXED:
+            *f = microphp_fixed_to_double((int32_t)v->value.int_val);
+            return ZVAL_FLOAT;
+        case ZVAL_STRING: {
+            const char *s = microphp_string_data(v);
+            bool is_float;
+            if (!s || numeric_prefix(s, &is_float) == 0) {
+                *i = 0;
+                return ZVAL_INT;
+            }
+            if (!is_float) {
+                errno = 0;
+                long long iv = strtoll(s, NULL, 10);
+                if (errno != ERANGE && iv >= MICROPHP_INT_MIN && iv <= MICROPHP_INT_MAX) {
+                    *i = iv;
+                    return ZVAL_INT;
+                }
+            }
+            *f = strtod(s, NULL);
+            return ZVAL_FLOAT;
+        }
+        default:
+            return -1;
+    }
+}
+
+// (int) of a float: truncated, NaN and infinities give 0 and values out
+// of range wrap modulo 2^64 (then to int width), as PHP does
+static microphp_int_t float_to_int(double f) {
+    if (f >= (double)MICROPHP_INT_MIN && f < -(double)MICROPHP_INT_MIN) return (microphp_int_t)f;
+    if (!isfinite(f)) return 0;
+    double m = fmod(trunc(f), 18446744073709551616.0);
+    uint64_t u = m < 0 ? 0 - (uint64_t)-m : (uint64_t)m;
+    return (microphp_int_t)u;
+}
+
+// Numeric strings past the int range saturate instead
+static microphp_int_t to_int(const zval_t *v) {
+    if (v->type == ZVAL_FIXED) return v->value.int_val / MICROPHP_FIXED_ONE;
+    
+    microphp_int_t i = 0;
+    double f = 0.0;
+    int kind = to_number(v, &i, &f);
+    if (kind != ZVAL_FLOAT) return i;
+    if (v->type == ZVAL_STRING) {
+        if (f >= -(double)MICROPHP_INT_MIN) return MICROPHP_INT_MAX;
+        if (f < (double)MICROPHP_INT_MIN) return MICROPHP_INT_MIN;
+    }
+    return float_to_int(f);
+}
+
+static double to_float(const zval_t *v) {
+    microphp_int_t i = 0;
+    double f = 0.0;
+    int kind = to_number(v, &i, &f);
+    return kind == ZVAL_FLOAT ? f : (double)i;
+}
+
+int64_t microphp_zval_to_int(const zval_t *zval) {
+    return to_int(zval);
+}
+
+double microphp_zval_to_float(const zval_t *zval) {
+    return to_float(zval);
+}
+
+// Int add/sub/mul at int_val width (one instruction plus an overflow
+// check on 32-bit cores with MICROPHP_INT32_FAST). False on overflow,
+// where the caller redoes the operation in floats as PHP does.
+static inline bool int_add(microphp_int_t x, microphp_int_t y, microphp_int_t *r) {
+#ifdef __GNUC__
+    return !__builtin_add_overflow(x, y, r);
+#else
+    if ((y > 0 && x > MICROPHP_INT_MAX - y) || (y < 0 && x < MICROPHP_INT_MIN - y)) return false;
+    *r = x + y;
+    return true;
+#endif
+}
+
+static inline bool int_sub(microphp_int_t x, microphp_int_t y, microphp_int_t *r) {
+#ifdef __GNUC__
+    return !__builtin_sub_overflow(x, y, r);
+#else
+    if ((y < 0 && x > MICROPHP_INT_MAX + y) || (y > 0 && x < MICROPHP_INT_MIN + y)) return false;
+    *r = x - y;
+    return true;
+#endif
+}
+
+static inline bool int_mul(microphp_int_t x, microphp_int_t y, microphp_int_t *r) {
+#ifdef __GNUC__
+    return !__builtin_mul_overflow(x, y, r);
+#else
+    if (x != 0 && y != 0 &&
+        (x > 0 ? (y > 0 ? x > MICROPHP_INT_MAX / y : y < MICROPHP_INT_MIN / x)
+               : (y > 0 ? x < MICROPHP_INT_MIN / y : x < MICROPHP_INT_MAX / y))) {
+        return false;
+    }
+    *r = x * y;
+    return true;
+#endif
+}
+
+// Fixed point mixes with ints (and null/bool) without leaving integer math
+static bool fixed_operand(const zval_t *v) {
+    return v->type == ZVAL_FIXED || v->type == ZVAL_INT || v->type == ZVAL_BOOL || v->type == ZVAL_NULL;
+}
+
+static bool fixed_pair(const zval_t *a, const zval_t *b) {
+    return (a->type == ZVAL_FIXED || b->type == ZVAL_FIXED) && fixed_operand(a) && fixed_operand(b);
+}
+
+static int32_t fixed_value(const zval_t *v) {
+    switch (v->type) {
+        case ZVAL_FIXED: return (int32_t)v->value.int_val;
+        case ZVAL_INT:   return microphp_fixed_from_int(v->value.int_val);
+        case ZVAL_BOOL:  return v->value.bool_val ? MICROPHP_FIXED_ONE : 0;
+        default:         return 0;
+    }
+}
+
+// Q16.16 in 64 bits for comparisons, so ints outside the fixed range
+// still order correctly against fixed values
+static int64_t fixed_wide(const zval_t *v) {
+    if (v->type != ZVAL_INT) return fixed_value(v);
+    int64_t limit = (int64_t)1 << 40;
+    int64_t i = v->value.int_val;
+    return (i > limit ? limit : i < -limit ? -limit : i) * MICROPHP_FIXED_ONE;
+}
+
+static int fixed_arith(vm_context_t *vm, opcode_t op, int32_t x, int32_t y, zval_t *result) {
+    switch (op) {
+        case OP_ADD: *result = microphp_zval_fixed(microphp_fixed_add(x, y)); return 0;
+        case OP_SUB: *result = microphp_zval_fixed(microphp_fixed_sub(x, y)); return 0;
+        case OP_MUL: *result = microphp_zval_fixed(microphp_fixed_mul(x, y)); return 0;
+        case OP_DIV:
+            if (y == 0) {
+                vm_fail(vm, "Division by zero");
+                return -1;
+            }
+            *result = microphp_zval_fixed(microphp_fixed_div(x, y));
+            return 0;
+        default:
+            vm_fail(vm, "Invalid arithmetic opcode");
+            return -1;
+    }
+}
+
+// Integer results that overflow become floats, as in PHP
+static int arith_op(vm_context_t *vm, opcode_t op, const zval_t *a, const zval_t *b, zval_t *result) {
+    if (op != OP_MOD && fixed_pair(a, b)) return fixed_arith(vm, op, fixed_value(a), fixed_value(b), result);
+    
+    microphp_int_t ai = 0, bi = 0;
+    double af = 0.0, bf = 0.0;
+    int ak = to_number(a, &ai, &af);
+    int bk = to_number(b, &bi, &bf);
+    
+    if (ak < 0 || bk < 0) {
+        vm_fail(vm, "Unsupported operand types");
+        return -1;
+    }
+    
+    if (op == OP_MOD) {
+        microphp_int_t x = ak == ZVAL_FLOAT ? float_to_int(af) : ai;
+        microphp_int_t y = bk == ZVAL_FLOAT ? float_to_int(bf) : bi;
+        if (y == 0) {
+            vm_fail(vm, "Modulo by zero");
+            return -1;
+        }
+        *result = microphp_zval_int(y == -1 ? 0 : x % y);
+        return 0;
+    }
+    
+    if (ak == ZVAL_INT && bk == ZVAL_INT) {
+        microphp_int_t r;
+        switch (op) {
+            case OP_ADD:
+                if (!int_add(ai, bi, &r)) break;
+                *result = microphp_zval_int(r);
+                return 0;
+            case OP_SUB:
+                if (!int_sub(ai, bi, &r)) break;
+                *result = microphp_zval_int(r);
+                return 0;
+            case OP_MUL:
+                if (!int_mul(ai, bi, &r)) break;
+                *result = microphp_zval_int(r);
+                return 0;
+            case OP_DIV:
+                if (bi == 0) {
+                    vm_fail(vm, "Division by zero");
+                    return -1;
+                }
+                // Exact integer quotients stay integers
+                if (bi != -1 && ai % bi == 0) {
+                    *result = microphp_zval_int(ai / bi);
+                    return 0;
+                }
+                *result = microphp_zval_float((double)ai / (double)bi);
+                return 0;
+            default:
+                break;
+        }
+    }
+    
+    double x = ak == ZVAL_FLOAT ? af : (double)ai;
+    double y = bk == ZVAL_FLOAT ? bf : (double)bi;
+    
+    switch (op) {
+        case OP_ADD:
+            *result = microphp_zval_float(x + y);
+            return 0;
+        case OP_SUB:
+            *result = microphp_zval_float(x - y);
+            return 0;
+        case OP_MUL:
+            *result = microphp_zval_float(x * y);
+            return 0;
+        case OP_DIV:
+            if (y == 0.0) {
+                vm_fail(vm, "Division by zero");
+                return -1;
+            }
+            *result = microphp_zval_float(x / y);
+            return 0;
+        default:
+            vm_fail(vm, "Invalid arithmetic opcode");
+            return -1;
+    }
+}
+
+// Shifts by the int width or more shift every bit out
+static microphp_int_t bitwise_op(opcode_t op, microphp_int_t a, microphp_int_t b) {
+    const microphp_int_t bits = (microphp_int_t)(8 * sizeof(microphp_int_t));
+    switch (op) {
+        case OP_BIT_AND: return a & b;
+        case OP_BIT_OR:  return a | b;
+        case OP_BIT_XOR: return a ^ b;
+        case OP_SHL:     return (b < 0 || b >= bits) ? 0 : (microphp_int_t)((uint64_t)a << b);
+        case OP_SHR:     return (b < 0 || b >= bits) ? (a < 0 ? -1 : 0) : (a >> b);
+        default:         return 0;
+    }
+}
+
+// Ordering for <, <=, >, >=: strings compare bytewise unless both are
+// numeric, everything else numerically
+static int compare_values(const zval_t *a, const zval_t *b) {
+    if (a->type == ZVAL_STRING && b->type == ZVAL_STRING && !(numeric_string(a) && numeric_string(b))) {
+        size_t a_len = microphp_string_len(a);
+        size_t b_len = microphp_string_len(b);
+        size_t n = a_len < b_len ? a_len : b_len;
+        int cmp = n ? memcmp(microphp_string_data(a), microphp_string_data(b), n) : 0;
+        if (cmp != 0) return cmp < 0 ? -1 : 1;
+        return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+    }
+    
+    if (fixed_pair(a, b)) {
+        int64_t x = fixed_wide(a);
+        int64_t y = fixed_wide(b);
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+    
+    microphp_int_t ai = 0, bi = 0;
+    double af = 0.0, bf = 0.0;
+    int ak = to_number(a, &ai, &af);
+    int bk = to_number(b, &bi, &bf);
+    
+    if (ak == ZVAL_INT && bk == ZVAL_INT) {
+        return ai < bi ? -1 : (ai > bi ? 1 : 0);
+    }
+    
+    double x = ak == ZVAL_FLOAT ? af : (double)ai;
+    double y = bk == ZVAL_FLOAT ? bf : (double)bi;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// PHP loose equality (==)
+static bool loose_equals(const zval_t *a, const zval_t *b) {
+    if (a->type == b->type) {
+        // "10" == "1e1"
+        if (a->type == ZVAL_STRING && numeric_string(a) && numeric_string(b)) {
+            return compare_values(a, b) == 0;
+        }
+        return microphp_zval_equals(a, b);
+    }
+    
+    if (a->type == ZVAL_BOOL || b->type == ZVAL_BOOL ||
+        a->type == ZVAL_NULL || b->type == ZVAL_NULL) {
+        return microphp_zval_to_bool(a) == microphp_zval_to_bool(b);
+    }
+    
+    if (a->type == ZVAL_ARRAY || b->type == ZVAL_ARRAY) {
+        return false;
+    }
+    
+    return compare_values(a, b) == 0;
+}
+
+// ++/-- on a string. Numeric strings step as numbers. Other strings
+// increment the way PHP does, the last letter or digit carrying leftwards
+// ("Az" -> "Ba", "zz" -> "aaa", "a9" -> "b0"), and do not decrement,
+// except "" which goes to "1" or -1.
+static zval_t string_step(const zval_t *v, microphp_int_t delta) {
+    if (numeric_string(v)) {
+        microphp_int_t i = 0, r;
+        double f = 0.0;
+        int kind = to_number(v, &i, &f);
+        if (kind == ZVAL_INT && int_add(i, delta, &r)) return microphp_zval_int(r);
+        return microphp_zval_float((kind == ZVAL_FLOAT ? f : (double)i) + (double)delta);
+    }
+    
+    size_t len = microphp_string_len(v);
+    if (len == 0) return delta > 0 ? microphp_zval_string("1", 1) : microphp_zval_int(-1);
+    
+    zval_t result = microphp_zval_string(microphp_string_data(v), len);
+    if (result.type != ZVAL_STRING || delta < 0) return result;
+    
+    char *s = microphp_string_buffer(&result);
+    char carry = 0;
+    for (size_t pos = len; pos-- > 0; ) {
+        char c = s[pos];
+        if (c >= 'a' && c <= 'z') {
+            carry = 'a';
+        } else if (c >= 'A' && c <= 'Z') {
+            carry = 'A';
+        } else if (c >= '0' && c <= '9') {
+            carry = '1';
+        } else {
+            return result;  // Stops at anything else: "-z" -> "-a"
+        }
+        if (c != 'z' && c != 'Z' && c != '9') {
+            s[pos] = (char)(c + 1);
+            return result;
+        }
+        s[pos] = carry == '1' ? '0' : carry;
+    }
+    
+    // Carried out of the first character
+    zval_t head = microphp_zval_string(&carry, 1);
+    zval_t grown = microphp_string_concat(&head, &result);
+    microphp_zval_destroy(&head);
+    microphp_zval_destroy(&result);
+    return grown;
+}
+
+// ++/-- in place
+static void step_value(zval_t *v, microphp_int_t delta) {
+    if (v->type == ZVAL_INT) {
+        microphp_int_t r;
+        if (int_add(v->value.int_val, delta, &r)) v->value.int_val = r;
+        else *v = microphp_zval_float((double)v->value.int_val + (double)delta);
+    } else if (v->type == ZVAL_FLOAT) {
+        v->value.float_val += (double)delta;
+    } else if (v->type == ZVAL_FIXED) {
+        v->value.int_val = microphp_fixed_add((int32_t)v->value.int_val, (int32_t)(delta * MICROPHP_FIXED_ONE));
+    } else if (v->type == ZVAL_NULL && delta > 0) {
+        // null++ is 1, null-- stays null
+        *v = microphp_zval_int(1);
+    } else if (v->type == ZVAL_STRING) {
+        zval_t result = string_step(v, delta);
+        microphp_zval_destroy(v);
+        *v = result;
+    }
+}
+
+static zval_t cast_to_string(const zval_t *v) {
+    char buf[MICROPHP_NUM_BUF];
+    
+    switch (v->type) {
+        case ZVAL_STRING:
+            return microphp_zval_string(microphp_string_data(v), microphp_string_len(v));
+        case ZVAL_ARRAY:
+            return microphp_zval_string("Array", 5);
+        default:
+            return microphp_zval_string(buf, microphp_scalar_format(v, buf));
+    }
+}
+
+// $container[$index] read; missing elements read as null
+static zval_t index_read(const zval_t *container, const zval_t *index) {
+    int64_t i = to_int(index);
+    
+    if (container->type == ZVAL_ARRAY) {
+        zval_t result = microphp_zval_null();
+        if (i >= 0) {
+            microphp_array_get(container, (size_t)i, &result);
+        }
+        return result;
+    }
+    
+    if (container->type == ZVAL_STRING) {
+        int64_t len = (int64_t)microphp_string_len(container);
+        if (i < 0) i += len;
+        if (i >= 0 && i < len) {
+            // Byte buffers hand out the byte itself, no string per access
+            const char *str = microphp_string_data(container);
+            if (container->flags & ZVAL_FLAG_BYTES) return microphp_zval_int((uint8_t)str[i]);
+            return microphp_zval_string(&str[i], 1);
+        }
+    }
+    
+    return microphp_zval_null();
+}
+
+// $var[$index] = value / $var[] = value, in place on the variable slot
+// $buf[$i] = byte on a byte buffer: in place, or appending at the end
+static int byte_write(vm_context_t *vm, zval_t *target, const zval_t *index, const zval_t *value) {
+    size_t len = microphp_string_len(target);
+    int64_t i = index ? to_int(index) : (int64_t)len;
+    if (i < 0) i += (int64_t)len;
+    if (i < 0 || i > (int64_t)len) {
+        vm_fail(vm, "Byte index out of range");
+        return -1;
+    }
+    
+    char byte = (char)(uint8_t)to_int(value);
+    if ((size_t)i == len) {
+        if (microphp_string_append_bytes(target, &byte, 1) != 0) {
+            vm_fail(vm, "Out of memory");
+            return -1;
+        }
+        return 0;
+    }
+    microphp_string_buffer(target)[i] = byte;
+    return 0;
+}
+
+static int index_write(vm_context_t *vm, zval_t *target, const zval_t *index, const zval_t *value) {
+    if (target->type == ZVAL_NULL) {
+        *target = microphp_zval_array(0);
+    }
+    if (target->type == ZVAL_STRING && (target->flags & ZVAL_FLAG_BYTES) && !(target->flags & ZVAL_FLAG_BORROWED)) {
+        return byte_write(vm, target, index, value);
+    }
+    if (target->type != ZVAL_ARRAY) {
+        vm_fail(vm, "Cannot use a scalar value as an array");
+        return -1;
+    }
+    
+    if (!index) {
+        return microphp_array_push(target, value);
+    }
+    
+    int64_t i = to_int(index);
+    if (i < 0) {
+        vm_fail(vm, "Negative array index");
+        return -1;
+    }
+    
+    // Arrays are dense vectors: fill any gap with nulls
+    zval_t null_val = microphp_zval_null();
+    while ((size_t)i > microphp_array_size(target)) {
+        microphp_array_push(target, &null_val);
+    }
+    
+    if ((size_t)i == microphp_array_size(target)) {
+        return microphp_array_push(target, value);
+    }
+    return microphp_array_set(target, (size_t)i, value);
+}
+
+// Generic form of a typed binary opcode on the two top stack slots, for
+// operands whose tags are not what the compiler inferred (an int that
+// overflowed into a float) or an int result that overflows
+static void typed_fallback(vm_context_t *vm, opcode_t op) {
+    zval_t *b = &vm->stack[vm->stack_top - 1];
+    zval_t *a = b - 1;
+    zval_t result;
+    
+    switch (op) {
+        case OP_ADD_I: case OP_ADD_F:
+            if (arith_op(vm, OP_ADD, a, b, &result) != 0) return;
+            break;
+        case OP_SUB_I: case OP_SUB_F:
+            if (arith_op(vm, OP_SUB, a, b, &result) != 0) return;
+            break;
+        case OP_MUL_I: case OP_MUL_F:
+            if (arith_op(vm, OP_MUL, a, b, &result) != 0) return;
+            break;
+        case OP_DIV_F:
+            if (arith_op(vm, OP_DIV, a, b, &result) != 0) return;
+            break;
+        case OP_EQ_I:  result = microphp_zval_bool(loose_equals(a, b)); break;
+        case OP_NEQ_I: result = microphp_zval_bool(!loose_equals(a, b)); break;
+        case OP_LT_I:  case OP_LT_F:  result = microphp_zval_bool(compare_values(a, b) < 0); break;
+        case OP_LTE_I: case OP_LTE_F: result = microphp_zval_bool(compare_values(a, b) <= 0); break;
+        case OP_GT_I:  case OP_GT_F:  result = microphp_zval_bool(compare_values(a, b) > 0); break;
+        default:                      result = microphp_zval_bool(compare_values(a, b) >= 0); break;
+    }
+    
+    microphp_zval_destroy(a);
+    microphp_zval_destroy(b);
+    *a = result;
+    vm->stack_top--;
+    vm->pc++;
+}
+
+// Typed fast paths: work in place on the two top stack slots with no
+// copies or destroys. Only the tags are checked; a mismatch goes to
+// typed_fallback().
+#define TYPED_BINARY(tag, ctype, field, result_type, result_field, expr) \
+    do {                                                            \
+        if (vm->stack_top < 2) {                                    \
+            vm_fail(vm, "Stack underflow in typed operation");      \
+            break;                                                  \
+        }                                                           \
+        zval_t *b = &vm->stack[vm->stack_top - 1];                  \
+        zval_t *a = b - 1;                                          \
+        if (a->type != tag || b->type != tag) {                     \
+            typed_fallback(vm, instr->opcode);                      \
+            break;                                                  \
+        }                                                           \
+        ctype x = a->value.field;                                   \
+        ctype y = b->value.field;                                   \
+        a->type = result_type;                                      \
+        a->value.result_field = (expr);                             \
+        vm->stack_top--;                                            \
+        vm->pc++;                                                   \
+    } while (0)
+
+// Int add/sub/mul; an overflow goes to typed_fallback() for a float
+#define TYPED_INT_ARITH(fn)                                         \
+    do {                                                            \
+        if (vm->stack_top < 2) {                                    \
+            vm_fail(vm, "Stack underflow in typed operation");      \
+            break;                                                  \
+        }                                                           \
+        zval_t *b = &vm->stack[vm->stack_top - 1];                  \
+        zval_t *a = b - 1;                                          \
+        microphp_int_t r;                                           \
+        if (a->type != ZVAL_INT || b->type != ZVAL_INT ||           \
+            !fn(a->value.int_val, b->value.int_val, &r)) {          \
+            typed_fallback(vm, instr->opcode);                      \
+            break;                                                  \
+        }                                                           \
+        a->value.int_val = r;                                       \
+        vm->stack_top--;                                            \
+        vm->pc++;                                                   \
+    } while (0)
+
+// Little-endian reads from validated switch tables
+static uint16_t read_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint64_t read_le64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+// Entry selected by a switch table, or -1 when the subject's type does
+// not match the keys
+static long switch_lookup(const zval_t *constants, const zval_t *table, size_t entries, const zval_t *subject) {
+    const uint8_t *data = (const uint8_t*)microphp_string_data(table);
+    long missing = (long)entries - 1;
+    uint8_t kind = data[0];
+    
+    if (kind == MICROPHP_SWITCH_STRING_HASH) {
+        if (subject->type != ZVAL_STRING) return -1;
+    } else if (subject->type != ZVAL_INT) {
+        return -1;
+    }
+    
+    if (kind == MICROPHP_SWITCH_DENSE) {
+        uint64_t offset = (uint64_t)subject->value.int_val - read_le64(data + 1);
+        return offset < (uint64_t)missing ? (long)offset : missing;
+    }
+    
+    uint32_t seed = (uint32_t)read_le16(data + 1) | ((uint32_t)read_le16(data + 3) << 16);
+    uint16_t size = read_le16(data + 5);
+    uint16_t buckets = read_le16(data + 7);
+    const uint8_t *bucket_seeds = data + 9;
+    const uint8_t *slots = bucket_seeds + 2 * buckets;
+    
+    if (kind == MICROPHP_SWITCH_INT_HASH) {
+        uint8_t key[8];
+        uint64_t value = (uint64_t)subject->value.int_val;
+        for (int i = 0; i < 8; i++) key[i] = (uint8_t)(value >> (8 * i));
+        uint32_t bucket = microphp_hash_bytes(key, 8, seed) & (buckets - 1);
+        uint32_t index = microphp_hash_bytes(key, 8, read_le16(bucket_seeds + 2 * bucket)) & (size - 1);
+        const uint8_t *slot = slots + index * 10;
+        uint16_t entry = read_le16(slot + 8);
+        return (entry != MICROPHP_SWITCH_EMPTY && read_le64(slot) == value) ? entry : missing;
+    }
+    
+    const char *str = microphp_string_data(subject);
+    size_t len = microphp_string_len(subject);
+    uint32_t bucket = microphp_hash_bytes(str, len, seed) & (buckets - 1);
+    uint32_t index = microphp_hash_bytes(str, len, read_le16(bucket_seeds + 2 * bucket)) & (size - 1);
+    const uint8_t *slot = slots + index * 4;
+    uint16_t entry = read_le16(slot + 2);
+    if (entry == MICROPHP_SWITCH_EMPTY) return missing;
+    return microphp_zval_equals(&constants[read_le16(slot)], subject) ? entry : missing;
+}
+
+// Fuel is paid a basic block at a time: when control leaves the block
+// ending at instr (pc already updated, tasks already switched), its
+// instructions are charged and the next block starts at pc. A slice
+// stops once its fuel is gone, overrunning by at most one block.
+static void fuel_charge(vm_context_t *vm, const instruction_t *instr) {
+    vm->fuel -= instr - vm->block + 1;
+    vm->block = vm->pc;
+    if (vm->fuel <= 0 && vm->running) {
+        vm->suspended = true;
+        vm->running = false;
+    }
+}
+
+#define BLOCK_END(vm, instr) do { if ((vm)->budget) fuel_charge(vm, instr); } while (0)
+
+// Loop back-edges and calls: where the running task may be preempted or
+// give way to a GPIO or timer handler
+#define SAFEPOINT(vm, instr) do { \
+    if (interrupt_pending(vm)) interrupt_dispatch(vm); \
+    if (--(vm)->slice_left == 0) task_preempt(vm); \
+    BLOCK_END(vm, instr); \
+} while (0)
+
+// VM execution
+int microphp_vm_run(vm_context_t *vm) {
+    return microphp_vm_run_slice(vm, 0);
+}
+
+// Prepares a fresh run of the program
+static int vm_start(vm_context_t *vm) {
+    microphp_clear_error(vm);
+    
+    // Main runs as a task alongside any the host spawned
+    size_t main_task = 0;
+    while (main_task < vm->task_capacity && vm->tasks[main_task].state != MICROPHP_TASK_FREE) main_task++;
+    if (main_task == vm->task_capacity) {
+        vm_fail(vm, "No free task slot for main");
+        return -1;
+    }
+    vm->current_task = main_task;
+    vm->tasks[main_task].state = MICROPHP_TASK_RUNNING;
+    vm->tasks[main_task].io_handle = -1;
+    vm->slice_left = MICROPHP_TASK_SLICE;
+    vm->yield = MICROPHP_YIELD_NONE;
+    memset(&vm->idle_stats, 0, sizeof(vm->idle_stats));
+    
+    // Enter main function
+    const function_t *main_fn = &vm->bytecode->functions[vm->bytecode->main_offset];
+    if (push_frame(vm, main_fn, NULL, 0) != 0) {
+        vm_fail(vm, "Out of memory");
+        return -1;
+    }
+    vm->pc = main_fn->code;
+    return 0;
+}
+
+int microphp_vm_run_slice(vm_context_t *vm, uint32_t budget) {
+    if (!vm || !vm->bytecode) return -1;
+    
+    if (!vm->suspended && vm_start(vm) != 0) return -1;
+    vm->suspended = false;
+    vm->budget = budget;
+    vm->fuel = budget;
+    vm->block = vm->pc;
+    vm->idle_mark_ms = microphp_vm_millis(vm);
+    vm->running = true;
+    
+    const zval_t *constants = vm->bytecode->constants;
+    zval_t *globals = vm->globals;
+    
+    // Main execution loop
+    while (vm->running) {
+        instruction_t *instr = vm->pc;
+        // Re-derived each step: calls move the frame and may grow vm->locals
+        zval_t *locals = &vm->locals[vm->frames[vm->frame_count - 1].locals_base];
+        
+        switch (instr->opcode) {
+            case OP_NOP:
+                vm->pc++;
+                break;
+                
+            case OP_CONST: {
+                // Strings borrow the program's bytes instead of copying them;
+                // short ones are inline and copy with the zval
+                zval_t value = constants[instr->operand1];
+                if (value.type == ZVAL_STRING && !(value.flags & ZVAL_FLAG_INLINE)) value.flags = ZVAL_FLAG_BORROWED;
+                stack_push_value(vm, value);
+                vm->pc++;
+                break;
+            }
+                
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD: {
+                zval_t b, a, result;
+                if (stack_pop(vm, &b) != 0 || stack_pop(vm, &a) != 0) {
+                    vm_fail(vm, "Stack underflow in arithmetic");
+                    break;
+                }
+                
+                int rc = arith_op(vm, instr->opcode, &a, &b, &result);
+                microphp_zval_destroy(&a);
+                microphp_zval_destroy(&b);
+                if (rc != 0) break;
+                
+                stack_push_value(vm, result);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_BIT_AND:
+            case OP_BIT_OR:
+            case OP_BIT_XOR:
+            case OP_SHL:
+            case OP_SHR: {
+                zval_t b, a;
+                if (stack_pop(vm, &b) != 0 || stack_pop(vm, &a) != 0) {
+                    vm_fail(vm, "Stack underflow in bitwise operation");
+                    break;
+                }
+                
+                microphp_int_t result = bitwise_op(instr->opcode, to_int(&a), to_int(&b));
+                microphp_zval_destroy(&a);
+                microphp_zval_destroy(&b);
+                stack_push_value(vm, microphp_zval_int(result));
+                vm->pc++;
+                break;
+            }
+            
+            case OP_BIT_NOT:
+            case OP_NEG: {
+                zval_t *top = stack_peek(vm, 0);
+                if (!top) {
+                    vm_fail(vm, "Stack underflow in unary operation");
+                    break;
+                }
+                
+                zval_t result;
+                if (instr->opcode == OP_BIT_NOT) {
+                    result = microphp_zval_int(~to_int(top));
+                } else if (top->type == ZVAL_FLOAT) {
+                    result = microphp_zval_float(-top->value.float_val);
+                } else if (top->type == ZVAL_FIXED) {
+                    result = microphp_zval_fixed(microphp_fixed_sub(0, (int32_t)top->value.int_val));
+                } else {
+                    microphp_int_t i = 0;
+                    double f = 0.0;
+                    int kind = to_number(top, &i, &f);
+                    if (kind < 0) {
+                        vm_fail(vm, "Unsupported operand types");
+                        break;
+                    }
+                    // -PHP_INT_MIN does not fit and becomes a float
+                    result = kind == ZVAL_FLOAT ? microphp_zval_float(-f)
+                           : i == MICROPHP_INT_MIN ? microphp_zval_float(-(double)i)
+                           : microphp_zval_int(-i);
+                }
+                microphp_zval_destroy(top);
+                *top = result;
+                vm->pc++;
+                break;
+            }
+            
+            case OP_INC:
+            case OP_DEC: {
+                zval_t *top = stack_peek(vm, 0);
+                if (!top) {
+                    vm_fail(vm, "Stack underflow in INC/DEC");
+                    break;
+                }
+                
+                step_value(top, instr->opcode == OP_INC ? 1 : -1);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_EQ:
+            case OP_NEQ:
+            case OP_IDENTICAL:
+            case OP_NOT_IDENTICAL:
+            case OP_LT:
+            case OP_LTE:
+            case OP_GT:
+            case OP_GTE: {
+                zval_t b, a;
+                if (stack_pop(vm, &b) != 0 || stack_pop(vm, &a) != 0) {
+                    vm_fail(vm, "Stack underflow in comparison");
+                    break;
+                }
+                
+                bool result;
+                switch (instr->opcode) {
+                    case OP_EQ:            result = loose_equals(&a, &b); break;
+                    case OP_NEQ:           result = !loose_equals(&a, &b); break;
+                    case OP_IDENTICAL:     result = microphp_zval_equals(&a, &b); break;
+                    case OP_NOT_IDENTICAL: result = !microphp_zval_equals(&a, &b); break;
+                    case OP_LT:            result = compare_values(&a, &b) < 0; break;
+                    case OP_LTE:           result = compare_values(&a, &b) <= 0; break;
+                    case OP_GT:            result = compare_values(&a, &b) > 0; break;
+                    default:               result = compare_values(&a, &b) >= 0; break;
+                }
+                
+                microphp_zval_destroy(&a);
+                microphp_zval_destroy(&b);
+                stack_push_value(vm, microphp_zval_bool(result));
+                vm->pc++;
+                break;
+            }
+            
+            case OP_AND:
+            case OP_OR: {
+                zval_t b, a;
+                if (stack_pop(vm, &b) != 0 || stack_pop(vm, &a) != 0) {
+                    vm_fail(vm, "Stack underflow in logical operation");
+                    break;
+                }
+                
+                bool x = microphp_zval_to_bool(&a);
+                bool y = microphp_zval_to_bool(&b);
+                microphp_zval_destroy(&a);
+                microphp_zval_destroy(&b);
+                stack_push_value(vm, microphp_zval_bool(instr->opcode == OP_AND ? (x && y) : (x || y)));
+                vm->pc++;
+                break;
+            }
+            
+            case OP_NOT: {
+                zval_t *top = stack_peek(vm, 0);
+                if (!top) {
+                    vm_fail(vm, "Stack underflow in NOT");
+                    break;
+                }
+                
+                bool result = !microphp_zval_to_bool(top);
+                microphp_zval_destroy(top);
+                *top = microphp_zval_bool(result);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_JMP:
+                vm->pc = &vm->frames[vm->frame_count - 1].function->code[instr->operand1];
+                if (vm->pc <= instr) {
+                    SAFEPOINT(vm, instr);
+                } else {
+                    BLOCK_END(vm, instr);
+                }
+                break;
+                
+            case OP_JMPZ:
+            case OP_JMPNZ: {
+                zval_t cond;
+                if (stack_pop(vm, &cond) != 0) {
+                    vm_fail(vm, "Stack underflow in conditional jump");
+                    break;
+                }
+                
+                bool truthy = microphp_zval_to_bool(&cond);
+                microphp_zval_destroy(&cond);
+                if (truthy == (instr->opcode == OP_JMPNZ)) {
+                    vm->pc = &vm->frames[vm->frame_count - 1].function->code[instr->operand1];
+                    if (vm->pc <= instr) {
+                        SAFEPOINT(vm, instr);
+                    } else {
+                        BLOCK_END(vm, instr);
+                    }
+                } else {
+                    vm->pc++;
+                }
+                break;
+            }
+            
+            case OP_CALL: {
+                if (vm->stack_top < instr->operand2) {
+                    vm_fail(vm, "Stack underflow in CALL");
+                    break;
+                }
+                
+                const function_t *fn = &vm->bytecode->functions[instr->operand1];
+                if (push_frame(vm, fn, vm->pc + 1, instr->operand2) != 0) {
+                    vm_fail(vm, "Out of memory");
+                    break;
+                }
+                vm->pc = fn->code;
+                SAFEPOINT(vm, instr);
+                break;
+            }
+            
+            case OP_CALL_BUILTIN: {
+                size_t argc = instr->operand2;
+                if (vm->stack_top < argc) {
+                    vm_fail(vm, "Stack underflow in CALL_BUILTIN");
+                    break;
+                }
+                
+                zval_t *args = &vm->stack[vm->stack_top - argc];
+                zval_t result = microphp_builtins[instr->operand1].fn(vm, args, argc);
+                if (vm->yield == MICROPHP_YIELD_RETRY && !vm->error_msg) {
+                    // Arguments stay put; the call runs again when the task wakes
+                    microphp_zval_destroy(&result);
+                    vm->yield = MICROPHP_YIELD_NONE;
+                    task_suspend(vm, MICROPHP_TASK_SLEEPING);
+                    schedule(vm);
+                    BLOCK_END(vm, instr);
+                    break;
+                }
+                for (size_t i = 0; i < argc; i++) {
+                    microphp_zval_destroy(&args[i]);
+                }
+                vm->stack_top -= argc;
+                
+                if (vm->error_msg) {
+                    microphp_zval_destroy(&result);
+                    vm->running = false;
+                    break;
+                }
+                stack_push_value(vm, result);
+                vm->pc++;
+                
+                if (vm->yield == MICROPHP_YIELD_EXIT) {
+                    // Nothing of the program keeps running: no task, timer or pin handler
+                    vm->yield = MICROPHP_YIELD_NONE;
+                    timers_clear(vm);
+                    gpio_clear(vm);
+                    vm->running = false;
+                } else if (vm->yield == MICROPHP_YIELD_SLEEP) {
+                    vm->yield = MICROPHP_YIELD_NONE;
+                    task_suspend(vm, MICROPHP_TASK_SLEEPING);
+                    schedule(vm);
+                    BLOCK_END(vm, instr);
+                }
+                break;
+            }
+            
+            case OP_RETURN: {
+                zval_t result;
+                if (stack_pop(vm, &result) != 0) {
+                    result = microphp_zval_null();
+                }
+                
+                instruction_t *return_pc = vm->frames[vm->frame_count - 1].return_pc;
+                pop_frame(vm);
+                
+                if (vm->frame_count == 0) {
+                    microphp_zval_destroy(&result);
+                    if (!task_exit(vm)) vm->running = false;
+                    BLOCK_END(vm, instr);
+                    break;
+                }
+                
+                stack_push_value(vm, result);
+                vm->pc = return_pc;
+                BLOCK_END(vm, instr);
+                break;
+            }
+            
+            case OP_POP: {
+                zval_t value;
+                if (stack_pop(vm, &value) != 0) {
+                    vm_fail(vm, "Stack underflow in POP");
+                    break;
+                }
+                microphp_zval_destroy(&value);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_DUP: {
+                zval_t *top = stack_peek(vm, 0);
+                if (!top) {
+                    vm_fail(vm, "Stack underflow in DUP");
+                    break;
+                }
+                zval_t copy = microphp_zval_null();
+                microphp_zval_copy(&copy, top);
+                stack_push_value(vm, copy);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_SWAP: {
+                zval_t *a = stack_peek(vm, 0);
+                zval_t *b = stack_peek(vm, 1);
+                if (!a || !b) {
+                    vm_fail(vm, "Stack underflow in SWAP");
+                    break;
+                }
+                zval_t tmp = *a;
+                *a = *b;
+                *b = tmp;
+                vm->pc++;
+                break;
+            }
+            
+            case OP_GET_LOCAL:
+                stack_push(vm, &locals[instr->operand1]);
+                vm->pc++;
+                break;
+                
+            case OP_GET_GLOBAL:
+                stack_push(vm, &globals[instr->operand1]);
+                vm->pc++;
+                break;
+                
+            case OP_SET_LOCAL:
+            case OP_SET_GLOBAL: {
+                zval_t value;
+                if (stack_pop(vm, &value) != 0) {
+                    vm_fail(vm, "Stack underflow in SET");
+                    break;
+                }
+                
+                zval_t *slot = instr->opcode == OP_SET_LOCAL ? &locals[instr->operand1]
+                                                             : &globals[instr->operand1];
+                microphp_zval_destroy(slot);
+                *slot = value;
+                vm->pc++;
+                break;
+            }
+            
+            case OP_NEW_ARRAY: {
+                size_t count = instr->operand1;
+                if (vm->stack_top < count) {
+                    vm_fail(vm, "Stack underflow in NEW_ARRAY");
+                    break;
+                }
+                
+                zval_t array = microphp_zval_array(count);
+                if (array.type != ZVAL_ARRAY) {
+                    vm_fail(vm, "Out of memory");
+                    break;
+                }
+                zval_t *items = &vm->stack[vm->stack_top - count];
+                for (size_t i = 0; i < count; i++) {
+                    array.value.array_val.data[i] = items[i];
+                }
+                array.value.array_val.size = count;
+                vm->stack_top -= count;
+                
+                stack_push_value(vm, array);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_ARRAY_GET: {
+                zval_t index, container;
+                if (stack_pop(vm, &index) != 0 || stack_pop(vm, &container) != 0) {
+                    vm_fail(vm, "Stack underflow in ARRAY_GET");
+                    break;
+                }
+                
+                zval_t result = index_read(&container, &index);
+                microphp_zval_destroy(&container);
+                microphp_zval_destroy(&index);
+                stack_push_value(vm, result);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_ARRAY_SET: {
+                bool append = (instr->operand2 & MICROPHP_ARRAY_SET_APPEND) != 0;
+                zval_t value, index;
+                if (stack_pop(vm, &value) != 0 || (!append && stack_pop(vm, &index) != 0)) {
+                    vm_fail(vm, "Stack underflow in ARRAY_SET");
+                    break;
+                }
+                
+                zval_t *target = (instr->operand2 & MICROPHP_ARRAY_SET_GLOBAL) ? &globals[instr->operand1]
+                                                                               : &locals[instr->operand1];
+                int rc = index_write(vm, target, append ? NULL : &index, &value);
+                microphp_zval_destroy(&value);
+                if (!append) microphp_zval_destroy(&index);
+                if (rc != 0) break;
+                
+                vm->pc++;
+                break;
+            }
+            
+            case OP_STRING_CONCAT: {
+                zval_t b, a;
+                if (stack_pop(vm, &b) != 0 || stack_pop(vm, &a) != 0) {
+                    vm_fail(vm, "Stack underflow in STRING_CONCAT");
+                    break;
+                }
+                
+                // a is a temporary: a . b . c grows it in place
+                int rc = microphp_string_append(&a, &b);
+                microphp_zval_destroy(&b);
+                if (rc != 0) {
+                    microphp_zval_destroy(&a);
+                    vm_fail(vm, "Out of memory");
+                    break;
+                }
+                stack_push_value(vm, a);
+                vm->pc++;
+                break;
+            }
+            
+            case OP_APPEND_LOCAL:
+            case OP_APPEND_GLOBAL: {
+                size_t count = instr->operand2;
+                if (vm->stack_top < count) {
+                    vm_fail(vm, "Stack underflow in APPEND");
+                    break;
+                }
+                
+                zval_t *slot = instr->opcode == OP_APPEND_LOCAL ? &locals[instr->operand1]
+                                                                : &globals[instr->operand1];
+                zval_t *parts = &vm->stack[vm->stack_top - count];
+                int rc = 0;
+                for (size_t i = 0; i < count; i++) {
+                    if (rc == 0) rc = microphp_string_append(slot, &parts[i]);
+                    microphp_zval_destroy(&parts[i]);
+                }
+                vm->stack_top -= count;
+                if (rc != 0) {
+                    vm_fail(vm, "Out of memory");
+                    break;
+                }
+                vm->pc++;
+                break;
+            }
+            
+            case OP_CAST_INT:
+            case OP_CAST_FLOAT:
+            case OP_CAST_STRING:
+            case OP_CAST_BOOL: {
+                zval_t *top = stack_peek(vm, 0);
+                if (!top) {
+                    vm_fail(vm, "Stack underflow in CAST");
+                    break;
+                }
+                
+                zval_t result;
+                switch (instr->opcode) {
+                    case OP_CAST_INT:    result = microphp_zval_int(top->type == ZVAL_ARRAY ? (top->value.array_val.size > 0) : to_int(top)); break;
+                    case OP_CAST_FLOAT:  result = microphp_zval_float(top->type == ZVAL_ARRAY ? (top->value.array_val.size > 0) : to_float(top)); break;
+                    case OP_CAST_STRING: result = cast_to_string(top); break;
+                    default:             result = microphp_zval_bool(microphp_zval_to_bool(top)); break;
+                }
+                microphp_zval_destroy(top);
+                *top = result;
+                vm->pc++;
+                break;
+            }
+            
+            case OP_ADD_I:
+                TYPED_INT_ARITH(int_add);
+                break;
+            case OP_SUB_I:
+                TYPED_INT_ARITH(int_sub);
+                break;
+            case OP_MUL_I:
+                TYPED_INT_ARITH(int_mul);
+                break;
+            case OP_LT_I:
+                TYPED_BINARY(ZVAL_INT, microphp_int_t, int_val, ZVAL_BOOL, bool_val, x < y);
+                break;
+            case OP_LTE_I:
+                TYPED_BINARY(ZVAL_INT, microphp_int_t, int_val, ZVAL_BOOL, bool_val, x <= y);
+                break;
+            case OP_GT_I:
+                TYPED_BINARY(ZVAL_INT, microphp_int_t, int_val, ZVAL_BOOL, bool_val, x > y);
+                break;
+            case OP_GTE_I:
+                TYPED_BINARY(ZVAL_INT, microphp_int_t, int_val, ZVAL_BOOL, bool_val, x >= y);
+                break;
+            case OP_EQ_I:
+                TYPED_BINARY(ZVAL_INT, microphp_int_t, int_val, ZVAL_BOOL, bool_val, x == y);
+                break;
+            case OP_NEQ_I:
+                TYPED_BINARY(ZVAL_INT, microphp_int_t, int_val, ZVAL_BOOL, bool_val, x != y);
+                break;
+            case OP_ADD_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_FLOAT, float_val, x + y);
+                break;
+            case OP_SUB_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_FLOAT, float_val, x - y);
+                break;
+            case OP_MUL_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_FLOAT, float_val, x * y);
+                break;
+            case OP_LT_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_BOOL, bool_val, x < y);
+                break;
+            case OP_LTE_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_BOOL, bool_val, x <= y);
+                break;
+            case OP_GT_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_BOOL, bool_val, x > y);
+                break;
+            case OP_GTE_F:
+                TYPED_BINARY(ZVAL_FLOAT, double, float_val, ZVAL_BOOL, bool_val, x >= y);
+                break;
+                
+            case OP_DIV_F: {
+                if (vm->stack_top < 2) {
+                    vm_fail(vm, "Stack underflow in typed operation");
+                    break;
+                }
+                zval_t *b = &vm->stack[vm->stack_top - 1];
+                zval_t *a = b - 1;
+                if (a->type != ZVAL_FLOAT || b->type != ZVAL_FLOAT) {
+                    typed_fallback(vm, instr->opcode);
+                    break;
+                }
+                if (b->value.float_val == 0.0) {
+                    vm_fail(vm, "Division by zero");
+                    break;
+                }
+                a->value.float_val /= b->value.float_val;
+                a->type = ZVAL_FLOAT;
+                vm->stack_top--;
+                vm->pc++;
+                break;
+            }
+            
+            case OP_INC_I:
+            case OP_DEC_I: {
+                if (vm->stack_top < 1) {
+                    vm_fail(vm, "Stack underflow in typed operation");
+                    break;
+                }
+                zval_t *top = &vm->stack[vm->stack_top - 1];
+                microphp_int_t r;
+                if (top->type == ZVAL_INT && int_add(top->value.int_val, instr->opcode == OP_INC_I ? 1 : -1, &r)) {
+                    top->value.int_val = r;
+                } else {
+                    step_value(top, instr->opcode == OP_INC_I ? 1 : -1);
+                }
+                vm->pc++;
+                break;
+            }
+            
+            case OP_INC_JLT_LOCAL:
+            case OP_INC_JLT_GLOBAL: {
+                if (vm->stack_top < 1) {
+                    vm_fail(vm, "Stack underflow in counted loop");
+                    break;
+                }
+                zval_t *bound = &vm->stack[--vm->stack_top];
+                zval_t *counter = instr->opcode == OP_INC_JLT_LOCAL ? &locals[instr->operand1]
+                                                                    : &globals[instr->operand1];
+                microphp_int_t r;
+                bool below;
+                if (counter->type == ZVAL_INT && bound->type == ZVAL_INT && int_add(counter->value.int_val, 1, &r)) {
+                    counter->value.int_val = r;
+                    below = r < bound->value.int_val;
+                } else {
+                    step_value(counter, 1);
+                    below = compare_values(counter, bound) < 0;
+                    microphp_zval_destroy(bound);
+                }
+                if (below) {
+                    vm->pc = &vm->frames[vm->frame_count - 1].function->code[instr->operand2];
+                    SAFEPOINT(vm, instr);
+                } else {
+                    vm->pc++;
+                }
+                break;
+            }
+            
+            case OP_SWITCH_TABLE: {
+                zval_t subject;
+                if (stack_pop(vm, &subject) != 0) {
+                    vm_fail(vm, "Stack underflow in SWITCH_TABLE");
+                    break;
+                }
+                
+                long entry = switch_lookup(constants, &constants[instr->operand1], instr->operand2, &subject);
+                microphp_zval_destroy(&subject);
+                if (entry < 0) {
+                    vm->pc = instr + instr->operand2 + 1;
+                } else {
+                    vm->pc = &vm->frames[vm->frame_count - 1].function->code[instr[1 + entry].operand1];
+                }
+                BLOCK_END(vm, instr);
+                break;
+            }
+            
+            case OP_MATCH_ERROR:
+                vm_fail(vm, "Unhandled match case");
+                break;
+            
+            default:
+                vm_fail(vm, "Unimplemented opcode");
+                break;
+        }
+    }
+    
+    idle_stats_mark(vm);
+    output_drain(vm);
+    if (vm->suspended) return MICROPHP_RUN_YIELDED;
+    
+    // Unwind frames left behind by an error, along with the other tasks
+    while (vm->frame_count > 0) {
+        pop_frame(vm);
+    }
+    tasks_clear(vm);
+    
+    return vm->error_msg ? -1 : MICROPHP_RUN_DONE;
+}
+
+void microphp_vm_reset(vm_context_t *vm) {
+    if (!vm) return;
+    
+    microphp_output_flush(vm);
+    tasks_clear(vm);
+    gpio_clear(vm);
+    timers_clear(vm);
+    io_clear(vm);
+#ifdef MICROPHP_DSP
+    microphp_dsp_clear(vm);
+#endif
+    
+    // Reset stack
+    for (size_t i = 0; i < vm->stack_top; i++) {
+        microphp_zval_destroy(&vm->stack[i]);
+    }
+    vm->stack_top = 0;
+    
+    // Reset frames and locals
+    for (size_t i = 0; i < vm->locals_top; i++) {
+        microphp_zval_destroy(&vm->locals[i]);
+    }
+    vm->locals_top = 0;
+    vm->frame_count = 0;
+    
+    // Reset globals
+    for (size_t i = 0; i < vm->global_count; i++) {
+        microphp_zval_destroy(&vm->globals[i]);
+        vm->globals[i] = microphp_zval_null();
+    }
+    
+    vm->pc = NULL;
+    vm->running = false;
+    vm->suspended = false;
+    
+    error_clear(vm);
+}
+
+// Error handling
+const char* microphp_get_error(vm_context_t *vm) {
+    return vm ? vm->error_msg : NULL;
+}
+
+void microphp_clear_error(vm_context_t *vm) {
+    if (vm) error_clear(vm);
 }
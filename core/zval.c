@@ -2,24 +2,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 // Zval creation
 zval_t microphp_zval_null(void) {
     zval_t zval;
     zval.type = ZVAL_NULL;
+    zval.flags = 0;
     return zval;
 }
 
 zval_t microphp_zval_bool(bool value) {
     zval_t zval;
     zval.type = ZVAL_BOOL;
+    zval.flags = 0;
     zval.value.bool_val = value;
     return zval;
 }
 
 zval_t microphp_zval_int(int64_t value) {
+#if MICROPHP_INT32_FAST
+    if (value < MICROPHP_INT_MIN || value > MICROPHP_INT_MAX) return microphp_zval_float((double)value);
+#endif
     zval_t zval;
     zval.type = ZVAL_INT;
+    zval.flags = 0;
     zval.value.int_val = value;
     return zval;
 }
@@ -27,36 +34,67 @@ zval_t microphp_zval_int(int64_t value) {
 zval_t microphp_zval_float(double value) {
     zval_t zval;
     zval.type = ZVAL_FLOAT;
+    zval.flags = 0;
     zval.value.float_val = value;
     return zval;
 }
 
-zval_t microphp_zval_string(const char *str, size_t len) {
+zval_t microphp_zval_fixed(int32_t raw) {
+    zval_t zval;
+    zval.type = ZVAL_FIXED;
+    zval.flags = 0;
+    zval.value.int_val = raw;
+    return zval;
+}
+
+// Uninitialized string of len bytes plus terminator: inline when it
+// fits, otherwise one heap block. Null if the allocation fails.
+static zval_t string_reserve(size_t len) {
     zval_t zval;
     zval.type = ZVAL_STRING;
     
-    if (str && len > 0) {
-        zval.value.string_val.str = malloc(len + 1);
-        if (zval.value.string_val.str) {
-            memcpy(zval.value.string_val.str, str, len);
-            zval.value.string_val.str[len] = '\0';
-            zval.value.string_val.len = len;
-        } else {
-            zval.type = ZVAL_NULL;
-            zval.value.string_val.str = NULL;
-            zval.value.string_val.len = 0;
-        }
-    } else {
-        zval.value.string_val.str = NULL;
-        zval.value.string_val.len = 0;
+    if (len <= MICROPHP_SSO_MAX) {
+        zval.flags = ZVAL_FLAG_INLINE;
+        zval.value.small[len] = '\0';
+        zval.value.small[MICROPHP_SSO_SIZE - 1] = (char)len;
+        return zval;
     }
     
+    zval.flags = 0;
+    zval.value.string_val.str = malloc(len + 1);
+    if (!zval.value.string_val.str) {
+        zval.type = ZVAL_NULL;
+        return zval;
+    }
+    zval.value.string_val.str[len] = '\0';
+    zval.value.string_val.len = len;
+    zval.value.string_val.capacity = len;
+    return zval;
+}
+
+zval_t microphp_zval_string(const char *str, size_t len) {
+    if (!str) len = 0;
+    zval_t zval = string_reserve(len);
+    if (zval.type == ZVAL_STRING && len > 0) memcpy(microphp_string_buffer(&zval), str, len);
+    return zval;
+}
+
+zval_t microphp_zval_bytes(const void *data, size_t len) {
+    zval_t zval = string_reserve(len);
+    if (zval.type != ZVAL_STRING) return zval;
+    
+    if (len > 0) {
+        if (data) memcpy(microphp_string_buffer(&zval), data, len);
+        else memset(microphp_string_buffer(&zval), 0, len);
+    }
+    zval.flags |= ZVAL_FLAG_BYTES;
     return zval;
 }
 
 zval_t microphp_zval_array(size_t initial_capacity) {
     zval_t zval;
     zval.type = ZVAL_ARRAY;
+    zval.flags = 0;
     
     if (initial_capacity > 0) {
         zval.value.array_val.data = malloc(initial_capacity * sizeof(zval_t));
@@ -83,13 +121,98 @@ zval_t microphp_zval_array(size_t initial_capacity) {
     return zval;
 }
 
+// Packed numeric arrays: array_val.data holds raw elements of one kind,
+// size and capacity count elements
+static size_t packed_width(int kind) {
+    switch (kind) {
+        case MICROPHP_PACKED_I16: return sizeof(int16_t);
+        case MICROPHP_PACKED_I32: return sizeof(int32_t);
+        case MICROPHP_PACKED_F32: return sizeof(float);
+        default:                  return sizeof(double);
+    }
+}
+
+static zval_t packed_load(const void *data, int kind, size_t i) {
+    switch (kind) {
+        case MICROPHP_PACKED_I16: return microphp_zval_int(((const int16_t*)data)[i]);
+        case MICROPHP_PACKED_I32: return microphp_zval_int(((const int32_t*)data)[i]);
+        case MICROPHP_PACKED_F32: return microphp_zval_float(((const float*)data)[i]);
+        default:                  return microphp_zval_float(((const double*)data)[i]);
+    }
+}
+
+// Truncates like an (int) cast, then saturates to [lo, hi]; NaN gives 0
+static int64_t packed_int(double value, int64_t lo, int64_t hi) {
+    if (isnan(value)) return 0;
+    if (value <= (double)lo) return lo;
+    if (value >= (double)hi) return hi;
+    return (int64_t)value;
+}
+
+static int64_t clamp_int(int64_t value, int64_t lo, int64_t hi) {
+    return value < lo ? lo : value > hi ? hi : value;
+}
+
+static void packed_store_double(void *data, int kind, size_t i, double value) {
+    switch (kind) {
+        case MICROPHP_PACKED_I16: ((int16_t*)data)[i] = (int16_t)packed_int(value, INT16_MIN, INT16_MAX); break;
+        case MICROPHP_PACKED_I32: ((int32_t*)data)[i] = (int32_t)packed_int(value, INT32_MIN, INT32_MAX); break;
+        case MICROPHP_PACKED_F32: ((float*)data)[i] = (float)value; break;
+        default:                  ((double*)data)[i] = value; break;
+    }
+}
+
+static bool is_number(const zval_t *value) {
+    return value->type == ZVAL_INT || value->type == ZVAL_FLOAT || value->type == ZVAL_FIXED;
+}
+
+// value must be a number
+static void packed_store(void *data, int kind, size_t i, const zval_t *value) {
+    if (value->type == ZVAL_FLOAT) {
+        packed_store_double(data, kind, i, value->value.float_val);
+        return;
+    }
+    if (value->type == ZVAL_FIXED) {
+        packed_store_double(data, kind, i, microphp_fixed_to_double((int32_t)value->value.int_val));
+        return;
+    }
+    int64_t n = value->value.int_val;
+    switch (kind) {
+        case MICROPHP_PACKED_I16: ((int16_t*)data)[i] = (int16_t)clamp_int(n, INT16_MIN, INT16_MAX); break;
+        case MICROPHP_PACKED_I32: ((int32_t*)data)[i] = (int32_t)clamp_int(n, INT32_MIN, INT32_MAX); break;
+        default:                  packed_store_double(data, kind, i, (double)n); break;
+    }
+}
+
+// Back to a plain array of zvals, e.g. before storing a string
+static int packed_unpack(zval_t *array) {
+    int kind = array->flags & ZVAL_FLAG_PACKED;
+    size_t size = array->value.array_val.size;
+    size_t capacity = array->value.array_val.capacity;
+    void *raw = array->value.array_val.data;
+    
+    zval_t *data = NULL;
+    if (capacity > 0) {
+        data = malloc(capacity * sizeof(zval_t));
+        if (!data) return -1;
+        for (size_t i = 0; i < capacity; i++) {
+            data[i] = i < size ? packed_load(raw, kind, i) : microphp_zval_null();
+        }
+    }
+    free(raw);
+    array->value.array_val.data = data;
+    array->flags &= ~ZVAL_FLAG_PACKED;
+    return 0;
+}
+
 // Zval destruction
 void microphp_zval_destroy(zval_t *zval) {
     if (!zval) return;
     
     switch (zval->type) {
         case ZVAL_STRING:
-            if (zval->value.string_val.str) {
+            if (zval->flags & ZVAL_FLAG_INLINE) break;
+            if (zval->value.string_val.str && !(zval->flags & ZVAL_FLAG_BORROWED)) {
                 free(zval->value.string_val.str);
                 zval->value.string_val.str = NULL;
             }
@@ -97,7 +220,10 @@ void microphp_zval_destroy(zval_t *zval) {
             break;
             
         case ZVAL_ARRAY:
-            if (zval->value.array_val.data) {
+            if (zval->value.array_val.data && (zval->flags & ZVAL_FLAG_PACKED)) {
+                free(zval->value.array_val.data);
+                zval->value.array_val.data = NULL;
+            } else if (zval->value.array_val.data) {
                 for (size_t i = 0; i < zval->value.array_val.size; i++) {
                     microphp_zval_destroy(&zval->value.array_val.data[i]);
                 }
@@ -119,6 +245,7 @@ void microphp_zval_destroy(zval_t *zval) {
     }
     
     zval->type = ZVAL_NULL;
+    zval->flags = 0;
 }
 
 // Zval copying
@@ -131,6 +258,14 @@ void microphp_zval_copy(zval_t *dest, const zval_t *src) {
     // Copy basic structure
     dest->type = src->type;
     
+    // Borrowed strings stay borrowed: their owner outlives every copy.
+    // Inline strings carry their bytes in the zval.
+    if (src->type == ZVAL_STRING && (src->flags & (ZVAL_FLAG_BORROWED | ZVAL_FLAG_INLINE))) {
+        dest->flags = src->flags;
+        dest->value = src->value;
+        return;
+    }
+    
     switch (src->type) {
         case ZVAL_NULL:
             break;
@@ -140,6 +275,7 @@ void microphp_zval_copy(zval_t *dest, const zval_t *src) {
             break;
             
         case ZVAL_INT:
+        case ZVAL_FIXED:
             dest->value.int_val = src->value.int_val;
             break;
             
@@ -148,37 +284,38 @@ void microphp_zval_copy(zval_t *dest, const zval_t *src) {
             break;
             
         case ZVAL_STRING:
-            if (src->value.string_val.str && src->value.string_val.len > 0) {
-                dest->value.string_val.str = malloc(src->value.string_val.len + 1);
-                if (dest->value.string_val.str) {
-                    memcpy(dest->value.string_val.str, src->value.string_val.str, src->value.string_val.len);
-                    dest->value.string_val.str[src->value.string_val.len] = '\0';
-                    dest->value.string_val.len = src->value.string_val.len;
-                } else {
-                    dest->type = ZVAL_NULL;
-                }
-            } else {
-                dest->value.string_val.str = NULL;
-                dest->value.string_val.len = 0;
-            }
+            *dest = microphp_zval_string(src->value.string_val.str, src->value.string_val.len);
+            if (dest->type == ZVAL_STRING) dest->flags |= src->flags & ZVAL_FLAG_BYTES;
             break;
             
         case ZVAL_ARRAY:
-            if (src->value.array_val.data && src->value.array_val.capacity > 0) {
+            if (src->flags & ZVAL_FLAG_PACKED) {
+                size_t width = packed_width(src->flags & ZVAL_FLAG_PACKED);
+                dest->value.array_val.data = malloc(src->value.array_val.capacity ? src->value.array_val.capacity * width : 1);
+                if (dest->value.array_val.data) {
+                    if (src->value.array_val.size > 0) {
+                        memcpy(dest->value.array_val.data, src->value.array_val.data, src->value.array_val.size * width);
+                    }
+                    dest->flags = src->flags & ZVAL_FLAG_PACKED;
+                    dest->value.array_val.capacity = src->value.array_val.capacity;
+                    dest->value.array_val.size = src->value.array_val.size;
+                } else {
+                    dest->type = ZVAL_NULL;
+                }
+            } else if (src->value.array_val.data && src->value.array_val.capacity > 0) {
                 dest->value.array_val.data = malloc(src->value.array_val.capacity * sizeof(zval_t));
                 if (dest->value.array_val.data) {
                     dest->value.array_val.capacity = src->value.array_val.capacity;
                     dest->value.array_val.size = src->value.array_val.size;
                     
-                    // Copy array elements
+                    // Copy array elements; copying destroys the target
+                    // first, so every slot starts out null
+                    for (size_t i = 0; i < src->value.array_val.capacity; i++) {
+                        dest->value.array_val.data[i] = microphp_zval_null();
+                    }
                     for (size_t i = 0; i < src->value.array_val.size; i++) {
                         microphp_zval_copy(&dest->value.array_val.data[i], &src->value.array_val.data[i]);
                     }
-                    
-                    // Initialize remaining elements to null
-                    for (size_t i = src->value.array_val.size; i < src->value.array_val.capacity; i++) {
-                        dest->value.array_val.data[i] = microphp_zval_null();
-                    }
                 } else {
                     dest->type = ZVAL_NULL;
                 }
@@ -211,19 +348,39 @@ bool microphp_zval_equals(const zval_t *a, const zval_t *b) {
             return a->value.bool_val == b->value.bool_val;
             
         case ZVAL_INT:
+        case ZVAL_FIXED:
             return a->value.int_val == b->value.int_val;
             
         case ZVAL_FLOAT:
             return a->value.float_val == b->value.float_val;
             
         case ZVAL_STRING:
-            if (a->value.string_val.len != b->value.string_val.len) return false;
-            if (a->value.string_val.str == b->value.string_val.str) return true;
-            if (!a->value.string_val.str || !b->value.string_val.str) return false;
-            return memcmp(a->value.string_val.str, b->value.string_val.str, a->value.string_val.len) == 0;
+        {
+            size_t len = microphp_string_len(a);
+            if (len != microphp_string_len(b)) return false;
+            if (len == 0) return true;
+            const char *a_str = microphp_string_data(a);
+            const char *b_str = microphp_string_data(b);
+            if (a_str == b_str) return true;
+            if (!a_str || !b_str) return false;
+            return memcmp(a_str, b_str, len) == 0;
+        }
             
         case ZVAL_ARRAY:
             if (a->value.array_val.size != b->value.array_val.size) return false;
+            if ((a->flags | b->flags) & ZVAL_FLAG_PACKED) {
+                for (size_t i = 0; i < a->value.array_val.size; i++) {
+                    zval_t x = microphp_zval_null();
+                    zval_t y = microphp_zval_null();
+                    microphp_array_get(a, i, &x);
+                    microphp_array_get(b, i, &y);
+                    bool equal = microphp_zval_equals(&x, &y);
+                    microphp_zval_destroy(&x);
+                    microphp_zval_destroy(&y);
+                    if (!equal) return false;
+                }
+                return true;
+            }
             for (size_t i = 0; i < a->value.array_val.size; i++) {
                 if (!microphp_zval_equals(&a->value.array_val.data[i], &b->value.array_val.data[i])) {
                     return false;
@@ -241,10 +398,51 @@ bool microphp_zval_equals(const zval_t *a, const zval_t *b) {
     return false;
 }
 
+// PHP truthiness
+bool microphp_zval_to_bool(const zval_t *zval) {
+    if (!zval) return false;
+    
+    switch (zval->type) {
+        case ZVAL_NULL:
+            return false;
+        case ZVAL_BOOL:
+            return zval->value.bool_val;
+        case ZVAL_INT:
+        case ZVAL_FIXED:
+            return zval->value.int_val != 0;
+        case ZVAL_FLOAT:
+            return zval->value.float_val != 0.0;
+        case ZVAL_STRING:
+            // "" and "0" are falsy
+            if (microphp_string_len(zval) == 0) return false;
+            return !(microphp_string_len(zval) == 1 && microphp_string_data(zval)[0] == '0');
+        case ZVAL_ARRAY:
+            return zval->value.array_val.size > 0;
+        default:
+            return true;
+    }
+}
+
 // Array operations
 int microphp_array_push(zval_t *array, const zval_t *value) {
     if (!array || array->type != ZVAL_ARRAY || !value) return -1;
     
+    if (array->flags & ZVAL_FLAG_PACKED) {
+        if (is_number(value)) {
+            int kind = array->flags & ZVAL_FLAG_PACKED;
+            if (array->value.array_val.size >= array->value.array_val.capacity) {
+                size_t new_capacity = array->value.array_val.capacity == 0 ? 8 : array->value.array_val.capacity * 2;
+                void *new_data = realloc(array->value.array_val.data, new_capacity * packed_width(kind));
+                if (!new_data) return -1;
+                array->value.array_val.data = new_data;
+                array->value.array_val.capacity = new_capacity;
+            }
+            packed_store(array->value.array_val.data, kind, array->value.array_val.size++, value);
+            return 0;
+        }
+        if (packed_unpack(array) != 0) return -1;
+    }
+    
     // Grow array if needed
     if (array->value.array_val.size >= array->value.array_val.capacity) {
         size_t new_capacity = array->value.array_val.capacity == 0 ? 8 : array->value.array_val.capacity * 2;
@@ -271,6 +469,11 @@ int microphp_array_get(const zval_t *array, size_t index, zval_t *result) {
     if (!array || array->type != ZVAL_ARRAY || !result) return -1;
     if (index >= array->value.array_val.size) return -1;
     
+    if (array->flags & ZVAL_FLAG_PACKED) {
+        microphp_zval_destroy(result);
+        *result = packed_load(array->value.array_val.data, array->flags & ZVAL_FLAG_PACKED, index);
+        return 0;
+    }
     microphp_zval_copy(result, &array->value.array_val.data[index]);
     return 0;
 }
@@ -279,6 +482,13 @@ int microphp_array_set(zval_t *array, size_t index, const zval_t *value) {
     if (!array || array->type != ZVAL_ARRAY || !value) return -1;
     if (index >= array->value.array_val.size) return -1;
     
+    if (array->flags & ZVAL_FLAG_PACKED) {
+        if (is_number(value)) {
+            packed_store(array->value.array_val.data, array->flags & ZVAL_FLAG_PACKED, index, value);
+            return 0;
+        }
+        if (packed_unpack(array) != 0) return -1;
+    }
     microphp_zval_destroy(&array->value.array_val.data[index]);
     microphp_zval_copy(&array->value.array_val.data[index], value);
     return 0;
@@ -289,92 +499,457 @@ size_t microphp_array_size(const zval_t *array) {
     return array->value.array_val.size;
 }
 
+zval_t microphp_array_packed(int kind, size_t size) {
+    zval_t zval = microphp_zval_array(0);
+    zval.value.array_val.data = calloc(size ? size : 1, packed_width(kind));
+    if (!zval.value.array_val.data) return microphp_zval_null();
+    zval.value.array_val.size = size;
+    zval.value.array_val.capacity = size;
+    zval.flags = kind & ZVAL_FLAG_PACKED;
+    return zval;
+}
+
+int microphp_array_pack(zval_t *array, int kind) {
+    if (!array || array->type != ZVAL_ARRAY) return -1;
+    if ((array->flags & ZVAL_FLAG_PACKED) == kind) return 0;
+    
+    size_t size = array->value.array_val.size;
+    for (size_t i = 0; i < size && !(array->flags & ZVAL_FLAG_PACKED); i++) {
+        if (!is_number(&array->value.array_val.data[i])) return -1;
+    }
+    
+    zval_t packed = microphp_array_packed(kind, size);
+    if (packed.type != ZVAL_ARRAY) return -1;
+    for (size_t i = 0; i < size; i++) {
+        zval_t value = microphp_zval_null();
+        microphp_array_get(array, i, &value);
+        packed_store(packed.value.array_val.data, kind, i, &value);
+    }
+    microphp_zval_destroy(array);
+    *array = packed;
+    return 0;
+}
+
+int microphp_array_kind(const zval_t *array) {
+    if (!array || array->type != ZVAL_ARRAY) return 0;
+    return array->flags & ZVAL_FLAG_PACKED;
+}
+
+// Reduction kernels: plain loops over the raw buffer. The float ones keep
+// four independent accumulators so the compiler can vectorize them
+// without reassociating a single dependency chain.
+#define SUM_INT_KERNEL(name, type)                                      \
+    static int64_t name(const type *p, size_t n) {                      \
+        int64_t sum = 0;                                                \
+        for (size_t i = 0; i < n; i++) sum += p[i];                     \
+        return sum;                                                     \
+    }
+
+#define SUM_FLOAT_KERNEL(name, type)                                    \
+    static double name(const type *p, size_t n) {                       \
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;                          \
+        size_t i = 0;                                                   \
+        for (; i + 4 <= n; i += 4) {                                    \
+            s0 += p[i];                                                 \
+            s1 += p[i + 1];                                             \
+            s2 += p[i + 2];                                             \
+            s3 += p[i + 3];                                             \
+        }                                                               \
+        for (; i < n; i++) s0 += p[i];                                  \
+        return (s0 + s1) + (s2 + s3);                                   \
+    }
+
+#define MIN_MAX_KERNEL(name, type)                                      \
+    static type name(const type *p, size_t n, bool max) {               \
+        type best = p[0];                                               \
+        if (max) {                                                      \
+            for (size_t i = 1; i < n; i++) best = p[i] > best ? p[i] : best; \
+        } else {                                                        \
+            for (size_t i = 1; i < n; i++) best = p[i] < best ? p[i] : best; \
+        }                                                               \
+        return best;                                                    \
+    }
+
+SUM_INT_KERNEL(sum_i16, int16_t)
+SUM_INT_KERNEL(sum_i32, int32_t)
+SUM_FLOAT_KERNEL(sum_f32, float)
+SUM_FLOAT_KERNEL(sum_f64, double)
+MIN_MAX_KERNEL(min_max_i16, int16_t)
+MIN_MAX_KERNEL(min_max_i32, int32_t)
+MIN_MAX_KERNEL(min_max_f32, float)
+MIN_MAX_KERNEL(min_max_f64, double)
+
+// Plain arrays: ints stay ints until a float (or fixed) value shows up
+static zval_t reduce_plain(const zval_t *data, size_t count, int op) {
+    bool is_float = false;
+    int64_t n = 0;
+    double f = 0;
+    for (size_t i = 0; i < count; i++) {
+        const zval_t *value = &data[i];
+        if (!is_number(value)) return microphp_zval_null();
+        if (value->type != ZVAL_INT && !is_float) {
+            is_float = true;
+            f = (double)n;
+        }
+        double x = value->type == ZVAL_FLOAT ? value->value.float_val :
+                   value->type == ZVAL_FIXED ? microphp_fixed_to_double((int32_t)value->value.int_val) :
+                   (double)value->value.int_val;
+        if (is_float) {
+            if (i == 0 || op == MICROPHP_REDUCE_SUM) f = i == 0 ? x : f + x;
+            else if (op == MICROPHP_REDUCE_MIN) f = x < f ? x : f;
+            else f = x > f ? x : f;
+        } else {
+            int64_t y = value->value.int_val;
+            if (i == 0) n = y;
+            else if (op == MICROPHP_REDUCE_SUM && ((y > 0 && n > INT64_MAX - y) || (y < 0 && n < INT64_MIN - y))) {
+                is_float = true;   // Overflow: the sum goes on as a float, as in PHP
+                f = (double)n + (double)y;
+            }
+            else if (op == MICROPHP_REDUCE_SUM) n += y;
+            else if (op == MICROPHP_REDUCE_MIN) n = y < n ? y : n;
+            else n = y > n ? y : n;
+        }
+    }
+    return is_float ? microphp_zval_float(f) : microphp_zval_int(n);
+}
+
+zval_t microphp_array_reduce(const zval_t *array, size_t start, size_t count, int op) {
+    size_t size = microphp_array_size(array);
+    if (start >= size || count == 0) return microphp_zval_null();
+    if (count > size - start) count = size - start;
+    
+    int kind = array->flags & ZVAL_FLAG_PACKED;
+    const char *raw = (const char*)array->value.array_val.data;
+    if (!kind) return reduce_plain(array->value.array_val.data + start, count, op);
+    
+    const void *p = raw + start * packed_width(kind);
+    bool max = op == MICROPHP_REDUCE_MAX;
+    switch (kind) {
+        case MICROPHP_PACKED_I16:
+            return microphp_zval_int(op == MICROPHP_REDUCE_SUM ? sum_i16(p, count) : min_max_i16(p, count, max));
+        case MICROPHP_PACKED_I32:
+            return microphp_zval_int(op == MICROPHP_REDUCE_SUM ? sum_i32(p, count) : min_max_i32(p, count, max));
+        case MICROPHP_PACKED_F32:
+            return microphp_zval_float(op == MICROPHP_REDUCE_SUM ? sum_f32(p, count) : min_max_f32(p, count, max));
+        default:
+            return microphp_zval_float(op == MICROPHP_REDUCE_SUM ? sum_f64(p, count) : min_max_f64(p, count, max));
+    }
+}
+
+// value * mul + add for every element. Packed arrays keep their kind;
+// plain ones come back as f64.
+zval_t microphp_array_scale(const zval_t *array, double mul, double add) {
+    if (!array || array->type != ZVAL_ARRAY) return microphp_zval_null();
+    
+    zval_t source = microphp_zval_null();
+    microphp_zval_copy(&source, array);
+    int kind = source.flags & ZVAL_FLAG_PACKED;
+    if (!kind) {
+        kind = MICROPHP_PACKED_F64;
+        if (microphp_array_pack(&source, kind) != 0) {
+            microphp_zval_destroy(&source);
+            return microphp_zval_null();
+        }
+    }
+    
+    size_t n = source.value.array_val.size;
+    void *data = source.value.array_val.data;
+    switch (kind) {
+        case MICROPHP_PACKED_F32: {
+            float *p = data;
+            for (size_t i = 0; i < n; i++) p[i] = (float)(p[i] * mul + add);
+            break;
+        }
+        case MICROPHP_PACKED_F64: {
+            double *p = data;
+            for (size_t i = 0; i < n; i++) p[i] = p[i] * mul + add;
+            break;
+        }
+        default:
+            for (size_t i = 0; i < n; i++) {
+                zval_t value = packed_load(data, kind, i);
+                packed_store_double(data, kind, i, (double)value.value.int_val * mul + add);
+            }
+            break;
+    }
+    return source;
+}
+
+// Q16.16 fixed point
+static int32_t fixed_saturate(int64_t value) {
+    return value > INT32_MAX ? INT32_MAX : value < INT32_MIN ? INT32_MIN : (int32_t)value;
+}
+
+int32_t microphp_fixed_from_int(int64_t value) {
+    if (value > INT32_MAX >> MICROPHP_FIXED_FRAC_BITS) return INT32_MAX;
+    if (value < INT32_MIN >> MICROPHP_FIXED_FRAC_BITS) return INT32_MIN;
+    return (int32_t)(value * MICROPHP_FIXED_ONE);
+}
+
+int32_t microphp_fixed_from_double(double value) {
+    if (isnan(value)) return 0;
+    double scaled = value * MICROPHP_FIXED_ONE;
+    if (scaled >= (double)INT32_MAX) return INT32_MAX;
+    if (scaled <= (double)INT32_MIN) return INT32_MIN;
+    return (int32_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+double microphp_fixed_to_double(int32_t raw) {
+    return (double)raw / MICROPHP_FIXED_ONE;
+}
+
+int32_t microphp_fixed_add(int32_t a, int32_t b) {
+    return fixed_saturate((int64_t)a + b);
+}
+
+int32_t microphp_fixed_sub(int32_t a, int32_t b) {
+    return fixed_saturate((int64_t)a - b);
+}
+
+// Rounds to nearest
+int32_t microphp_fixed_mul(int32_t a, int32_t b) {
+    int64_t product = (int64_t)a * b + (1 << (MICROPHP_FIXED_FRAC_BITS - 1));
+    return fixed_saturate(product >> MICROPHP_FIXED_FRAC_BITS);
+}
+
+// Truncates toward zero
+int32_t microphp_fixed_div(int32_t a, int32_t b) {
+    return fixed_saturate((int64_t)a * MICROPHP_FIXED_ONE / b);
+}
+
+int microphp_fixed_format(int32_t raw, char *buf, size_t size) {
+    uint32_t magnitude = raw < 0 ? 0u - (uint32_t)raw : (uint32_t)raw;
+    uint32_t whole = magnitude >> MICROPHP_FIXED_FRAC_BITS;
+    uint32_t frac = (uint32_t)((((uint64_t)(magnitude & (MICROPHP_FIXED_ONE - 1)) * 10000) +
+                                (MICROPHP_FIXED_ONE / 2)) >> MICROPHP_FIXED_FRAC_BITS);
+    if (frac == 10000) {
+        whole++;
+        frac = 0;
+    }
+    
+    char text[24];
+    size_t len = 0;
+    if (raw < 0 && (whole || frac)) text[len++] = '-';
+    len += microphp_utoa(whole, text + len);
+    if (frac) {
+        int digits = 4;
+        while (frac % 10 == 0) {
+            frac /= 10;
+            digits--;
+        }
+        text[len++] = '.';
+        for (int i = digits - 1; i >= 0; i--) {
+            text[len + (size_t)i] = (char)('0' + frac % 10);
+            frac /= 10;
+        }
+        len += (size_t)digits;
+    }
+    
+    if (size > 0) {
+        size_t n = len < size ? len : size - 1;
+        memcpy(buf, text, n);
+        buf[n] = '\0';
+    }
+    return (int)len;
+}
+
 // String operations
+
+// Text of a concatenation operand; numbers are formatted into scratch
+// (MICROPHP_NUM_BUF bytes)
+static void string_operand(const zval_t *v, char *scratch, const char **str, size_t *len) {
+    if (v->type == ZVAL_STRING) {
+        *str = microphp_string_data(v);
+        *len = microphp_string_len(v);
+    } else {
+        *len = microphp_scalar_format(v, scratch);
+        *str = scratch;
+    }
+}
+
 zval_t microphp_string_concat(const zval_t *a, const zval_t *b) {
     if (!a || !b) return microphp_zval_null();
     
-    // Convert to strings if needed
-    const char *a_str = NULL;
-    size_t a_len = 0;
-    const char *b_str = NULL;
-    size_t b_len = 0;
-    
-    if (a->type == ZVAL_STRING) {
-        a_str = a->value.string_val.str;
-        a_len = a->value.string_val.len;
-    } else if (a->type == ZVAL_INT) {
-        // TODO: Convert int to string
-        a_str = "";
-        a_len = 0;
-    } else if (a->type == ZVAL_FLOAT) {
-        // TODO: Convert float to string
-        a_str = "";
-        a_len = 0;
-    }
-    
-    if (b->type == ZVAL_STRING) {
-        b_str = b->value.string_val.str;
-        b_len = b->value.string_val.len;
-    } else if (b->type == ZVAL_INT) {
-        // TODO: Convert int to string
-        b_str = "";
-        b_len = 0;
-    } else if (b->type == ZVAL_FLOAT) {
-        // TODO: Convert float to string
-        b_str = "";
-        b_len = 0;
-    }
-    
-    // Concatenate strings
-    size_t total_len = a_len + b_len;
-    char *result_str = malloc(total_len + 1);
-    if (!result_str) return microphp_zval_null();
-    
-    if (a_str) memcpy(result_str, a_str, a_len);
-    if (b_str) memcpy(result_str + a_len, b_str, b_len);
-    result_str[total_len] = '\0';
-    
-    zval_t result = microphp_zval_string(result_str, total_len);
-    free(result_str);
+    char a_num[MICROPHP_NUM_BUF], b_num[MICROPHP_NUM_BUF];
+    const char *a_str, *b_str;
+    size_t a_len, b_len;
+    string_operand(a, a_num, &a_str, &a_len);
+    string_operand(b, b_num, &b_str, &b_len);
+    
+    // Concatenate straight into the result's storage
+    zval_t result = string_reserve(a_len + b_len);
+    if (result.type != ZVAL_STRING) return result;
     
+    char *result_str = microphp_string_buffer(&result);
+    if (a_len) memcpy(result_str, a_str, a_len);
+    if (b_len) memcpy(result_str + a_len, b_str, b_len);
+    
+    // Appending to a byte buffer (or onto one) gives a byte buffer
+    if ((a->type == ZVAL_STRING && (a->flags & ZVAL_FLAG_BYTES)) ||
+        (b->type == ZVAL_STRING && (b->flags & ZVAL_FLAG_BYTES))) {
+        result.flags |= ZVAL_FLAG_BYTES;
+    }
     return result;
 }
 
+int microphp_string_append_bytes(zval_t *string, const char *data, size_t len) {
+    if (!string) return -1;
+    if (string->type != ZVAL_STRING || (string->flags & ZVAL_FLAG_BORROWED)) {
+        zval_t tail = microphp_zval_string(data, len);
+        int rc = microphp_string_append(string, &tail);
+        microphp_zval_destroy(&tail);
+        return rc;
+    }
+    if (len == 0) return 0;
+    
+    size_t old_len = microphp_string_len(string);
+    size_t new_len = old_len + len;
+    if (new_len < old_len) return -1;
+    
+    if ((string->flags & ZVAL_FLAG_INLINE) && new_len <= MICROPHP_SSO_MAX) {
+        memcpy(string->value.small + old_len, data, len);
+        string->value.small[new_len] = '\0';
+        string->value.small[MICROPHP_SSO_SIZE - 1] = (char)new_len;
+        return 0;
+    }
+    
+    // Out of room: grow the capacity by half (at least to fit), moving
+    // inline bytes to the heap
+    bool inlined = string->flags & ZVAL_FLAG_INLINE;
+    if (inlined || new_len > string->value.string_val.capacity) {
+        size_t capacity = inlined ? MICROPHP_SSO_MAX : string->value.string_val.capacity;
+        capacity += capacity / 2;
+        if (capacity < new_len || capacity == SIZE_MAX) capacity = new_len;
+        char *str = inlined ? malloc(capacity + 1) : realloc(string->value.string_val.str, capacity + 1);
+        if (!str) return -1;
+        if (inlined) memcpy(str, string->value.small, old_len);
+        string->flags &= ~ZVAL_FLAG_INLINE;
+        string->value.string_val.str = str;
+        string->value.string_val.capacity = capacity;
+    }
+    
+    memcpy(string->value.string_val.str + old_len, data, len);
+    string->value.string_val.str[new_len] = '\0';
+    string->value.string_val.len = new_len;
+    return 0;
+}
+
+int microphp_string_append(zval_t *string, const zval_t *value) {
+    if (!string || !value) return -1;
+    
+    if (string->type != ZVAL_STRING || (string->flags & ZVAL_FLAG_BORROWED) || value == string) {
+        zval_t result = microphp_string_concat(string, value);
+        if (result.type != ZVAL_STRING) return -1;
+        microphp_zval_destroy(string);
+        *string = result;
+        return 0;
+    }
+    
+    char num[MICROPHP_NUM_BUF];
+    const char *str;
+    size_t len;
+    string_operand(value, num, &str, &len);
+    if (microphp_string_append_bytes(string, str, len) != 0) return -1;
+    if (value->type == ZVAL_STRING && (value->flags & ZVAL_FLAG_BYTES)) string->flags |= ZVAL_FLAG_BYTES;
+    return 0;
+}
+
 int microphp_string_length(const zval_t *string) {
     if (!string || string->type != ZVAL_STRING) return -1;
-    return (int)string->value.string_val.len;
+    return (int)microphp_string_len(string);
+}
+
+// Seeded FNV-1a; shared by the compiler and VM for switch hash tables.
+// Tables index with the low bits, which plain FNV barely mixes, hence
+// the final avalanche step.
+uint32_t microphp_hash_bytes(const void *data, size_t len, uint32_t seed) {
+    const uint8_t *bytes = data;
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
 }
 
 // Built-in functions
-zval_t microphp_builtin_print(const zval_t *args, size_t count) {
+void microphp_print_write(const zval_t *args, size_t count, microphp_write_fn write, void *user) {
+    char num[MICROPHP_NUM_BUF];
     for (size_t i = 0; i < count; i++) {
         const zval_t *arg = &args[i];
         switch (arg->type) {
             case ZVAL_NULL:
-                printf("NULL");
+                write(user, "NULL", 4);
                 break;
             case ZVAL_BOOL:
-                printf("%s", arg->value.bool_val ? "true" : "false");
+                if (arg->value.bool_val) {
+                    write(user, "true", 4);
+                } else {
+                    write(user, "false", 5);
+                }
                 break;
+            case ZVAL_FLOAT: {
+                // %f: six decimals, and up to 309 whole digits
+                char text[320];
+                size_t len = microphp_dtoa_fixed(arg->value.float_val, 6, text, sizeof(text));
+                write(user, text, len);
+                break;
+            }
             case ZVAL_INT:
-                printf("%lld", arg->value.int_val);
+            case ZVAL_FIXED:
+                write(user, num, microphp_scalar_format(arg, num));
+                break;
+            case ZVAL_STRING:
+                write(user, microphp_string_data(arg), microphp_string_len(arg));
+                break;
+            case ZVAL_ARRAY:
+                write(user, "Array(", 6);
+                write(user, num, microphp_utoa(arg->value.array_val.size, num));
+                write(user, ")", 1);
                 break;
-            case ZVAL_FLOAT:
-                printf("%f", arg->value.float_val);
+            default:
+                write(user, "Unknown type", 12);
                 break;
+        }
+    }
+    write(user, "\n", 1);
+}
+
+void microphp_echo_write(const zval_t *args, size_t count, microphp_write_fn write, void *user) {
+    char num[MICROPHP_NUM_BUF];
+    for (size_t i = 0; i < count; i++) {
+        const zval_t *arg = &args[i];
+        switch (arg->type) {
             case ZVAL_STRING:
-                printf("%.*s", (int)arg->value.string_val.len, arg->value.string_val.str);
+                write(user, microphp_string_data(arg), microphp_string_len(arg));
                 break;
             case ZVAL_ARRAY:
-                printf("Array(%zu)", arg->value.array_val.size);
+                write(user, "Array", 5);
                 break;
             default:
-                printf("Unknown type");
+                write(user, num, microphp_scalar_format(arg, num));
                 break;
         }
     }
-    printf("\n");
-    
+}
+
+static void write_stdout(void *user, const char *data, size_t len) {
+    (void)user;
+    fwrite(data, 1, len, stdout);
+}
+
+zval_t microphp_builtin_print(const zval_t *args, size_t count) {
+    microphp_print_write(args, count, write_stdout, NULL);
+    return microphp_zval_null();
+}
+
+zval_t microphp_builtin_echo(const zval_t *args, size_t count) {
+    microphp_echo_write(args, count, write_stdout, NULL);
     return microphp_zval_null();
 }
 
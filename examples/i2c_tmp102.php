@@ -3,7 +3,7 @@
 // This demonstrates I2C communication and sensor data processing
 
 // Open I2C bus 0 on pins SCL=22, SDA=21 with 400kHz speed
-$i2c = i2c_open(0, scl: 22, sda: 21, speed: 400000);
+$i2c = i2c_open(0, 22, 21, 400000);
 
 if ($i2c === false) {
     echo "Failed to open I2C bus\n";
@@ -18,15 +18,9 @@ $TEMP_REG = 0x00;  // Temperature register
 $TMP102_ADDR = 0x48;  // TMP102 I2C address
 
 while (true) {
-    // Write to pointer register to select temperature register
-    if (i2c_write($i2c, $TMP102_ADDR, [$TEMP_REG]) !== true) {
-        echo "Failed to write to TMP102\n";
-        sleep_ms(2000);
-        continue;
-    }
-    
-    // Read 2 bytes of temperature data
-    $raw_data = i2c_read($i2c, $TMP102_ADDR, 2);
+    // Select the temperature register, then read its 2 bytes, as one
+    // transaction with a repeated start
+    $raw_data = i2c_xfer($i2c, [[0, $TMP102_ADDR, [$TEMP_REG]], [1, $TMP102_ADDR, 2]]);
     
     if ($raw_data === false) {
         echo "Failed to read from TMP102\n";
@@ -20,6 +20,17 @@ int esp32_gpio_write(int pin, bool value);
 bool esp32_gpio_read(int pin);
 int esp32_gpio_set_pull(int pin, int pull);
 
+// GPIO interrupts: isr runs in interrupt context on each selected edge,
+// with the pin level and a microsecond timestamp taken at entry
+#define GPIO_EDGE_RISING   1
+#define GPIO_EDGE_FALLING  2
+#define GPIO_EDGE_BOTH     3
+
+typedef void (*esp32_gpio_isr_t)(int pin, bool level, uint32_t time_us, void *arg);
+
+int esp32_gpio_irq_enable(int pin, int edges, esp32_gpio_isr_t isr, void *arg);
+int esp32_gpio_irq_disable(int pin);
+
 // PWM functions
 typedef struct {
     int channel;
@@ -78,6 +89,23 @@ int esp32_uart_write(int uart_num, const uint8_t *data, size_t len);
 int esp32_uart_read(int uart_num, uint8_t *data, size_t len);
 int esp32_uart_available(int uart_num);
 
+// Asynchronous DMA transfers: done runs in interrupt context with the
+// bytes moved or a negative error. Buffers must stay valid until then,
+// or until the matching abort returns.
+typedef void (*esp32_xfer_done_t)(int result, void *arg);
+
+int esp32_spi_transfer_async(int host, const uint8_t *tx_data, uint8_t *rx_data, size_t len,
+                             esp32_xfer_done_t done, void *arg);
+int esp32_spi_abort(int host);
+int esp32_uart_write_async(int uart_num, const uint8_t *data, size_t len, esp32_xfer_done_t done, void *arg);
+int esp32_uart_read_async(int uart_num, uint8_t *data, size_t len, esp32_xfer_done_t done, void *arg);
+int esp32_uart_abort(int uart_num);
+int esp32_i2c_write_async(int port, uint8_t addr, const uint8_t *data, size_t len,
+                          esp32_xfer_done_t done, void *arg);
+int esp32_i2c_read_async(int port, uint8_t addr, uint8_t *data, size_t len,
+                         esp32_xfer_done_t done, void *arg);
+int esp32_i2c_abort(int port);
+
 // Timer functions
 typedef struct {
     int timer_num;
@@ -107,6 +135,10 @@ int esp32_rtc_set_time(const esp32_rtc_time_t *time);
 void esp32_sleep_ms(uint32_t ms);
 void esp32_sleep_us(uint32_t us);
 
+// Light sleep for up to ms with GPIO and timer wakeups enabled, returning
+// early on an interrupt. A microphp_idle_fn; user is unused.
+void esp32_idle_ms(void *user, uint32_t ms);
+
 // System functions
 uint32_t esp32_get_free_heap(void);
 uint32_t esp32_get_min_free_heap(void);
@@ -20,6 +20,17 @@ int rp2040_gpio_write(int pin, bool value);
 bool rp2040_gpio_read(int pin);
 int rp2040_gpio_set_pull(int pin, int pull);
 
+// GPIO interrupts: isr runs in interrupt context on each selected edge,
+// with the pin level and a microsecond timestamp taken at entry
+#define GPIO_EDGE_RISING   1
+#define GPIO_EDGE_FALLING  2
+#define GPIO_EDGE_BOTH     3
+
+typedef void (*rp2040_gpio_isr_t)(int pin, bool level, uint32_t time_us, void *arg);
+
+int rp2040_gpio_irq_enable(int pin, int edges, rp2040_gpio_isr_t isr, void *arg);
+int rp2040_gpio_irq_disable(int pin);
+
 // PWM functions
 typedef struct {
     int slice;
@@ -79,6 +90,23 @@ int rp2040_uart_write(int uart_num, const uint8_t *data, size_t len);
 int rp2040_uart_read(int uart_num, uint8_t *data, size_t len);
 int rp2040_uart_available(int uart_num);
 
+// Asynchronous DMA transfers: done runs in interrupt context with the
+// bytes moved or a negative error. Buffers must stay valid until then,
+// or until the matching abort returns.
+typedef void (*rp2040_xfer_done_t)(int result, void *arg);
+
+int rp2040_spi_transfer_async(int spi_num, const uint8_t *tx_data, uint8_t *rx_data, size_t len,
+                              rp2040_xfer_done_t done, void *arg);
+int rp2040_spi_abort(int spi_num);
+int rp2040_uart_write_async(int uart_num, const uint8_t *data, size_t len, rp2040_xfer_done_t done, void *arg);
+int rp2040_uart_read_async(int uart_num, uint8_t *data, size_t len, rp2040_xfer_done_t done, void *arg);
+int rp2040_uart_abort(int uart_num);
+int rp2040_i2c_write_async(int i2c_num, uint8_t addr, const uint8_t *data, size_t len,
+                           rp2040_xfer_done_t done, void *arg);
+int rp2040_i2c_read_async(int i2c_num, uint8_t addr, uint8_t *data, size_t len,
+                          rp2040_xfer_done_t done, void *arg);
+int rp2040_i2c_abort(int i2c_num);
+
 // Timer functions
 typedef struct {
     int timer_num;
@@ -108,6 +136,10 @@ int rp2040_rtc_set_time(const rp2040_rtc_time_t *time);
 void rp2040_sleep_ms(uint32_t ms);
 void rp2040_sleep_us(uint32_t us);
 
+// WFI until ms pass or any interrupt arrives. A microphp_idle_fn; user is
+// unused.
+void rp2040_idle_ms(void *user, uint32_t ms);
+
 // System functions
 uint32_t rp2040_get_free_heap(void);
 uint32_t rp2040_get_min_free_heap(void);
@@ -45,6 +45,10 @@ else
     exit 1
 fi
 
+echo
+echo "Compiling and running examples and test scripts..."
+ctest --output-on-failure
+
 echo
 echo "=== All tests passed! ==="
 echo "The micro-PHP project builds successfully."
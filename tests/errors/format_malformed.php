@@ -0,0 +1,3 @@
+<?php
+// A literal printf format that cannot be parsed is a compile error
+printf("%5.", 1);
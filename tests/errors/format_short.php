@@ -0,0 +1,3 @@
+<?php
+// So is one that needs more arguments than the call passes
+$s = sprintf("%s and %s\n", "one");
@@ -0,0 +1,159 @@
+// printf-family formatting (format.c) where PHP differs from C, the
+// malformed and short-of-arguments paths, snprintf-style truncation and
+// number_format
+
+#include "microphp.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+static void check(const char *what, const char *got, int got_len, const char *expected, int expected_len) {
+    if (strcmp(got, expected) == 0 && got_len == expected_len) return;
+    failures++;
+    printf("%s: \"%s\" (%d), expected \"%s\" (%d)\n", what, got, got_len, expected, expected_len);
+}
+
+static void check_format(const char *format, const zval_t *args, size_t count, const char *expected) {
+    char buf[256];
+    int len = microphp_format_buffer(buf, sizeof(buf), format, strlen(format), args, count);
+    check(format, buf, len, expected, (int)strlen(expected));
+}
+
+static void check_rejected(const char *format, const zval_t *args, size_t count) {
+    char buf[64];
+    memcpy(buf, "untouched", 10);
+    int len = microphp_format_buffer(buf, sizeof(buf), format, strlen(format), args, count);
+    check(format, buf, len, "", -1);
+}
+
+static void check_arity(const char *format, int expected) {
+    int arity = microphp_format_arity(format, strlen(format));
+    if (arity == expected) return;
+    failures++;
+    printf("arity of \"%s\": %d, expected %d\n", format, arity, expected);
+}
+
+typedef struct {
+    char text[256];
+    size_t len;
+} sink_t;
+
+static void sink_write(void *user, const char *data, size_t len) {
+    sink_t *sink = user;
+    memcpy(sink->text + sink->len, data, len);
+    sink->len += len;
+    sink->text[sink->len] = '\0';
+}
+
+static void check_number(double value, int decimals, const char *point, const char *sep, const char *expected) {
+    sink_t sink = { "", 0 };
+    int len = microphp_number_format(value, decimals, point, strlen(point), sep, strlen(sep), sink_write, &sink);
+    char what[64];
+    snprintf(what, sizeof(what), "number_format(%.17g, %d)", value, decimals);
+    check(what, sink.text, len, expected, (int)strlen(expected));
+}
+
+static void php_divergences(void) {
+    zval_t i42 = microphp_zval_int(42);
+    zval_t minus3 = microphp_zval_int(-3);
+    zval_t big = microphp_zval_float(12345.678);
+    zval_t tiny = microphp_zval_float(0.00001234);
+    zval_t e20 = microphp_zval_float(1e20);
+    zval_t ab = microphp_zval_string("ab", 2);
+    zval_t pair[2] = { microphp_zval_string("a", 1), microphp_zval_string("b", 1) };
+
+    // Exponents are not padded to two digits
+    check_format("%e", &big, 1, "1.234568e+4");
+    check_format("%.2E", &tiny, 1, "1.23E-5");
+    check_format("%g", &e20, 1, "1.0e+20");
+    check_format("%G", &tiny, 1, "1.234E-5");
+
+    // Space is a padding character, not a sign flag
+    check_format("[% d]", &i42, 1, "[42]");
+    check_format("[% 5d]", &i42, 1, "[   42]");
+    check_format("[%'*6s]", &ab, 1, "[****ab]");
+
+    // Zero padding on the left goes after the sign, on the right it is zeros
+    check_format("[%05d]", &minus3, 1, "[-0003]");
+    check_format("[%-05d]", &minus3, 1, "[-3000]");
+    check_format("[%-5s]", &ab, 1, "[ab   ]");
+
+    check_format("%+d %+d", (zval_t[]){ i42, minus3 }, 2, "+42 -3");
+    check_format("%u", &minus3, 1, "18446744073709551613");
+    check_format("%b %o %X", (zval_t[]){ i42, i42, i42 }, 3, "101010 52 2A");
+    check_format("%c%c", (zval_t[]){ microphp_zval_int('o'), microphp_zval_int('k') }, 2, "ok");
+    check_format("%.1s|%5.1f|%F", (zval_t[]){ ab, big, big }, 3, "a|12345.7|12345.678000");
+    check_format("%2$s %1$s %2$s", pair, 2, "b a b");
+    check_format("100%%", NULL, 0, "100%");
+    check_format("%s", &e20, 1, "1.0E+20");
+    // (int) of an out-of-range float wraps, to the int width
+    check_format("%d", &e20, 1, MICROPHP_INT32_FAST ? "1661992960" : "7766279631452241920");
+}
+
+static void rejected(void) {
+    zval_t one = microphp_zval_int(1);
+
+    // Malformed
+    check_rejected("%", &one, 1);
+    check_rejected("abc%", &one, 1);
+    check_rejected("%y", &one, 1);
+    check_rejected("%0$s", &one, 1);
+    check_rejected("%'", &one, 1);
+    check_rejected("%5.", &one, 1);
+    check_rejected("%99999999999d", &one, 1);
+
+    // Short of arguments; nothing is written before the check
+    check_rejected("%s %s", &one, 1);
+    check_rejected("x%2$s", &one, 1);
+    check_rejected("%d", NULL, 0);
+
+    check_arity("", 0);
+    check_arity("plain %% text", 0);
+    check_arity("%s %d %f", 3);
+    check_arity("%3$s %s", 3);
+    check_arity("%1$s %1$s", 1);
+    check_arity("%s %1$s %s", 2);
+    check_arity("%", -1);
+    check_arity("%q", -1);
+    check_arity("%0$s", -1);
+}
+
+static void truncation(void) {
+    zval_t word = microphp_zval_string("formatted", 9);
+    char buf[8];
+
+    int len = microphp_format_buffer(buf, sizeof(buf), "[%s]", 4, &word, 1);
+    check("truncated", buf, len, "[format", 11);
+
+    memcpy(buf, "xyz", 4);
+    len = microphp_format_buffer(buf, 0, "%s", 2, &word, 1);
+    check("size 0", buf, len, "xyz", 9);
+}
+
+static void number_format(void) {
+    check_number(1234.5678, 2, ".", ",", "1,234.57");
+    check_number(1234567.891, 2, ",", ".", "1.234.567,89");
+    check_number(1234.5, 0, ".", ",", "1,235");
+    check_number(0.5, 0, ".", ",", "1");
+    check_number(1.005, 2, ".", ",", "1.01");
+    check_number(-1234.567, 1, ".", " ", "-1 234.6");
+    check_number(-0.4, 0, ".", ",", "0");
+    check_number(999.999, 2, ".", ",", "1,000.00");
+    check_number(0, 3, ".", ",", "0.000");
+    check_number(1234.5, 1, "::", "", "1234::5");
+    check_number(100000, -2, ".", ",", "100,000");
+}
+
+int main(void) {
+    php_divergences();
+    rejected();
+    truncation();
+    number_format();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
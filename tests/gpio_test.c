@@ -0,0 +1,128 @@
+// GPIO edges posted as an ISR would: each queued edge runs the handler in
+// order, edges on a pin without one are skipped, and posts past a full
+// ring of MICROPHP_EVENTS_MAX are refused and counted. Takes the compiled
+// gpio_test.php.
+
+#include "microphp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The core's defaults
+#ifndef MICROPHP_EVENTS_MAX
+#define MICROPHP_EVENTS_MAX 32
+#endif
+#ifndef MICROPHP_GPIO_PINS
+#define MICROPHP_GPIO_PINS 48
+#endif
+
+#define OVERFLOW 5
+
+static int failures = 0;
+
+static void expect(const char *what, unsigned long got, unsigned long expected) {
+    if (got == expected) return;
+    failures++;
+    printf("%s: %lu, expected %lu\n", what, got, expected);
+}
+
+typedef struct {
+    char text[4096];
+    size_t len;
+} sink_t;
+
+static size_t sink_write(void *user, const char *data, size_t len) {
+    sink_t *sink = user;
+    if (len > sizeof(sink->text) - 1 - sink->len) len = sizeof(sink->text) - 1 - sink->len;
+    memcpy(sink->text + sink->len, data, len);
+    sink->len += len;
+    sink->text[sink->len] = '\0';
+    return len;
+}
+
+static uint8_t* read_file(const char *filename, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <gpio_test.mbc>\n", argv[0]);
+        return 2;
+    }
+    size_t size;
+    uint8_t *data = read_file(argv[1], &size);
+    vm_context_t *vm = data ? microphp_vm_create() : NULL;
+    if (!vm || microphp_vm_load_bytecode(vm, data, size) != 0) {
+        fprintf(stderr, "Error: cannot load '%s'\n", argv[1]);
+        return 1;
+    }
+    free(data);
+
+    sink_t sink = { "", 0 };
+    microphp_vm_set_output(vm, sink_write, &sink);
+
+    // Step the script until it has attached its handler
+    int rc = MICROPHP_RUN_YIELDED;
+    while (rc == MICROPHP_RUN_YIELDED && !strstr(sink.text, "armed\n")) {
+        rc = microphp_vm_run_slice(vm, 1);
+        microphp_output_flush(vm);
+    }
+    expect("armed", strstr(sink.text, "armed\n") != NULL, 1);
+
+    // An edge on a pin without a handler takes a slot but prints nothing;
+    // one outside the pin range is refused without counting as a drop
+    char expected[4096] = "armed\n";
+    size_t accepted = 0;
+    expect("post to pin 5", microphp_gpio_post(vm, 5, true, 1), 1);
+    accepted++;
+    expect("post to pin -1", microphp_gpio_post(vm, -1, true, 2), 0);
+    expect("post to pin MICROPHP_GPIO_PINS", microphp_gpio_post(vm, MICROPHP_GPIO_PINS, true, 3), 0);
+    for (uint32_t i = 0; i < MICROPHP_EVENTS_MAX + OVERFLOW; i++) {
+        bool level = (i & 1) == 0;
+        uint32_t time_us = 100 + i * 10;
+        bool queued = microphp_gpio_post(vm, 4, level, time_us);
+        expect("post to pin 4", queued, accepted < MICROPHP_EVENTS_MAX);
+        if (queued) {
+            accepted++;
+            size_t len = strlen(expected);
+            snprintf(expected + len, sizeof(expected) - len, "4 %s %lu\n", level ? "rise" : "fall",
+                     (unsigned long)time_us);
+        }
+    }
+    expect("dropped", microphp_gpio_dropped(vm), OVERFLOW + 1);
+
+    while (rc == MICROPHP_RUN_YIELDED) {
+        rc = microphp_vm_run_slice(vm, 0);
+    }
+    microphp_output_flush(vm);
+    strcat(expected, "done\n");
+    expect("run", rc, MICROPHP_RUN_DONE);
+    if (strcmp(sink.text, expected) != 0) {
+        failures++;
+        printf("output:\n%s\nexpected:\n%s\n", sink.text, expected);
+    }
+
+    // The ring has room again once the handlers drained it
+    expect("post after draining", microphp_gpio_post(vm, 4, true, 0), 1);
+    expect("dropped after draining", microphp_gpio_dropped(vm), OVERFLOW + 1);
+    microphp_vm_destroy(vm);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+<?php
+// Run by gpio_test: reports each edge the host posts on pin 4
+
+function edge($pin, $level, $time_us) {
+    echo $pin, $level ? " rise " : " fall ", $time_us, "\n";
+}
+
+gpio_on(4, 3, "edge");
+echo "armed\n";
+for ($i = 0; $i < 10; $i++) {
+    sleep_ms(1);
+}
+echo "done\n";
@@ -0,0 +1,75 @@
+// Host runner for the tests: runs an MBC program on the virtual clock and
+// writes its output to stdout
+#include "microphp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLICE_BUDGET 1
+
+static uint8_t* read_file(const char *filename, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = length >= 0 ? malloc((size_t)length + 1) : NULL;
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long horizon_ms = 0;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            horizon_ms = strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [-t horizon_ms] <program.mbc>\n", argv[0]);
+        return 2;
+    }
+    
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    if (!data) {
+        fprintf(stderr, "Error: Cannot read '%s'\n", path);
+        return 2;
+    }
+    
+    vm_context_t *vm = microphp_vm_create();
+    if (!vm) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(data);
+        return 1;
+    }
+    if (microphp_vm_load_bytecode(vm, data, size) != 0) {
+        fprintf(stderr, "Error: %s\n", microphp_get_error(vm));
+        microphp_vm_destroy(vm);
+        free(data);
+        return 1;
+    }
+    free(data);
+    
+    // With a horizon, scripts that never finish (a blink loop) stop once
+    // that much virtual time has passed
+    int rc;
+    do {
+        rc = microphp_vm_run_slice(vm, horizon_ms ? SLICE_BUDGET : 0);
+    } while (rc == MICROPHP_RUN_YIELDED && microphp_vm_millis(vm) < horizon_ms);
+    
+    microphp_output_flush(vm);
+    fflush(stdout);
+    if (rc < 0) fprintf(stderr, "Error: %s\n", microphp_get_error(vm));
+    microphp_vm_destroy(vm);
+    return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+// Number formatting against the C library: microphp_dtoa/ftoa as %.*G,
+// microphp_dtoa_fixed as %.*f and shortest digits reading back exactly,
+// over random doubles from a fixed seed, plus the PHP layout echo uses
+
+#include "microphp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define ITERATIONS 300000
+#define REPORT_MAX 20
+
+static int failures = 0;
+
+static void fail(const char *what, double value, const char *got, const char *expected) {
+    if (failures++ < REPORT_MAX) printf("%s %.17g: \"%s\", expected \"%s\"\n", what, value, got, expected);
+}
+
+static uint64_t seed = 88172645463325252ULL;
+
+static uint64_t next_random(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+// Every bit pattern, small fractions and wide binary exponents in turn
+static double random_double(int i) {
+    uint64_t r = next_random();
+    double value;
+    switch (i % 3) {
+        case 0:
+            memcpy(&value, &r, sizeof(value));
+            return value;
+        case 1:
+            return (double)((int64_t)(r % 2000000) - 1000000) / (double)(1 + next_random() % 1000);
+        default:
+            return ldexp((double)(r >> 11), (int)(next_random() % 200) - 150);
+    }
+}
+
+static void fuzz(void) {
+    char got[512], expected[512];
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        double value = random_double(i);
+        if (!isfinite(value)) continue;
+
+        int precision = (int)(next_random() % 18);
+        if (precision > 0) {
+            microphp_dtoa(value, precision, got);
+            snprintf(expected, sizeof(expected), "%.*G", precision, value);
+            if (strcmp(got, expected) != 0) fail("dtoa", value, got, expected);
+        } else {
+            microphp_dtoa(value, 0, got);
+            if (strtod(got, NULL) != value) fail("shortest", value, got, "a round trip");
+        }
+
+        float single = (float)value;
+        if (isfinite(single)) {
+            int digits = 1 + (int)(next_random() % 9);
+            microphp_ftoa(single, digits, got);
+            snprintf(expected, sizeof(expected), "%.*G", digits, (double)single);
+            if (strcmp(got, expected) != 0) fail("ftoa", single, got, expected);
+            microphp_ftoa(single, 0, got);
+            if (strtof(got, NULL) != single) fail("shortest float", single, got, "a round trip");
+        }
+
+        int decimals = (int)(next_random() % 20);
+        if (fabs(value) < 1e30) {
+            microphp_dtoa_fixed(value, decimals, got, sizeof(got));
+            snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+            if (strcmp(got, expected) != 0) fail("fixed", value, got, expected);
+        }
+    }
+}
+
+// What echo prints: %.14G digits (with float32, at most the 9 that read
+// back), a one-digit mantissa keeping ".0" and the exponent unpadded, as
+// PHP does; either way the exponent starts at 1e15
+static void php_layout(void) {
+#if MICROPHP_FLOAT_PRECISION == 14
+    static const struct {
+        double value;
+        const char *text;
+    } cases[] = {
+        { 1e15, "1.0E+15" },
+        { 1e20, "1.0E+20" },
+        { -1e15, "-1.0E+15" },
+        { 1e14, "1.0E+14" },
+        { 1e13, "10000000000000" },
+        { 1.5e20, "1.5E+20" },
+        { 1e-5, "1.0E-5" },
+        { 1.25e-7, "1.25E-7" },
+        { 0.0001, "0.0001" },
+        { 1e30, "1.0E+30" },
+        { 0.1 + 0.2, "0.3" },
+        { -0.0, "-0" },
+        { 2.5, "2.5" },
+#ifdef MICROPHP_FLOAT64
+        { 1e100, "1.0E+100" },
+        { 123456789012345678.0, "1.2345678901235E+17" },
+        { 3.14159265358979, "3.1415926535898" },
+#else
+        { 123456789012345678.0, "1.2345679E+17" },
+        { 3.14159265358979, "3.1415927" },
+        { 16777217.0, "16777216" },
+#endif
+    };
+    char got[MICROPHP_NUM_BUF];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        microphp_float_format(cases[i].value, got);
+        if (strcmp(got, cases[i].text) != 0) fail("float_format", cases[i].value, got, cases[i].text);
+    }
+
+    // The plain %G form stays C's
+    microphp_dtoa(1e15, 14, got);
+    if (strcmp(got, "1E+15") != 0) fail("dtoa", 1e15, got, "1E+15");
+#endif
+}
+
+int main(void) {
+    fuzz();
+    php_layout();
+
+    if (failures > 0) {
+        printf("%d mismatches\n", failures);
+        return 1;
+    }
+    return 0;
+}
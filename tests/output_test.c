@@ -0,0 +1,92 @@
+// Buffered output with a blocking policy: a sink that makes room ends the
+// wait, one that never takes anything only holds a write up for wait_ms
+// before the rest is dropped and counted
+
+#include "microphp.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+static void expect(const char *what, unsigned long got, unsigned long expected) {
+    if (got == expected) return;
+    failures++;
+    printf("%s: %lu, expected %lu\n", what, got, expected);
+}
+
+static size_t refuse(void *user, const char *data, size_t len) {
+    (void)user;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+// Takes nothing for the first few offers, then everything
+typedef struct {
+    int refusals;
+    size_t taken;
+} slow_sink_t;
+
+static size_t slow(void *user, const char *data, size_t len) {
+    slow_sink_t *sink = user;
+    (void)data;
+    if (sink->refusals > 0) {
+        sink->refusals--;
+        return 0;
+    }
+    sink->taken += len;
+    return len;
+}
+
+static void blocking(vm_context_t *vm, uint32_t wait_ms) {
+    microphp_output_policy_t policy = { 0, false, 0, MICROPHP_OUTPUT_BLOCK, wait_ms };
+    microphp_vm_set_output_policy(vm, &policy);
+}
+
+int main(void) {
+    char text[1000];
+    memset(text, 'x', sizeof(text));
+
+    vm_context_t *vm = microphp_vm_create();
+    if (!vm) return 1;
+
+    // A dead sink: each full ring waits wait_ms, then the write gives up
+    microphp_vm_set_output(vm, refuse, NULL);
+    blocking(vm, 5);
+    uint32_t start = microphp_vm_millis(vm);
+    microphp_output_write(vm, text, sizeof(text));
+    expect("dropped", microphp_output_dropped(vm), sizeof(text) - microphp_output_flush(vm));
+    expect("waited ms", microphp_vm_millis(vm) - start, 5);
+
+    // Still full: the next write waits again, then drops all of it
+    microphp_output_write(vm, text, 10);
+    expect("dropped after a second write", microphp_output_dropped(vm), sizeof(text) - microphp_output_flush(vm) + 10);
+    microphp_vm_destroy(vm);
+
+    // wait_ms 0 takes the default bound instead of waiting forever
+    vm = microphp_vm_create();
+    if (!vm) return 1;
+    microphp_vm_set_output(vm, refuse, NULL);
+    blocking(vm, 0);
+    microphp_output_write(vm, text, sizeof(text));
+    expect("dropped with the default wait", microphp_output_dropped(vm) > 0, 1);
+    microphp_vm_destroy(vm);
+
+    // A slow sink: the write waits for it and nothing is lost
+    vm = microphp_vm_create();
+    if (!vm) return 1;
+    slow_sink_t sink = { 3, 0 };
+    microphp_vm_set_output(vm, slow, &sink);
+    blocking(vm, 50);
+    microphp_output_write(vm, text, sizeof(text));
+    expect("remaining", microphp_output_flush(vm), 0);
+    expect("dropped by a slow sink", microphp_output_dropped(vm), 0);
+    expect("taken", sink.taken, sizeof(text));
+    microphp_vm_destroy(vm);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
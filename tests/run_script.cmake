@@ -0,0 +1,33 @@
+# Compiles SCRIPT at OPT (with any further compiler FLAGS, separated by
+# semicolons), runs it for at most HORIZON virtual ms and, when EXPECTED
+# is set, compares its output with that file
+
+get_filename_component(name ${SCRIPT} NAME_WE)
+set(program ${WORK_DIR}/${name}${OPT}.mbc)
+
+execute_process(
+    COMMAND ${COMPILER} ${OPT} ${FLAGS} ${SCRIPT} -o ${program}
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SCRIPT} does not compile at ${OPT}:\n${output}")
+endif()
+
+execute_process(
+    COMMAND ${RUNNER} -t ${HORIZON} ${program}
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SCRIPT} fails at ${OPT}:\n${output}${errors}")
+endif()
+
+if(EXPECTED)
+    file(READ ${EXPECTED} expected)
+    if(NOT output STREQUAL expected)
+        file(WRITE ${WORK_DIR}/${name}${OPT}.actual "${output}")
+        message(FATAL_ERROR "${SCRIPT} output differs at ${OPT}; "
+            "got ${WORK_DIR}/${name}${OPT}.actual, expected ${EXPECTED}")
+    endif()
+endif()
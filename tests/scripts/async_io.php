@@ -0,0 +1,54 @@
+<?php
+// Asynchronous transfers on the simulated wire: a task waiting on one
+// lets the others run, it completes after its wire time, and io_await
+// returns the bytes moved (the count for writes)
+
+function ticker($n) {
+    for ($i = 0; $i < $n; $i++) {
+        echo "tick ", millis(), "\n";
+        sleep_ms(30);
+    }
+}
+
+task_spawn("ticker", 5);
+
+// 1152 bytes at 115200 baud, ten bits a byte: 100 ms
+$start = millis();
+$h = uart_write_async(0, bytes(1152));
+echo "uart started at ", millis() - $start, "\n";
+echo "uart wrote ", io_await($h), " at ", millis() - $start, "\n";
+echo "await again: ", io_await($h) === false ? "false" : "?", "\n";
+
+// Full-duplex SPI reads back what it sent: 5000 bytes at 10 MHz, 4 ms
+$tx = bytes(5000);
+$tx[0] = 0xA5;
+$tx[4999] = 0x5A;
+$start = millis();
+$h = spi_xfer_async(1, $tx);
+$polls = 0;
+while (!io_done($h)) {
+    $polls++;
+    sleep_ms(1);
+}
+$rx = io_await($h);
+echo "spi done at ", millis() - $start, " after ", $polls, " polls: ", bytes_len($rx), " ", $rx[0], " ", $rx[4999], "\n";
+
+// Two in flight at once finish on their own clocks
+$start = millis();
+$read = uart_read_async(2, 288);
+$write = i2c_write_async(0, 0x48, bytes([1, 0x60]));
+$w = io_await($write);
+echo "i2c wrote ", $w, " at ", millis() - $start, "\n";
+$r = io_await($read);
+echo "uart read ", bytes_len($r), " zeros ", $r[0] + $r[287], " at ", millis() - $start, "\n";
+
+// Only MICROPHP_IO_MAX transfers are in flight at a time
+$handles = [];
+for ($i = 0; $i < 5; $i++) {
+    $handles[] = uart_write_async(0, "abcd");
+}
+echo $handles[3] !== false ? "four started" : "?", ", fifth ", $handles[4] === false ? "refused" : "?", "\n";
+for ($i = 0; $i < 4; $i++) {
+    io_await($handles[$i]);
+}
+echo "main done at ", millis(), "\n";
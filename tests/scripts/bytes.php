@@ -0,0 +1,35 @@
+<?php
+// Byte buffers: byte-valued indexing, append, pack/unpack, slices,
+// copy on write and transfer results
+
+$b = bytes(4);
+echo bytes_len($b), " ", $b[0], "\n";
+$b[0] = 0x12; $b[1] = 0x34; $b[3] = 255; $b[] = 7;
+echo $b[0], " ", $b[1], " ", $b[-1], " len ", bytes_len($b), "\n";
+echo bytes_unpack($b, "u16le"), " ", bytes_unpack($b, "u16be"), " ", bytes_unpack($b, "i8", 3), " ", bytes_unpack($b, "u32be", 1), "\n";
+
+$p = bytes_pack("i16be", -2) . bytes_pack("float", 1.5) . bytes_pack("f64be", -0.25);
+echo bytes_len($p), " ", $p[0], " ", $p[1], " ", bytes_unpack($p, "i16be"), " ", bytes_unpack($p, "f32le", 2), " ", bytes_unpack($p, "f64be", 6), "\n";
+
+$s = bytes_slice($b, 1, 2);
+echo bytes_len($s), " ", $s[0], "\n";
+$c = bytes("AB");
+$d = bytes([1, 2, 300]);
+echo $c[1], " ", $d === false ? "false" : "?", "\n";
+$str = "AB";
+$x = (string)$c;
+echo $str[1], " ", $x[0], "\n";
+echo bytes_unpack($b, "u64le") === false ? "badfmt" : "?", " ", bytes_unpack($b, "u32le", 3) === false ? "oob" : "?", "\n";
+
+$r = i2c_xfer(0, [[0, 0x48, [0]], [1, 0x48, 2]]);
+echo bytes_len($r), " ", $r[0], $r[1], "\n";
+
+$q = $c;
+$q[0] = 0x61;
+echo $c[0], " ", $q[0], "\n";
+
+$sum = 0;
+$big = bytes(512);
+for ($i = 0; $i < 512; $i++) { $big[$i] = $i; }
+for ($i = 0; $i < 512; $i++) { $sum += $big[$i]; }
+echo $sum, "\n";
@@ -0,0 +1,23 @@
+<?php
+// Dead code, jump threading and block layout: continue/break across
+// nested loops, constant conditions, and code after return
+
+$n = 0;
+while (true) {
+    $n++;
+    if ($n > 5 && $n % 2 == 0) { continue; }
+    if ($n >= 20) break;
+    echo $n, " ";
+}
+echo "\n";
+
+for ($i = 0; $i < 3; $i++) { for ($j = 0; $j < 3; $j++) { if ($j == 1) continue 2; echo $i, $j, " "; } }
+echo "\n";
+
+function f($x) { if ($x) { return 1; } else { return 2; } echo "dead"; }
+echo f(true), f(false), "\n";
+
+$a = 3; $b = $a > 2 || $a < 0 ? "y" : "n"; echo $b, "\n";
+while (false) { echo "never"; }
+if (true) { echo "always\n"; } else { echo "never\n"; }
+if (!($a == 3 && $b == "y")) echo "bad\n"; else echo "good\n";
@@ -0,0 +1,53 @@
+<?php
+// DSP built-ins against known answers: FFT bins of a cosine on a DC
+// offset, FIR state carried across blocks, levels, biquad gain at DC and
+// blocks the FFT does not take
+
+// 0.5 + 2 cos(2 pi k / 4) over 16 samples: bin 0 is 16 * 0.5, bin 4 is
+// 16 / 2 * 2, every other bin 0
+$x = [];
+for ($k = 0; $k < 16; $k++) {
+    $c = [1, 0, -1, 0][$k % 4];
+    $x[] = 0.5 + 2 * $c;
+}
+$bins = dsp_fft($x);
+$rest = 0.0;
+for ($k = 1; $k <= 8; $k++) {
+    if ($k != 4 && $bins[$k] > $rest) $rest = $bins[$k];
+}
+echo "dc ", number_format($bins[0], 3), " bin4 ", number_format($bins[4], 3),
+     " rest ", number_format($rest, 3), "\n";
+
+// A two-tap average: the first output of the second block sees the last
+// sample of the first
+$fir = dsp_fir([0.5, 0.5]);
+$a = dsp_filter($fir, [2, 4]);
+$b = dsp_filter($fir, [6, 8]);
+echo "fir ", $a[0], " ", $a[1], " ", $b[0], " ", $b[1], "\n";
+echo "free ", dsp_free($fir) ? "ok" : "?", " again ", dsp_free($fir) ? "?" : "false", "\n";
+
+echo "rms ", number_format(dsp_rms([3, -4, 3, -4]), 4), " peak ", dsp_peak([1, -5, 2]), "\n";
+
+// Settled on a constant input a lowpass passes it, a highpass blocks it
+$ones = [];
+for ($i = 0; $i < 200; $i++) {
+    $ones[] = 1.0;
+}
+$lp = dsp_biquad("lowpass", 100 / 1000, 0.707);
+$hp = dsp_biquad("highpass", 100 / 1000, 0.707);
+$low = dsp_filter($lp, $ones);
+$high = dsp_filter($hp, $ones);
+echo "dc gain lowpass ", number_format($low[199], 3), " highpass ", number_format(abs_of($high[199]), 3), "\n";
+
+// Coefficients as given: two cascaded sections of gain 0.5
+$half = dsp_biquad([0.5, 0, 0, 0, 0, 0.5, 0, 0, 0, 0]);
+$q = dsp_filter($half, [8, -4]);
+echo "cascade ", $q[0], " ", $q[1], "\n";
+
+echo "fft of 12 ", dsp_fft([1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12]) === false ? "false" : "?",
+     " of 0 ", dsp_fft([]) === false ? "false" : "?", "\n";
+echo "bad biquad ", dsp_biquad([1, 2, 3]) === false ? "false" : "?", "\n";
+
+function abs_of($v) {
+    return $v < 0 ? -$v : $v;
+}
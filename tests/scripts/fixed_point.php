@@ -0,0 +1,31 @@
+<?php
+// Compiled with --fixed: float literals are Q16.16, arithmetic on them
+// and on them with ints saturates at the ends of the range, and echo
+// prints up to four decimals
+
+$a = 1.5;
+$b = 0.25;
+echo $a + $b, " ", $a - $b, " ", $a * $b, " ", $a / $b, " ", -$a, "\n";
+
+// Mixed with ints the result stays fixed
+$n = 3;
+echo $a * $n, " ", $n - $a, " ", $n / 2.0, " ", $a + 1, " ", 7 * 0.1, "\n";
+echo $a > $n ? "more" : "less", " ", $a == 1.5 ? "equal" : "?", " ", 2.0 == 2 ? "equal" : "?", "\n";
+
+// Saturates instead of wrapping
+$big = 30000.0;
+echo $big + $big, " ", -$big - $big, " ", $big * 4, " ", 1.0 / 0.0001, "\n";
+echo fixed(40000), " ", fixed(-40000), "\n";
+
+// Raw values for registers and back
+echo fixed_raw(1.0), " ", fixed_raw(-0.5), " ", fixed_raw(0.0001), "\n";
+echo fixed_from_raw(98304), " ", fixed_from_raw(1), " ", fixed_from_raw(-65536), " ", fixed_from_raw(PHP_INT_MAX), "\n";
+
+// At most four decimals, trailing zeros dropped
+echo 3.14159, " ", 0.5, " ", 2.0, " ", -0.0625, " ", 1.0 / 3, " ", 0.00001, "\n";
+
+$t = 0.0;
+for ($i = 0; $i < 10; $i++) {
+    $t = $t + 0.1;
+}
+echo $t, " ", (int)$t, " ", (float)7, "\n";
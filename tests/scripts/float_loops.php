@@ -0,0 +1,35 @@
+<?php
+// Loops the counted-loop fusion must leave alone: the pwm_fade duty
+// ramps step a float by 0.02, so they stay LTE_F/ADD_F loops, and their
+// trip counts follow the float rounding
+
+function ramp($from, $to, $step) {
+    $n = 0;
+    for ($duty = $from; $duty <= $to; $duty += $step) {
+        $n++;
+    }
+    return $n . " " . $duty;
+}
+
+$up = 0;
+for ($duty = 0.0; $duty <= 1.0; $duty += 0.02) {
+    $up++;
+}
+echo $up, " ", $duty, "\n";
+
+$down = 0;
+for ($duty = 1.0; $duty >= 0.0; $duty -= 0.02) {
+    $down++;
+}
+echo $down, " ", $duty, "\n";
+
+echo ramp(0.0, 1.0, 0.02), "\n";
+echo ramp(0, 2.5, 1), "\n";
+echo ramp(0.5, 3, 1), "\n";
+
+// An int counter against a float bound
+$n = 0;
+for ($i = 0; $i < 2.5; $i++) {
+    $n++;
+}
+echo $n, " ", $i, "\n";
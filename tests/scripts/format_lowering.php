@@ -0,0 +1,40 @@
+<?php
+// printf as a statement becomes echo and sprintf a concatenation from -O1
+// when the format is only %s, %d and %%; output must not change
+
+function tag($n) {
+    echo "[", $n, "]";
+    return $n;
+}
+
+printf("x=%d y=%s\n", 3.7, "a");
+printf("%d%% done\n", "42abc");
+printf("plain\n");
+printf("");
+printf("%s|%s|%s|%s\n", true, false, null, 2.50);
+printf("%s %d\n", 1e15, -1.9);
+printf("%s\n", [1, 2]);
+
+$s = sprintf("%d", 42.9);
+echo $s, " ", $s . "", "\n";
+$s = sprintf("%d%%", 7);
+echo $s, "\n";
+$s = sprintf("");
+echo "[", $s, "]\n";
+$s = sprintf("%s", 12) . sprintf("%s", 0.1 + 0.2);
+echo $s, "\n";
+$s = sprintf("%s/%s", [1], "x");
+echo $s, "\n";
+
+// Arguments are evaluated once, left to right
+printf("%s-%s\n", tag(1), tag(2));
+$s = sprintf("%d+%d", tag(3), tag(4));
+echo " ", $s, "\n";
+
+// Left to the runtime formatter
+printf("%05d|%-4s|%x\n", 42, "ab", 255);
+printf("%2\$s %1\$s\n", "a", "b");
+$s = sprintf("%.2f", 3.14159);
+echo $s, "\n";
+$n = printf("%s\n", "counted");
+echo $n, "\n";
@@ -0,0 +1,21 @@
+<?php
+// Tickless idle: tasks and a timer whose wakeups fall close together
+// share one sleep, each running at most the idle slack late
+
+function a($ms) {
+    for ($i = 0; $i < 10; $i++) { sleep_ms($ms); }
+    echo "a($ms) done ", millis(), "\n";
+}
+
+function t($id) {
+    global $n;
+    $n++;
+    if ($n == 10) { timer_cancel($id); echo "timer done ", millis(), "\n"; }
+}
+
+$n = 0;
+task_spawn("a", 100);
+task_spawn("a", 103);
+timer_every(97, "t");
+$x = 0;
+for ($i = 0; $i < 50000; $i++) { $x += $i; }
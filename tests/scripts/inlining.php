@@ -0,0 +1,15 @@
+<?php
+// Inlining of small functions: leaf calls, nested calls, locals that
+// start out null, missing and extra arguments, and recursion (not inlined)
+
+function sq($x) { return $x * $x; }
+function led_on() { echo "on "; }
+function cnt() { $c++; return $c; }
+function pick($a, $b) { if ($a > $b) { $m = $a; } return $m; }
+function two($a, $b) { return $a . $b; }
+function fact($n) { if ($n <= 1) return 1; return $n * fact($n - 1); }
+
+$s = 0;
+for ($i = 0; $i < 5; $i++) { $s += sq($i); led_on(); }
+echo "\n", $s, " ", cnt(), cnt(), " ", sq(sq(2)), "\n";
+echo pick(3, 1), "|", pick(1, 3), "|", two("a"), "|", two("a", "b", "c"), "|", fact(5), "\n";
@@ -0,0 +1,61 @@
+<?php
+// Int results that overflow become floats, as in PHP
+
+$max = PHP_INT_MAX;
+$min = PHP_INT_MIN;
+echo $max + 1, "\n";
+echo $min - 1, "\n";
+echo $max * 2, "\n";
+echo -$min, "\n";
+echo 3037000500 * 3037000500, "\n";
+echo 3037000499 * 3037000499, "\n";
+
+// Inferred int, float at run time: typed opcodes take the generic path
+$a = $max + 1;
+$b = $a - 1;
+echo $b, " ", $b < $a ? "less" : "not less", "\n";
+$c = $max;
+$c++;
+$c++;
+echo $c, "\n";
+$d = $min;
+$d--;
+echo $d, "\n";
+
+// Counted loop across the top of the range
+$n = 0;
+for ($i = $max - 3; $i < $max; $i++) {
+    $n++;
+}
+echo $n, " ", $i, "\n";
+$n = 0;
+for ($i = $max - 1; $i <= $max; $i++) {
+    $n++;
+    if ($n > 5) break;
+}
+echo $n, " ", $i, "\n";
+
+// Literals and numeric strings too big for an int
+echo 9223372036854775807, "\n";
+echo 9223372036854775808, "\n";
+echo -9223372036854775808, "\n";
+echo 0xFFFFFFFFFFFFFFFF, "\n";
+echo "9223372036854775808" + 0, "\n";
+$s = "9223372036854775807";
+$s++;
+echo $s, "\n";
+
+// (int) wraps floats, saturates strings
+echo (int)1e19, "\n";
+echo (int)-1.5e19, "\n";
+echo (int)"9223372036854775808", "\n";
+echo (int)"-9223372036854775809", "\n";
+echo (int)(0.0 / 1.0), "\n";
+
+// Shifts past the width
+echo 1 << 62, " ", 1 << 63, " ", 1 << 64, "\n";
+echo -1 >> 63, " ", -1 >> 64, " ", 8 >> 64, "\n";
+
+// array_sum promotes too
+echo array_sum([$max, 1]), "\n";
+echo array_sum([$max, -1]), "\n";
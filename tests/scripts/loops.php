@@ -0,0 +1,27 @@
+<?php
+// Loop optimizations: invariants hoisted, induction multiplies strength
+// reduced, counted loops fused, float steps and loops that never run
+
+$w = 7; $s = 0; $arr = [];
+for ($i = 0; $i < 10; $i++) {
+    $s += $i * 4 + $w * 3;
+    $arr[$i * 2] = $w + 1;
+}
+echo $s, " ", tens(), "\n";
+
+function tens() { $t = 0; for ($k = 1; $k <= 5; $k++) { $t += $k * 10; } return $t; }
+
+$n = 5; $acc = "";
+for ($j = 0; $j < $n; $j++) { if ($j == 2) continue; $acc .= $j * 3; $acc .= ","; }
+echo $acc, "\n";
+
+for ($d = 0.0; $d <= 1.0; $d += 0.25) { echo $d * 100.0, " "; }
+echo "\n";
+
+$x = 10;
+while ($x > 0) { $x -= 3; echo $x + $w * 2, " "; }
+echo "\n";
+
+for ($i = 10; $i < 5; $i++) { echo "never"; }
+for ($i = 0; $i < 4; $i++) { $n = $i; }
+echo $arr[18], " ", $i, " ", $n, "\n";
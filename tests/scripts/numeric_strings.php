@@ -0,0 +1,56 @@
+<?php
+// ++/-- and comparisons on numeric strings
+
+function check($b) {
+    echo $b ? "true" : "false", "\n";
+}
+
+// Terminates: "0" steps as a number
+$n = 0;
+for ($i = "0"; $i < 3; $i++) {
+    $n++;
+}
+echo $n, " ", $i, "\n";
+
+$s = "5";
+$s++;
+echo $s, "\n";
+$s = "1.5";
+$s--;
+echo $s, "\n";
+$s = " 7";
+$s++;
+echo $s, "\n";
+
+// Other strings increment alphanumerically and do not decrement
+$words = ["a", "Az", "zz", "a9", "Zz9", "-z"];
+for ($k = 0; $k < 6; $k++) {
+    $s = $words[$k];
+    $s++;
+    echo $s, " ";
+}
+echo "\n";
+$s = "abc";
+$s--;
+echo $s, "\n";
+$s = "";
+$s++;
+echo $s, "\n";
+$s = "";
+$s--;
+echo $s, "\n";
+
+// Bools are left alone
+$b = true;
+$b++;
+check($b);
+
+// Numeric strings compare as numbers
+check("10" == "1e1");
+check("100" == "1e2 ");
+check("abc" == "ABC");
+check("10" < "9");
+check("10" < "9a");
+check(" 1" == "1");
+check("0x1A" == "26");
+echo "12abc" + 1, " ", "1.5e3" + 0, " ", "inf" + 0, "\n";
@@ -0,0 +1,34 @@
+<?php
+// Packed typed arrays: element conversion and clamping, reductions over
+// ranges, copy on write, and falling back to a plain array
+
+$a = array_packed("i16", 4);
+$a[0] = 100000;
+$a[1] = -5.9;
+$a[2] = 7;
+$a[] = 3;
+echo $a[0], " ", $a[1], " ", $a[2], " ", $a[3], " ", $a[4], "\n";
+echo array_sum($a), " ", array_min($a), " ", array_max($a), " ", array_avg($a), "\n";
+
+$b = $a;
+$b[0] = 1;
+echo $a[0], " ", $b[0], "\n";
+
+$f = array_pack([1, 2.5, 3], "f32");
+echo array_sum($f), " ", $f[1], "\n";
+
+$w = array_packed("f64", 1000);
+for ($i = 0; $i < 1000; $i++) { $w[$i] = $i * 0.5; }
+echo array_sum($w), " ", array_avg($w, 10, 20), " ", array_max($w, 990, 100), "\n";
+
+$s = array_scale($a, 2, 1);
+echo $s[0], " ", $s[1], "\n";
+$a[2] = "x";
+echo $a[2], " ", array_sum($a) === false ? "false" : "?", "\n";
+echo array_sum([1, 2, 3]), " ", array_sum([1, 2.5]), " ", array_pack(["a"], "i32") === false ? "false" : "?", "\n";
+
+$e = array_packed("i32", 0);
+$c = $e;
+$c[] = 5;
+echo array_sum($c), " ", $e[0] === null ? "empty" : "?", "\n";
+echo bytes_len(bytes(array_pack([65, 66], "i16"))), "\n";
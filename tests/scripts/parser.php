@@ -0,0 +1,44 @@
+<?php
+// Front end: scopes, globals, functions, arrays, operators, casts and
+// control flow written the way scripts write them
+
+$count = 0;
+$name = 'world';
+
+function add($a, $b) {
+    $sum = $a + $b;
+    return $sum;
+}
+
+function bump() {
+    global $count;
+    $count += 10;
+}
+
+function fib($n) { if ($n < 2) return $n; return fib($n - 1) + fib($n - 2); }
+
+for ($i = 0; $i < 5; $i++) {
+    $count = add($count, $i);
+}
+bump();
+echo "count=$count name=$name\n";
+echo "fib=", fib(20), "\n";
+
+$arr = [1, 2, 3];
+$arr[] = 4;
+$arr[0] += 10;
+$arr[1]++;
+echo $arr[0], " ", $arr[1], " ", $arr[3], "\n";
+
+/* Precedence and numeric forms */
+$x = 0x48 << 4 | 3;
+echo $x, " ", 7 / 2, " ", 8 / 2, " ", 7 % 3, " ", -5, " ", 2 + 3 * 4 - 1, " ", (2 + 3) * 4, "\n";
+echo 1 < 2 && 2 < 3 ? "and" : "", " ", !0 || false ? "or" : "", "\n";
+
+while (true) { $i--; if ($i < 0) break; if ($i == 3) continue; echo $i; }
+echo "\n", $i === -1 ? "ok" : "bad", "\n", (int)"42" + 1, (string)3.5, "\n";
+
+$n = 3;
+while ($n > 0) { echo $n--; }
+echo "\n";
+if ($n > 0) { echo "pos\n"; } elseif ($n == 0) { echo "zero\n"; } else { echo "neg\n"; }
@@ -0,0 +1,39 @@
+<?php
+// Strings: inline and heap storage either side of the short-string
+// limit, copies, comparison, and appends built in place
+
+$a = "abcdefghijklmnopqrstu"; $b = $a . "v"; $c = $b . "w"; $d = $c . "xyz";
+echo $a, "|", $b, "|", $c, "|", $d, "\n";
+$arr = [$a, $b, $c, $d]; $arr2 = $arr; $arr2[0] = "x";
+echo $arr[0], $arr2[0], $arr[3], "\n";
+echo $b == "abcdefghijklmnopqrstuv" ? "eq" : "ne", " ", $c < $d ? "lt" : "ge", " ", $d[24], "\n";
+switch ($a) { case "abcdefghijklmnopqrstu": echo "sw ok\n"; break; default: echo "sw bad\n"; }
+$e = ""; echo $e ? "t" : "f", " ", "0" ? "t" : "f", " ", (string)12345, " ", "12" + 3, "\n";
+$s = ""; for ($i = 0; $i < 30; $i++) { $s = $s . "k"; } echo $s, "\n";
+print("short", "and a much longer heap allocated string");
+echo "\n";
+
+$g = "";
+function build($n) {
+    $s = "";
+    for ($i = 0; $i < $n; $i++) { $s .= "ab" . "cd"; }
+    $t = "x";
+    for ($i = 0; $i < 5; $i++) { $t = $t . "y" . "z"; }
+    $u = "q";
+    $u = $u . $u . "!";
+    $v = "m"; $v .= $v . "n";
+    $w = "k"; echo ($w .= "j"), "\n";
+    return bytes_len($s) . " " . $t . " " . $u . " " . $v;
+}
+function addg($x) { global $g; $g .= $x; return "-"; }
+echo build(100000), "\n";
+$g = "G"; $g = $g . addg("h") . "i"; echo $g, "\n";
+$g .= addg("p") . "q"; echo $g, "\n";
+$n = null; $n .= "z"; echo $n, "\n";
+$m = "0123456789abcdefghij"; for ($i = 0; $i < 10; $i++) { $m .= $i; } echo $m, "\n";
+
+function tag($k, $v) { $s = "<"; $s .= $k . ">" . $v; $s = $s . "</" . $k . ">"; return $s; }
+$out = "";
+for ($i = 0; $i < 8; $i++) { $out .= tag("i", $i % 3 == 0 ? "x" : "yy"); }
+echo $out, "\n";
+$r = ""; $r .= "a"; $q = $r; $r .= "b"; echo $q, $r, "\n";
@@ -0,0 +1,73 @@
+<?php
+// switch and match: dense tables, sparse cases, fallthrough, loose
+// switch comparison against strict match, and continue inside switch
+
+function cmd($c) {
+    switch ($c) {
+        case 1: return "one";
+        case 2:
+        case 3: $r = "two-three"; break;
+        case 4: $r = "four";
+        case 5: $r = $r . "+five"; break;
+        default: $r = "other";
+    }
+    return $r;
+}
+for ($i = 0; $i < 8; $i++) { echo cmd($i), "\n"; }
+echo cmd("2"), "\n";
+echo cmd(3.0), "\n";
+echo cmd(true), "\n";
+
+function sparse($c) {
+    switch ($c) {
+        case 10: return "a";
+        case 1000: return "b";
+        case -77777: return "c";
+        case 123456789: return "d";
+    }
+    return "none";
+}
+echo sparse(10), sparse(1000), sparse(-77777), sparse(123456789), sparse(5), sparse("1000"), "\n";
+
+function word($s) {
+    return match ($s) {
+        "get", "fetch" => 1,
+        "put" => 2,
+        "del" => 3,
+        "list" => 4,
+        default => 0,
+    };
+}
+echo word("get"), word("fetch"), word("put"), word("del"), word("list"), word("x"), word(1), "\n";
+
+$t = 0;
+for ($i = 0; $i < 10; $i++) {
+    switch ($i % 4) {
+        case 0: continue 2;
+        case 1: $t = $t + 1; break;
+        case 2: $t = $t + 10; continue;
+        default: $t = $t + 100;
+    }
+    $t = $t + 1000;
+}
+echo $t, "\n";
+
+// A numeric string label compares numerically, table or not
+function name($s) {
+    switch ($s) {
+        case "alpha": return "a";
+        case "beta": return "b";
+        case "gamma": return "g";
+        case "delta": return "d";
+        case "10": return "ten";
+        default: return "-";
+    }
+}
+echo name("1e1"), name("010"), name(" 10.0"), name("10"), name("beta"), name("zeta"), name(10), "\n";
+
+$k = 2;
+echo match ($k) { 1 => "x", 2 => "y", 3 => "z" }, "\n";
+echo match (true) { $k > 5 => "big", $k > 1 => "mid", default => "small" }, "\n";
+$x = 7;
+switch ($x) { }
+echo "done\n";
@@ -0,0 +1,41 @@
+<?php
+// Cooperative tasks: sleep_ms yields to the scheduler, a busy task is
+// preempted, and task_spawn fails once every slot is taken
+
+function poller($name, $period, $n) {
+    for ($i = 0; $i < $n; $i++) {
+        echo millis(), " ", $name, " ", $i, "\n";
+        sleep_ms($period);
+    }
+}
+
+function spinner() {
+    global $stop, $spins;
+    while (!$stop) { $spins++; }
+    echo "spinner stopped at ", millis(), "\n";
+}
+
+function turns($name) {
+    for ($i = 0; $i < 3; $i++) {
+        echo $name, $i, " ";
+        task_yield();
+    }
+}
+
+$spins = 0;
+$stop = false;
+echo task_spawn("poller", "A", 100, 3), "\n";
+echo task_spawn("poller", "B", 250, 2), "\n";
+echo task_spawn("spinner"), "\n";
+echo task_spawn("poller", "C", 1, 1) === false ? "full\n" : "spawned\n";
+sleep_ms(600);
+$stop = true;
+echo "main done at ", millis(), "\n";
+sleep_ms(10);
+
+// Slots free up once tasks finish
+task_spawn("turns", "x");
+task_spawn("turns", "y");
+turns("m");
+sleep_ms(10);
+echo "\n";
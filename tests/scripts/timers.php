@@ -0,0 +1,30 @@
+<?php
+// Timers: timer_every and timer_after preempt a busy main task, a
+// handler cancels its own timer, and a sleeping handler holds its timer
+
+function tick($id) {
+    global $ticks;
+    $ticks++;
+    echo "tick ", millis(), "\n";
+    if ($ticks == 5) { timer_cancel($id); }
+}
+
+function once($id) { echo "once ", millis(), "\n"; }
+
+function slow($id) { global $slow; $slow++; sleep_ms(25); }
+
+$ticks = 0;
+$slow = 0;
+$a = timer_every(10, "tick");
+timer_after(33, "once");
+$s = timer_every(10, "slow");
+echo "a=", $a, "\n";
+
+$x = 0;
+for ($i = 0; $i < 200000; $i++) { $x += $i; }
+echo "main busy done ", millis(), "\n";
+sleep_ms(100);
+timer_cancel($s);
+echo "slow ran ", $slow, "\n";
+echo "cancel again ", timer_cancel($s) ? "true" : "false", "\n";
+echo "main exits ", millis(), "\n";
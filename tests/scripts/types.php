@@ -0,0 +1,28 @@
+<?php
+// Type inference: typed int/float opcodes where the types are known, and
+// the generic path where a variable changes type
+
+$sum = 0;
+for ($i = 0; $i < 100; $i++) {
+    $sum += $i * 2;
+}
+echo $sum, "\n";
+
+$f = 1.5;
+$g = $f * 2.0;
+echo $g / 3.0, "\n";
+
+function fib($n) { if ($n < 2) return $n; return fib($n - 1) + fib($n - 2); }
+echo fib(20), "\n";
+
+// $x is an int until the loop makes it a string
+$x = 5;
+while ($x > 0) { $x--; if ($x == 2) { $x = "a"; break; } }
+echo $x, "\n";
+
+$k = 0;
+while (true) { $k++; if ($k >= 10) break; }
+echo $k, "\n";
+
+$y = null; $y++; echo $y + 1, "\n";
+$m = 7; $m = $m / 2; echo $m, " ", $m * 2, "\n";
@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fleet.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const bytecode_t *program;
+    vm_context_t *vm;        // Created on the first slice, freed when finished
+    uint32_t now_ms;         // Virtual clock
+    fleet_stats_t stats;
+} fleet_instance_t;
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at
+// the bottom, thieves take from the top. Capacity covers every instance,
+// so it never grows.
+typedef struct {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(fleet_instance_t*) *slots;
+    int64_t mask;
+} run_queue_t;
+
+typedef struct {
+    fleet_t *fleet;
+    run_queue_t queue;
+    uint32_t rng;            // Victim selection
+    pthread_t thread;
+} worker_t;
+
+struct fleet {
+    fleet_config_t config;
+    fleet_instance_t *instances;
+    size_t instance_count;
+    size_t instance_capacity;
+    worker_t *workers;
+    _Atomic size_t remaining;
+};
+
+static void* fleet_malloc(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        fprintf(stderr, "fleetsim: memory allocation failed\n");
+        abort();
+    }
+    return ptr;
+}
+
+// Run queues
+static void rq_init(run_queue_t *q, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    q->slots = fleet_malloc(size * sizeof(*q->slots));
+    for (size_t i = 0; i < size; i++) atomic_init(&q->slots[i], NULL);
+    q->mask = (int64_t)size - 1;
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+}
+
+static void rq_push(run_queue_t *q, fleet_instance_t *inst) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    atomic_store_explicit(&q->slots[b & q->mask], inst, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+static fleet_instance_t* rq_pop(run_queue_t *q) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    
+    if (t > b) {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    
+    fleet_instance_t *inst = atomic_load_explicit(&q->slots[b & q->mask], memory_order_relaxed);
+    if (t == b) {
+        // Last one: race any thief for it
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            inst = NULL;
+        }
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return inst;
+}
+
+static fleet_instance_t* rq_steal(run_queue_t *q) {
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    
+    fleet_instance_t *inst = atomic_load_explicit(&q->slots[t & q->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return inst;
+}
+
+// Simulated platform: every instance keeps its own clock
+static uint32_t sim_clock(void *user) {
+    return ((fleet_instance_t*)user)->now_ms;
+}
+
+static void sim_idle(void *user, uint32_t ms) {
+    fleet_instance_t *inst = user;
+    inst->now_ms += ms;
+    inst->stats.asleep_ms += ms;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Runs one slice. Returns true once the instance has finished.
+static bool run_slice(fleet_t *fleet, fleet_instance_t *inst) {
+    if (!inst->vm) {
+        inst->vm = microphp_vm_create();
+        if (!inst->vm || microphp_vm_attach(inst->vm, inst->program) != 0) {
+            microphp_vm_destroy(inst->vm);
+            inst->vm = NULL;
+            inst->stats.status = -1;
+            snprintf(inst->stats.error, sizeof(inst->stats.error), "Out of memory");
+            return true;
+        }
+        microphp_vm_set_platform(inst->vm, sim_clock, sim_idle, inst);
+    }
+    
+    uint64_t start = now_ns();
+    int rc = microphp_vm_run_slice(inst->vm, fleet->config.budget);
+    inst->stats.wall_ns += now_ns() - start;
+    inst->stats.slices++;
+    inst->stats.instructions += (uint64_t)((int64_t)fleet->config.budget - inst->vm->fuel);
+    inst->now_ms += fleet->config.slice_ms;
+    
+    if (rc == MICROPHP_RUN_YIELDED && inst->now_ms < fleet->config.horizon_ms) return false;
+    
+    inst->stats.status = rc;
+    inst->stats.sim_ms = inst->now_ms;
+    if (rc < 0) {
+        const char *error = microphp_get_error(inst->vm);
+        snprintf(inst->stats.error, sizeof(inst->stats.error), "%s", error ? error : "unknown error");
+    }
+    microphp_vm_destroy(inst->vm);
+    inst->vm = NULL;
+    return true;
+}
+
+static fleet_instance_t* find_work(worker_t *self) {
+    fleet_instance_t *inst = rq_pop(&self->queue);
+    if (inst) return inst;
+    
+    // Steal, starting from a random victim
+    unsigned n = self->fleet->config.threads;
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 17;
+    self->rng ^= self->rng << 5;
+    for (unsigned i = 0, v = self->rng % n; i < n; i++, v = (v + 1) % n) {
+        worker_t *victim = &self->fleet->workers[v];
+        if (victim == self) continue;
+        inst = rq_steal(&victim->queue);
+        if (inst) return inst;
+    }
+    return NULL;
+}
+
+static void* worker_main(void *arg) {
+    worker_t *self = arg;
+    fleet_t *fleet = self->fleet;
+    
+    while (atomic_load_explicit(&fleet->remaining, memory_order_acquire) > 0) {
+        fleet_instance_t *inst = find_work(self);
+        if (!inst) {
+            sched_yield();
+            continue;
+        }
+        
+        if (run_slice(fleet, inst)) {
+            atomic_fetch_sub_explicit(&fleet->remaining, 1, memory_order_release);
+        } else {
+            rq_push(&self->queue, inst);
+        }
+    }
+    return NULL;
+}
+
+fleet_t* fleet_create(const fleet_config_t *config) {
+    fleet_t *fleet = fleet_malloc(sizeof(fleet_t));
+    memset(fleet, 0, sizeof(fleet_t));
+    fleet->config = *config;
+    
+    if (fleet->config.threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        fleet->config.threads = cores > 0 ? (unsigned)cores : 1;
+    }
+    if (fleet->config.budget == 0) fleet->config.budget = 1;
+    return fleet;
+}
+
+void fleet_destroy(fleet_t *fleet) {
+    if (!fleet) return;
+    
+    for (size_t i = 0; i < fleet->instance_count; i++) {
+        microphp_vm_destroy(fleet->instances[i].vm);
+    }
+    free(fleet->instances);
+    free(fleet);
+}
+
+int fleet_add(fleet_t *fleet, const bytecode_t *program, const char *name, size_t count) {
+    if (!fleet || !program) return -1;
+    
+    if (fleet->instance_count + count > fleet->instance_capacity) {
+        size_t capacity = fleet->instance_capacity ? fleet->instance_capacity : 64;
+        while (capacity < fleet->instance_count + count) capacity *= 2;
+        fleet_instance_t *instances = realloc(fleet->instances, capacity * sizeof(fleet_instance_t));
+        if (!instances) return -1;
+        fleet->instances = instances;
+        fleet->instance_capacity = capacity;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        fleet_instance_t *inst = &fleet->instances[fleet->instance_count++];
+        memset(inst, 0, sizeof(*inst));
+        inst->program = program;
+        inst->stats.name = name;
+    }
+    return 0;
+}
+
+int fleet_run(fleet_t *fleet) {
+    if (!fleet) return -1;
+    
+    unsigned threads = fleet->config.threads;
+    fleet->workers = fleet_malloc(threads * sizeof(worker_t));
+    atomic_init(&fleet->remaining, fleet->instance_count);
+    
+    // Deal instances round-robin before any worker starts
+    for (unsigned i = 0; i < threads; i++) {
+        worker_t *w = &fleet->workers[i];
+        w->fleet = fleet;
+        w->rng = 2654435761u * (i + 1);
+        rq_init(&w->queue, fleet->instance_count);
+    }
+    for (size_t i = 0; i < fleet->instance_count; i++) {
+        rq_push(&fleet->workers[i % threads].queue, &fleet->instances[i]);
+    }
+    
+    unsigned started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&fleet->workers[started].thread, NULL, worker_main, &fleet->workers[started]) != 0) break;
+    }
+    if (started == 0) {
+        // No threads at all: run everything here
+        worker_main(&fleet->workers[0]);
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(fleet->workers[i].thread, NULL);
+    }
+    
+    for (unsigned i = 0; i < threads; i++) {
+        free(fleet->workers[i].queue.slots);
+    }
+    free(fleet->workers);
+    fleet->workers = NULL;
+    return 0;
+}
+
+size_t fleet_instance_count(const fleet_t *fleet) {
+    return fleet ? fleet->instance_count : 0;
+}
+
+const fleet_stats_t* fleet_stats(const fleet_t *fleet, size_t index) {
+    if (!fleet || index >= fleet->instance_count) return NULL;
+    return &fleet->instances[index].stats;
+}
+
+unsigned fleet_threads(const fleet_t *fleet) {
+    return fleet ? fleet->config.threads : 0;
+}
@@ -0,0 +1,47 @@
+#ifndef MICROPHP_FLEET_H
+#define MICROPHP_FLEET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "microphp.h"
+
+// Fleet simulator: many VM instances multiplexed over a work-stealing
+// worker pool. Each instance runs in slices of `budget` instructions; a
+// slice costs slice_ms of simulated time, and sleeps skip ahead on the
+// instance's own virtual clock.
+
+typedef struct {
+    unsigned threads;        // Workers, 0 = online cores
+    uint32_t budget;         // Instructions per slice
+    uint32_t slice_ms;       // Simulated time one slice costs
+    uint32_t horizon_ms;     // Simulated time each instance runs for
+} fleet_config_t;
+
+typedef struct {
+    const char *name;        // Script the instance runs
+    int status;              // MICROPHP_RUN_DONE, MICROPHP_RUN_YIELDED (horizon reached) or -1
+    char error[64];
+    uint32_t sim_ms;         // Simulated time reached
+    uint32_t asleep_ms;      // Of which every task slept
+    uint64_t slices;
+    uint64_t instructions;   // As charged by the VM's fuel accounting
+    uint64_t wall_ns;        // Host time spent running the instance
+} fleet_stats_t;
+
+typedef struct fleet fleet_t;
+
+fleet_t* fleet_create(const fleet_config_t *config);
+void fleet_destroy(fleet_t *fleet);
+
+// Adds count instances of program, which must outlive the fleet
+int fleet_add(fleet_t *fleet, const bytecode_t *program, const char *name, size_t count);
+
+// Runs every instance to completion or the horizon
+int fleet_run(fleet_t *fleet);
+
+size_t fleet_instance_count(const fleet_t *fleet);
+const fleet_stats_t* fleet_stats(const fleet_t *fleet, size_t index);
+unsigned fleet_threads(const fleet_t *fleet);
+
+#endif // MICROPHP_FLEET_H
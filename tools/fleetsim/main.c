@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fleet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SCRIPTS 64
+
+void print_usage(const char *program_name) {
+    printf("micro-PHP fleet simulator (fleetsim) v%s\n", MICROPHP_VERSION);
+    printf("Usage: %s [options] <script.mbc>[:count] ...\n", program_name);
+    printf("\nOptions:\n");
+    printf("  -j <n>        Worker threads (default: online cores)\n");
+    printf("  -b <n>        Instructions per slice (default 10000)\n");
+    printf("  -s <ms>       Simulated time a slice costs (default 1)\n");
+    printf("  -t <ms>       Simulated time per instance (default 10000)\n");
+    printf("  -q            Summary only, no per-instance report\n");
+    printf("  -h, --help    Show this help message\n");
+    printf("\nExamples:\n");
+    printf("  %s sensor.mbc:5000 gateway.mbc:200\n", program_name);
+    printf("  %s -j 8 -t 60000 -q blink.mbc:10000\n", program_name);
+}
+
+static int read_file(const char *filename, uint8_t **content, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open input file '%s'\n", filename);
+        return -1;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length < 0) {
+        fclose(file);
+        return -1;
+    }
+    
+    *size = (size_t)length;
+    *content = malloc(*size ? *size : 1);
+    if (!*content) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        fclose(file);
+        return -1;
+    }
+    
+    size_t bytes_read = fread(*content, 1, *size, file);
+    fclose(file);
+    
+    if (bytes_read != *size) {
+        fprintf(stderr, "Error: Failed to read file completely\n");
+        free(*content);
+        return -1;
+    }
+    return 0;
+}
+
+static bool parse_uint(const char *text, unsigned long *value) {
+    char *end;
+    *value = strtoul(text, &end, 10);
+    return *text != '\0' && *end == '\0';
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    fleet_config_t config = { 0, 10000, 1, 10000 };
+    bool quiet = false;
+    char *scripts[MAX_SCRIPTS];
+    size_t counts[MAX_SCRIPTS];
+    size_t script_count = 0;
+    
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        unsigned long value;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-b") == 0 ||
+                   strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-t") == 0) {
+            if (i + 1 >= argc || !parse_uint(argv[i + 1], &value) || value > UINT32_MAX / 2) {
+                fprintf(stderr, "Error: Invalid value after %s\n", argv[i]);
+                return 1;
+            }
+            switch (argv[i][1]) {
+                case 'j': config.threads = (unsigned)value; break;
+                case 'b': config.budget = (uint32_t)value; break;
+                case 's': config.slice_ms = (uint32_t)value; break;
+                case 't': config.horizon_ms = (uint32_t)value; break;
+            }
+            i++;
+        } else if (argv[i][0] != '-') {
+            if (script_count == MAX_SCRIPTS) {
+                fprintf(stderr, "Error: Too many scripts (max %d)\n", MAX_SCRIPTS);
+                return 1;
+            }
+            
+            // script.mbc:count
+            char *colon = strrchr(argv[i], ':');
+            counts[script_count] = 1;
+            if (colon) {
+                if (!parse_uint(colon + 1, &value) || value == 0) {
+                    fprintf(stderr, "Error: Invalid instance count in '%s'\n", argv[i]);
+                    return 1;
+                }
+                *colon = '\0';
+                counts[script_count] = value;
+            }
+            scripts[script_count++] = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (script_count == 0) {
+        fprintf(stderr, "Error: No scripts specified\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    // Load each program once; every instance of it shares the bytecode
+    fleet_t *fleet = fleet_create(&config);
+    bytecode_t *programs[MAX_SCRIPTS];
+    size_t loaded = 0;
+    int status = 0;
+    
+    for (; loaded < script_count; loaded++) {
+        uint8_t *data;
+        size_t size;
+        if (read_file(scripts[loaded], &data, &size) != 0) {
+            status = 1;
+            break;
+        }
+        
+        const char *error = NULL;
+        programs[loaded] = microphp_program_load(data, size, NULL, &error);
+        free(data);
+        if (!programs[loaded]) {
+            fprintf(stderr, "Error: %s: %s\n", scripts[loaded], error);
+            status = 1;
+            break;
+        }
+        fleet_add(fleet, programs[loaded], scripts[loaded], counts[loaded]);
+    }
+    
+    if (status == 0) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        fleet_run(fleet);
+        double wall = seconds_since(&start);
+        
+        // Per-instance throughput: instructions executed per host second
+        size_t count = fleet_instance_count(fleet);
+        size_t failed = 0;
+        double sim_total = 0;
+        uint64_t slices = 0;
+        if (!quiet) printf("%-8s %-24s %-8s %10s %10s %10s %14s\n",
+                           "id", "script", "status", "sim_ms", "asleep_ms", "slices", "instr/s");
+        for (size_t i = 0; i < count; i++) {
+            const fleet_stats_t *s = fleet_stats(fleet, i);
+            sim_total += s->sim_ms;
+            slices += s->slices;
+            if (s->status < 0) failed++;
+            if (quiet) continue;
+            
+            double rate = s->wall_ns ? (double)s->instructions * 1e9 / (double)s->wall_ns : 0;
+            printf("%-8zu %-24s %-8s %10u %10u %10llu %14.0f",
+                   i, s->name, s->status < 0 ? "error" : s->status == MICROPHP_RUN_DONE ? "done" : "horizon",
+                   s->sim_ms, s->asleep_ms, (unsigned long long)s->slices, rate);
+            if (s->status < 0) printf("  %s", s->error);
+            printf("\n");
+        }
+        
+        printf("\n%zu instance(s) on %u worker(s): %.3f s wall, %llu slices, %.1f simulated s per wall s, %zu failed\n",
+               count, fleet_threads(fleet), wall, (unsigned long long)slices,
+               wall > 0 ? sim_total / 1000.0 / wall : 0, failed);
+        if (failed) status = 1;
+    }
+    
+    fleet_destroy(fleet);
+    for (size_t i = 0; i < loaded; i++) {
+        microphp_program_free(programs[i]);
+    }
+    return status;
+}
@@ -13,7 +13,7 @@ from pathlib import Path
 
 # MBC file format constants
 MBC_MAGIC = b'MBC\0'
-MBC_VERSION = 1
+MBC_VERSION = 2
 
 # Zval types
 ZVAL_TYPES = {
@@ -25,7 +25,8 @@ ZVAL_TYPES = {
     5: 'ARRAY',
     6: 'OBJECT',
     7: 'CLOSURE',
-    8: 'RESOURCE'
+    8: 'RESOURCE',
+    9: 'FIXED'
 }
 
 # Opcode types
@@ -73,7 +74,42 @@ OPCODE_TYPES = {
     40: 'CAST_INT',
     41: 'CAST_FLOAT',
     42: 'CAST_STRING',
-    43: 'CAST_BOOL'
+    43: 'CAST_BOOL',
+    44: 'CALL_BUILTIN',
+    45: 'IDENTICAL',
+    46: 'NOT_IDENTICAL',
+    47: 'NEG',
+    48: 'BIT_AND',
+    49: 'BIT_OR',
+    50: 'BIT_XOR',
+    51: 'BIT_NOT',
+    52: 'SHL',
+    53: 'SHR',
+    54: 'ADD_I',
+    55: 'SUB_I',
+    56: 'MUL_I',
+    57: 'LT_I',
+    58: 'LTE_I',
+    59: 'GT_I',
+    60: 'GTE_I',
+    61: 'EQ_I',
+    62: 'NEQ_I',
+    63: 'INC_I',
+    64: 'DEC_I',
+    65: 'ADD_F',
+    66: 'SUB_F',
+    67: 'MUL_F',
+    68: 'DIV_F',
+    69: 'LT_F',
+    70: 'LTE_F',
+    71: 'GT_F',
+    72: 'GTE_F',
+    73: 'INC_JLT_LOCAL',
+    74: 'INC_JLT_GLOBAL',
+    75: 'SWITCH_TABLE',
+    76: 'MATCH_ERROR',
+    77: 'APPEND_LOCAL',
+    78: 'APPEND_GLOBAL'
 }
 
 def read_mbc_header(file):
@@ -89,14 +125,24 @@ def read_mbc_header(file):
     constant_count = struct.unpack('<I', file.read(4))[0]
     function_count = struct.unpack('<I', file.read(4))[0]
     main_offset = struct.unpack('<I', file.read(4))[0]
+    global_count = struct.unpack('<I', file.read(4))[0]
     
     return {
         'version': version,
         'constant_count': constant_count,
         'function_count': function_count,
-        'main_offset': main_offset
+        'main_offset': main_offset,
+        'global_count': global_count
     }
 
+def read_globals(file, count):
+    """Read the global slot map (slot index -> variable name)."""
+    names = []
+    for _ in range(count):
+        name_len = struct.unpack('<I', file.read(4))[0]
+        names.append(file.read(name_len).decode('utf-8', errors='replace'))
+    return names
+
 def read_zval(file):
     """Read a zval from the file."""
     zval_type = struct.unpack('<B', file.read(1))[0]
@@ -123,6 +169,8 @@ def read_zval(file):
     elif zval_type == 8:  # RESOURCE
         ptr_type = struct.unpack('<I', file.read(4))[0]
         zval_info['resource_type'] = ptr_type
+    elif zval_type == 9:  # FIXED (Q16.16)
+        zval_info['value'] = struct.unpack('<i', file.read(4))[0] / 65536.0
     
     return zval_info
 
@@ -156,6 +204,7 @@ def read_function(file):
     
     return {
         'name': name,
+        'name_len': name_len,
         'code_size': code_size,
         'local_count': local_count,
         'param_count': param_count,
@@ -177,6 +226,7 @@ def inspect_mbc_file(filepath):
             print(f"  Constants: {header['constant_count']}")
             print(f"  Functions: {header['function_count']}")
             print(f"  Main function offset: {header['main_offset']}")
+            print(f"  Globals: {header['global_count']}")
             print()
             
             # Read constants
@@ -210,6 +260,13 @@ def inspect_mbc_file(filepath):
                         print(f"  [{i}] Error reading function: {e}")
                         print()
             
+            # Read global slot map
+            if header['global_count'] > 0:
+                print("Globals:")
+                for slot, name in enumerate(read_globals(file, header['global_count'])):
+                    print(f"  [{slot}] ${name}")
+                print()
+            
             print("=== End of file ===")
             
     except FileNotFoundError:
@@ -3,7 +3,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <errno.h>
 #include <ctype.h>
+#include <strings.h>
 
 // Memory management
 static void* compiler_malloc(size_t size) {
@@ -24,6 +26,14 @@ static void* compiler_realloc(void *ptr, size_t size) {
     return new_ptr;
 }
 
+static void scope_destroy(scope_t *scope) {
+    for (size_t i = 0; i < scope->symbol_count; i++) {
+        free(scope->symbols[i].name);
+    }
+    free(scope->symbols);
+    memset(scope, 0, sizeof(scope_t));
+}
+
 // Compiler context management
 compiler_context_t* compiler_create(const char *source, size_t source_len) {
     compiler_context_t *ctx = compiler_malloc(sizeof(compiler_context_t));
@@ -45,6 +55,7 @@ compiler_context_t* compiler_create(const char *source, size_t source_len) {
     ctx->ast_root = NULL;
     ctx->error_msg = NULL;
     ctx->has_error = false;
+    ctx->opt_level = COMPILER_OPT_DEFAULT;
     
     return ctx;
 }
@@ -70,6 +81,26 @@ void compiler_destroy(compiler_context_t *ctx) {
         ast_destroy_node(ctx->ast_root);
     }
     
+    // Free code generation state
+    if (ctx->functions) {
+        for (size_t i = 0; i < ctx->function_count; i++) {
+            free(ctx->functions[i].name);
+            free(ctx->functions[i].code);
+            scope_destroy(&ctx->functions[i].scope);
+        }
+        free(ctx->functions);
+    }
+    scope_destroy(&ctx->globals);
+    
+    if (ctx->constants) {
+        for (size_t i = 0; i < ctx->constant_count; i++) {
+            microphp_zval_destroy(&ctx->constants[i]);
+        }
+        free(ctx->constants);
+    }
+    
+    if (ctx->inlines) free(ctx->inlines);
+    
     free(ctx);
 }
 
@@ -150,7 +181,13 @@ static void skip_whitespace(compiler_context_t *ctx) {
 }
 
 static void skip_comment(compiler_context_t *ctx) {
-    if (ctx->position < ctx->source_len && ctx->source[ctx->position] == '/') {
+    if (ctx->position < ctx->source_len && ctx->source[ctx->position] == '#') {
+        // Shell-style single line comment
+        while (ctx->position < ctx->source_len && ctx->source[ctx->position] != '\n') {
+            ctx->position++;
+            ctx->column++;
+        }
+    } else if (ctx->position < ctx->source_len && ctx->source[ctx->position] == '/') {
         ctx->position++;
         ctx->column++;
         
@@ -192,7 +229,6 @@ static void skip_comment(compiler_context_t *ctx) {
 
 static token_type_t read_identifier_or_keyword(compiler_context_t *ctx) {
     size_t start = ctx->position;
-    size_t start_column = ctx->column;
     
     while (ctx->position < ctx->source_len && 
            (isalnum(ctx->source[ctx->position]) || ctx->source[ctx->position] == '_')) {
@@ -206,76 +242,97 @@ static token_type_t read_identifier_or_keyword(compiler_context_t *ctx) {
     word[len] = '\0';
     
     // Check for keywords
+    token_type_t type = TOKEN_IDENTIFIER;
     if (strcmp(word, "if") == 0) {
-        free(word);
-        return TOKEN_IF;
+        type = TOKEN_IF;
     } else if (strcmp(word, "else") == 0) {
-        free(word);
-        return TOKEN_ELSE;
+        type = TOKEN_ELSE;
+    } else if (strcmp(word, "elseif") == 0) {
+        type = TOKEN_ELSEIF;
     } else if (strcmp(word, "while") == 0) {
-        free(word);
-        return TOKEN_WHILE;
+        type = TOKEN_WHILE;
     } else if (strcmp(word, "for") == 0) {
-        free(word);
-        return TOKEN_FOR;
+        type = TOKEN_FOR;
     } else if (strcmp(word, "function") == 0) {
-        free(word);
-        return TOKEN_FUNCTION;
+        type = TOKEN_FUNCTION;
     } else if (strcmp(word, "return") == 0) {
-        free(word);
-        return TOKEN_RETURN;
-    } else if (strcmp(word, "true") == 0) {
-        free(word);
-        return TOKEN_TRUE;
-    } else if (strcmp(word, "false") == 0) {
-        free(word);
-        return TOKEN_FALSE;
-    } else if (strcmp(word, "null") == 0) {
-        free(word);
-        return TOKEN_NULL;
+        type = TOKEN_RETURN;
+    } else if (strcmp(word, "break") == 0) {
+        type = TOKEN_BREAK;
+    } else if (strcmp(word, "continue") == 0) {
+        type = TOKEN_CONTINUE;
+    } else if (strcmp(word, "global") == 0) {
+        type = TOKEN_GLOBAL;
+    } else if (strcmp(word, "switch") == 0) {
+        type = TOKEN_SWITCH;
+    } else if (strcmp(word, "case") == 0) {
+        type = TOKEN_CASE;
+    } else if (strcmp(word, "default") == 0) {
+        type = TOKEN_DEFAULT;
+    } else if (strcmp(word, "match") == 0) {
+        type = TOKEN_MATCH;
+    } else if (strcasecmp(word, "true") == 0) {
+        type = TOKEN_TRUE;
+    } else if (strcasecmp(word, "false") == 0) {
+        type = TOKEN_FALSE;
+    } else if (strcasecmp(word, "null") == 0) {
+        type = TOKEN_NULL;
     } else if (strcmp(word, "var") == 0) {
-        free(word);
-        return TOKEN_VAR;
+        type = TOKEN_VAR;
     } else if (strcmp(word, "const") == 0) {
-        free(word);
-        return TOKEN_CONST;
+        type = TOKEN_CONST;
     } else if (strcmp(word, "echo") == 0) {
-        free(word);
-        return TOKEN_ECHO;
+        type = TOKEN_ECHO;
     } else if (strcmp(word, "print") == 0) {
-        free(word);
-        return TOKEN_PRINT;
-    } else if (strcmp(word, "sleep_ms") == 0) {
-        free(word);
-        return TOKEN_SLEEP_MS;
-    } else if (strcmp(word, "millis") == 0) {
-        free(word);
-        return TOKEN_MILLIS;
-    } else if (strcmp(word, "OUTPUT") == 0) {
-        free(word);
-        return TOKEN_IDENTIFIER;  // Treat as identifier for now
-    } else if (strcmp(word, "INPUT") == 0) {
-        free(word);
-        return TOKEN_IDENTIFIER;  // Treat as identifier for now
-    } else if (strcmp(word, "true") == 0) {
-        free(word);
-        return TOKEN_TRUE;
-    } else if (strcmp(word, "false") == 0) {
-        free(word);
-        return TOKEN_FALSE;
-    }
-    
-    // Not a keyword, it's an identifier
-    add_token(ctx, TOKEN_IDENTIFIER, word, len);
+        type = TOKEN_PRINT;
+    }
+    
+    // Built-in and HAL function names (sleep_ms, OUTPUT, ...) stay identifiers
+    if (type == TOKEN_IDENTIFIER) {
+        add_token(ctx, TOKEN_IDENTIFIER, word, len);
+    } else {
+        add_token(ctx, type, NULL, 0);
+    }
     free(word);
-    return TOKEN_IDENTIFIER;
+    return type;
+}
+
+static void read_variable(compiler_context_t *ctx) {
+    ctx->position++; // Skip '$'
+    ctx->column++;
+    
+    size_t start = ctx->position;
+    while (ctx->position < ctx->source_len && 
+           (isalnum(ctx->source[ctx->position]) || ctx->source[ctx->position] == '_')) {
+        ctx->position++;
+        ctx->column++;
+    }
+    
+    if (ctx->position == start) {
+        compiler_set_error(ctx, "Expected variable name after '$' at line %d, column %d", ctx->line, ctx->column);
+        return;
+    }
+    
+    add_token(ctx, TOKEN_VARIABLE, ctx->source + start, ctx->position - start);
 }
 
 static void read_number(compiler_context_t *ctx) {
     size_t start = ctx->position;
-    size_t start_column = ctx->column;
     bool is_float = false;
     
+    // Hexadecimal literal
+    if (ctx->source[ctx->position] == '0' && ctx->position + 1 < ctx->source_len &&
+        (ctx->source[ctx->position + 1] == 'x' || ctx->source[ctx->position + 1] == 'X')) {
+        ctx->position += 2;
+        ctx->column += 2;
+        while (ctx->position < ctx->source_len && isxdigit(ctx->source[ctx->position])) {
+            ctx->position++;
+            ctx->column++;
+        }
+        add_token(ctx, TOKEN_INT, ctx->source + start, ctx->position - start);
+        return;
+    }
+    
     // Read integer part
     while (ctx->position < ctx->source_len && isdigit(ctx->source[ctx->position])) {
         ctx->position++;
@@ -295,6 +352,22 @@ static void read_number(compiler_context_t *ctx) {
         }
     }
     
+    // Check for exponent
+    if (ctx->position < ctx->source_len &&
+        (ctx->source[ctx->position] == 'e' || ctx->source[ctx->position] == 'E')) {
+        size_t exp = ctx->position + 1;
+        if (exp < ctx->source_len && (ctx->source[exp] == '+' || ctx->source[exp] == '-')) exp++;
+        if (exp < ctx->source_len && isdigit(ctx->source[exp])) {
+            is_float = true;
+            ctx->column += exp - ctx->position;
+            ctx->position = exp;
+            while (ctx->position < ctx->source_len && isdigit(ctx->source[ctx->position])) {
+                ctx->position++;
+                ctx->column++;
+            }
+        }
+    }
+    
     size_t len = ctx->position - start;
     char *number = compiler_malloc(len + 1);
     memcpy(number, ctx->source + start, len);
@@ -309,39 +382,99 @@ static void read_number(compiler_context_t *ctx) {
     free(number);
 }
 
+static bool is_variable_start(const compiler_context_t *ctx, size_t pos) {
+    return pos + 1 < ctx->source_len && ctx->source[pos] == '$' &&
+           (isalpha(ctx->source[pos + 1]) || ctx->source[pos + 1] == '_');
+}
+
+// Reads a quoted string. Double-quoted strings decode escapes and
+// interpolate simple "$name" references by emitting the token sequence
+// ( "text" . $name . "text" ), so the parser sees a plain concatenation.
 static void read_string(compiler_context_t *ctx) {
+    char quote = ctx->source[ctx->position];
+    bool interpolate = false;
+    
     ctx->position++; // Skip opening quote
     ctx->column++;
     
-    size_t start = ctx->position;
-    size_t start_column = ctx->column;
+    // First pass: find the end and whether interpolation is needed
+    size_t end = ctx->position;
+    while (end < ctx->source_len && ctx->source[end] != quote) {
+        if (ctx->source[end] == '\\' && end + 1 < ctx->source_len) {
+            end++;
+        } else if (quote == '"' && is_variable_start(ctx, end)) {
+            interpolate = true;
+        }
+        end++;
+    }
     
-    while (ctx->position < ctx->source_len && ctx->source[ctx->position] != '"') {
-        if (ctx->source[ctx->position] == '\\') {
-            ctx->position++; // Skip escape character
-            ctx->column++;
+    if (end >= ctx->source_len) {
+        compiler_set_error(ctx, "Unterminated string at line %d, column %d", ctx->line, ctx->column);
+        ctx->position = ctx->source_len;
+        return;
+    }
+    
+    if (interpolate) add_token(ctx, TOKEN_LEFT_PAREN, NULL, 0);
+    
+    char *string = compiler_malloc(end - ctx->position + 1);
+    size_t len = 0;
+    bool first_part = true;
+    
+    while (ctx->position < end) {
+        char c = ctx->source[ctx->position];
+        
+        if (c == '\\' && ctx->position + 1 < end) {
+            char next = ctx->source[ctx->position + 1];
+            char decoded = 0;
+            
+            if (quote == '\'') {
+                // Single quotes only escape the quote and backslash
+                if (next == '\'' || next == '\\') decoded = next;
+            } else {
+                switch (next) {
+                    case 'n':  decoded = '\n'; break;
+                    case 't':  decoded = '\t'; break;
+                    case 'r':  decoded = '\r'; break;
+                    case '0':  decoded = '\0'; break;
+                    case '\\': decoded = '\\'; break;
+                    case '"':  decoded = '"'; break;
+                    case '$':  decoded = '$'; break;
+                    default:   break;
+                }
+            }
+            
+            if (decoded || next == '0') {
+                string[len++] = decoded;
+                ctx->position += 2;
+                ctx->column += 2;
+                continue;
+            }
+        }
+        
+        if (interpolate && is_variable_start(ctx, ctx->position)) {
+            if (!first_part) add_token(ctx, TOKEN_DOT, NULL, 0);
+            add_token(ctx, TOKEN_STRING, string, len);
+            add_token(ctx, TOKEN_DOT, NULL, 0);
+            len = 0;
+            first_part = false;
+            
+            read_variable(ctx);
+            continue;
         }
         
-        if (ctx->source[ctx->position] == '\n') {
+        if (c == '\n') {
             ctx->line++;
             ctx->column = 1;
         } else {
             ctx->column++;
         }
+        string[len++] = c;
         ctx->position++;
     }
     
-    if (ctx->position >= ctx->source_len) {
-        compiler_set_error(ctx, "Unterminated string at line %d, column %d", ctx->line, ctx->column);
-        return;
-    }
-    
-    size_t len = ctx->position - start;
-    char *string = compiler_malloc(len + 1);
-    memcpy(string, ctx->source + start, len);
-    string[len] = '\0';
-    
+    if (interpolate && !first_part) add_token(ctx, TOKEN_DOT, NULL, 0);
     add_token(ctx, TOKEN_STRING, string, len);
+    if (interpolate) add_token(ctx, TOKEN_RIGHT_PAREN, NULL, 0);
     free(string);
     
     ctx->position++; // Skip closing quote
@@ -353,20 +486,38 @@ int compiler_lex(compiler_context_t *ctx) {
     ctx->line = 1;
     ctx->column = 1;
     ctx->token_count = 0;
+    ctx->current_token = 0;
     
     while (ctx->position < ctx->source_len) {
-        skip_whitespace(ctx);
-        skip_comment(ctx);
+        // Skip any run of whitespace and comments
+        size_t before;
+        do {
+            before = ctx->position;
+            skip_whitespace(ctx);
+            skip_comment(ctx);
+        } while (ctx->position != before);
         
         if (ctx->position >= ctx->source_len) break;
+        if (ctx->has_error) return -1;
         
         char c = ctx->source[ctx->position];
         
-        if (isalpha(c) || c == '_') {
+        if (strncmp(ctx->source + ctx->position, "<?php", 5) == 0) {
+            // Open tag
+            ctx->position += 5;
+            ctx->column += 5;
+        } else if (strncmp(ctx->source + ctx->position, "?>", 2) == 0) {
+            // Close tag acts as a statement terminator
+            add_token(ctx, TOKEN_SEMICOLON, NULL, 0);
+            ctx->position += 2;
+            ctx->column += 2;
+        } else if (isalpha(c) || c == '_') {
             read_identifier_or_keyword(ctx);
+        } else if (c == '$') {
+            read_variable(ctx);
         } else if (isdigit(c)) {
             read_number(ctx);
-        } else if (c == '"') {
+        } else if (c == '"' || c == '\'') {
             read_string(ctx);
         } else {
             // Handle operators and punctuation
@@ -440,10 +591,19 @@ int compiler_lex(compiler_context_t *ctx) {
                     break;
                     
                 case '=':
-                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
+                    if (ctx->position + 2 < ctx->source_len && ctx->source[ctx->position + 1] == '=' &&
+                        ctx->source[ctx->position + 2] == '=') {
+                        add_token(ctx, TOKEN_IDENTICAL, NULL, 0);
+                        ctx->position += 3;
+                        ctx->column += 3;
+                    } else if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
                         add_token(ctx, TOKEN_EQUAL, NULL, 0);
                         ctx->position += 2;
                         ctx->column += 2;
+                    } else if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '>') {
+                        add_token(ctx, TOKEN_DOUBLE_ARROW, NULL, 0);
+                        ctx->position += 2;
+                        ctx->column += 2;
                     } else {
                         add_token(ctx, TOKEN_ASSIGN, NULL, 0);
                         ctx->position++;
@@ -452,7 +612,12 @@ int compiler_lex(compiler_context_t *ctx) {
                     break;
                     
                 case '!':
-                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
+                    if (ctx->position + 2 < ctx->source_len && ctx->source[ctx->position + 1] == '=' &&
+                        ctx->source[ctx->position + 2] == '=') {
+                        add_token(ctx, TOKEN_NOT_IDENTICAL, NULL, 0);
+                        ctx->position += 3;
+                        ctx->column += 3;
+                    } else if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
                         add_token(ctx, TOKEN_NOT_EQUAL, NULL, 0);
                         ctx->position += 2;
                         ctx->column += 2;
@@ -464,7 +629,11 @@ int compiler_lex(compiler_context_t *ctx) {
                     break;
                     
                 case '<':
-                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
+                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '<') {
+                        add_token(ctx, TOKEN_SHIFT_LEFT, NULL, 0);
+                        ctx->position += 2;
+                        ctx->column += 2;
+                    } else if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
                         add_token(ctx, TOKEN_LESS_EQUAL, NULL, 0);
                         ctx->position += 2;
                         ctx->column += 2;
@@ -476,7 +645,11 @@ int compiler_lex(compiler_context_t *ctx) {
                     break;
                     
                 case '>':
-                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
+                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '>') {
+                        add_token(ctx, TOKEN_SHIFT_RIGHT, NULL, 0);
+                        ctx->position += 2;
+                        ctx->column += 2;
+                    } else if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
                         add_token(ctx, TOKEN_GREATER_EQUAL, NULL, 0);
                         ctx->position += 2;
                         ctx->column += 2;
@@ -493,8 +666,9 @@ int compiler_lex(compiler_context_t *ctx) {
                         ctx->position += 2;
                         ctx->column += 2;
                     } else {
-                        compiler_set_error(ctx, "Unexpected character '&' at line %d, column %d", ctx->line, ctx->column);
-                        return -1;
+                        add_token(ctx, TOKEN_BIT_AND, NULL, 0);
+                        ctx->position++;
+                        ctx->column++;
                     }
                     break;
                     
@@ -504,11 +678,24 @@ int compiler_lex(compiler_context_t *ctx) {
                         ctx->position += 2;
                         ctx->column += 2;
                     } else {
-                        compiler_set_error(ctx, "Unexpected character '|' at line %d, column %d", ctx->line, ctx->column);
-                        return -1;
+                        add_token(ctx, TOKEN_BIT_OR, NULL, 0);
+                        ctx->position++;
+                        ctx->column++;
                     }
                     break;
                     
+                case '^':
+                    add_token(ctx, TOKEN_BIT_XOR, NULL, 0);
+                    ctx->position++;
+                    ctx->column++;
+                    break;
+                    
+                case '~':
+                    add_token(ctx, TOKEN_BIT_NOT, NULL, 0);
+                    ctx->position++;
+                    ctx->column++;
+                    break;
+                    
                 case '(':
                     add_token(ctx, TOKEN_LEFT_PAREN, NULL, 0);
                     ctx->position++;
@@ -558,9 +745,15 @@ int compiler_lex(compiler_context_t *ctx) {
                     break;
                     
                 case '.':
-                    add_token(ctx, TOKEN_DOT, NULL, 0);
-                    ctx->position++;
-                    ctx->column++;
+                    if (ctx->position + 1 < ctx->source_len && ctx->source[ctx->position + 1] == '=') {
+                        add_token(ctx, TOKEN_CONCAT_ASSIGN, NULL, 0);
+                        ctx->position += 2;
+                        ctx->column += 2;
+                    } else {
+                        add_token(ctx, TOKEN_DOT, NULL, 0);
+                        ctx->position++;
+                        ctx->column++;
+                    }
                     break;
                     
                 case '?':
@@ -582,24 +775,23 @@ int compiler_lex(compiler_context_t *ctx) {
         }
     }
     
+    if (ctx->has_error) return -1;
+    
     add_token(ctx, TOKEN_EOF, NULL, 0);
     return 0;
 }
 
 // Token access
 token_t* compiler_next_token(compiler_context_t *ctx) {
-    static size_t current_token = 0;
-    
-    if (current_token >= ctx->token_count) {
+    if (ctx->current_token >= ctx->token_count) {
         return NULL;
     }
     
-    return &ctx->tokens[current_token++];
+    return &ctx->tokens[ctx->current_token++];
 }
 
 void compiler_rewind_tokens(compiler_context_t *ctx) {
-    // This would need to be implemented with a proper token index
-    // For now, we'll just reset to the beginning
+    ctx->current_token = 0;
 }
 
 // AST manipulation
@@ -620,16 +812,18 @@ void ast_destroy_node(ast_node_t *node) {
     // Clean up node-specific data
     switch (node->type) {
         case AST_NODE_LITERAL:
-            if (node->data.literal.literal_type == 2) { // String
+            if (node->data.literal.literal_type == LITERAL_STRING) {
                 free(node->data.literal.value.string_val);
             }
             break;
             
         case AST_NODE_IDENTIFIER:
+        case AST_NODE_NAMED_CONSTANT:
             free(node->data.identifier.name);
             break;
             
         case AST_NODE_FUNCTION_CALL:
+        case AST_NODE_FUNCTION_DEFINITION:
             free(node->data.function_call.name);
             if (node->data.function_call.arguments) {
                 for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
@@ -647,12 +841,23 @@ void ast_destroy_node(ast_node_t *node) {
             break;
             
         case AST_NODE_CONTROL:
+        case AST_NODE_IF_STATEMENT:
+        case AST_NODE_WHILE_STATEMENT:
+        case AST_NODE_FOR_STATEMENT:
+        case AST_NODE_TERNARY:
             if (node->data.control.condition) ast_destroy_node(node->data.control.condition);
             if (node->data.control.then_block) ast_destroy_node(node->data.control.then_block);
             if (node->data.control.else_block) ast_destroy_node(node->data.control.else_block);
             break;
             
         case AST_NODE_BLOCK:
+        case AST_NODE_ARRAY_LITERAL:
+        case AST_NODE_ECHO:
+        case AST_NODE_GLOBAL:
+        case AST_NODE_SWITCH:
+        case AST_NODE_CASE:
+        case AST_NODE_MATCH:
+        case AST_NODE_MATCH_ARM:
             if (node->data.block.statements) {
                 for (size_t i = 0; i < node->data.block.statement_count; i++) {
                     ast_destroy_node(node->data.block.statements[i]);
@@ -670,24 +875,25 @@ void ast_destroy_node(ast_node_t *node) {
 
 ast_node_t* ast_create_literal_int(int64_t value) {
     ast_node_t *node = ast_create_node(AST_NODE_LITERAL);
-    node->data.literal.literal_type = 0; // Int
+    node->data.literal.literal_type = LITERAL_INT;
     node->data.literal.value.int_val = value;
     return node;
 }
 
 ast_node_t* ast_create_literal_float(double value) {
     ast_node_t *node = ast_create_node(AST_NODE_LITERAL);
-    node->data.literal.literal_type = 1; // Float
+    node->data.literal.literal_type = LITERAL_FLOAT;
     node->data.literal.value.float_val = value;
     return node;
 }
 
 ast_node_t* ast_create_literal_string(const char *value, size_t len) {
     ast_node_t *node = ast_create_node(AST_NODE_LITERAL);
-    node->data.literal.literal_type = 2; // String
+    node->data.literal.literal_type = LITERAL_STRING;
     node->data.literal.value.string_val = compiler_malloc(len + 1);
-    memcpy(node->data.literal.value.string_val, value, len);
+    if (len > 0) memcpy(node->data.literal.value.string_val, value, len);
     node->data.literal.value.string_val[len] = '\0';
+    node->data.literal.string_len = len;
     return node;
 }
 
@@ -718,30 +924,4078 @@ ast_node_t* ast_create_function_call(const char *name, size_t len, ast_node_t **
     return node;
 }
 
-// Parsing (simplified implementation)
-int compiler_parse(compiler_context_t *ctx) {
-    // TODO: Implement full parser
-    // For now, just create a simple AST
-    ctx->ast_root = ast_create_node(AST_NODE_BLOCK);
-    return 0;
+// Parsing
+static token_t* peek_token(compiler_context_t *ctx, size_t offset) {
+    size_t index = ctx->current_token + offset;
+    if (index >= ctx->token_count) index = ctx->token_count - 1; // EOF
+    return &ctx->tokens[index];
 }
 
-// Code generation (simplified implementation)
-int compiler_generate_bytecode(compiler_context_t *ctx, uint8_t **output, size_t *output_size) {
-    // TODO: Implement full code generation
-    // For now, just create a minimal bytecode structure
+static bool check_token(compiler_context_t *ctx, token_type_t type) {
+    return peek_token(ctx, 0)->type == type;
+}
+
+static bool match_token(compiler_context_t *ctx, token_type_t type) {
+    if (!check_token(ctx, type)) return false;
+    compiler_next_token(ctx);
+    return true;
+}
+
+static token_t* expect_token(compiler_context_t *ctx, token_type_t type, const char *what) {
+    if (!check_token(ctx, type)) {
+        if (!ctx->has_error) {
+            compiler_set_error(ctx, "Expected %s at line %d", what, peek_token(ctx, 0)->line);
+        }
+        return NULL;
+    }
+    return compiler_next_token(ctx);
+}
+
+static void node_list_append(ast_node_t *list, ast_node_t *item) {
+    list->data.block.statements = compiler_realloc(list->data.block.statements,
+        (list->data.block.statement_count + 1) * sizeof(ast_node_t*));
+    list->data.block.statements[list->data.block.statement_count++] = item;
+}
+
+static ast_node_t* parse_assignment(compiler_context_t *ctx);
+static ast_node_t* parse_match(compiler_context_t *ctx, int line);
+
+static ast_node_t* parse_call_arguments(compiler_context_t *ctx, ast_node_t *call) {
+    if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'('")) {
+        ast_destroy_node(call);
+        return NULL;
+    }
+    
+    while (!check_token(ctx, TOKEN_RIGHT_PAREN)) {
+        // Named arguments (pin: 15) are passed positionally
+        if (check_token(ctx, TOKEN_IDENTIFIER) && peek_token(ctx, 1)->type == TOKEN_COLON) {
+            compiler_next_token(ctx);
+            compiler_next_token(ctx);
+        }
+        
+        ast_node_t *arg = parse_assignment(ctx);
+        if (!arg) {
+            ast_destroy_node(call);
+            return NULL;
+        }
+        
+        call->data.function_call.arguments = compiler_realloc(call->data.function_call.arguments,
+            (call->data.function_call.argument_count + 1) * sizeof(ast_node_t*));
+        call->data.function_call.arguments[call->data.function_call.argument_count++] = arg;
+        
+        if (!match_token(ctx, TOKEN_COMMA)) break;
+    }
+    
+    if (!expect_token(ctx, TOKEN_RIGHT_PAREN, "')'")) {
+        ast_destroy_node(call);
+        return NULL;
+    }
+    return call;
+}
+
+static ast_node_t* parse_primary(compiler_context_t *ctx) {
+    token_t *token = compiler_next_token(ctx);
+    if (!token) return NULL;
+    
+    ast_node_t *node = NULL;
+    
+    switch (token->type) {
+        case TOKEN_INT: {
+            // Integer literals too big for an int are floats, as in PHP
+            errno = 0;
+            unsigned long long value = strtoull(token->value, NULL, 0);
+            if (errno == ERANGE || value > (ctx->int32 ? (unsigned long long)INT32_MAX : INT64_MAX)) {
+                node = ast_create_literal_float(errno == ERANGE ? strtod(token->value, NULL) : (double)value);
+            } else {
+                node = ast_create_literal_int((int64_t)value);
+            }
+            break;
+        }
+            
+        case TOKEN_FLOAT:
+            node = ast_create_literal_float(strtod(token->value, NULL));
+            break;
+            
+        case TOKEN_STRING:
+            node = ast_create_literal_string(token->value ? token->value : "", token->value_len);
+            break;
+            
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+            node = ast_create_node(AST_NODE_LITERAL);
+            node->data.literal.literal_type = LITERAL_BOOL;
+            node->data.literal.value.bool_val = token->type == TOKEN_TRUE;
+            break;
+            
+        case TOKEN_NULL:
+            node = ast_create_node(AST_NODE_LITERAL);
+            node->data.literal.literal_type = LITERAL_NULL;
+            break;
+            
+        case TOKEN_VARIABLE:
+            node = ast_create_identifier(token->value, token->value_len);
+            break;
+            
+        case TOKEN_PRINT:
+            node = ast_create_function_call("print", 5, NULL, 0);
+            node->line = token->line;
+            if (check_token(ctx, TOKEN_LEFT_PAREN)) {
+                return parse_call_arguments(ctx, node);
+            }
+            // print expr
+            node->data.function_call.arguments = compiler_malloc(sizeof(ast_node_t*));
+            node->data.function_call.arguments[0] = parse_assignment(ctx);
+            if (!node->data.function_call.arguments[0]) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            node->data.function_call.argument_count = 1;
+            return node;
+            
+        case TOKEN_IDENTIFIER:
+            if (check_token(ctx, TOKEN_LEFT_PAREN)) {
+                if (strcasecmp(token->value, "array") == 0) {
+                    // array(...) is an array literal
+                    node = ast_create_node(AST_NODE_ARRAY_LITERAL);
+                    node->line = token->line;
+                    compiler_next_token(ctx);
+                    while (!check_token(ctx, TOKEN_RIGHT_PAREN)) {
+                        ast_node_t *item = parse_assignment(ctx);
+                        if (!item) {
+                            ast_destroy_node(node);
+                            return NULL;
+                        }
+                        node_list_append(node, item);
+                        if (!match_token(ctx, TOKEN_COMMA)) break;
+                    }
+                    if (!expect_token(ctx, TOKEN_RIGHT_PAREN, "')'")) {
+                        ast_destroy_node(node);
+                        return NULL;
+                    }
+                    return node;
+                }
+                node = ast_create_function_call(token->value, token->value_len, NULL, 0);
+                node->line = token->line;
+                return parse_call_arguments(ctx, node);
+            }
+            node = ast_create_identifier(token->value, token->value_len);
+            node->type = AST_NODE_NAMED_CONSTANT;
+            break;
+            
+        case TOKEN_MATCH:
+            return parse_match(ctx, token->line);
+            
+        case TOKEN_LEFT_PAREN:
+            node = parse_assignment(ctx);
+            if (!node) return NULL;
+            if (!expect_token(ctx, TOKEN_RIGHT_PAREN, "')'")) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            return node;
+            
+        case TOKEN_LEFT_BRACKET:
+            node = ast_create_node(AST_NODE_ARRAY_LITERAL);
+            node->line = token->line;
+            while (!check_token(ctx, TOKEN_RIGHT_BRACKET)) {
+                ast_node_t *item = parse_assignment(ctx);
+                if (!item) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+                node_list_append(node, item);
+                if (!match_token(ctx, TOKEN_COMMA)) break;
+            }
+            if (!expect_token(ctx, TOKEN_RIGHT_BRACKET, "']'")) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            return node;
+            
+        default:
+            compiler_set_error(ctx, "Unexpected token in expression at line %d, column %d",
+                               token->line, token->column);
+            return NULL;
+    }
+    
+    node->line = token->line;
+    return node;
+}
+
+static bool is_assignable(const ast_node_t *node) {
+    return node && (node->type == AST_NODE_IDENTIFIER || node->type == AST_NODE_INDEX);
+}
+
+static ast_node_t* parse_postfix(compiler_context_t *ctx) {
+    ast_node_t *node = parse_primary(ctx);
+    
+    while (node) {
+        int line = peek_token(ctx, 0)->line;
+        
+        if (match_token(ctx, TOKEN_LEFT_BRACKET)) {
+            ast_node_t *index = NULL;
+            if (!check_token(ctx, TOKEN_RIGHT_BRACKET)) {
+                index = parse_assignment(ctx);
+                if (!index) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+            }
+            if (!expect_token(ctx, TOKEN_RIGHT_BRACKET, "']'")) {
+                ast_destroy_node(index);
+                ast_destroy_node(node);
+                return NULL;
+            }
+            node = ast_create_binary_op(AST_NODE_INDEX, node, index);
+            node->line = line;
+        } else if (is_assignable(node) &&
+                   (check_token(ctx, TOKEN_INCREMENT) || check_token(ctx, TOKEN_DECREMENT))) {
+            token_t *op = compiler_next_token(ctx);
+            ast_node_t *inc = ast_create_node(AST_NODE_INC_DEC);
+            inc->op = op->type;
+            inc->left = node;
+            inc->data.inc_dec.prefix = false;
+            inc->line = line;
+            node = inc;
+        } else {
+            break;
+        }
+    }
+    
+    return node;
+}
+
+static int cast_opcode(const token_t *token) {
+    if (token->type != TOKEN_IDENTIFIER || !token->value) return -1;
+    if (strcmp(token->value, "int") == 0 || strcmp(token->value, "integer") == 0) return OP_CAST_INT;
+    if (strcmp(token->value, "float") == 0 || strcmp(token->value, "double") == 0) return OP_CAST_FLOAT;
+    if (strcmp(token->value, "string") == 0) return OP_CAST_STRING;
+    if (strcmp(token->value, "bool") == 0 || strcmp(token->value, "boolean") == 0) return OP_CAST_BOOL;
+    return -1;
+}
+
+static ast_node_t* parse_unary(compiler_context_t *ctx) {
+    token_t *token = peek_token(ctx, 0);
+    
+    switch (token->type) {
+        case TOKEN_NOT:
+        case TOKEN_MINUS:
+        case TOKEN_BIT_NOT: {
+            compiler_next_token(ctx);
+            ast_node_t *operand = parse_unary(ctx);
+            if (!operand) return NULL;
+            
+            // Fold negative numeric literals
+            if (token->type == TOKEN_MINUS && operand->type == AST_NODE_LITERAL) {
+                if (operand->data.literal.literal_type == LITERAL_INT) {
+                    operand->data.literal.value.int_val = (int64_t)(0 - (uint64_t)operand->data.literal.value.int_val);
+                    return operand;
+                }
+                if (operand->data.literal.literal_type == LITERAL_FLOAT) {
+                    operand->data.literal.value.float_val = -operand->data.literal.value.float_val;
+                    return operand;
+                }
+            }
+            
+            ast_node_t *node = ast_create_node(AST_NODE_UNARY_OP);
+            node->op = token->type;
+            node->left = operand;
+            node->line = token->line;
+            return node;
+        }
+        
+        case TOKEN_PLUS:
+            compiler_next_token(ctx);
+            return parse_unary(ctx);
+            
+        case TOKEN_INCREMENT:
+        case TOKEN_DECREMENT: {
+            compiler_next_token(ctx);
+            ast_node_t *target = parse_postfix(ctx);
+            if (!target) return NULL;
+            if (!is_assignable(target)) {
+                compiler_set_error(ctx, "Invalid increment/decrement target at line %d", token->line);
+                ast_destroy_node(target);
+                return NULL;
+            }
+            
+            ast_node_t *node = ast_create_node(AST_NODE_INC_DEC);
+            node->op = token->type;
+            node->left = target;
+            node->data.inc_dec.prefix = true;
+            node->line = token->line;
+            return node;
+        }
+        
+        case TOKEN_LEFT_PAREN: {
+            int opcode = cast_opcode(peek_token(ctx, 1));
+            if (opcode >= 0 && peek_token(ctx, 2)->type == TOKEN_RIGHT_PAREN) {
+                compiler_next_token(ctx);
+                compiler_next_token(ctx);
+                compiler_next_token(ctx);
+                
+                ast_node_t *operand = parse_unary(ctx);
+                if (!operand) return NULL;
+                
+                ast_node_t *node = ast_create_node(AST_NODE_CAST);
+                node->op = opcode;
+                node->left = operand;
+                node->line = token->line;
+                return node;
+            }
+            return parse_postfix(ctx);
+        }
+        
+        default:
+            return parse_postfix(ctx);
+    }
+}
+
+// Binary operator precedence, lowest first (0 = not a binary operator)
+static int binary_precedence(token_type_t type) {
+    switch (type) {
+        case TOKEN_OR:            return 1;
+        case TOKEN_AND:           return 2;
+        case TOKEN_BIT_OR:        return 3;
+        case TOKEN_BIT_XOR:       return 4;
+        case TOKEN_BIT_AND:       return 5;
+        case TOKEN_EQUAL:
+        case TOKEN_NOT_EQUAL:
+        case TOKEN_IDENTICAL:
+        case TOKEN_NOT_IDENTICAL: return 6;
+        case TOKEN_LESS_THAN:
+        case TOKEN_LESS_EQUAL:
+        case TOKEN_GREATER_THAN:
+        case TOKEN_GREATER_EQUAL: return 7;
+        case TOKEN_DOT:           return 8;
+        case TOKEN_SHIFT_LEFT:
+        case TOKEN_SHIFT_RIGHT:   return 9;
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:         return 10;
+        case TOKEN_MULTIPLY:
+        case TOKEN_DIVIDE:
+        case TOKEN_MODULO:        return 11;
+        default:                  return 0;
+    }
+}
+
+static ast_node_t* parse_binary(compiler_context_t *ctx, int min_precedence) {
+    ast_node_t *left = parse_unary(ctx);
+    
+    while (left) {
+        token_t *token = peek_token(ctx, 0);
+        int precedence = binary_precedence(token->type);
+        if (precedence == 0 || precedence < min_precedence) break;
+        
+        compiler_next_token(ctx);
+        ast_node_t *right = parse_binary(ctx, precedence + 1);
+        if (!right) {
+            ast_destroy_node(left);
+            return NULL;
+        }
+        
+        left = ast_create_binary_op(AST_NODE_BINARY_OP, left, right);
+        left->op = token->type;
+        left->line = token->line;
+    }
+    
+    return left;
+}
+
+static ast_node_t* parse_ternary(compiler_context_t *ctx) {
+    ast_node_t *condition = parse_binary(ctx, 1);
+    if (!condition || !check_token(ctx, TOKEN_QUESTION)) return condition;
+    
+    int line = compiler_next_token(ctx)->line;
+    ast_node_t *node = ast_create_node(AST_NODE_TERNARY);
+    node->line = line;
+    node->data.control.condition = condition;
+    node->data.control.then_block = parse_assignment(ctx);
+    if (!node->data.control.then_block || !expect_token(ctx, TOKEN_COLON, "':'")) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    node->data.control.else_block = parse_assignment(ctx);
+    if (!node->data.control.else_block) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+static bool is_assignment_operator(token_type_t type) {
+    switch (type) {
+        case TOKEN_ASSIGN:
+        case TOKEN_PLUS_ASSIGN:
+        case TOKEN_MINUS_ASSIGN:
+        case TOKEN_MULTIPLY_ASSIGN:
+        case TOKEN_DIVIDE_ASSIGN:
+        case TOKEN_MODULO_ASSIGN:
+        case TOKEN_CONCAT_ASSIGN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static ast_node_t* parse_assignment(compiler_context_t *ctx) {
+    ast_node_t *target = parse_ternary(ctx);
+    if (!target || !is_assignment_operator(peek_token(ctx, 0)->type)) return target;
+    
+    token_t *op = compiler_next_token(ctx);
+    if (!is_assignable(target)) {
+        compiler_set_error(ctx, "Invalid assignment target at line %d", op->line);
+        ast_destroy_node(target);
+        return NULL;
+    }
+    
+    ast_node_t *value = parse_assignment(ctx);
+    if (!value) {
+        ast_destroy_node(target);
+        return NULL;
+    }
+    
+    ast_node_t *node = ast_create_node(AST_NODE_ASSIGNMENT);
+    node->op = op->type;
+    node->line = op->line;
+    node->data.assignment.value = value;
+    
+    if (target->type == AST_NODE_IDENTIFIER) {
+        node->data.assignment.variable = target->data.identifier.name;
+        node->data.assignment.variable_len = target->data.identifier.name_len;
+        target->data.identifier.name = NULL;
+        ast_destroy_node(target);
+    } else {
+        node->left = target;
+    }
+    
+    return node;
+}
+
+ast_node_t* compiler_parse_expression(compiler_context_t *ctx) {
+    return parse_assignment(ctx);
+}
+
+static bool expect_statement_end(compiler_context_t *ctx) {
+    return expect_token(ctx, TOKEN_SEMICOLON, "';'") != NULL;
+}
+
+// Comma-separated expression list for for(...) clauses, as a block
+static ast_node_t* parse_expression_list(compiler_context_t *ctx, token_type_t terminator) {
+    ast_node_t *list = ast_create_node(AST_NODE_BLOCK);
     
-    *output_size = sizeof(bytecode_t);
-    *output = compiler_malloc(*output_size);
+    while (!check_token(ctx, terminator)) {
+        ast_node_t *expr = compiler_parse_expression(ctx);
+        if (!expr) {
+            ast_destroy_node(list);
+            return NULL;
+        }
+        ast_node_t *stmt = ast_create_node(AST_NODE_EXPRESSION);
+        stmt->left = expr;
+        stmt->line = expr->line;
+        node_list_append(list, stmt);
+        if (!match_token(ctx, TOKEN_COMMA)) break;
+    }
     
-    bytecode_t *bytecode = (bytecode_t*)*output;
-    memcpy(bytecode->magic, "MBC\0", 4);
-    bytecode->version = 1;
-    bytecode->constant_count = 0;
-    bytecode->constants = NULL;
-    bytecode->function_count = 0;
-    bytecode->functions = NULL;
-    bytecode->main_offset = 0;
+    return list;
+}
+
+// switch (subject) { case expr: ... default: ... }
+static ast_node_t* parse_switch(compiler_context_t *ctx, int line) {
+    if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'(' after switch")) return NULL;
+    
+    ast_node_t *node = ast_create_node(AST_NODE_SWITCH);
+    node->line = line;
+    node->left = compiler_parse_expression(ctx);
+    if (!node->left || !expect_token(ctx, TOKEN_RIGHT_PAREN, "')'") ||
+        !expect_token(ctx, TOKEN_LEFT_BRACE, "'{'")) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    
+    bool has_default = false;
+    while (!match_token(ctx, TOKEN_RIGHT_BRACE)) {
+        token_t *token = compiler_next_token(ctx);
+        ast_node_t *clause = ast_create_node(AST_NODE_CASE);
+        clause->line = token->line;
+        node_list_append(node, clause);
+        
+        if (token->type == TOKEN_CASE) {
+            clause->left = compiler_parse_expression(ctx);
+            if (!clause->left) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+        } else if (token->type == TOKEN_DEFAULT) {
+            if (has_default) {
+                compiler_set_error(ctx, "Switch statements may only contain one default clause (line %d)", token->line);
+                ast_destroy_node(node);
+                return NULL;
+            }
+            has_default = true;
+        } else {
+            compiler_set_error(ctx, "Expected case or default in switch at line %d", token->line);
+            ast_destroy_node(node);
+            return NULL;
+        }
+        
+        if (!match_token(ctx, TOKEN_COLON) && !match_token(ctx, TOKEN_SEMICOLON)) {
+            compiler_set_error(ctx, "Expected ':' after case at line %d", token->line);
+            ast_destroy_node(node);
+            return NULL;
+        }
+        
+        clause->right = ast_create_node(AST_NODE_BLOCK);
+        while (!check_token(ctx, TOKEN_CASE) && !check_token(ctx, TOKEN_DEFAULT) &&
+               !check_token(ctx, TOKEN_RIGHT_BRACE)) {
+            if (check_token(ctx, TOKEN_EOF)) {
+                compiler_set_error(ctx, "Unterminated switch starting at line %d", line);
+                ast_destroy_node(node);
+                return NULL;
+            }
+            ast_node_t *stmt = compiler_parse_statement(ctx);
+            if (!stmt) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            node_list_append(clause->right, stmt);
+        }
+    }
+    
+    return node;
+}
+
+// match (subject) { a, b => expr, default => expr }
+static ast_node_t* parse_match(compiler_context_t *ctx, int line) {
+    if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'(' after match")) return NULL;
+    
+    ast_node_t *node = ast_create_node(AST_NODE_MATCH);
+    node->line = line;
+    node->left = parse_assignment(ctx);
+    if (!node->left || !expect_token(ctx, TOKEN_RIGHT_PAREN, "')'") ||
+        !expect_token(ctx, TOKEN_LEFT_BRACE, "'{'")) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    
+    bool has_default = false;
+    while (!check_token(ctx, TOKEN_RIGHT_BRACE)) {
+        ast_node_t *arm = ast_create_node(AST_NODE_MATCH_ARM);
+        arm->line = peek_token(ctx, 0)->line;
+        node_list_append(node, arm);
+        
+        if (match_token(ctx, TOKEN_DEFAULT)) {
+            if (has_default) {
+                compiler_set_error(ctx, "Match expressions may only contain one default arm (line %d)", arm->line);
+                ast_destroy_node(node);
+                return NULL;
+            }
+            has_default = true;
+        } else {
+            do {
+                ast_node_t *condition = parse_assignment(ctx);
+                if (!condition) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+                node_list_append(arm, condition);
+            } while (match_token(ctx, TOKEN_COMMA) && !check_token(ctx, TOKEN_DOUBLE_ARROW));
+        }
+        
+        if (!expect_token(ctx, TOKEN_DOUBLE_ARROW, "'=>'")) {
+            ast_destroy_node(node);
+            return NULL;
+        }
+        arm->right = parse_assignment(ctx);
+        if (!arm->right) {
+            ast_destroy_node(node);
+            return NULL;
+        }
+        
+        if (!match_token(ctx, TOKEN_COMMA)) break;
+    }
+    
+    if (!expect_token(ctx, TOKEN_RIGHT_BRACE, "'}'")) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+static ast_node_t* parse_if(compiler_context_t *ctx, int line) {
+    if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'(' after if")) return NULL;
+    
+    ast_node_t *node = ast_create_node(AST_NODE_IF_STATEMENT);
+    node->line = line;
+    node->data.control.condition = compiler_parse_expression(ctx);
+    if (!node->data.control.condition || !expect_token(ctx, TOKEN_RIGHT_PAREN, "')'")) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    
+    node->data.control.then_block = compiler_parse_statement(ctx);
+    if (!node->data.control.then_block) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    
+    int else_line = peek_token(ctx, 0)->line;
+    if (match_token(ctx, TOKEN_ELSEIF)) {
+        node->data.control.else_block = parse_if(ctx, else_line);
+        if (!node->data.control.else_block) {
+            ast_destroy_node(node);
+            return NULL;
+        }
+    } else if (match_token(ctx, TOKEN_ELSE)) {
+        node->data.control.else_block = compiler_parse_statement(ctx);
+        if (!node->data.control.else_block) {
+            ast_destroy_node(node);
+            return NULL;
+        }
+    }
+    
+    return node;
+}
+
+static ast_node_t* parse_function_definition(compiler_context_t *ctx, int line) {
+    token_t *name = expect_token(ctx, TOKEN_IDENTIFIER, "function name");
+    if (!name) return NULL;
+    
+    ast_node_t *node = ast_create_function_call(name->value, name->value_len, NULL, 0);
+    node->type = AST_NODE_FUNCTION_DEFINITION;
+    node->line = line;
+    
+    if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'(' after function name")) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    
+    while (!check_token(ctx, TOKEN_RIGHT_PAREN)) {
+        token_t *param = expect_token(ctx, TOKEN_VARIABLE, "parameter name");
+        if (!param) {
+            ast_destroy_node(node);
+            return NULL;
+        }
+        
+        node->data.function_call.arguments = compiler_realloc(node->data.function_call.arguments,
+            (node->data.function_call.argument_count + 1) * sizeof(ast_node_t*));
+        node->data.function_call.arguments[node->data.function_call.argument_count++] =
+            ast_create_identifier(param->value, param->value_len);
+        
+        if (!match_token(ctx, TOKEN_COMMA)) break;
+    }
+    
+    if (!expect_token(ctx, TOKEN_RIGHT_PAREN, "')'") || !check_token(ctx, TOKEN_LEFT_BRACE)) {
+        if (!ctx->has_error) compiler_set_error(ctx, "Expected function body at line %d", line);
+        ast_destroy_node(node);
+        return NULL;
+    }
+    
+    node->left = compiler_parse_block(ctx);
+    if (!node->left) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+ast_node_t* compiler_parse_block(compiler_context_t *ctx) {
+    token_t *open = expect_token(ctx, TOKEN_LEFT_BRACE, "'{'");
+    if (!open) return NULL;
+    
+    ast_node_t *block = ast_create_node(AST_NODE_BLOCK);
+    block->line = open->line;
+    
+    while (!check_token(ctx, TOKEN_RIGHT_BRACE)) {
+        if (check_token(ctx, TOKEN_EOF)) {
+            compiler_set_error(ctx, "Unterminated block starting at line %d", open->line);
+            ast_destroy_node(block);
+            return NULL;
+        }
+        
+        ast_node_t *stmt = compiler_parse_statement(ctx);
+        if (!stmt) {
+            ast_destroy_node(block);
+            return NULL;
+        }
+        node_list_append(block, stmt);
+    }
+    
+    compiler_next_token(ctx);
+    return block;
+}
+
+ast_node_t* compiler_parse_statement(compiler_context_t *ctx) {
+    token_t *token = peek_token(ctx, 0);
+    int line = token->line;
+    ast_node_t *node = NULL;
+    
+    switch (token->type) {
+        case TOKEN_LEFT_BRACE:
+            return compiler_parse_block(ctx);
+            
+        case TOKEN_SEMICOLON:
+            compiler_next_token(ctx);
+            node = ast_create_node(AST_NODE_BLOCK);
+            node->line = line;
+            return node;
+            
+        case TOKEN_IF:
+            compiler_next_token(ctx);
+            return parse_if(ctx, line);
+            
+        case TOKEN_SWITCH:
+            compiler_next_token(ctx);
+            return parse_switch(ctx, line);
+            
+        case TOKEN_WHILE:
+            compiler_next_token(ctx);
+            if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'(' after while")) return NULL;
+            node = ast_create_node(AST_NODE_WHILE_STATEMENT);
+            node->line = line;
+            node->data.control.condition = compiler_parse_expression(ctx);
+            if (!node->data.control.condition || !expect_token(ctx, TOKEN_RIGHT_PAREN, "')'")) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            node->data.control.then_block = compiler_parse_statement(ctx);
+            if (!node->data.control.then_block) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            return node;
+            
+        case TOKEN_FOR:
+            compiler_next_token(ctx);
+            if (!expect_token(ctx, TOKEN_LEFT_PAREN, "'(' after for")) return NULL;
+            node = ast_create_node(AST_NODE_FOR_STATEMENT);
+            node->line = line;
+            
+            // for (init; condition; step): init in left, step in right
+            node->left = parse_expression_list(ctx, TOKEN_SEMICOLON);
+            if (!node->left || !expect_statement_end(ctx)) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            if (!check_token(ctx, TOKEN_SEMICOLON)) {
+                node->data.control.condition = compiler_parse_expression(ctx);
+                if (!node->data.control.condition) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+            }
+            if (!expect_statement_end(ctx)) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            node->right = parse_expression_list(ctx, TOKEN_RIGHT_PAREN);
+            if (!node->right || !expect_token(ctx, TOKEN_RIGHT_PAREN, "')'")) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            node->data.control.then_block = compiler_parse_statement(ctx);
+            if (!node->data.control.then_block) {
+                ast_destroy_node(node);
+                return NULL;
+            }
+            return node;
+            
+        case TOKEN_FUNCTION:
+            compiler_next_token(ctx);
+            return parse_function_definition(ctx, line);
+            
+        case TOKEN_RETURN:
+            compiler_next_token(ctx);
+            node = ast_create_node(AST_NODE_RETURN);
+            node->line = line;
+            if (!check_token(ctx, TOKEN_SEMICOLON)) {
+                node->left = compiler_parse_expression(ctx);
+                if (!node->left) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+            }
+            break;
+            
+        case TOKEN_BREAK:
+        case TOKEN_CONTINUE:
+            compiler_next_token(ctx);
+            node = ast_create_node(token->type == TOKEN_BREAK ? AST_NODE_BREAK : AST_NODE_CONTINUE);
+            node->line = line;
+            node->data.literal.value.int_val = 1;
+            if (check_token(ctx, TOKEN_INT)) {
+                node->data.literal.value.int_val = strtoll(compiler_next_token(ctx)->value, NULL, 0);
+                if (node->data.literal.value.int_val < 1) {
+                    compiler_set_error(ctx, "Invalid loop level at line %d", line);
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+            }
+            break;
+            
+        case TOKEN_GLOBAL:
+            compiler_next_token(ctx);
+            node = ast_create_node(AST_NODE_GLOBAL);
+            node->line = line;
+            do {
+                token_t *var = expect_token(ctx, TOKEN_VARIABLE, "variable after global");
+                if (!var) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+                node_list_append(node, ast_create_identifier(var->value, var->value_len));
+            } while (match_token(ctx, TOKEN_COMMA));
+            break;
+            
+        case TOKEN_ECHO:
+            compiler_next_token(ctx);
+            node = ast_create_node(AST_NODE_ECHO);
+            node->line = line;
+            do {
+                ast_node_t *expr = compiler_parse_expression(ctx);
+                if (!expr) {
+                    ast_destroy_node(node);
+                    return NULL;
+                }
+                node_list_append(node, expr);
+            } while (match_token(ctx, TOKEN_COMMA));
+            break;
+            
+        default: {
+            ast_node_t *expr = compiler_parse_expression(ctx);
+            if (!expr) return NULL;
+            node = ast_create_node(AST_NODE_EXPRESSION);
+            node->line = line;
+            node->left = expr;
+            break;
+        }
+    }
+    
+    if (!expect_statement_end(ctx)) {
+        ast_destroy_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+int compiler_parse(compiler_context_t *ctx) {
+    compiler_rewind_tokens(ctx);
+    
+    ctx->ast_root = ast_create_node(AST_NODE_BLOCK);
+    ctx->ast_root->line = 1;
+    
+    while (!check_token(ctx, TOKEN_EOF)) {
+        ast_node_t *stmt = compiler_parse_statement(ctx);
+        if (!stmt) {
+            if (!ctx->has_error) {
+                compiler_set_error(ctx, "Syntax error at line %d", peek_token(ctx, 0)->line);
+            }
+            return -1;
+        }
+        node_list_append(ctx->ast_root, stmt);
+    }
+    
+    return 0;
+}
+
+// Scope analysis
+static symbol_t* scope_lookup(scope_t *scope, const char *name) {
+    for (size_t i = 0; i < scope->symbol_count; i++) {
+        if (strcmp(scope->symbols[i].name, name) == 0) {
+            return &scope->symbols[i];
+        }
+    }
+    return NULL;
+}
+
+static symbol_t* scope_add(scope_t *scope, const char *name, uint16_t slot, bool is_global) {
+    if (scope->symbol_count >= scope->symbol_capacity) {
+        scope->symbol_capacity = scope->symbol_capacity ? scope->symbol_capacity * 2 : 8;
+        scope->symbols = compiler_realloc(scope->symbols, scope->symbol_capacity * sizeof(symbol_t));
+    }
+    
+    symbol_t *symbol = &scope->symbols[scope->symbol_count++];
+    symbol->name = compiler_malloc(strlen(name) + 1);
+    strcpy(symbol->name, name);
+    symbol->slot = slot;
+    symbol->is_global = is_global;
+    return symbol;
+}
+
+static int global_slot(compiler_context_t *ctx, const char *name) {
+    symbol_t *symbol = scope_lookup(&ctx->globals, name);
+    if (symbol) return symbol->slot;
+    
+    if (ctx->globals.slot_count >= MICROPHP_MAX_GLOBALS) {
+        compiler_set_error(ctx, "Too many global variables (max %d)", MICROPHP_MAX_GLOBALS);
+        return -1;
+    }
+    return scope_add(&ctx->globals, name, ctx->globals.slot_count++, true)->slot;
+}
+
+static compiler_function_t* current_function(compiler_context_t *ctx) {
+    return &ctx->functions[ctx->current_function];
+}
+
+// Allocate an anonymous frame slot for compiler temporaries
+static int alloc_temp_slot(compiler_context_t *ctx) {
+    scope_t *scope = &current_function(ctx)->scope;
+    if (scope->slot_count >= MICROPHP_MAX_LOCALS) {
+        compiler_set_error(ctx, "Too many local variables in %s (max %d)",
+                           current_function(ctx)->name, MICROPHP_MAX_LOCALS);
+        return -1;
+    }
+    return scope->slot_count++;
+}
+
+// Resolve $name in the function being compiled. Top-level code and
+// names declared with `global` live in global slots; everything else
+// gets the next dense frame slot.
+static symbol_t* declare_variable(compiler_context_t *ctx, const char *name) {
+    compiler_function_t *fn = current_function(ctx);
+    symbol_t *symbol = scope_lookup(&fn->scope, name);
+    if (symbol) return symbol;
+    
+    if (!fn->definition) {
+        int slot = global_slot(ctx, name);
+        return slot < 0 ? NULL : scope_add(&fn->scope, name, (uint16_t)slot, true);
+    }
+    
+    int slot = alloc_temp_slot(ctx);
+    return slot < 0 ? NULL : scope_add(&fn->scope, name, (uint16_t)slot, false);
+}
+
+static void resolve_node(compiler_context_t *ctx, ast_node_t *node, bool globals_only) {
+    if (!node || ctx->has_error) return;
+    
+    switch (node->type) {
+        case AST_NODE_GLOBAL:
+            if (globals_only) {
+                compiler_function_t *fn = current_function(ctx);
+                for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                    const char *name = node->data.block.statements[i]->data.identifier.name;
+                    if (scope_lookup(&fn->scope, name)) continue;
+                    int slot = global_slot(ctx, name);
+                    if (slot < 0) return;
+                    scope_add(&fn->scope, name, (uint16_t)slot, true);
+                }
+            }
+            return;
+            
+        case AST_NODE_FUNCTION_DEFINITION:
+            // Function bodies get their own scope
+            if (ctx->current_function == 0) return;
+            compiler_set_error(ctx, "Nested function definitions are not supported (line %d)", node->line);
+            return;
+            
+        case AST_NODE_IDENTIFIER:
+            if (!globals_only) declare_variable(ctx, node->data.identifier.name);
+            return;
+            
+        case AST_NODE_ASSIGNMENT:
+            if (!globals_only && node->data.assignment.variable) {
+                declare_variable(ctx, node->data.assignment.variable);
+            }
+            resolve_node(ctx, node->data.assignment.value, globals_only);
+            break;
+            
+        case AST_NODE_FUNCTION_CALL:
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                resolve_node(ctx, node->data.function_call.arguments[i], globals_only);
+            }
+            break;
+            
+        case AST_NODE_IF_STATEMENT:
+        case AST_NODE_WHILE_STATEMENT:
+        case AST_NODE_FOR_STATEMENT:
+        case AST_NODE_TERNARY:
+        case AST_NODE_CONTROL:
+            resolve_node(ctx, node->data.control.condition, globals_only);
+            resolve_node(ctx, node->data.control.then_block, globals_only);
+            resolve_node(ctx, node->data.control.else_block, globals_only);
+            break;
+            
+        case AST_NODE_BLOCK:
+        case AST_NODE_ARRAY_LITERAL:
+        case AST_NODE_ECHO:
+        case AST_NODE_SWITCH:
+        case AST_NODE_MATCH:
+        case AST_NODE_MATCH_ARM:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                resolve_node(ctx, node->data.block.statements[i], globals_only);
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    resolve_node(ctx, node->left, globals_only);
+    resolve_node(ctx, node->right, globals_only);
+}
+
+static compiler_function_t* add_function(compiler_context_t *ctx, const char *name, ast_node_t *definition) {
+    if (ctx->function_count >= MICROPHP_MAX_FUNCTIONS) {
+        compiler_set_error(ctx, "Too many functions (max %d)", MICROPHP_MAX_FUNCTIONS);
+        return NULL;
+    }
+    
+    if (ctx->function_count >= ctx->function_capacity) {
+        ctx->function_capacity = ctx->function_capacity ? ctx->function_capacity * 2 : 8;
+        ctx->functions = compiler_realloc(ctx->functions, ctx->function_capacity * sizeof(compiler_function_t));
+    }
+    
+    compiler_function_t *fn = &ctx->functions[ctx->function_count++];
+    memset(fn, 0, sizeof(compiler_function_t));
+    fn->name = compiler_malloc(strlen(name) + 1);
+    strcpy(fn->name, name);
+    fn->definition = definition;
+    return fn;
+}
+
+static int find_function(compiler_context_t *ctx, const char *name) {
+    // Function 0 is the top-level script and cannot be called
+    for (size_t i = 1; i < ctx->function_count; i++) {
+        if (strcasecmp(ctx->functions[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int compiler_resolve_scopes(compiler_context_t *ctx) {
+    if (!ctx->ast_root) return -1;
+    
+    // Function 0 is the top-level script
+    add_function(ctx, "{main}", NULL);
+    
+    // Hoist function definitions so calls may precede them
+    for (size_t i = 0; i < ctx->ast_root->data.block.statement_count; i++) {
+        ast_node_t *stmt = ctx->ast_root->data.block.statements[i];
+        if (stmt->type != AST_NODE_FUNCTION_DEFINITION) continue;
+        
+        const char *name = stmt->data.function_call.name;
+        if (find_function(ctx, name) >= 0 || microphp_builtin_lookup(name) >= 0) {
+            compiler_set_error(ctx, "Cannot redeclare function %s() (line %d)", name, stmt->line);
+            return -1;
+        }
+        if (!add_function(ctx, name, stmt)) return -1;
+    }
+    
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        compiler_function_t *fn = &ctx->functions[i];
+        ctx->current_function = i;
+        
+        if (fn->definition) {
+            // Parameters take the first slots, in order
+            fn->param_count = fn->definition->data.function_call.argument_count;
+            for (size_t p = 0; p < fn->param_count; p++) {
+                const char *name = fn->definition->data.function_call.arguments[p]->data.identifier.name;
+                if (scope_lookup(&fn->scope, name)) {
+                    compiler_set_error(ctx, "Duplicate parameter $%s in %s()", name, fn->name);
+                    return -1;
+                }
+                scope_add(&fn->scope, name, fn->scope.slot_count++, false);
+            }
+            
+            resolve_node(ctx, fn->definition->left, true);
+            resolve_node(ctx, fn->definition->left, false);
+        } else {
+            resolve_node(ctx, ctx->ast_root, false);
+        }
+        
+        if (ctx->has_error) return -1;
+    }
+    
+    ctx->current_function = 0;
+    return 0;
+}
+
+// Little-endian byte writer for MBC output and switch tables
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} mbc_writer_t;
+
+static void write_bytes(mbc_writer_t *w, const void *data, size_t len) {
+    if (w->size + len > w->capacity) {
+        while (w->size + len > w->capacity) {
+            w->capacity = w->capacity ? w->capacity * 2 : 256;
+        }
+        w->data = compiler_realloc(w->data, w->capacity);
+    }
+    if (len > 0) memcpy(w->data + w->size, data, len);
+    w->size += len;
+}
+
+static void write_u8(mbc_writer_t *w, uint8_t value) {
+    write_bytes(w, &value, 1);
+}
+
+static void write_u16(mbc_writer_t *w, uint16_t value) {
+    uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+    write_bytes(w, bytes, 2);
+}
+
+static void write_u32(mbc_writer_t *w, uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    write_bytes(w, bytes, 4);
+}
+
+static void write_u64(mbc_writer_t *w, uint64_t value) {
+    write_u32(w, (uint32_t)value);
+    write_u32(w, (uint32_t)(value >> 32));
+}
+
+// Code generation
+typedef struct loop_context {
+    size_t *breaks;
+    size_t break_count;
+    size_t *continues;
+    size_t continue_count;
+    struct loop_context *outer;
+} loop_context_t;
+
+static size_t emit(compiler_context_t *ctx, opcode_t opcode, uint16_t operand1, uint16_t operand2) {
+    compiler_function_t *fn = current_function(ctx);
+    
+    if (fn->code_size >= UINT16_MAX) {
+        if (!ctx->has_error) compiler_set_error(ctx, "Function %s is too large", fn->name);
+        return 0;
+    }
+    
+    if (fn->code_size >= fn->code_capacity) {
+        fn->code_capacity = fn->code_capacity ? fn->code_capacity * 2 : 64;
+        fn->code = compiler_realloc(fn->code, fn->code_capacity * sizeof(instruction_t));
+    }
+    
+    instruction_t *instr = &fn->code[fn->code_size];
+    instr->opcode = opcode;
+    instr->operand1 = operand1;
+    instr->operand2 = operand2;
+    return fn->code_size++;
+}
+
+static size_t code_position(compiler_context_t *ctx) {
+    return current_function(ctx)->code_size;
+}
+
+static void patch_jump(compiler_context_t *ctx, size_t jump, size_t target) {
+    current_function(ctx)->code[jump].operand1 = (uint16_t)target;
+}
+
+// Add a constant to the pool, taking ownership of value
+static int add_constant(compiler_context_t *ctx, zval_t value) {
+    for (size_t i = 0; i < ctx->constant_count; i++) {
+        if (microphp_zval_equals(&ctx->constants[i], &value)) {
+            microphp_zval_destroy(&value);
+            return (int)i;
+        }
+    }
+    
+    if (ctx->constant_count >= MICROPHP_MAX_CONSTANTS) {
+        microphp_zval_destroy(&value);
+        compiler_set_error(ctx, "Too many constants (max %d)", MICROPHP_MAX_CONSTANTS);
+        return -1;
+    }
+    
+    if (ctx->constant_count >= ctx->constant_capacity) {
+        ctx->constant_capacity = ctx->constant_capacity ? ctx->constant_capacity * 2 : 32;
+        ctx->constants = compiler_realloc(ctx->constants, ctx->constant_capacity * sizeof(zval_t));
+    }
+    
+    ctx->constants[ctx->constant_count] = value;
+    return (int)ctx->constant_count++;
+}
+
+static void emit_constant(compiler_context_t *ctx, zval_t value) {
+    int index = add_constant(ctx, value);
+    if (index >= 0) emit(ctx, OP_CONST, (uint16_t)index, 0);
+}
+
+// Float literals, as Q16.16 under --fixed
+static zval_t float_constant(const compiler_context_t *ctx, double value) {
+    return ctx->fixed_point ? microphp_zval_fixed(microphp_fixed_from_double(value)) : microphp_zval_float(value);
+}
+
+// Compile-time named constants
+typedef struct {
+    const char *name;
+    int literal_type;
+    int64_t int_val;
+    double float_val;
+    const char *string_val;
+} named_constant_t;
+
+static const named_constant_t named_constants[] = {
+    { "INPUT",          LITERAL_INT,    0, 0.0, NULL },
+    { "OUTPUT",         LITERAL_INT,    1, 0.0, NULL },
+    { "INPUT_PULLUP",   LITERAL_INT,    2, 0.0, NULL },
+    { "INPUT_PULLDOWN", LITERAL_INT,    3, 0.0, NULL },
+    { "PHP_INT_MAX",    LITERAL_INT,    INT64_MAX, 0.0, NULL },
+    { "PHP_INT_MIN",    LITERAL_INT,    INT64_MIN, 0.0, NULL },
+    { "PHP_EOL",        LITERAL_STRING, 0, 0.0, "\n" },
+    { "M_PI",           LITERAL_FLOAT,  0, 3.14159265358979323846, NULL },
+};
+
+// PHP_INT_MAX and PHP_INT_MIN follow the target's int width
+static int64_t named_int(const compiler_context_t *ctx, const named_constant_t *c) {
+    if (ctx->int32 && c->int_val == INT64_MAX) return INT32_MAX;
+    if (ctx->int32 && c->int_val == INT64_MIN) return INT32_MIN;
+    return c->int_val;
+}
+
+static void emit_load_variable(compiler_context_t *ctx, const char *name) {
+    symbol_t *symbol = scope_lookup(&current_function(ctx)->scope, name);
+    if (!symbol) {
+        compiler_set_error(ctx, "Unresolved variable $%s", name);
+        return;
+    }
+    emit(ctx, symbol->is_global ? OP_GET_GLOBAL : OP_GET_LOCAL, symbol->slot, 0);
+}
+
+static void emit_store_variable(compiler_context_t *ctx, const char *name) {
+    symbol_t *symbol = scope_lookup(&current_function(ctx)->scope, name);
+    if (!symbol) {
+        compiler_set_error(ctx, "Unresolved variable $%s", name);
+        return;
+    }
+    emit(ctx, symbol->is_global ? OP_SET_GLOBAL : OP_SET_LOCAL, symbol->slot, 0);
+}
+
+static opcode_t binary_opcode(int op) {
+    switch (op) {
+        case TOKEN_PLUS:            case TOKEN_PLUS_ASSIGN:     return OP_ADD;
+        case TOKEN_MINUS:           case TOKEN_MINUS_ASSIGN:    return OP_SUB;
+        case TOKEN_MULTIPLY:        case TOKEN_MULTIPLY_ASSIGN: return OP_MUL;
+        case TOKEN_DIVIDE:          case TOKEN_DIVIDE_ASSIGN:   return OP_DIV;
+        case TOKEN_MODULO:          case TOKEN_MODULO_ASSIGN:   return OP_MOD;
+        case TOKEN_DOT:             case TOKEN_CONCAT_ASSIGN:   return OP_STRING_CONCAT;
+        case TOKEN_EQUAL:           return OP_EQ;
+        case TOKEN_NOT_EQUAL:       return OP_NEQ;
+        case TOKEN_IDENTICAL:       return OP_IDENTICAL;
+        case TOKEN_NOT_IDENTICAL:   return OP_NOT_IDENTICAL;
+        case TOKEN_LESS_THAN:       return OP_LT;
+        case TOKEN_LESS_EQUAL:      return OP_LTE;
+        case TOKEN_GREATER_THAN:    return OP_GT;
+        case TOKEN_GREATER_EQUAL:   return OP_GTE;
+        case TOKEN_BIT_AND:         return OP_BIT_AND;
+        case TOKEN_BIT_OR:          return OP_BIT_OR;
+        case TOKEN_BIT_XOR:         return OP_BIT_XOR;
+        case TOKEN_SHIFT_LEFT:      return OP_SHL;
+        case TOKEN_SHIFT_RIGHT:     return OP_SHR;
+        default:                    return OP_NOP;
+    }
+}
+
+// Type inference
+//
+// Flow-sensitive abstract interpretation over the AST of each function.
+// The environment maps every symbol of the function's scope to the join
+// of the types it may hold at the current point; loops iterate to a fixed
+// point. Results are stored on the nodes (value_type, op_type) for the
+// code generator to pick typed opcodes.
+typedef struct {
+    uint8_t *types;
+    size_t count;
+    bool reachable;
+} type_env_t;
+
+typedef struct infer_loop {
+    type_env_t breaks;
+    type_env_t continues;
+    struct infer_loop *outer;
+} infer_loop_t;
+
+typedef struct {
+    compiler_context_t *ctx;
+    compiler_function_t *fn;
+    infer_loop_t *loop;
+    uint8_t return_type;
+} infer_state_t;
+
+static uint8_t type_join(uint8_t a, uint8_t b) {
+    if (a == TYPE_NONE) return b;
+    if (b == TYPE_NONE) return a;
+    return a == b ? a : TYPE_ANY;
+}
+
+static void env_init(type_env_t *env, size_t count, bool reachable) {
+    env->count = count;
+    env->types = compiler_malloc(count ? count : 1);
+    memset(env->types, TYPE_NONE, count ? count : 1);
+    env->reachable = reachable;
+}
+
+static void env_copy(type_env_t *dst, const type_env_t *src) {
+    memcpy(dst->types, src->types, src->count ? src->count : 1);
+    dst->reachable = src->reachable;
+}
+
+static void env_join(type_env_t *dst, const type_env_t *src) {
+    if (!src->reachable) return;
+    if (!dst->reachable) {
+        env_copy(dst, src);
+        return;
+    }
+    for (size_t i = 0; i < dst->count; i++) {
+        dst->types[i] = type_join(dst->types[i], src->types[i]);
+    }
+}
+
+static bool env_equal(const type_env_t *a, const type_env_t *b) {
+    return a->reachable == b->reachable && memcmp(a->types, b->types, a->count) == 0;
+}
+
+// Globals another function can write through `global` are unknowable
+static bool symbol_is_shared(compiler_context_t *ctx, compiler_function_t *fn, const symbol_t *symbol) {
+    if (!symbol->is_global) return false;
+    if (fn->definition) return true;
+    
+    for (size_t i = 1; i < ctx->function_count; i++) {
+        symbol_t *other = scope_lookup(&ctx->functions[i].scope, symbol->name);
+        if (other && other->is_global) return true;
+    }
+    return false;
+}
+
+static long env_index(infer_state_t *st, const char *name) {
+    symbol_t *symbol = scope_lookup(&st->fn->scope, name);
+    return symbol ? (long)(symbol - st->fn->scope.symbols) : -1;
+}
+
+static uint8_t env_read(infer_state_t *st, type_env_t *env, const char *name) {
+    long index = env_index(st, name);
+    if (index < 0) return TYPE_ANY;
+    if (symbol_is_shared(st->ctx, st->fn, &st->fn->scope.symbols[index])) return TYPE_ANY;
+    // Unassigned variables read as null
+    return env->types[index] == TYPE_NONE ? TYPE_NULL : env->types[index];
+}
+
+static void env_write(infer_state_t *st, type_env_t *env, const char *name, uint8_t type) {
+    long index = env_index(st, name);
+    if (index < 0) return;
+    env->types[index] = symbol_is_shared(st->ctx, st->fn, &st->fn->scope.symbols[index]) ? TYPE_ANY : type;
+}
+
+// Numeric class of an operand as the VM coerces it
+static uint8_t numeric_kind(uint8_t type) {
+    switch (type) {
+        case TYPE_NULL:
+        case TYPE_BOOL:
+        case TYPE_INT:   return TYPE_INT;
+        case TYPE_FLOAT: return TYPE_FLOAT;
+        case TYPE_NONE:  return TYPE_NONE;
+        default:         return TYPE_ANY;
+    }
+}
+
+static uint8_t arithmetic_type(opcode_t op, uint8_t a, uint8_t b) {
+    uint8_t ka = numeric_kind(a);
+    uint8_t kb = numeric_kind(b);
+    
+    if (op == OP_MOD) return TYPE_INT;
+    if (ka == TYPE_NONE || kb == TYPE_NONE) return TYPE_NONE;
+    if (op == OP_DIV) return (ka == TYPE_FLOAT || kb == TYPE_FLOAT) ? TYPE_FLOAT : TYPE_ANY;
+    if (ka == TYPE_ANY || kb == TYPE_ANY) return TYPE_ANY;
+    return (ka == TYPE_INT && kb == TYPE_INT) ? TYPE_INT : TYPE_FLOAT;
+}
+
+static uint8_t binary_result_type(opcode_t op, uint8_t a, uint8_t b) {
+    switch (op) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+            return arithmetic_type(op, a, b);
+        case OP_STRING_CONCAT:
+            return TYPE_STRING;
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_SHL:
+        case OP_SHR:
+            return TYPE_INT;
+        default:
+            return TYPE_BOOL;
+    }
+}
+
+// Typed opcodes need both operand tags to be exactly int or float
+static uint8_t operand_class(uint8_t a, uint8_t b) {
+    return (a == b && (a == TYPE_INT || a == TYPE_FLOAT)) ? a : TYPE_ANY;
+}
+
+// Fixed-point values have no typed opcodes, so they infer as any
+static uint8_t float_type(const compiler_context_t *ctx) {
+    return ctx->fixed_point ? TYPE_ANY : TYPE_FLOAT;
+}
+
+static uint8_t builtin_return_type(const char *name) {
+    if (strcmp(name, "millis") == 0) return TYPE_INT;
+    if (strcmp(name, "gpio_on") == 0 || strcmp(name, "gpio_off") == 0 || strcmp(name, "timer_cancel") == 0 ||
+        strcmp(name, "io_done") == 0) {
+        return TYPE_BOOL;
+    }
+    if (strcmp(name, "echo") == 0 || strcmp(name, "print") == 0 || strcmp(name, "sleep_ms") == 0 ||
+        strcmp(name, "task_yield") == 0) {
+        return TYPE_NULL;
+    }
+    return TYPE_ANY;
+}
+
+static uint8_t infer_expression(infer_state_t *st, type_env_t *env, ast_node_t *node);
+static void infer_statement(infer_state_t *st, type_env_t *env, ast_node_t *node);
+
+static void infer_switch(infer_state_t *st, type_env_t *env, ast_node_t *node);
+static uint8_t infer_match(infer_state_t *st, type_env_t *env, ast_node_t *node);
+
+static uint8_t infer_assignment(infer_state_t *st, type_env_t *env, ast_node_t *node) {
+    const char *name = node->data.assignment.variable;
+    bool compound = node->op != TOKEN_ASSIGN;
+    
+    if (!name) {
+        // $a[i] op= v: index first, then value; the array stays an array
+        ast_node_t *target = node->left;
+        if (target->right) infer_expression(st, env, target->right);
+        infer_expression(st, env, node->data.assignment.value);
+        if (target->left && target->left->type == AST_NODE_IDENTIFIER) {
+            const char *base = target->left->data.identifier.name;
+            uint8_t old = env_read(st, env, base);
+            env_write(st, env, base, (old == TYPE_NULL || old == TYPE_ARRAY) ? TYPE_ARRAY : TYPE_ANY);
+        }
+        node->op_type = TYPE_ANY;
+        return TYPE_ANY;
+    }
+    
+    uint8_t old = compound ? env_read(st, env, name) : TYPE_NONE;
+    uint8_t value = infer_expression(st, env, node->data.assignment.value);
+    uint8_t result = value;
+    
+    if (compound) {
+        opcode_t op = binary_opcode(node->op);
+        result = binary_result_type(op, old, value);
+        node->op_type = operand_class(old, value);
+    }
+    
+    env_write(st, env, name, result);
+    return result;
+}
+
+static uint8_t infer_expression(infer_state_t *st, type_env_t *env, ast_node_t *node) {
+    if (!node) return TYPE_NULL;
+    
+    uint8_t type = TYPE_ANY;
+    node->op_type = TYPE_ANY;
+    
+    switch (node->type) {
+        case AST_NODE_LITERAL:
+            switch (node->data.literal.literal_type) {
+                case LITERAL_INT:    type = TYPE_INT; break;
+                case LITERAL_FLOAT:  type = float_type(st->ctx); break;
+                case LITERAL_STRING: type = TYPE_STRING; break;
+                case LITERAL_BOOL:   type = TYPE_BOOL; break;
+                default:             type = TYPE_NULL; break;
+            }
+            break;
+            
+        case AST_NODE_NAMED_CONSTANT:
+            type = TYPE_ANY;
+            for (size_t i = 0; i < sizeof(named_constants) / sizeof(named_constants[0]); i++) {
+                if (strcmp(named_constants[i].name, node->data.identifier.name) == 0) {
+                    type = named_constants[i].literal_type == LITERAL_INT ? TYPE_INT :
+                           named_constants[i].literal_type == LITERAL_FLOAT ? float_type(st->ctx) : TYPE_STRING;
+                }
+            }
+            break;
+            
+        case AST_NODE_IDENTIFIER:
+            type = env_read(st, env, node->data.identifier.name);
+            break;
+            
+        case AST_NODE_BINARY_OP: {
+            uint8_t left = infer_expression(st, env, node->left);
+            
+            if (node->op == TOKEN_AND || node->op == TOKEN_OR) {
+                // The right side runs conditionally
+                type_env_t skipped;
+                env_init(&skipped, env->count, true);
+                env_copy(&skipped, env);
+                infer_expression(st, env, node->right);
+                env_join(env, &skipped);
+                free(skipped.types);
+                type = TYPE_BOOL;
+                break;
+            }
+            
+            uint8_t right = infer_expression(st, env, node->right);
+            opcode_t op = binary_opcode(node->op);
+            type = binary_result_type(op, left, right);
+            node->op_type = operand_class(left, right);
+            break;
+        }
+            
+        case AST_NODE_UNARY_OP: {
+            uint8_t operand = infer_expression(st, env, node->left);
+            if (node->op == TOKEN_NOT) {
+                type = TYPE_BOOL;
+            } else if (node->op == TOKEN_BIT_NOT) {
+                type = TYPE_INT;
+            } else {
+                uint8_t kind = numeric_kind(operand);
+                type = kind == TYPE_NONE ? TYPE_NONE : kind;
+            }
+            break;
+        }
+            
+        case AST_NODE_CAST:
+            infer_expression(st, env, node->left);
+            switch (node->op) {
+                case OP_CAST_INT:    type = TYPE_INT; break;
+                case OP_CAST_FLOAT:  type = float_type(st->ctx); break;
+                case OP_CAST_STRING: type = TYPE_STRING; break;
+                default:             type = TYPE_BOOL; break;
+            }
+            break;
+            
+        case AST_NODE_INDEX:
+            infer_expression(st, env, node->left);
+            infer_expression(st, env, node->right);
+            type = TYPE_ANY;
+            break;
+            
+        case AST_NODE_ARRAY_LITERAL:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                infer_expression(st, env, node->data.block.statements[i]);
+            }
+            type = TYPE_ARRAY;
+            break;
+            
+        case AST_NODE_TERNARY: {
+            infer_expression(st, env, node->data.control.condition);
+            type_env_t other;
+            env_init(&other, env->count, true);
+            env_copy(&other, env);
+            uint8_t then_type = infer_expression(st, env, node->data.control.then_block);
+            uint8_t else_type = infer_expression(st, &other, node->data.control.else_block);
+            env_join(env, &other);
+            free(other.types);
+            type = type_join(then_type, else_type);
+            break;
+        }
+            
+        case AST_NODE_FUNCTION_CALL: {
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                infer_expression(st, env, node->data.function_call.arguments[i]);
+            }
+            int function = find_function(st->ctx, node->data.function_call.name);
+            type = function >= 0 ? st->ctx->functions[function].return_type
+                                 : builtin_return_type(node->data.function_call.name);
+            break;
+        }
+            
+        case AST_NODE_ASSIGNMENT:
+            type = infer_assignment(st, env, node);
+            break;
+            
+        case AST_NODE_MATCH:
+            type = infer_match(st, env, node);
+            break;
+            
+        case AST_NODE_INC_DEC: {
+            ast_node_t *target = node->left;
+            if (target->type != AST_NODE_IDENTIFIER) {
+                infer_expression(st, env, target);
+                type = TYPE_ANY;
+                break;
+            }
+            
+            const char *name = target->data.identifier.name;
+            uint8_t old = env_read(st, env, name);
+            uint8_t updated = old;
+            if (old == TYPE_NULL) {
+                updated = node->op == TOKEN_INCREMENT ? TYPE_INT : TYPE_NULL;
+            } else if (old != TYPE_INT && old != TYPE_FLOAT && old != TYPE_NONE) {
+                updated = TYPE_ANY;
+            }
+            node->op_type = old == TYPE_INT ? TYPE_INT : TYPE_ANY;
+            env_write(st, env, name, updated);
+            type = node->data.inc_dec.prefix ? updated : old;
+            break;
+        }
+            
+        default:
+            type = TYPE_ANY;
+            break;
+    }
+    
+    node->value_type = type;
+    return type;
+}
+
+// Runs a loop body to a fixed point. head is the state entering the
+// condition; on return env holds the state after the loop exits.
+static void infer_loop(infer_state_t *st, type_env_t *env, ast_node_t *condition,
+                       ast_node_t *body, ast_node_t *step) {
+    type_env_t head, iter;
+    env_init(&head, env->count, true);
+    env_init(&iter, env->count, true);
+    env_copy(&head, env);
+    
+    infer_loop_t loop;
+    env_init(&loop.breaks, env->count, false);
+    env_init(&loop.continues, env->count, false);
+    loop.outer = st->loop;
+    
+    for (int pass = 0; pass < 16; pass++) {
+        env_copy(&iter, &head);
+        loop.breaks.reachable = false;
+        loop.continues.reachable = false;
+        st->loop = &loop;
+        
+        if (condition) infer_expression(st, &iter, condition);
+        
+        // Exit state: condition false, or any break
+        env_copy(env, &iter);
+        if (!condition) env->reachable = false;
+        
+        infer_statement(st, &iter, body);
+        env_join(&iter, &loop.continues);
+        if (step) infer_statement(st, &iter, step);
+        
+        st->loop = loop.outer;
+        
+        type_env_t next;
+        env_init(&next, head.count, true);
+        env_copy(&next, &head);
+        env_join(&next, &iter);
+        bool stable = env_equal(&next, &head);
+        env_copy(&head, &next);
+        free(next.types);
+        
+        if (stable) break;
+    }
+    
+    env_join(env, &loop.breaks);
+    
+    free(head.types);
+    free(iter.types);
+    free(loop.breaks.types);
+    free(loop.continues.types);
+}
+
+static void infer_statement(infer_state_t *st, type_env_t *env, ast_node_t *node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case AST_NODE_BLOCK:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                infer_statement(st, env, node->data.block.statements[i]);
+            }
+            break;
+            
+        case AST_NODE_EXPRESSION:
+            infer_expression(st, env, node->left);
+            break;
+            
+        case AST_NODE_ECHO:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                infer_expression(st, env, node->data.block.statements[i]);
+            }
+            break;
+            
+        case AST_NODE_IF_STATEMENT: {
+            infer_expression(st, env, node->data.control.condition);
+            type_env_t other;
+            env_init(&other, env->count, true);
+            env_copy(&other, env);
+            infer_statement(st, env, node->data.control.then_block);
+            infer_statement(st, &other, node->data.control.else_block);
+            env_join(env, &other);
+            free(other.types);
+            break;
+        }
+            
+        case AST_NODE_WHILE_STATEMENT:
+            infer_loop(st, env, node->data.control.condition, node->data.control.then_block, NULL);
+            break;
+            
+        case AST_NODE_FOR_STATEMENT:
+            infer_statement(st, env, node->left);
+            infer_loop(st, env, node->data.control.condition, node->data.control.then_block, node->right);
+            break;
+            
+        case AST_NODE_BREAK:
+        case AST_NODE_CONTINUE: {
+            infer_loop_t *loop = st->loop;
+            for (int64_t level = 1; loop && level < node->data.literal.value.int_val; level++) {
+                loop = loop->outer;
+            }
+            if (loop) {
+                env_join(node->type == AST_NODE_BREAK ? &loop->breaks : &loop->continues, env);
+            }
+            env->reachable = false;
+            break;
+        }
+            
+        case AST_NODE_RETURN: {
+            uint8_t type = node->left ? infer_expression(st, env, node->left) : TYPE_NULL;
+            if (env->reachable) st->return_type = type_join(st->return_type, type);
+            env->reachable = false;
+            break;
+        }
+            
+        case AST_NODE_SWITCH:
+            infer_switch(st, env, node);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// State in which some case body or match arm is entered: the subject
+// and any prefix of the labels have been evaluated
+static void infer_dispatch(infer_state_t *st, type_env_t *env, ast_node_t *node, type_env_t *dispatch) {
+    infer_expression(st, env, node->left);
+    env_copy(dispatch, env);
+    
+    for (size_t i = 0; i < node->data.block.statement_count; i++) {
+        ast_node_t *clause = node->data.block.statements[i];
+        if (node->type == AST_NODE_SWITCH) {
+            if (!clause->left) continue;
+            infer_expression(st, env, clause->left);
+            env_join(dispatch, env);
+            continue;
+        }
+        for (size_t c = 0; c < clause->data.block.statement_count; c++) {
+            infer_expression(st, env, clause->data.block.statements[c]);
+            env_join(dispatch, env);
+        }
+    }
+}
+
+static void infer_switch(infer_state_t *st, type_env_t *env, ast_node_t *node) {
+    type_env_t dispatch, body;
+    env_init(&dispatch, env->count, true);
+    env_init(&body, env->count, false);
+    infer_dispatch(st, env, node, &dispatch);
+    
+    // break and continue both leave a switch
+    infer_loop_t loop;
+    env_init(&loop.breaks, env->count, false);
+    env_init(&loop.continues, env->count, false);
+    loop.outer = st->loop;
+    st->loop = &loop;
+    
+    bool has_default = false;
+    for (size_t i = 0; i < node->data.block.statement_count; i++) {
+        ast_node_t *clause = node->data.block.statements[i];
+        if (!clause->left) has_default = true;
+        env_join(&body, &dispatch);
+        infer_statement(st, &body, clause->right);
+    }
+    st->loop = loop.outer;
+    
+    env_copy(env, &body);
+    env_join(env, &loop.breaks);
+    env_join(env, &loop.continues);
+    if (!has_default) env_join(env, &dispatch);
+    
+    free(dispatch.types);
+    free(body.types);
+    free(loop.breaks.types);
+    free(loop.continues.types);
+}
+
+static uint8_t infer_match(infer_state_t *st, type_env_t *env, ast_node_t *node) {
+    type_env_t dispatch, arm;
+    env_init(&dispatch, env->count, true);
+    env_init(&arm, env->count, true);
+    infer_dispatch(st, env, node, &dispatch);
+    
+    // Without a matching arm the VM raises an error, so only arms flow on
+    uint8_t type = TYPE_NONE;
+    env->reachable = false;
+    for (size_t i = 0; i < node->data.block.statement_count; i++) {
+        env_copy(&arm, &dispatch);
+        type = type_join(type, infer_expression(st, &arm, node->data.block.statements[i]->right));
+        env_join(env, &arm);
+    }
+    
+    free(dispatch.types);
+    free(arm.types);
+    return type;
+}
+
+static uint8_t infer_function(compiler_context_t *ctx, size_t index) {
+    compiler_function_t *fn = &ctx->functions[index];
+    infer_state_t st = { ctx, fn, NULL, TYPE_NONE };
+    
+    type_env_t env;
+    env_init(&env, fn->scope.symbol_count, true);
+    for (size_t i = 0; i < fn->scope.symbol_count; i++) {
+        const symbol_t *symbol = &fn->scope.symbols[i];
+        bool is_param = !symbol->is_global && symbol->slot < fn->param_count;
+        env.types[i] = (is_param || symbol_is_shared(ctx, fn, symbol)) ? TYPE_ANY : TYPE_NULL;
+    }
+    
+    infer_statement(&st, &env, fn->definition ? fn->definition->left : ctx->ast_root);
+    
+    // Falling off the end returns null
+    if (env.reachable) st.return_type = type_join(st.return_type, TYPE_NULL);
+    
+    free(env.types);
+    return st.return_type;
+}
+
+int compiler_infer_types(compiler_context_t *ctx) {
+    if (ctx->function_count == 0) return -1;
+    
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        ctx->functions[i].return_type = TYPE_NONE;
+    }
+    
+    // Iterate until return types (and with them every annotation) settle
+    for (int round = 0; round < 16; round++) {
+        bool changed = false;
+        for (size_t i = 0; i < ctx->function_count; i++) {
+            ctx->current_function = i;
+            uint8_t type = infer_function(ctx, i);
+            if (type != ctx->functions[i].return_type) {
+                ctx->functions[i].return_type = type;
+                changed = true;
+            }
+        }
+        if (!changed) break;
+    }
+    
+    ctx->current_function = 0;
+    return 0;
+}
+
+static void emit_expression(compiler_context_t *ctx, ast_node_t *node);
+static void emit_assignment(compiler_context_t *ctx, ast_node_t *node, bool want_value);
+static void emit_inc_dec(compiler_context_t *ctx, ast_node_t *node, bool want_value);
+static void emit_match(compiler_context_t *ctx, ast_node_t *node);
+static void emit_statement(compiler_context_t *ctx, ast_node_t *node);
+
+// Array element target: `$var[...]` only
+static symbol_t* index_base_symbol(compiler_context_t *ctx, ast_node_t *target) {
+    if (!target->left || target->left->type != AST_NODE_IDENTIFIER) {
+        compiler_set_error(ctx, "Nested array assignment is not supported (line %d)", target->line);
+        return NULL;
+    }
+    return scope_lookup(&current_function(ctx)->scope, target->left->data.identifier.name);
+}
+
+static uint16_t array_set_flags(const symbol_t *symbol, bool append) {
+    return (symbol->is_global ? MICROPHP_ARRAY_SET_GLOBAL : 0) | (append ? MICROPHP_ARRAY_SET_APPEND : 0);
+}
+
+static bool is_simple_operand(const ast_node_t *node) {
+    return node->type == AST_NODE_LITERAL || node->type == AST_NODE_IDENTIFIER;
+}
+
+// Push the element index; returns the temp slot holding it, or -1 if the
+// index expression is simple enough to evaluate twice
+static int emit_index_operand(compiler_context_t *ctx, ast_node_t *index, bool reused) {
+    if (!reused || is_simple_operand(index)) {
+        emit_expression(ctx, index);
+        return -1;
+    }
+    
+    int temp = alloc_temp_slot(ctx);
+    if (temp < 0) return -1;
+    emit_expression(ctx, index);
+    emit(ctx, OP_SET_LOCAL, (uint16_t)temp, 0);
+    emit(ctx, OP_GET_LOCAL, (uint16_t)temp, 0);
+    return temp;
+}
+
+static void emit_reload_index(compiler_context_t *ctx, ast_node_t *index, int temp) {
+    if (temp >= 0) {
+        emit(ctx, OP_GET_LOCAL, (uint16_t)temp, 0);
+    } else {
+        emit_expression(ctx, index);
+    }
+}
+
+// Specialized opcode for an operation whose operands were inferred to be
+// both int or both float; falls back to the generic opcode otherwise
+static opcode_t typed_opcode(compiler_context_t *ctx, opcode_t op, uint8_t op_type) {
+    opcode_t typed = op;
+    
+    if (op_type == TYPE_INT) {
+        switch (op) {
+            case OP_ADD: typed = OP_ADD_I; break;
+            case OP_SUB: typed = OP_SUB_I; break;
+            case OP_MUL: typed = OP_MUL_I; break;
+            case OP_LT:  typed = OP_LT_I; break;
+            case OP_LTE: typed = OP_LTE_I; break;
+            case OP_GT:  typed = OP_GT_I; break;
+            case OP_GTE: typed = OP_GTE_I; break;
+            case OP_EQ:  typed = OP_EQ_I; break;
+            case OP_NEQ: typed = OP_NEQ_I; break;
+            case OP_INC: typed = OP_INC_I; break;
+            case OP_DEC: typed = OP_DEC_I; break;
+            default: break;
+        }
+    } else if (op_type == TYPE_FLOAT) {
+        switch (op) {
+            case OP_ADD: typed = OP_ADD_F; break;
+            case OP_SUB: typed = OP_SUB_F; break;
+            case OP_MUL: typed = OP_MUL_F; break;
+            case OP_DIV: typed = OP_DIV_F; break;
+            case OP_LT:  typed = OP_LT_F; break;
+            case OP_LTE: typed = OP_LTE_F; break;
+            case OP_GT:  typed = OP_GT_F; break;
+            case OP_GTE: typed = OP_GTE_F; break;
+            default: break;
+        }
+    }
+    
+    if (typed != op) ctx->typed_op_count++;
+    return typed;
+}
+
+// Operands of a chain of `.`, in order
+static void concat_operands(ast_node_t *node, ast_node_t ***parts, size_t *count) {
+    if (node->type == AST_NODE_BINARY_OP && node->op == TOKEN_DOT && !node->hoisted) {
+        concat_operands(node->left, parts, count);
+        concat_operands(node->right, parts, count);
+        return;
+    }
+    *parts = compiler_realloc(*parts, (*count + 1) * sizeof(ast_node_t*));
+    (*parts)[(*count)++] = node;
+}
+
+// Whether evaluating node could change $name: it assigns, or makes a
+// call while $name is shared with other functions or tasks
+static bool may_modify(const ast_node_t *node, bool shared) {
+    if (!node) return false;
+    
+    switch (node->type) {
+        case AST_NODE_ASSIGNMENT:
+        case AST_NODE_INC_DEC:
+        case AST_NODE_FUNCTION_DEFINITION:
+            return true;
+            
+        case AST_NODE_FUNCTION_CALL:
+            if (shared) return true;
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                if (may_modify(node->data.function_call.arguments[i], shared)) return true;
+            }
+            break;
+            
+        case AST_NODE_TERNARY:
+            if (may_modify(node->data.control.condition, shared) ||
+                may_modify(node->data.control.then_block, shared) ||
+                may_modify(node->data.control.else_block, shared)) {
+                return true;
+            }
+            break;
+            
+        case AST_NODE_ARRAY_LITERAL:
+        case AST_NODE_MATCH:
+        case AST_NODE_MATCH_ARM:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                if (may_modify(node->data.block.statements[i], shared)) return true;
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    return may_modify(node->left, shared) || may_modify(node->right, shared);
+}
+
+// String building: `$s .= a . b` and `$s = $s . a . b` append each
+// operand to $s in place (OP_APPEND_*), so a string grown in a loop is not
+// copied whole on every step. The operands are evaluated before $s is
+// touched, so the rewrite needs them not to modify $s.
+static bool emit_append(compiler_context_t *ctx, ast_node_t *node, bool want_value) {
+    if (ctx->opt_level == COMPILER_OPT_NONE) return false;
+    if (node->op != TOKEN_CONCAT_ASSIGN && node->op != TOKEN_ASSIGN) return false;
+    
+    const char *name = node->data.assignment.variable;
+    compiler_function_t *fn = current_function(ctx);
+    symbol_t *symbol = scope_lookup(&fn->scope, name);
+    ast_node_t *value = node->data.assignment.value;
+    if (!symbol || !value) return false;
+    if (node->op == TOKEN_ASSIGN && (value->type != AST_NODE_BINARY_OP || value->op != TOKEN_DOT)) return false;
+    
+    ast_node_t **parts = NULL;
+    size_t count = 0;
+    concat_operands(value, &parts, &count);
+    
+    size_t first = 0;
+    bool rewritable = true;
+    if (node->op == TOKEN_ASSIGN) {
+        const ast_node_t *head = parts[0];
+        rewritable = head->type == AST_NODE_IDENTIFIER && !head->hoisted &&
+                     strcmp(head->data.identifier.name, name) == 0;
+        first = 1;
+    }
+    bool shared = symbol_is_shared(ctx, fn, symbol);
+    for (size_t i = first; rewritable && i < count; i++) {
+        if (may_modify(parts[i], shared)) rewritable = false;
+    }
+    if (!rewritable) {
+        free(parts);
+        return false;
+    }
+    
+    for (size_t i = first; i < count; i++) {
+        emit_expression(ctx, parts[i]);
+    }
+    emit(ctx, symbol->is_global ? OP_APPEND_GLOBAL : OP_APPEND_LOCAL, symbol->slot, (uint16_t)(count - first));
+    if (want_value) emit_load_variable(ctx, name);
+    ctx->append_count++;
+    free(parts);
+    return true;
+}
+
+static void emit_assignment(compiler_context_t *ctx, ast_node_t *node, bool want_value) {
+    ast_node_t *value = node->data.assignment.value;
+    bool compound = node->op != TOKEN_ASSIGN;
+    
+    if (node->data.assignment.variable) {
+        const char *name = node->data.assignment.variable;
+        if (emit_append(ctx, node, want_value)) return;
+        if (compound) emit_load_variable(ctx, name);
+        emit_expression(ctx, value);
+        if (compound) emit(ctx, typed_opcode(ctx, binary_opcode(node->op), node->op_type), 0, 0);
+        if (want_value) emit(ctx, OP_DUP, 0, 0);
+        emit_store_variable(ctx, name);
+        return;
+    }
+    
+    ast_node_t *target = node->left;
+    symbol_t *symbol = index_base_symbol(ctx, target);
+    if (!symbol) return;
+    
+    bool append = target->right == NULL;
+    if (append && compound) {
+        compiler_set_error(ctx, "Cannot use [] for reading (line %d)", node->line);
+        return;
+    }
+    
+    int index_temp = -1;
+    if (!append) index_temp = emit_index_operand(ctx, target->right, compound);
+    
+    if (compound) {
+        emit_load_variable(ctx, target->left->data.identifier.name);
+        emit_reload_index(ctx, target->right, index_temp);
+        emit(ctx, OP_ARRAY_GET, 0, 0);
+    }
+    emit_expression(ctx, value);
+    if (compound) emit(ctx, binary_opcode(node->op), 0, 0);
+    
+    int value_temp = -1;
+    if (want_value) {
+        value_temp = alloc_temp_slot(ctx);
+        if (value_temp < 0) return;
+        emit(ctx, OP_DUP, 0, 0);
+        emit(ctx, OP_SET_LOCAL, (uint16_t)value_temp, 0);
+    }
+    
+    emit(ctx, OP_ARRAY_SET, symbol->slot, array_set_flags(symbol, append));
+    if (want_value) emit(ctx, OP_GET_LOCAL, (uint16_t)value_temp, 0);
+}
+
+static void emit_inc_dec(compiler_context_t *ctx, ast_node_t *node, bool want_value) {
+    opcode_t opcode = node->op == TOKEN_INCREMENT ? OP_INC : OP_DEC;
+    bool prefix = node->data.inc_dec.prefix;
+    ast_node_t *target = node->left;
+    
+    if (target->type == AST_NODE_IDENTIFIER) {
+        const char *name = target->data.identifier.name;
+        emit_load_variable(ctx, name);
+        if (want_value && !prefix) emit(ctx, OP_DUP, 0, 0);
+        emit(ctx, typed_opcode(ctx, opcode, node->op_type), 0, 0);
+        if (want_value && prefix) emit(ctx, OP_DUP, 0, 0);
+        emit_store_variable(ctx, name);
+        return;
+    }
+    
+    symbol_t *symbol = index_base_symbol(ctx, target);
+    if (!symbol) return;
+    if (!target->right) {
+        compiler_set_error(ctx, "Cannot use [] for reading (line %d)", node->line);
+        return;
+    }
+    
+    int index_temp = emit_index_operand(ctx, target->right, true);
+    emit_load_variable(ctx, target->left->data.identifier.name);
+    emit_reload_index(ctx, target->right, index_temp);
+    emit(ctx, OP_ARRAY_GET, 0, 0);
+    
+    int value_temp = -1;
+    if (want_value) {
+        value_temp = alloc_temp_slot(ctx);
+        if (value_temp < 0) return;
+    }
+    
+    if (want_value && !prefix) {
+        emit(ctx, OP_DUP, 0, 0);
+        emit(ctx, OP_SET_LOCAL, (uint16_t)value_temp, 0);
+    }
+    emit(ctx, opcode, 0, 0);
+    if (want_value && prefix) {
+        emit(ctx, OP_DUP, 0, 0);
+        emit(ctx, OP_SET_LOCAL, (uint16_t)value_temp, 0);
+    }
+    
+    emit(ctx, OP_ARRAY_SET, symbol->slot, array_set_flags(symbol, false));
+    if (want_value) emit(ctx, OP_GET_LOCAL, (uint16_t)value_temp, 0);
+}
+
+// printf/sprintf with a literal format are checked here: a malformed
+// format or missing arguments is a compile error instead of false at run
+// time. From -O1 a format of bare %s and %d directives taking the
+// arguments in order is lowered away entirely: printf as a statement
+// becomes an echo of the pieces and sprintf a concatenation, with %d as
+// an (int) cast. Returns the literal format node, or NULL.
+static const ast_node_t* format_literal(compiler_context_t *ctx, ast_node_t *node) {
+    const char *name = node->data.function_call.name;
+    if (strcmp(name, "printf") != 0 && strcmp(name, "sprintf") != 0) return NULL;
+    if (find_function(ctx, name) >= 0 || node->data.function_call.argument_count == 0) return NULL;
+    
+    const ast_node_t *format = node->data.function_call.arguments[0];
+    if (format->type != AST_NODE_LITERAL || format->data.literal.literal_type != LITERAL_STRING || format->hoisted) return NULL;
+    
+    size_t given = node->data.function_call.argument_count - 1;
+    int arity = microphp_format_arity(format->data.literal.value.string_val, format->data.literal.string_len);
+    if (arity < 0) {
+        compiler_set_error(ctx, "Malformed format string in %s() (line %d)", name, node->line);
+        return NULL;
+    }
+    if ((size_t)arity > given) {
+        compiler_set_error(ctx, "%s() needs %d argument%s after the format, %zu given (line %d)",
+                           name, arity, arity == 1 ? "" : "s", given, node->line);
+        return NULL;
+    }
+    return format;
+}
+
+// Emits the pieces of a lowerable format in order, each converted for
+// echo or concatenation. Returns the piece count, or -1 (with nothing
+// emitted) when the format needs the runtime formatter.
+static int emit_format_pieces(compiler_context_t *ctx, ast_node_t *node, const ast_node_t *format, bool concat) {
+    if (ctx->opt_level == COMPILER_OPT_NONE) return -1;
+    
+    const char *text = format->data.literal.value.string_val;
+    size_t len = format->data.literal.string_len;
+    size_t directives = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] != '%') continue;
+        if (text[i + 1] == '%') {
+            i++;
+        } else if (text[i + 1] == 's' || text[i + 1] == 'd') {
+            directives++;
+            i++;
+        } else {
+            return -1;
+        }
+    }
+    // Every argument is formatted once, in order, so evaluation order holds
+    if (directives != node->data.function_call.argument_count - 1) return -1;
+    
+    char *run = malloc(len + 1);
+    if (!run) {
+        compiler_set_error(ctx, "Out of memory");
+        return -1;
+    }
+    
+    int pieces = 0;
+    size_t run_len = 0;
+    size_t arg = 1;
+    for (size_t i = 0; i <= len; i++) {
+        bool directive = i < len && text[i] == '%' && text[i + 1] != '%';
+        if (i < len && !directive) {
+            run[run_len++] = text[i];
+            if (text[i] == '%') i++;
+            continue;
+        }
+        if (run_len > 0) {
+            emit_constant(ctx, microphp_zval_string(run, run_len));
+            if (concat && pieces > 0) emit(ctx, OP_STRING_CONCAT, 0, 0);
+            pieces++;
+            run_len = 0;
+        }
+        if (!directive) break;
+        
+        ast_node_t *value = node->data.function_call.arguments[arg++];
+        emit_expression(ctx, value);
+        if (text[i + 1] == 'd') {
+            emit(ctx, OP_CAST_INT, 0, 0);
+        } else if (concat && value->value_type != TYPE_STRING) {
+            // Concatenation would render an array as ""
+            emit(ctx, OP_CAST_STRING, 0, 0);
+        }
+        if (concat && pieces == 0 && text[i + 1] == 'd') emit(ctx, OP_CAST_STRING, 0, 0);
+        if (concat && pieces > 0) emit(ctx, OP_STRING_CONCAT, 0, 0);
+        pieces++;
+        i++;
+    }
+    free(run);
+    
+    if (concat && pieces == 0) {
+        emit_constant(ctx, microphp_zval_string(NULL, 0));
+        pieces++;
+    }
+    ctx->format_count++;
+    return pieces;
+}
+
+// printf(...) as a statement; false if it is an ordinary call
+static bool emit_printf_statement(compiler_context_t *ctx, ast_node_t *node) {
+    if (strcmp(node->data.function_call.name, "printf") != 0) return false;
+    const ast_node_t *format = format_literal(ctx, node);
+    if (!format) return ctx->has_error;
+    
+    int pieces = emit_format_pieces(ctx, node, format, false);
+    if (pieces < 0) return ctx->has_error;
+    if (pieces > 0) {
+        emit(ctx, OP_CALL_BUILTIN, (uint16_t)microphp_builtin_lookup("echo"), (uint16_t)pieces);
+        emit(ctx, OP_POP, 0, 0);
+    }
+    return true;
+}
+
+static void emit_call(compiler_context_t *ctx, ast_node_t *node) {
+    const char *name = node->data.function_call.name;
+    size_t argc = node->data.function_call.argument_count;
+    
+    const ast_node_t *format = format_literal(ctx, node);
+    if (ctx->has_error) return;
+    if (format && strcmp(name, "sprintf") == 0 && emit_format_pieces(ctx, node, format, true) >= 0) return;
+    if (ctx->has_error) return;
+    
+    for (size_t i = 0; i < argc; i++) {
+        emit_expression(ctx, node->data.function_call.arguments[i]);
+    }
+    
+    int function = find_function(ctx, name);
+    if (function >= 0) {
+        emit(ctx, OP_CALL, (uint16_t)function, (uint16_t)argc);
+        return;
+    }
+    
+    int builtin = microphp_builtin_lookup(name);
+    if (builtin >= 0) {
+        emit(ctx, OP_CALL_BUILTIN, (uint16_t)builtin, (uint16_t)argc);
+        return;
+    }
+    
+    compiler_set_error(ctx, "Call to undefined function %s() (line %d)", name, node->line);
+}
+
+static void emit_expression(compiler_context_t *ctx, ast_node_t *node) {
+    if (!node || ctx->has_error) return;
+    
+    if (node->hoisted) {
+        emit(ctx, OP_GET_LOCAL, node->hoist_slot, 0);
+        return;
+    }
+    
+    switch (node->type) {
+        case AST_NODE_LITERAL:
+            switch (node->data.literal.literal_type) {
+                case LITERAL_INT:
+                    emit_constant(ctx, microphp_zval_int(node->data.literal.value.int_val));
+                    break;
+                case LITERAL_FLOAT:
+                    emit_constant(ctx, float_constant(ctx, node->data.literal.value.float_val));
+                    break;
+                case LITERAL_STRING:
+                    emit_constant(ctx, microphp_zval_string(node->data.literal.value.string_val,
+                                                            node->data.literal.string_len));
+                    break;
+                case LITERAL_BOOL:
+                    emit_constant(ctx, microphp_zval_bool(node->data.literal.value.bool_val));
+                    break;
+                default:
+                    emit_constant(ctx, microphp_zval_null());
+                    break;
+            }
+            break;
+            
+        case AST_NODE_IDENTIFIER:
+            emit_load_variable(ctx, node->data.identifier.name);
+            break;
+            
+        case AST_NODE_NAMED_CONSTANT: {
+            const char *name = node->data.identifier.name;
+            for (size_t i = 0; i < sizeof(named_constants) / sizeof(named_constants[0]); i++) {
+                const named_constant_t *c = &named_constants[i];
+                if (strcmp(c->name, name) != 0) continue;
+                
+                if (c->literal_type == LITERAL_INT) {
+                    emit_constant(ctx, microphp_zval_int(named_int(ctx, c)));
+                } else if (c->literal_type == LITERAL_FLOAT) {
+                    emit_constant(ctx, float_constant(ctx, c->float_val));
+                } else {
+                    emit_constant(ctx, microphp_zval_string(c->string_val, strlen(c->string_val)));
+                }
+                return;
+            }
+            compiler_set_error(ctx, "Undefined constant %s (line %d)", name, node->line);
+            break;
+        }
+            
+        case AST_NODE_BINARY_OP:
+            if (node->op == TOKEN_AND || node->op == TOKEN_OR) {
+                // Short-circuit evaluation producing a bool
+                bool is_and = node->op == TOKEN_AND;
+                opcode_t skip = is_and ? OP_JMPZ : OP_JMPNZ;
+                
+                emit_expression(ctx, node->left);
+                size_t first = emit(ctx, skip, 0, 0);
+                emit_expression(ctx, node->right);
+                size_t second = emit(ctx, skip, 0, 0);
+                emit_constant(ctx, microphp_zval_bool(is_and));
+                size_t done = emit(ctx, OP_JMP, 0, 0);
+                patch_jump(ctx, first, code_position(ctx));
+                patch_jump(ctx, second, code_position(ctx));
+                emit_constant(ctx, microphp_zval_bool(!is_and));
+                patch_jump(ctx, done, code_position(ctx));
+                break;
+            }
+            
+            emit_expression(ctx, node->left);
+            emit_expression(ctx, node->right);
+            emit(ctx, typed_opcode(ctx, binary_opcode(node->op), node->op_type), 0, 0);
+            break;
+            
+        case AST_NODE_UNARY_OP:
+            emit_expression(ctx, node->left);
+            emit(ctx, node->op == TOKEN_NOT ? OP_NOT : (node->op == TOKEN_MINUS ? OP_NEG : OP_BIT_NOT), 0, 0);
+            break;
+            
+        case AST_NODE_CAST:
+            emit_expression(ctx, node->left);
+            if (node->op == OP_CAST_FLOAT && ctx->fixed_point) {
+                emit(ctx, OP_CALL_BUILTIN, (uint16_t)microphp_builtin_lookup("fixed"), 1);
+                break;
+            }
+            emit(ctx, (opcode_t)node->op, 0, 0);
+            break;
+            
+        case AST_NODE_INDEX:
+            if (!node->right) {
+                compiler_set_error(ctx, "Cannot use [] for reading (line %d)", node->line);
+                break;
+            }
+            emit_expression(ctx, node->left);
+            emit_expression(ctx, node->right);
+            emit(ctx, OP_ARRAY_GET, 0, 0);
+            break;
+            
+        case AST_NODE_ARRAY_LITERAL:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                emit_expression(ctx, node->data.block.statements[i]);
+            }
+            emit(ctx, OP_NEW_ARRAY, (uint16_t)node->data.block.statement_count, 0);
+            break;
+            
+        case AST_NODE_TERNARY: {
+            emit_expression(ctx, node->data.control.condition);
+            size_t else_jump = emit(ctx, OP_JMPZ, 0, 0);
+            emit_expression(ctx, node->data.control.then_block);
+            size_t end_jump = emit(ctx, OP_JMP, 0, 0);
+            patch_jump(ctx, else_jump, code_position(ctx));
+            emit_expression(ctx, node->data.control.else_block);
+            patch_jump(ctx, end_jump, code_position(ctx));
+            break;
+        }
+            
+        case AST_NODE_FUNCTION_CALL:
+            emit_call(ctx, node);
+            break;
+            
+        case AST_NODE_ASSIGNMENT:
+            emit_assignment(ctx, node, true);
+            break;
+            
+        case AST_NODE_INC_DEC:
+            emit_inc_dec(ctx, node, true);
+            break;
+            
+        case AST_NODE_MATCH:
+            emit_match(ctx, node);
+            break;
+            
+        default:
+            compiler_set_error(ctx, "Unsupported expression (line %d)", node->line);
+            break;
+    }
+}
+
+static void loop_add_jump(size_t **jumps, size_t *count, size_t jump) {
+    *jumps = compiler_realloc(*jumps, (*count + 1) * sizeof(size_t));
+    (*jumps)[(*count)++] = jump;
+}
+
+static void loop_finish(compiler_context_t *ctx, loop_context_t *loop, size_t continue_target, size_t break_target) {
+    for (size_t i = 0; i < loop->continue_count; i++) {
+        patch_jump(ctx, loop->continues[i], continue_target);
+    }
+    for (size_t i = 0; i < loop->break_count; i++) {
+        patch_jump(ctx, loop->breaks[i], break_target);
+    }
+    free(loop->continues);
+    free(loop->breaks);
+    ctx->loop = loop->outer;
+}
+
+// switch / match dispatch
+//
+// Labels are tested in order against the subject (== for switch, === for
+// match). With three or more labels that are all int or all string
+// literals, an OP_SWITCH_TABLE ahead of the tests selects the clause in
+// one step: a direct index when the ints are dense, otherwise a perfect
+// hash whose seeds are searched for here. The table is a string constant
+// and its entries are the OP_JMPs that follow the opcode, so the CFG
+// passes retarget them like any other jump.
+#define SWITCH_TABLE_MIN_LABELS 3
+#define SWITCH_DENSE_MAX_RANGE  512
+#define SWITCH_HASH_MAX_SLOTS   1024
+#define SWITCH_HASH_ATTEMPTS    8
+#define SWITCH_HASH_SEEDS       4096
+
+typedef struct {
+    ast_node_t *label;
+    size_t clause;
+} switch_label_t;
+
+// Jumps waiting for clause positions. Clause n is the end of the
+// construct and n + 1 is where a subject that matched nothing goes.
+typedef struct {
+    size_t *jumps;
+    size_t *clauses;
+    size_t count;
+} dispatch_jumps_t;
+
+static void dispatch_add(dispatch_jumps_t *d, size_t jump, size_t clause) {
+    d->jumps = compiler_realloc(d->jumps, (d->count + 1) * sizeof(size_t));
+    d->clauses = compiler_realloc(d->clauses, (d->count + 1) * sizeof(size_t));
+    d->jumps[d->count] = jump;
+    d->clauses[d->count++] = clause;
+}
+
+static void dispatch_finish(compiler_context_t *ctx, dispatch_jumps_t *d, const size_t *starts) {
+    for (size_t i = 0; i < d->count; i++) {
+        patch_jump(ctx, d->jumps[i], starts[d->clauses[i]]);
+    }
+    free(d->jumps);
+    free(d->clauses);
+}
+
+static switch_label_t *collect_labels(ast_node_t *node, size_t *count) {
+    switch_label_t *labels = NULL;
+    *count = 0;
+    
+    for (size_t c = 0; c < node->data.block.statement_count; c++) {
+        ast_node_t *clause = node->data.block.statements[c];
+        ast_node_t **conditions = &clause->left;
+        size_t condition_count = clause->left ? 1 : 0;
+        if (node->type == AST_NODE_MATCH) {
+            conditions = clause->data.block.statements;
+            condition_count = clause->data.block.statement_count;
+        }
+        
+        for (size_t i = 0; i < condition_count; i++) {
+            labels = compiler_realloc(labels, (*count + 1) * sizeof(switch_label_t));
+            labels[(*count)++] = (switch_label_t){ conditions[i], c };
+        }
+    }
+    return labels;
+}
+
+// Clause that ends the dispatch when nothing matches, or -1
+static long default_clause(ast_node_t *node) {
+    for (size_t c = 0; c < node->data.block.statement_count; c++) {
+        ast_node_t *clause = node->data.block.statements[c];
+        bool is_default = node->type == AST_NODE_MATCH ? clause->data.block.statement_count == 0 : !clause->left;
+        if (is_default) return (long)c;
+    }
+    return -1;
+}
+
+// LITERAL_INT or LITERAL_STRING when the labels can go in a table, else -1
+static int table_literal_type(const switch_label_t *labels, size_t count) {
+    if (count < SWITCH_TABLE_MIN_LABELS) return -1;
+    
+    int type = -1;
+    for (size_t i = 0; i < count; i++) {
+        const ast_node_t *label = labels[i].label;
+        if (label->type != AST_NODE_LITERAL || label->hoisted) return -1;
+        int literal_type = label->data.literal.literal_type;
+        if (literal_type != LITERAL_INT && literal_type != LITERAL_STRING) return -1;
+        if (type >= 0 && literal_type != type) return -1;
+        // "10" == "1e1": numeric labels need the == tests, not a hash
+        if (literal_type == LITERAL_STRING &&
+            microphp_numeric_string(label->data.literal.value.string_val, label->data.literal.string_len)) {
+            return -1;
+        }
+        type = literal_type;
+    }
+    return type;
+}
+
+static bool same_label(const ast_node_t *a, const ast_node_t *b) {
+    if (a->data.literal.literal_type == LITERAL_INT) {
+        return a->data.literal.value.int_val == b->data.literal.value.int_val;
+    }
+    return a->data.literal.string_len == b->data.literal.string_len &&
+           memcmp(a->data.literal.value.string_val, b->data.literal.value.string_val, a->data.literal.string_len) == 0;
+}
+
+// Slot of a label, hashed the way the VM hashes the subject
+static uint32_t label_hash(const ast_node_t *label, uint32_t seed) {
+    if (label->data.literal.literal_type == LITERAL_STRING) {
+        return microphp_hash_bytes(label->data.literal.value.string_val, label->data.literal.string_len, seed);
+    }
+    uint8_t key[8];
+    uint64_t value = (uint64_t)label->data.literal.value.int_val;
+    for (int i = 0; i < 8; i++) key[i] = (uint8_t)(value >> (8 * i));
+    return microphp_hash_bytes(key, 8, seed);
+}
+
+// Hash-and-displace: the table seed spreads the keys over buckets and each
+// bucket gets its own seed that puts its keys in free slots. Fills
+// slot_key with the key index in each slot (or MICROPHP_SWITCH_EMPTY).
+static bool place_keys(const switch_label_t *keys, size_t count, uint32_t seed, size_t size, size_t buckets,
+                       uint16_t *bucket_seeds, uint16_t *slot_key) {
+    size_t *bucket_of = compiler_malloc(count * sizeof(size_t));
+    size_t *bucket_size = compiler_malloc(buckets * sizeof(size_t));
+    size_t *slots = compiler_malloc(count * sizeof(size_t));
+    memset(bucket_size, 0, buckets * sizeof(size_t));
+    for (size_t slot = 0; slot < size; slot++) slot_key[slot] = MICROPHP_SWITCH_EMPTY;
+    for (size_t b = 0; b < buckets; b++) bucket_seeds[b] = 0;
+    
+    size_t largest = 0;
+    for (size_t k = 0; k < count; k++) {
+        bucket_of[k] = label_hash(keys[k].label, seed) & (buckets - 1);
+        if (++bucket_size[bucket_of[k]] > largest) largest = bucket_size[bucket_of[k]];
+    }
+    
+    // Fullest buckets first, while most slots are still free
+    bool placed = true;
+    for (size_t fill = largest; fill > 0 && placed; fill--) {
+        for (size_t b = 0; b < buckets && placed; b++) {
+            if (bucket_size[b] != fill) continue;
+            
+            placed = false;
+            for (uint32_t candidate = 0; candidate < SWITCH_HASH_SEEDS && !placed; candidate++) {
+                size_t taken = 0;
+                bool fits = true;
+                for (size_t k = 0; k < count && fits; k++) {
+                    if (bucket_of[k] != b) continue;
+                    size_t slot = label_hash(keys[k].label, candidate) & (size - 1);
+                    fits = slot_key[slot] == MICROPHP_SWITCH_EMPTY;
+                    for (size_t t = 0; t < taken && fits; t++) fits = slots[t] != slot;
+                    slots[taken++] = slot;
+                }
+                if (!fits) continue;
+                
+                taken = 0;
+                for (size_t k = 0; k < count; k++) {
+                    if (bucket_of[k] == b) slot_key[slots[taken++]] = (uint16_t)k;
+                }
+                bucket_seeds[b] = (uint16_t)candidate;
+                placed = true;
+            }
+        }
+    }
+    
+    free(bucket_of);
+    free(bucket_size);
+    free(slots);
+    return placed;
+}
+
+// Builds the table constant for labels of one literal type. On success
+// *entries holds the clause of each table entry, the last being the
+// no-match entry (clause n + 1).
+static int build_switch_table(compiler_context_t *ctx, const switch_label_t *labels, size_t count,
+                              size_t clause_count, int literal_type, size_t **entries, size_t *entry_count) {
+    // The first of equal labels wins
+    switch_label_t *keys = compiler_malloc(count * sizeof(switch_label_t));
+    size_t key_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t k = 0;
+        while (k < key_count && !same_label(keys[k].label, labels[i].label)) k++;
+        if (k == key_count) keys[key_count++] = labels[i];
+    }
+    
+    size_t missing = clause_count + 1;
+    mbc_writer_t w = { NULL, 0, 0 };
+    *entries = NULL;
+    *entry_count = 0;
+    
+    if (literal_type == LITERAL_INT) {
+        int64_t min = keys[0].label->data.literal.value.int_val;
+        int64_t max = min;
+        for (size_t k = 1; k < key_count; k++) {
+            int64_t value = keys[k].label->data.literal.value.int_val;
+            if (value < min) min = value;
+            if (value > max) max = value;
+        }
+        
+        uint64_t range = (uint64_t)max - (uint64_t)min + 1;
+        if (range != 0 && range <= SWITCH_DENSE_MAX_RANGE && range <= 2 * key_count + 8) {
+            *entry_count = (size_t)range + 1;
+            *entries = compiler_malloc(*entry_count * sizeof(size_t));
+            for (size_t e = 0; e < *entry_count; e++) (*entries)[e] = missing;
+            for (size_t k = 0; k < key_count; k++) {
+                uint64_t offset = (uint64_t)keys[k].label->data.literal.value.int_val - (uint64_t)min;
+                (*entries)[offset] = keys[k].clause;
+            }
+            
+            write_u8(&w, MICROPHP_SWITCH_DENSE);
+            write_u64(&w, (uint64_t)min);
+        }
+    }
+    
+    if (w.size == 0) {
+        size_t size = 1;
+        size_t buckets = 1;
+        while (size < key_count) size *= 2;
+        while (buckets * 2 < key_count) buckets *= 2;
+        
+        uint16_t *slot_key = compiler_malloc(SWITCH_HASH_MAX_SLOTS * sizeof(uint16_t));
+        uint16_t *bucket_seeds = compiler_malloc(buckets * sizeof(uint16_t));
+        uint32_t seed = 0;
+        bool found = false;
+        while (!found && size <= SWITCH_HASH_MAX_SLOTS) {
+            for (seed = 0; seed < SWITCH_HASH_ATTEMPTS; seed++) {
+                found = place_keys(keys, key_count, seed, size, buckets, bucket_seeds, slot_key);
+                if (found) break;
+            }
+            if (!found) size *= 2;
+        }
+        
+        if (found) {
+            *entry_count = key_count + 1;
+            *entries = compiler_malloc(*entry_count * sizeof(size_t));
+            for (size_t k = 0; k < key_count; k++) (*entries)[k] = keys[k].clause;
+            (*entries)[key_count] = missing;
+            
+            write_u8(&w, literal_type == LITERAL_INT ? MICROPHP_SWITCH_INT_HASH : MICROPHP_SWITCH_STRING_HASH);
+            write_u32(&w, seed);
+            write_u16(&w, (uint16_t)size);
+            write_u16(&w, (uint16_t)buckets);
+            for (size_t b = 0; b < buckets; b++) write_u16(&w, bucket_seeds[b]);
+            for (size_t slot = 0; slot < size && !ctx->has_error; slot++) {
+                uint16_t k = slot_key[slot];
+                const ast_node_t *key = k == MICROPHP_SWITCH_EMPTY ? NULL : keys[k].label;
+                if (literal_type == LITERAL_INT) {
+                    write_u64(&w, key ? (uint64_t)key->data.literal.value.int_val : 0);
+                } else {
+                    int constant = 0;
+                    if (key) {
+                        constant = add_constant(ctx, microphp_zval_string(key->data.literal.value.string_val,
+                                                                          key->data.literal.string_len));
+                    }
+                    write_u16(&w, (uint16_t)(constant < 0 ? 0 : constant));
+                }
+                write_u16(&w, k);
+            }
+        }
+        
+        free(slot_key);
+        free(bucket_seeds);
+    }
+    
+    free(keys);
+    int constant = -1;
+    if (w.size > 0 && !ctx->has_error) {
+        constant = add_constant(ctx, microphp_zval_string((const char*)w.data, w.size));
+    }
+    free(w.data);
+    if (constant < 0) {
+        free(*entries);
+        *entries = NULL;
+    }
+    return constant;
+}
+
+// OP_SWITCH_TABLE on the subject in slot, or on top of the stack if slot
+// is -1; a subject of another type continues after the entries. Returns
+// false if no table applies.
+static bool emit_switch_table(compiler_context_t *ctx, ast_node_t *node, int slot, const switch_label_t *labels,
+                              size_t count, dispatch_jumps_t *d) {
+    int literal_type = table_literal_type(labels, count);
+    if (ctx->opt_level == COMPILER_OPT_NONE || literal_type < 0) return false;
+    
+    size_t *entries;
+    size_t entry_count;
+    int table = build_switch_table(ctx, labels, count, node->data.block.statement_count, literal_type,
+                                   &entries, &entry_count);
+    if (table < 0) return false;
+    
+    if (slot >= 0) emit(ctx, OP_GET_LOCAL, (uint16_t)slot, 0);
+    emit(ctx, OP_SWITCH_TABLE, (uint16_t)table, (uint16_t)entry_count);
+    for (size_t e = 0; e < entry_count; e++) {
+        dispatch_add(d, emit(ctx, OP_JMP, 0, 0), entries[e]);
+    }
+    free(entries);
+    return true;
+}
+
+// Linear label tests against the subject held in slot
+static void emit_label_tests(compiler_context_t *ctx, int slot, const switch_label_t *labels, size_t count,
+                             opcode_t compare, dispatch_jumps_t *d) {
+    for (size_t i = 0; i < count; i++) {
+        emit(ctx, OP_GET_LOCAL, (uint16_t)slot, 0);
+        emit_expression(ctx, labels[i].label);
+        emit(ctx, compare, 0, 0);
+        dispatch_add(d, emit(ctx, OP_JMPNZ, 0, 0), labels[i].clause);
+    }
+}
+
+static void emit_switch(compiler_context_t *ctx, ast_node_t *node) {
+    size_t clause_count = node->data.block.statement_count;
+    size_t label_count;
+    switch_label_t *labels = collect_labels(node, &label_count);
+    dispatch_jumps_t d = { NULL, NULL, 0 };
+    
+    emit_expression(ctx, node->left);
+    int subject = alloc_temp_slot(ctx);
+    if (subject < 0) {
+        free(labels);
+        return;
+    }
+    emit(ctx, OP_SET_LOCAL, (uint16_t)subject, 0);
+    
+    // A subject of another type than the table's keys may still be == to
+    // a label, so the tests stay behind the table
+    emit_switch_table(ctx, node, subject, labels, label_count, &d);
+    emit_label_tests(ctx, subject, labels, label_count, OP_EQ, &d);
+    dispatch_add(&d, emit(ctx, OP_JMP, 0, 0), clause_count + 1);
+    free(labels);
+    
+    // break and continue leave the switch
+    loop_context_t loop = { NULL, 0, NULL, 0, ctx->loop };
+    ctx->loop = &loop;
+    
+    size_t *starts = compiler_malloc((clause_count + 2) * sizeof(size_t));
+    for (size_t c = 0; c < clause_count; c++) {
+        starts[c] = code_position(ctx);
+        emit_statement(ctx, node->data.block.statements[c]->right);
+    }
+    starts[clause_count] = code_position(ctx);
+    long fallback = default_clause(node);
+    starts[clause_count + 1] = fallback >= 0 ? starts[fallback] : starts[clause_count];
+    
+    loop_finish(ctx, &loop, starts[clause_count], starts[clause_count]);
+    dispatch_finish(ctx, &d, starts);
+    free(starts);
+}
+
+static void emit_match(compiler_context_t *ctx, ast_node_t *node) {
+    size_t arm_count = node->data.block.statement_count;
+    size_t label_count;
+    switch_label_t *labels = collect_labels(node, &label_count);
+    dispatch_jumps_t d = { NULL, NULL, 0 };
+    
+    // === never holds across types, so a table makes the tests redundant
+    emit_expression(ctx, node->left);
+    if (!emit_switch_table(ctx, node, -1, labels, label_count, &d)) {
+        int subject = alloc_temp_slot(ctx);
+        if (subject < 0) {
+            free(labels);
+            return;
+        }
+        emit(ctx, OP_SET_LOCAL, (uint16_t)subject, 0);
+        emit_label_tests(ctx, subject, labels, label_count, OP_IDENTICAL, &d);
+    }
+    free(labels);
+    
+    size_t *starts = compiler_malloc((arm_count + 2) * sizeof(size_t));
+    starts[arm_count + 1] = code_position(ctx);
+    long fallback = default_clause(node);
+    if (fallback >= 0) {
+        dispatch_add(&d, emit(ctx, OP_JMP, 0, 0), (size_t)fallback);
+    } else {
+        emit(ctx, OP_MATCH_ERROR, 0, 0);
+    }
+    
+    for (size_t a = 0; a < arm_count; a++) {
+        starts[a] = code_position(ctx);
+        emit_expression(ctx, node->data.block.statements[a]->right);
+        dispatch_add(&d, emit(ctx, OP_JMP, 0, 0), arm_count);
+    }
+    starts[arm_count] = code_position(ctx);
+    
+    dispatch_finish(ctx, &d, starts);
+    free(starts);
+}
+
+// Loop optimization
+//
+// Before a loop is emitted, invariant subexpressions of its condition,
+// body and step are computed once into temporaries ahead of it. Only
+// expressions that cannot fail are moved (scalar operands, no division by
+// a variable), so evaluating them when the loop runs zero times is
+// harmless. In counted for-loops `$i * c` becomes a temporary advanced by
+// step * c alongside the induction variable.
+typedef struct {
+    const char **written;
+    size_t written_count;
+    size_t written_capacity;
+} loop_effects_t;
+
+static void note_write(loop_effects_t *fx, const char *name) {
+    if (fx->written_count >= fx->written_capacity) {
+        fx->written_capacity = fx->written_capacity ? fx->written_capacity * 2 : 8;
+        fx->written = compiler_realloc(fx->written, fx->written_capacity * sizeof(char*));
+    }
+    fx->written[fx->written_count++] = name;
+}
+
+static size_t write_count(const loop_effects_t *fx, const char *name) {
+    size_t count = 0;
+    for (size_t i = 0; i < fx->written_count; i++) {
+        if (strcmp(fx->written[i], name) == 0) count++;
+    }
+    return count;
+}
+
+// Variable an assignment or ++/-- target modifies ($a and $a[...] both modify $a)
+static const char *modified_variable(ast_node_t *target) {
+    if (target->type == AST_NODE_IDENTIFIER) return target->data.identifier.name;
+    if (target->type == AST_NODE_INDEX && target->left && target->left->type == AST_NODE_IDENTIFIER) {
+        return target->left->data.identifier.name;
+    }
+    return NULL;
+}
+
+static void collect_effects(compiler_context_t *ctx, loop_effects_t *fx, ast_node_t *node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case AST_NODE_FUNCTION_DEFINITION:
+            return;
+            
+        case AST_NODE_ASSIGNMENT: {
+            const char *name = node->data.assignment.variable;
+            if (!name && node->left) name = modified_variable(node->left);
+            if (name) note_write(fx, name);
+            collect_effects(ctx, fx, node->data.assignment.value);
+            break;
+        }
+            
+        case AST_NODE_INC_DEC: {
+            const char *name = modified_variable(node->left);
+            if (name) note_write(fx, name);
+            break;
+        }
+            
+        case AST_NODE_FUNCTION_CALL:
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                collect_effects(ctx, fx, node->data.function_call.arguments[i]);
+            }
+            break;
+            
+        case AST_NODE_IF_STATEMENT:
+        case AST_NODE_WHILE_STATEMENT:
+        case AST_NODE_FOR_STATEMENT:
+        case AST_NODE_TERNARY:
+            collect_effects(ctx, fx, node->data.control.condition);
+            collect_effects(ctx, fx, node->data.control.then_block);
+            collect_effects(ctx, fx, node->data.control.else_block);
+            break;
+            
+        case AST_NODE_BLOCK:
+        case AST_NODE_ARRAY_LITERAL:
+        case AST_NODE_ECHO:
+        case AST_NODE_SWITCH:
+        case AST_NODE_MATCH:
+        case AST_NODE_MATCH_ARM:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                collect_effects(ctx, fx, node->data.block.statements[i]);
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    if (node->type != AST_NODE_INC_DEC) {
+        collect_effects(ctx, fx, node->left);
+        collect_effects(ctx, fx, node->right);
+    }
+}
+
+static bool is_scalar_type(uint8_t type) {
+    return type >= TYPE_NULL && type <= TYPE_STRING;
+}
+
+static bool is_nonzero_literal(const ast_node_t *node) {
+    if (node->type != AST_NODE_LITERAL) return false;
+    if (node->data.literal.literal_type == LITERAL_INT) return node->data.literal.value.int_val != 0;
+    if (node->data.literal.literal_type == LITERAL_FLOAT) return node->data.literal.value.float_val != 0.0;
+    return false;
+}
+
+static bool is_loop_invariant(compiler_context_t *ctx, const loop_effects_t *fx, ast_node_t *node) {
+    if (!node) return false;
+    if (node->hoisted) return true;
+    
+    switch (node->type) {
+        case AST_NODE_LITERAL:
+        case AST_NODE_NAMED_CONSTANT:
+            return true;
+            
+        case AST_NODE_IDENTIFIER: {
+            const char *name = node->data.identifier.name;
+            compiler_function_t *fn = current_function(ctx);
+            symbol_t *symbol = scope_lookup(&fn->scope, name);
+            if (!symbol || write_count(fx, name) > 0 || !is_scalar_type(node->value_type)) return false;
+            // Other functions, or other tasks at any safepoint, may write it
+            return !symbol_is_shared(ctx, fn, symbol);
+        }
+            
+        case AST_NODE_BINARY_OP:
+            if (node->op == TOKEN_AND || node->op == TOKEN_OR) return false;
+            if ((node->op == TOKEN_DIVIDE || node->op == TOKEN_MODULO) && !is_nonzero_literal(node->right)) {
+                return false;
+            }
+            return is_loop_invariant(ctx, fx, node->left) && is_loop_invariant(ctx, fx, node->right);
+            
+        case AST_NODE_UNARY_OP:
+        case AST_NODE_CAST:
+            return is_loop_invariant(ctx, fx, node->left);
+            
+        case AST_NODE_FUNCTION_CALL: {
+            if (find_function(ctx, node->data.function_call.name) >= 0) return false;
+            int builtin = microphp_builtin_lookup(node->data.function_call.name);
+            if (builtin < 0 || !(microphp_builtins[builtin].flags & MICROPHP_BUILTIN_PURE)) return false;
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                if (!is_loop_invariant(ctx, fx, node->data.function_call.arguments[i])) return false;
+            }
+            return true;
+        }
+            
+        default:
+            return false;
+    }
+}
+
+// Computes node into a fresh temporary; later emissions read the temporary
+static bool hoist_expression(compiler_context_t *ctx, ast_node_t *node) {
+    int slot = alloc_temp_slot(ctx);
+    if (slot < 0) return false;
+    
+    emit_expression(ctx, node);
+    emit(ctx, OP_SET_LOCAL, (uint16_t)slot, 0);
+    node->hoisted = true;
+    node->hoist_slot = (uint16_t)slot;
+    return true;
+}
+
+static void hoist_invariants(compiler_context_t *ctx, const loop_effects_t *fx, ast_node_t *node) {
+    if (!node || node->hoisted || ctx->has_error) return;
+    
+    switch (node->type) {
+        case AST_NODE_LITERAL:
+        case AST_NODE_NAMED_CONSTANT:
+        case AST_NODE_IDENTIFIER:
+        case AST_NODE_FUNCTION_DEFINITION:
+            return;
+            
+        case AST_NODE_BINARY_OP:
+        case AST_NODE_UNARY_OP:
+        case AST_NODE_CAST:
+        case AST_NODE_FUNCTION_CALL:
+            if (is_loop_invariant(ctx, fx, node)) {
+                if (hoist_expression(ctx, node)) ctx->hoisted_count++;
+                return;
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    switch (node->type) {
+        case AST_NODE_FUNCTION_CALL:
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                hoist_invariants(ctx, fx, node->data.function_call.arguments[i]);
+            }
+            return;
+            
+        case AST_NODE_ASSIGNMENT:
+            // Only the index of an $a[...] target is an expression
+            if (node->left) hoist_invariants(ctx, fx, node->left->right);
+            hoist_invariants(ctx, fx, node->data.assignment.value);
+            return;
+            
+        case AST_NODE_INC_DEC:
+            if (node->left->type == AST_NODE_INDEX) hoist_invariants(ctx, fx, node->left->right);
+            return;
+            
+        case AST_NODE_IF_STATEMENT:
+        case AST_NODE_WHILE_STATEMENT:
+        case AST_NODE_FOR_STATEMENT:
+        case AST_NODE_TERNARY:
+            hoist_invariants(ctx, fx, node->data.control.condition);
+            hoist_invariants(ctx, fx, node->data.control.then_block);
+            hoist_invariants(ctx, fx, node->data.control.else_block);
+            break;
+            
+        case AST_NODE_BLOCK:
+        case AST_NODE_ARRAY_LITERAL:
+        case AST_NODE_ECHO:
+        case AST_NODE_SWITCH:
+        case AST_NODE_MATCH:
+        case AST_NODE_MATCH_ARM:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                hoist_invariants(ctx, fx, node->data.block.statements[i]);
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    hoist_invariants(ctx, fx, node->left);
+    hoist_invariants(ctx, fx, node->right);
+}
+
+// Induction variable of a for-loop whose step is a single int `$i++`,
+// `$i--`, `$i += k` or `$i -= k`, written nowhere else in the loop
+typedef struct {
+    const char *name;
+    int64_t step;
+    uint16_t *derived;       // Temporaries holding $i * c
+    int64_t *increments;     // ... and what each advances by per iteration
+    size_t derived_count;
+} induction_t;
+
+static bool find_induction(const loop_effects_t *fx, ast_node_t *loop, induction_t *iv) {
+    ast_node_t *step = loop->right;
+    if (!step || step->data.block.statement_count != 1) return false;
+    
+    ast_node_t *expr = step->data.block.statements[0]->left;
+    if (!expr || expr->op_type != TYPE_INT) return false;
+    
+    if (expr->type == AST_NODE_INC_DEC && expr->left->type == AST_NODE_IDENTIFIER) {
+        iv->name = expr->left->data.identifier.name;
+        iv->step = expr->op == TOKEN_INCREMENT ? 1 : -1;
+    } else if (expr->type == AST_NODE_ASSIGNMENT && expr->data.assignment.variable &&
+               (expr->op == TOKEN_PLUS_ASSIGN || expr->op == TOKEN_MINUS_ASSIGN) &&
+               expr->data.assignment.value->type == AST_NODE_LITERAL &&
+               expr->data.assignment.value->data.literal.literal_type == LITERAL_INT) {
+        int64_t k = expr->data.assignment.value->data.literal.value.int_val;
+        iv->name = expr->data.assignment.variable;
+        iv->step = expr->op == TOKEN_PLUS_ASSIGN ? k : (int64_t)(0 - (uint64_t)k);
+    } else {
+        return false;
+    }
+    
+    // The step itself is the only write
+    return write_count(fx, iv->name) == 1;
+}
+
+static bool is_int_literal(const ast_node_t *node) {
+    return node->type == AST_NODE_LITERAL && node->data.literal.literal_type == LITERAL_INT;
+}
+
+// Replaces int `$i * c` / `c * $i` (c an int literal) with a derived temporary
+static void reduce_strength(compiler_context_t *ctx, induction_t *iv, ast_node_t *node) {
+    if (!node || node->hoisted || ctx->has_error) return;
+    
+    if (node->type == AST_NODE_BINARY_OP && node->op == TOKEN_MULTIPLY && node->op_type == TYPE_INT) {
+        ast_node_t *var = node->left;
+        ast_node_t *factor = node->right;
+        if (is_int_literal(var)) {
+            var = node->right;
+            factor = node->left;
+        }
+        if (var->type == AST_NODE_IDENTIFIER && strcmp(var->data.identifier.name, iv->name) == 0 &&
+            is_int_literal(factor)) {
+            if (!hoist_expression(ctx, node)) return;
+            
+            iv->derived = compiler_realloc(iv->derived, (iv->derived_count + 1) * sizeof(uint16_t));
+            iv->increments = compiler_realloc(iv->increments, (iv->derived_count + 1) * sizeof(int64_t));
+            iv->derived[iv->derived_count] = node->hoist_slot;
+            iv->increments[iv->derived_count] =
+                (int64_t)((uint64_t)iv->step * (uint64_t)factor->data.literal.value.int_val);
+            iv->derived_count++;
+            ctx->reduced_count++;
+            return;
+        }
+    }
+    
+    switch (node->type) {
+        case AST_NODE_FUNCTION_DEFINITION:
+        case AST_NODE_WHILE_STATEMENT:
+        case AST_NODE_FOR_STATEMENT:
+            // Inner loops are left to their own pass
+            return;
+            
+        case AST_NODE_FUNCTION_CALL:
+            for (size_t i = 0; i < node->data.function_call.argument_count; i++) {
+                reduce_strength(ctx, iv, node->data.function_call.arguments[i]);
+            }
+            return;
+            
+        case AST_NODE_ASSIGNMENT:
+            if (node->left) reduce_strength(ctx, iv, node->left->right);
+            reduce_strength(ctx, iv, node->data.assignment.value);
+            return;
+            
+        case AST_NODE_INC_DEC:
+            if (node->left->type == AST_NODE_INDEX) reduce_strength(ctx, iv, node->left->right);
+            return;
+            
+        case AST_NODE_IF_STATEMENT:
+        case AST_NODE_TERNARY:
+            reduce_strength(ctx, iv, node->data.control.condition);
+            reduce_strength(ctx, iv, node->data.control.then_block);
+            reduce_strength(ctx, iv, node->data.control.else_block);
+            return;
+            
+        case AST_NODE_BLOCK:
+        case AST_NODE_ARRAY_LITERAL:
+        case AST_NODE_ECHO:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                reduce_strength(ctx, iv, node->data.block.statements[i]);
+            }
+            return;
+            
+        case AST_NODE_SWITCH:
+        case AST_NODE_MATCH:
+        case AST_NODE_MATCH_ARM:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                reduce_strength(ctx, iv, node->data.block.statements[i]);
+            }
+            reduce_strength(ctx, iv, node->left);
+            reduce_strength(ctx, iv, node->right);
+            return;
+            
+        default:
+            reduce_strength(ctx, iv, node->left);
+            reduce_strength(ctx, iv, node->right);
+            return;
+    }
+}
+
+// Emits the loop preheader. Returns the induction variable's derived
+// temporaries, which the caller advances before each step.
+static void optimize_loop(compiler_context_t *ctx, ast_node_t *loop, induction_t *iv) {
+    memset(iv, 0, sizeof(*iv));
+    if (ctx->opt_level == COMPILER_OPT_NONE) return;
+    
+    loop_effects_t fx = { NULL, 0, 0 };
+    collect_effects(ctx, &fx, loop->data.control.condition);
+    collect_effects(ctx, &fx, loop->data.control.then_block);
+    if (loop->type == AST_NODE_FOR_STATEMENT) collect_effects(ctx, &fx, loop->right);
+    
+    hoist_invariants(ctx, &fx, loop->data.control.condition);
+    hoist_invariants(ctx, &fx, loop->data.control.then_block);
+    if (loop->type == AST_NODE_FOR_STATEMENT) {
+        hoist_invariants(ctx, &fx, loop->right);
+        
+        symbol_t *symbol = NULL;
+        if (find_induction(&fx, loop, iv)) symbol = scope_lookup(&current_function(ctx)->scope, iv->name);
+        if (symbol && !symbol_is_shared(ctx, current_function(ctx), symbol)) {
+            reduce_strength(ctx, iv, loop->data.control.condition);
+            reduce_strength(ctx, iv, loop->data.control.then_block);
+        }
+    }
+    
+    free(fx.written);
+}
+
+static void advance_induction(compiler_context_t *ctx, induction_t *iv) {
+    for (size_t i = 0; i < iv->derived_count; i++) {
+        emit(ctx, OP_GET_LOCAL, iv->derived[i], 0);
+        emit_constant(ctx, microphp_zval_int(iv->increments[i]));
+        emit(ctx, OP_ADD_I, 0, 0);
+        emit(ctx, OP_SET_LOCAL, iv->derived[i], 0);
+    }
+    free(iv->derived);
+    free(iv->increments);
+}
+
+static void emit_statement(compiler_context_t *ctx, ast_node_t *node) {
+    if (!node || ctx->has_error) return;
+    
+    switch (node->type) {
+        case AST_NODE_BLOCK:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                emit_statement(ctx, node->data.block.statements[i]);
+            }
+            break;
+            
+        case AST_NODE_EXPRESSION:
+            if (node->left->type == AST_NODE_ASSIGNMENT) {
+                emit_assignment(ctx, node->left, false);
+            } else if (node->left->type == AST_NODE_INC_DEC) {
+                emit_inc_dec(ctx, node->left, false);
+            } else if (node->left->type == AST_NODE_FUNCTION_CALL && !node->left->hoisted &&
+                       emit_printf_statement(ctx, node->left)) {
+                break;
+            } else {
+                emit_expression(ctx, node->left);
+                emit(ctx, OP_POP, 0, 0);
+            }
+            break;
+            
+        case AST_NODE_ECHO:
+            for (size_t i = 0; i < node->data.block.statement_count; i++) {
+                emit_expression(ctx, node->data.block.statements[i]);
+            }
+            emit(ctx, OP_CALL_BUILTIN, (uint16_t)microphp_builtin_lookup("echo"),
+                 (uint16_t)node->data.block.statement_count);
+            emit(ctx, OP_POP, 0, 0);
+            break;
+            
+        case AST_NODE_IF_STATEMENT: {
+            emit_expression(ctx, node->data.control.condition);
+            size_t else_jump = emit(ctx, OP_JMPZ, 0, 0);
+            emit_statement(ctx, node->data.control.then_block);
+            if (node->data.control.else_block) {
+                size_t end_jump = emit(ctx, OP_JMP, 0, 0);
+                patch_jump(ctx, else_jump, code_position(ctx));
+                emit_statement(ctx, node->data.control.else_block);
+                patch_jump(ctx, end_jump, code_position(ctx));
+            } else {
+                patch_jump(ctx, else_jump, code_position(ctx));
+            }
+            break;
+        }
+            
+        case AST_NODE_WHILE_STATEMENT: {
+            induction_t iv;
+            optimize_loop(ctx, node, &iv);
+            
+            loop_context_t loop = { NULL, 0, NULL, 0, ctx->loop };
+            ctx->loop = &loop;
+            
+            size_t top = code_position(ctx);
+            emit_expression(ctx, node->data.control.condition);
+            size_t exit_jump = emit(ctx, OP_JMPZ, 0, 0);
+            emit_statement(ctx, node->data.control.then_block);
+            emit(ctx, OP_JMP, (uint16_t)top, 0);
+            patch_jump(ctx, exit_jump, code_position(ctx));
+            
+            loop_finish(ctx, &loop, top, code_position(ctx));
+            break;
+        }
+            
+        case AST_NODE_FOR_STATEMENT: {
+            emit_statement(ctx, node->left);
+            
+            induction_t iv;
+            optimize_loop(ctx, node, &iv);
+            
+            loop_context_t loop = { NULL, 0, NULL, 0, ctx->loop };
+            ctx->loop = &loop;
+            
+            size_t top = code_position(ctx);
+            size_t exit_jump = 0;
+            bool has_condition = node->data.control.condition != NULL;
+            if (has_condition) {
+                emit_expression(ctx, node->data.control.condition);
+                exit_jump = emit(ctx, OP_JMPZ, 0, 0);
+            }
+            emit_statement(ctx, node->data.control.then_block);
+            size_t step = code_position(ctx);
+            advance_induction(ctx, &iv);
+            emit_statement(ctx, node->right);
+            emit(ctx, OP_JMP, (uint16_t)top, 0);
+            if (has_condition) patch_jump(ctx, exit_jump, code_position(ctx));
+            
+            loop_finish(ctx, &loop, step, code_position(ctx));
+            break;
+        }
+            
+        case AST_NODE_BREAK:
+        case AST_NODE_CONTINUE: {
+            loop_context_t *loop = ctx->loop;
+            for (int64_t level = 1; loop && level < node->data.literal.value.int_val; level++) {
+                loop = loop->outer;
+            }
+            if (!loop) {
+                compiler_set_error(ctx, "'%s' not in loop context (line %d)",
+                                   node->type == AST_NODE_BREAK ? "break" : "continue", node->line);
+                break;
+            }
+            
+            size_t jump = emit(ctx, OP_JMP, 0, 0);
+            if (node->type == AST_NODE_BREAK) {
+                loop_add_jump(&loop->breaks, &loop->break_count, jump);
+            } else {
+                loop_add_jump(&loop->continues, &loop->continue_count, jump);
+            }
+            break;
+        }
+            
+        case AST_NODE_SWITCH:
+            emit_switch(ctx, node);
+            break;
+            
+        case AST_NODE_RETURN:
+            if (node->left) {
+                emit_expression(ctx, node->left);
+            } else {
+                emit_constant(ctx, microphp_zval_null());
+            }
+            emit(ctx, OP_RETURN, 0, 0);
+            break;
+            
+        case AST_NODE_FUNCTION_DEFINITION:
+        case AST_NODE_GLOBAL:
+            // Compiled separately / resolved during scope analysis
+            break;
+            
+        default:
+            compiler_set_error(ctx, "Unsupported statement (line %d)", node->line);
+            break;
+    }
+}
+
+static void emit_function(compiler_context_t *ctx, size_t index) {
+    compiler_function_t *fn = &ctx->functions[index];
+    ctx->current_function = index;
+    ctx->loop = NULL;
+    
+    emit_statement(ctx, fn->definition ? fn->definition->left : ctx->ast_root);
+    
+    // Implicit `return null;`
+    emit_constant(ctx, microphp_zval_null());
+    emit(ctx, OP_RETURN, 0, 0);
+}
+
+// Control-flow optimization
+//
+// Runs on each function's emitted code. Instructions are removed by
+// overwriting them with OP_NOP and compacting, which remaps every jump
+// target to the next surviving instruction.
+#define CFG_MAX_ROUNDS 32
+#define CFG_MAX_ROTATE 8
+
+static bool is_conditional_jump(opcode_t op) {
+    return op == OP_JMPZ || op == OP_JMPNZ;
+}
+
+static bool is_jump(opcode_t op) {
+    return op == OP_JMP || is_conditional_jump(op);
+}
+
+// Operand holding the branch target of any jump, including the fused
+// counted-loop opcodes (those are only formed after the other passes)
+static uint16_t *branch_operand(instruction_t *instr) {
+    if (is_jump(instr->opcode)) return &instr->operand1;
+    if (instr->opcode == OP_INC_JLT_LOCAL || instr->opcode == OP_INC_JLT_GLOBAL) return &instr->operand2;
+    return NULL;
+}
+
+// Marks the OP_JMPs that form OP_SWITCH_TABLE entries. They must stay in
+// place, and for flow purposes each may also fall through to the next one
+// (the last to the code run for a subject of another type).
+static bool *switch_entries(const compiler_function_t *fn) {
+    bool *entries = compiler_malloc(fn->code_size + 1);
+    memset(entries, 0, fn->code_size + 1);
+    for (size_t i = 0; i < fn->code_size; i++) {
+        if (fn->code[i].opcode != OP_SWITCH_TABLE) continue;
+        for (size_t e = 1; e <= fn->code[i].operand2 && i + e < fn->code_size; e++) entries[i + e] = true;
+    }
+    return entries;
+}
+
+static bool *jump_targets(compiler_function_t *fn) {
+    bool *targets = compiler_malloc(fn->code_size + 1);
+    memset(targets, 0, fn->code_size + 1);
+    for (size_t i = 0; i < fn->code_size; i++) {
+        uint16_t *target = branch_operand(&fn->code[i]);
+        if (target) targets[*target] = true;
+    }
+    return targets;
+}
+
+static bool compact_code(compiler_function_t *fn) {
+    size_t *new_pos = compiler_malloc((fn->code_size + 1) * sizeof(size_t));
+    size_t out = 0;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        new_pos[i] = out;
+        if (fn->code[i].opcode != OP_NOP) fn->code[out++] = fn->code[i];
+    }
+    new_pos[fn->code_size] = out;
+    
+    bool changed = out != fn->code_size;
+    for (size_t i = 0; i < out; i++) {
+        uint16_t *target = branch_operand(&fn->code[i]);
+        if (target) *target = (uint16_t)new_pos[*target];
+    }
+    fn->code_size = out;
+    
+    free(new_pos);
+    return changed;
+}
+
+// Outcome of `CONST c; Jcc` when c is known: the next instruction to run
+static size_t constant_branch_target(compiler_context_t *ctx, const compiler_function_t *fn,
+                                     size_t const_index, size_t jump_index) {
+    const instruction_t *jump = &fn->code[jump_index];
+    bool truthy = microphp_zval_to_bool(&ctx->constants[fn->code[const_index].operand1]);
+    return truthy == (jump->opcode == OP_JMPNZ) ? jump->operand1 : jump_index + 1;
+}
+
+// Follow JMP chains and branches on constants; a cycle leaves the target as is
+static size_t thread_target(compiler_context_t *ctx, const compiler_function_t *fn, size_t target) {
+    size_t current = target;
+    
+    for (size_t hops = 0; hops <= fn->code_size; hops++) {
+        const instruction_t *instr = &fn->code[current];
+        if (instr->opcode == OP_JMP) {
+            current = instr->operand1;
+        } else if (instr->opcode == OP_CONST && current + 1 < fn->code_size &&
+                   is_conditional_jump(fn->code[current + 1].opcode)) {
+            current = constant_branch_target(ctx, fn, current, current + 1);
+        } else {
+            return current;
+        }
+    }
+    return target;
+}
+
+static bool thread_jumps(compiler_context_t *ctx, compiler_function_t *fn) {
+    bool changed = false;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        instruction_t *instr = &fn->code[i];
+        if (!is_jump(instr->opcode)) continue;
+        
+        size_t target = thread_target(ctx, fn, instr->operand1);
+        if (target != instr->operand1 && target < fn->code_size) {
+            instr->operand1 = (uint16_t)target;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// CONST c; Jcc L  and  CONST c; JMP (Jcc L)  resolve at compile time
+static bool fold_constant_branches(compiler_context_t *ctx, compiler_function_t *fn) {
+    bool *targets = jump_targets(fn);
+    bool changed = false;
+    
+    for (size_t i = 0; i + 1 < fn->code_size; i++) {
+        if (fn->code[i].opcode != OP_CONST || targets[i + 1]) continue;
+        
+        size_t jump = i + 1;
+        if (fn->code[jump].opcode == OP_JMP) jump = fn->code[jump].operand1;
+        if (jump + 1 >= fn->code_size || !is_conditional_jump(fn->code[jump].opcode)) continue;
+        
+        size_t next = constant_branch_target(ctx, fn, i, jump);
+        fn->code[i] = (instruction_t){ OP_JMP, (uint16_t)next, 0 };
+        fn->code[i + 1].opcode = OP_NOP;
+        targets[next] = true;
+        changed = true;
+    }
+    
+    free(targets);
+    return changed;
+}
+
+// Jcc L; JMP M; L:  becomes  J!cc M; L:
+static bool invert_branches(compiler_function_t *fn) {
+    bool *targets = jump_targets(fn);
+    bool changed = false;
+    
+    for (size_t i = 0; i + 2 < fn->code_size; i++) {
+        instruction_t *branch = &fn->code[i];
+        instruction_t *jump = &fn->code[i + 1];
+        if (!is_conditional_jump(branch->opcode) || jump->opcode != OP_JMP) continue;
+        if (branch->operand1 != i + 2 || targets[i + 1]) continue;
+        
+        branch->opcode = branch->opcode == OP_JMPZ ? OP_JMPNZ : OP_JMPZ;
+        branch->operand1 = jump->operand1;
+        jump->opcode = OP_NOP;
+        changed = true;
+    }
+    
+    free(targets);
+    return changed;
+}
+
+static bool remove_unreachable(compiler_function_t *fn) {
+    if (fn->code_size == 0) return false;
+    
+    bool *entries = switch_entries(fn);
+    bool *reached = compiler_malloc(fn->code_size);
+    size_t *worklist = compiler_malloc(fn->code_size * sizeof(size_t));
+    size_t pending = 0;
+    memset(reached, 0, fn->code_size);
+    
+    reached[0] = true;
+    worklist[pending++] = 0;
+    while (pending > 0) {
+        size_t i = worklist[--pending];
+        opcode_t op = fn->code[i].opcode;
+        size_t successors[2];
+        size_t count = 0;
+        
+        if (is_jump(op)) successors[count++] = fn->code[i].operand1;
+        if ((op != OP_JMP || entries[i]) && op != OP_RETURN && i + 1 < fn->code_size) successors[count++] = i + 1;
+        
+        for (size_t s = 0; s < count; s++) {
+            if (!reached[successors[s]]) {
+                reached[successors[s]] = true;
+                worklist[pending++] = successors[s];
+            }
+        }
+    }
+    
+    bool changed = false;
+    for (size_t i = 0; i < fn->code_size; i++) {
+        if (!reached[i] && fn->code[i].opcode != OP_NOP) {
+            fn->code[i].opcode = OP_NOP;
+            changed = true;
+        }
+    }
+    
+    free(worklist);
+    free(reached);
+    free(entries);
+    return changed;
+}
+
+// Jumps to the next instruction merge the two blocks
+static bool remove_fallthrough_jumps(compiler_function_t *fn) {
+    bool *entries = switch_entries(fn);
+    bool changed = false;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        instruction_t *instr = &fn->code[i];
+        if (!is_jump(instr->opcode) || instr->operand1 != i + 1 || entries[i]) continue;
+        
+        // A conditional jump still consumes its operand
+        instr->opcode = instr->opcode == OP_JMP ? OP_NOP : OP_POP;
+        changed = true;
+    }
+    
+    free(entries);
+    return changed;
+}
+
+// Header of the loop closed by the backward `JMP` at `index`, if its
+// condition is short straight-line code ending in a branch to index + 1
+static bool rotatable_loop(const compiler_function_t *fn, size_t index, size_t *branch) {
+    const instruction_t *jump = &fn->code[index];
+    if (jump->opcode != OP_JMP || jump->operand1 >= index) return false;
+    
+    size_t header = jump->operand1;
+    for (size_t i = header; i < index && i - header <= CFG_MAX_ROTATE; i++) {
+        opcode_t op = fn->code[i].opcode;
+        if (is_conditional_jump(op)) {
+            if (fn->code[i].operand1 != index + 1 || i == header) return false;
+            *branch = i;
+            return true;
+        }
+        if (op == OP_JMP || op == OP_RETURN) return false;
+    }
+    return false;
+}
+
+// Loop inversion: the back-edge `JMP header` is replaced by a copy of the
+// header's condition and an inverted branch into the body, so each
+// iteration dispatches one branch instead of a jump plus a branch
+static bool rotate_loops(compiler_function_t *fn) {
+    bool *entries = switch_entries(fn);
+    size_t *branch_at = compiler_malloc(fn->code_size * sizeof(size_t));
+    size_t extra = 0;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        branch_at[i] = 0;
+        if (!entries[i] && rotatable_loop(fn, i, &branch_at[i])) extra += branch_at[i] - fn->code[i].operand1;
+    }
+    free(entries);
+    if (extra == 0 || fn->code_size + extra > UINT16_MAX) {
+        free(branch_at);
+        return false;
+    }
+    
+    size_t old_size = fn->code_size;
+    instruction_t *old = fn->code;
+    size_t *new_pos = compiler_malloc((old_size + 1) * sizeof(size_t));
+    
+    fn->code_capacity = old_size + extra;
+    fn->code = compiler_malloc(fn->code_capacity * sizeof(instruction_t));
+    fn->code_size = 0;
+    
+    // Jump operands keep old indices until every position is known
+    for (size_t i = 0; i < old_size; i++) {
+        new_pos[i] = fn->code_size;
+        size_t branch = branch_at[i];
+        if (branch == 0) {
+            fn->code[fn->code_size++] = old[i];
+            continue;
+        }
+        
+        for (size_t h = old[i].operand1; h < branch; h++) {
+            fn->code[fn->code_size++] = old[h];
+        }
+        opcode_t inverted = old[branch].opcode == OP_JMPZ ? OP_JMPNZ : OP_JMPZ;
+        fn->code[fn->code_size++] = (instruction_t){ inverted, (uint16_t)(branch + 1), 0 };
+    }
+    new_pos[old_size] = fn->code_size;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        if (is_jump(fn->code[i].opcode)) {
+            fn->code[i].operand1 = (uint16_t)new_pos[fn->code[i].operand1];
+        }
+    }
+    
+    free(new_pos);
+    free(branch_at);
+    free(old);
+    return true;
+}
+
+static void optimize_function(compiler_context_t *ctx, compiler_function_t *fn) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (int round = 0; round < CFG_MAX_ROUNDS; round++) {
+            bool changed = thread_jumps(ctx, fn);
+            fold_constant_branches(ctx, fn);
+            changed |= compact_code(fn);
+            invert_branches(fn);
+            changed |= compact_code(fn);
+            remove_unreachable(fn);
+            changed |= compact_code(fn);
+            remove_fallthrough_jumps(fn);
+            changed |= compact_code(fn);
+            if (!changed) break;
+        }
+        
+        if (pass == 0 && !rotate_loops(fn)) break;
+    }
+}
+
+// Inlining
+//
+// Small non-recursive user functions are expanded at their call sites
+// after control-flow optimization. The callee's slots are renamed into a
+// region appended to the caller's frame; every inlined body in a caller
+// shares that region because bodies never run nested.
+#define INLINE_BUDGET_DEFAULT 12
+#define INLINE_BUDGET_SPEED   40
+#define INLINE_MAX_SLOTS      64
+
+static bool calls_reach(compiler_context_t *ctx, size_t from, size_t target, bool *visited) {
+    if (visited[from]) return false;
+    visited[from] = true;
+    
+    const compiler_function_t *fn = &ctx->functions[from];
+    for (size_t i = 0; i < fn->code_size; i++) {
+        if (fn->code[i].opcode != OP_CALL) continue;
+        size_t callee = fn->code[i].operand1;
+        if (callee == target || calls_reach(ctx, callee, target, visited)) return true;
+    }
+    return false;
+}
+
+static bool is_recursive(compiler_context_t *ctx, size_t index) {
+    bool *visited = compiler_malloc(ctx->function_count);
+    memset(visited, 0, ctx->function_count);
+    bool recursive = calls_reach(ctx, index, index, visited);
+    free(visited);
+    return recursive;
+}
+
+// Slot a local access refers to, or -1
+static int local_slot_operand(const instruction_t *instr) {
+    switch (instr->opcode) {
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_APPEND_LOCAL:
+            return instr->operand1;
+        case OP_ARRAY_SET:
+            return (instr->operand2 & MICROPHP_ARRAY_SET_GLOBAL) ? -1 : instr->operand1;
+        default:
+            return -1;
+    }
+}
+
+// Slots that may be read before being written on some path from entry.
+// A real call starts with them null; an inlined body must reset them.
+static uint64_t slots_read_before_write(const compiler_function_t *fn) {
+    bool *entries = switch_entries(fn);
+    uint64_t params = fn->param_count >= 64 ? UINT64_MAX : (((uint64_t)1 << fn->param_count) - 1);
+    uint64_t *assigned = compiler_malloc(fn->code_size * sizeof(uint64_t));
+    for (size_t i = 0; i < fn->code_size; i++) assigned[i] = UINT64_MAX;
+    assigned[0] = params;
+    
+    // Must-assigned sets at instruction entry, iterated to a fixed point
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < fn->code_size; i++) {
+            const instruction_t *instr = &fn->code[i];
+            uint64_t out = assigned[i];
+            if (instr->opcode == OP_SET_LOCAL) out |= (uint64_t)1 << instr->operand1;
+            
+            size_t successors[2];
+            size_t count = 0;
+            if (is_jump(instr->opcode)) successors[count++] = instr->operand1;
+            if ((instr->opcode != OP_JMP || entries[i]) && instr->opcode != OP_RETURN && i + 1 < fn->code_size) {
+                successors[count++] = i + 1;
+            }
+            
+            for (size_t s = 0; s < count; s++) {
+                uint64_t merged = assigned[successors[s]] & out;
+                if (successors[s] == 0) merged &= params;
+                if (merged != assigned[successors[s]]) {
+                    assigned[successors[s]] = merged;
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    uint64_t needs_reset = 0;
+    for (size_t i = 0; i < fn->code_size; i++) {
+        int slot = local_slot_operand(&fn->code[i]);
+        if (slot >= 0 && fn->code[i].opcode != OP_SET_LOCAL && !(assigned[i] & ((uint64_t)1 << slot))) {
+            needs_reset |= (uint64_t)1 << slot;
+        }
+    }
+    
+    free(assigned);
+    free(entries);
+    return needs_reset;
+}
+
+static bool is_inlinable(compiler_context_t *ctx, size_t index, size_t budget) {
+    const compiler_function_t *fn = &ctx->functions[index];
+    if (index == 0 || fn->code_size == 0 || fn->code_size > budget) return false;
+    if (fn->scope.slot_count > INLINE_MAX_SLOTS || fn->param_count > INLINE_MAX_SLOTS) return false;
+    return !is_recursive(ctx, index);
+}
+
+static void append_instruction(compiler_function_t *fn, instruction_t instr) {
+    if (fn->code_size >= fn->code_capacity) {
+        fn->code_capacity = fn->code_capacity ? fn->code_capacity * 2 : 64;
+        fn->code = compiler_realloc(fn->code, fn->code_capacity * sizeof(instruction_t));
+    }
+    fn->code[fn->code_size++] = instr;
+}
+
+static void record_inline(compiler_context_t *ctx, size_t caller, size_t callee) {
+    for (size_t i = 0; i < ctx->inline_count; i++) {
+        if (ctx->inlines[i].caller == caller && ctx->inlines[i].callee == callee) {
+            ctx->inlines[i].sites++;
+            return;
+        }
+    }
+    
+    if (ctx->inline_count >= ctx->inline_capacity) {
+        ctx->inline_capacity = ctx->inline_capacity ? ctx->inline_capacity * 2 : 8;
+        ctx->inlines = compiler_realloc(ctx->inlines, ctx->inline_capacity * sizeof(inline_record_t));
+    }
+    ctx->inlines[ctx->inline_count++] = (inline_record_t){ caller, callee, 1 };
+}
+
+// Expands `CALL callee argc` with the callee's slots shifted by base
+static void expand_call(compiler_function_t *out, const instruction_t *call, const compiler_function_t *callee,
+                        uint16_t base, uint64_t needs_reset, int null_constant) {
+    size_t argc = call->operand2;
+    size_t bound = argc < callee->param_count ? argc : callee->param_count;
+    
+    // Arguments arrive in order on the stack: drop extras, then bind
+    for (size_t i = bound; i < argc; i++) {
+        append_instruction(out, (instruction_t){ OP_POP, 0, 0 });
+    }
+    for (size_t p = bound; p-- > 0;) {
+        append_instruction(out, (instruction_t){ OP_SET_LOCAL, (uint16_t)(base + p), 0 });
+    }
+    for (size_t slot = 0; slot < callee->scope.slot_count; slot++) {
+        bool missing_param = slot >= bound && slot < callee->param_count;
+        if (missing_param || (needs_reset & ((uint64_t)1 << slot))) {
+            append_instruction(out, (instruction_t){ OP_CONST, (uint16_t)null_constant, 0 });
+            append_instruction(out, (instruction_t){ OP_SET_LOCAL, (uint16_t)(base + slot), 0 });
+        }
+    }
+    
+    size_t start = out->code_size;
+    size_t end = start + callee->code_size;
+    for (size_t i = 0; i < callee->code_size; i++) {
+        instruction_t instr = callee->code[i];
+        if (local_slot_operand(&instr) >= 0) {
+            instr.operand1 = (uint16_t)(instr.operand1 + base);
+        } else if (is_jump(instr.opcode)) {
+            instr.operand1 = (uint16_t)(instr.operand1 + start);
+        } else if (instr.opcode == OP_RETURN) {
+            // The return value is left on the caller's stack
+            instr = (instruction_t){ OP_JMP, (uint16_t)end, 0 };
+        }
+        append_instruction(out, instr);
+    }
+}
+
+static bool inline_calls(compiler_context_t *ctx, size_t caller_index, const compiler_function_t *bodies,
+                         const bool *inlinable, const uint64_t *needs_reset) {
+    compiler_function_t *caller = &ctx->functions[caller_index];
+    
+    uint16_t region = 0;
+    size_t growth = 0;
+    for (size_t i = 0; i < caller->code_size; i++) {
+        const instruction_t *instr = &caller->code[i];
+        if (instr->opcode != OP_CALL || !inlinable[instr->operand1] || instr->operand1 == caller_index) continue;
+        const compiler_function_t *callee = &bodies[instr->operand1];
+        if (callee->scope.slot_count > region) region = callee->scope.slot_count;
+        growth += callee->code_size + 2 * callee->scope.slot_count + instr->operand2;
+    }
+    if (growth == 0) return false;
+    if (caller->scope.slot_count + region > MICROPHP_MAX_LOCALS) return false;
+    if (caller->code_size + growth > UINT16_MAX) return false;
+    
+    int null_constant = add_constant(ctx, microphp_zval_null());
+    if (null_constant < 0) return false;
+    
+    uint16_t base = caller->scope.slot_count;
+    caller->scope.slot_count = (uint16_t)(base + region);
+    
+    size_t old_size = caller->code_size;
+    instruction_t *old = caller->code;
+    size_t *new_pos = compiler_malloc((old_size + 1) * sizeof(size_t));
+    bool *caller_jump = compiler_malloc(old_size + growth);
+    memset(caller_jump, 0, old_size + growth);
+    
+    caller->code = NULL;
+    caller->code_size = 0;
+    caller->code_capacity = 0;
+    
+    // Caller jumps keep old indices until every position is known
+    for (size_t i = 0; i < old_size; i++) {
+        new_pos[i] = caller->code_size;
+        const instruction_t *instr = &old[i];
+        if (instr->opcode == OP_CALL && inlinable[instr->operand1] && instr->operand1 != caller_index) {
+            expand_call(caller, instr, &bodies[instr->operand1], base, needs_reset[instr->operand1], null_constant);
+            record_inline(ctx, caller_index, instr->operand1);
+            continue;
+        }
+        if (is_jump(instr->opcode)) caller_jump[caller->code_size] = true;
+        append_instruction(caller, *instr);
+    }
+    new_pos[old_size] = caller->code_size;
+    
+    for (size_t i = 0; i < caller->code_size; i++) {
+        if (caller_jump[i]) caller->code[i].operand1 = (uint16_t)new_pos[caller->code[i].operand1];
+    }
+    
+    free(caller_jump);
+    free(new_pos);
+    free(old);
+    return true;
+}
+
+static void inline_functions(compiler_context_t *ctx) {
+    size_t budget = ctx->opt_level >= COMPILER_OPT_SPEED ? INLINE_BUDGET_SPEED : INLINE_BUDGET_DEFAULT;
+    bool *inlinable = compiler_malloc(ctx->function_count);
+    uint64_t *needs_reset = compiler_malloc(ctx->function_count * sizeof(uint64_t));
+    
+    // Decide on the bodies as they are before any expansion
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        inlinable[i] = is_inlinable(ctx, i, budget);
+        needs_reset[i] = inlinable[i] ? slots_read_before_write(&ctx->functions[i]) : 0;
+    }
+    
+    // Callers expand the bodies as they were before any inlining
+    compiler_function_t *bodies = compiler_malloc(ctx->function_count * sizeof(compiler_function_t));
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        bodies[i] = ctx->functions[i];
+        if (!inlinable[i]) continue;
+        bodies[i].code = compiler_malloc(bodies[i].code_size * sizeof(instruction_t));
+        memcpy(bodies[i].code, ctx->functions[i].code, bodies[i].code_size * sizeof(instruction_t));
+    }
+    
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        compiler_function_t *fn = &ctx->functions[i];
+        size_t before = fn->code_size;
+        if (!inline_calls(ctx, i, bodies, inlinable, needs_reset)) continue;
+        
+        optimize_function(ctx, fn);
+        ctx->inline_size_delta += (long)fn->code_size - (long)before;
+    }
+    
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        if (inlinable[i]) free(bodies[i].code);
+    }
+    free(bodies);
+    free(needs_reset);
+    free(inlinable);
+}
+
+// Counted loops: the rotated back-edge of `for (...; $i < n; $i++)`
+//   GET i; INC_I; SET i; GET i; <n>; LT_I; JMPNZ body
+// becomes  <n>; INC_JLT i, body.  Both operands were proven int.
+static bool fuse_counted_loop(compiler_context_t *ctx, compiler_function_t *fn, size_t p, const bool *targets) {
+    if (p + 6 >= fn->code_size) return false;
+    instruction_t *c = &fn->code[p];
+    for (size_t k = 1; k <= 6; k++) {
+        if (targets[p + k]) return false;
+    }
+    
+    bool local = c[0].opcode == OP_GET_LOCAL;
+    if (!local && c[0].opcode != OP_GET_GLOBAL) return false;
+    opcode_t set = local ? OP_SET_LOCAL : OP_SET_GLOBAL;
+    uint16_t slot = c[0].operand1;
+    
+    if (c[1].opcode != OP_INC_I || c[2].opcode != set || c[2].operand1 != slot) return false;
+    if (c[3].opcode != c[0].opcode || c[3].operand1 != slot) return false;
+    if (c[5].opcode != OP_LT_I && c[5].opcode != OP_LTE_I) return false;
+    if (c[6].opcode != OP_JMPNZ) return false;
+    
+    instruction_t bound = c[4];
+    if (bound.opcode == OP_GET_LOCAL || bound.opcode == OP_GET_GLOBAL) {
+        if (bound.opcode == c[0].opcode && bound.operand1 == slot) return false;
+        if (c[5].opcode == OP_LTE_I) return false;
+    } else if (bound.opcode == OP_CONST && ctx->constants[bound.operand1].type == ZVAL_INT) {
+        // $i <= n  is  $i < n + 1
+        if (c[5].opcode == OP_LTE_I) {
+            int64_t limit = ctx->constants[bound.operand1].value.int_val;
+            if (limit == (ctx->int32 ? INT32_MAX : INT64_MAX)) return false;
+            int constant = add_constant(ctx, microphp_zval_int(limit + 1));
+            if (constant < 0) return false;
+            bound.operand1 = (uint16_t)constant;
+        }
+    } else {
+        return false;
+    }
+    
+    uint16_t body = c[6].operand1;
+    c[0] = bound;
+    c[1] = (instruction_t){ local ? OP_INC_JLT_LOCAL : OP_INC_JLT_GLOBAL, slot, body };
+    for (size_t k = 2; k <= 6; k++) c[k].opcode = OP_NOP;
+    return true;
+}
+
+static size_t fuse_counted_loops(compiler_context_t *ctx, compiler_function_t *fn) {
+    bool *targets = jump_targets(fn);
+    size_t fused = 0;
+    
+    for (size_t i = 0; i < fn->code_size; i++) {
+        if (fuse_counted_loop(ctx, fn, i, targets)) fused++;
+    }
+    
+    free(targets);
+    if (fused > 0) compact_code(fn);
+    return fused;
+}
+
+// MBC serialization
+static void write_name(mbc_writer_t *w, const char *name) {
+    size_t len = strlen(name);
+    write_u32(w, (uint32_t)len);
+    write_bytes(w, name, len);
+}
+
+static void write_constant(mbc_writer_t *w, const zval_t *value) {
+    write_u8(w, (uint8_t)value->type);
+    
+    switch (value->type) {
+        case ZVAL_BOOL:
+            write_u8(w, value->value.bool_val ? 1 : 0);
+            break;
+        case ZVAL_INT:
+            write_u64(w, (uint64_t)value->value.int_val);
+            break;
+        case ZVAL_FLOAT: {
+            uint64_t bits;
+            memcpy(&bits, &value->value.float_val, sizeof(bits));
+            write_u64(w, bits);
+            break;
+        }
+        case ZVAL_FIXED:
+            write_u32(w, (uint32_t)value->value.int_val);
+            break;
+        case ZVAL_STRING:
+            write_u32(w, (uint32_t)microphp_string_len(value));
+            write_bytes(w, microphp_string_data(value), microphp_string_len(value));
+            break;
+        default:
+            break;
+    }
+}
+
+// Code generation
+int compiler_generate_bytecode(compiler_context_t *ctx, uint8_t **output, size_t *output_size) {
+    if (ctx->function_count == 0 && compiler_resolve_scopes(ctx) != 0) {
+        return -1;
+    }
+    
+    if (compiler_infer_types(ctx) != 0) return -1;
+    
+    ctx->typed_op_count = 0;
+    ctx->append_count = 0;
+    ctx->format_count = 0;
+    for (size_t i = 0; i < ctx->function_count && !ctx->has_error; i++) {
+        emit_function(ctx, i);
+    }
+    ctx->current_function = 0;
+    if (ctx->has_error) return -1;
+    
+    ctx->code_size_before = 0;
+    ctx->code_size_after = 0;
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        ctx->code_size_before += ctx->functions[i].code_size;
+        if (ctx->opt_level > COMPILER_OPT_NONE) optimize_function(ctx, &ctx->functions[i]);
+    }
+    if (ctx->opt_level > COMPILER_OPT_NONE) inline_functions(ctx);
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        if (ctx->opt_level > COMPILER_OPT_NONE) ctx->fused_loop_count += fuse_counted_loops(ctx, &ctx->functions[i]);
+        ctx->code_size_after += ctx->functions[i].code_size;
+    }
+    
+    mbc_writer_t w = { NULL, 0, 0 };
+    
+    // Header
+    write_bytes(&w, "MBC\0", 4);
+    write_u32(&w, MICROPHP_MBC_VERSION);
+    write_u32(&w, (uint32_t)ctx->constant_count);
+    write_u32(&w, (uint32_t)ctx->function_count);
+    write_u32(&w, 0); // Main function offset
+    write_u32(&w, ctx->globals.slot_count);
+    
+    // Constant pool
+    for (size_t i = 0; i < ctx->constant_count; i++) {
+        write_constant(&w, &ctx->constants[i]);
+    }
+    
+    // Functions
+    for (size_t i = 0; i < ctx->function_count; i++) {
+        const compiler_function_t *fn = &ctx->functions[i];
+        write_name(&w, fn->name);
+        write_u32(&w, (uint32_t)fn->code_size);
+        write_u32(&w, fn->scope.slot_count);
+        write_u32(&w, (uint32_t)fn->param_count);
+        
+        for (size_t j = 0; j < fn->code_size; j++) {
+            write_u16(&w, (uint16_t)fn->code[j].opcode);
+            write_u16(&w, fn->code[j].operand1);
+            write_u16(&w, fn->code[j].operand2);
+        }
+    }
+    
+    // Global slot map (symbols are added in slot order)
+    for (size_t i = 0; i < ctx->globals.symbol_count; i++) {
+        write_name(&w, ctx->globals.symbols[i].name);
+    }
     
+    *output = w.data;
+    *output_size = w.size;
     return 0;
 }
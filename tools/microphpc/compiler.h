@@ -4,14 +4,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
-
-// Version information
-#define MICROPHP_VERSION "0.1.0"
+#include "microphp.h"
 
 // Token types
 typedef enum {
     TOKEN_EOF = 0,
     TOKEN_IDENTIFIER,
+    TOKEN_VARIABLE,
     TOKEN_STRING,
     TOKEN_INT,
     TOKEN_FLOAT,
@@ -26,10 +25,13 @@ typedef enum {
     TOKEN_MULTIPLY_ASSIGN,
     TOKEN_DIVIDE_ASSIGN,
     TOKEN_MODULO_ASSIGN,
+    TOKEN_CONCAT_ASSIGN,
     TOKEN_INCREMENT,
     TOKEN_DECREMENT,
     TOKEN_EQUAL,
     TOKEN_NOT_EQUAL,
+    TOKEN_IDENTICAL,
+    TOKEN_NOT_IDENTICAL,
     TOKEN_LESS_THAN,
     TOKEN_LESS_EQUAL,
     TOKEN_GREATER_THAN,
@@ -37,6 +39,12 @@ typedef enum {
     TOKEN_AND,
     TOKEN_OR,
     TOKEN_NOT,
+    TOKEN_BIT_AND,
+    TOKEN_BIT_OR,
+    TOKEN_BIT_XOR,
+    TOKEN_BIT_NOT,
+    TOKEN_SHIFT_LEFT,
+    TOKEN_SHIFT_RIGHT,
     TOKEN_LEFT_PAREN,
     TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACE,
@@ -48,13 +56,22 @@ typedef enum {
     TOKEN_DOT,
     TOKEN_QUESTION,
     TOKEN_COLON,
+    TOKEN_DOUBLE_ARROW,
     TOKEN_IF,
     TOKEN_ELSE,
+    TOKEN_ELSEIF,
     TOKEN_WHILE,
     TOKEN_FOR,
     TOKEN_FOREACH,
     TOKEN_FUNCTION,
     TOKEN_RETURN,
+    TOKEN_BREAK,
+    TOKEN_CONTINUE,
+    TOKEN_GLOBAL,
+    TOKEN_SWITCH,
+    TOKEN_CASE,
+    TOKEN_DEFAULT,
+    TOKEN_MATCH,
     TOKEN_TRUE,
     TOKEN_FALSE,
     TOKEN_NULL,
@@ -91,14 +108,53 @@ typedef enum {
     AST_NODE_BLOCK,
     AST_NODE_RETURN,
     AST_NODE_FUNCTION_DEFINITION,
-    AST_NODE_CONTROL
+    AST_NODE_CONTROL,
+    AST_NODE_NAMED_CONSTANT,
+    AST_NODE_ARRAY_LITERAL,
+    AST_NODE_INDEX,
+    AST_NODE_CAST,
+    AST_NODE_INC_DEC,
+    AST_NODE_TERNARY,
+    AST_NODE_ECHO,
+    AST_NODE_BREAK,
+    AST_NODE_CONTINUE,
+    AST_NODE_GLOBAL,
+    AST_NODE_SWITCH,         // Subject in left, AST_NODE_CASE list in block
+    AST_NODE_CASE,           // Label in left (NULL for default), body in right
+    AST_NODE_MATCH,          // Subject in left, AST_NODE_MATCH_ARM list in block
+    AST_NODE_MATCH_ARM       // Conditions in block (empty for default), result in right
 } ast_node_type_t;
 
+// Static value types inferred by compiler_infer_types()
+typedef enum {
+    TYPE_NONE = 0,           // No value reaches this point (yet)
+    TYPE_NULL,
+    TYPE_BOOL,
+    TYPE_INT,
+    TYPE_FLOAT,
+    TYPE_STRING,
+    TYPE_ARRAY,
+    TYPE_ANY                 // Unknown at compile time
+} value_type_t;
+
+// Literal kinds (ast_node_t.data.literal.literal_type)
+#define LITERAL_INT    0
+#define LITERAL_FLOAT  1
+#define LITERAL_STRING 2
+#define LITERAL_BOOL   3
+#define LITERAL_NULL   4
+
 // AST node structure
 typedef struct ast_node {
     ast_node_type_t type;
     struct ast_node *left;
     struct ast_node *right;
+    int op;                  // Operator token for binary/unary/assignment nodes
+    int line;                // Source line for diagnostics
+    uint8_t value_type;      // Inferred result type (value_type_t)
+    uint8_t op_type;         // Proven operand type for typed opcodes (value_type_t)
+    bool hoisted;            // Value precomputed ahead of the enclosing loop
+    uint16_t hoist_slot;     // Local slot holding the hoisted value
     union {
         // For literals
         struct {
@@ -106,7 +162,9 @@ typedef struct ast_node {
                 int64_t int_val;
                 double float_val;
                 char *string_val;
+                bool bool_val;
             } value;
+            size_t string_len;
             int literal_type;
         } literal;
         
@@ -138,7 +196,12 @@ typedef struct ast_node {
             struct ast_node *else_block;
         } control;
         
-        // For blocks
+        // For ++/-- (target in left)
+        struct {
+            bool prefix;
+        } inc_dec;
+        
+        // For blocks, array literals and echo/global lists
         struct {
             struct ast_node **statements;
             size_t statement_count;
@@ -146,16 +209,46 @@ typedef struct ast_node {
     } data;
 } ast_node_t;
 
-// Bytecode structure (MBC - Micro-PHP Bytecode)
+// Symbol table entry: a $variable resolved to a frame or global slot
+typedef struct {
+    char *name;
+    uint16_t slot;
+    bool is_global;
+} symbol_t;
+
+// Variable scope of one function
 typedef struct {
-    char magic[4];           // "MBC\0"
-    uint32_t version;        // Bytecode version
-    uint32_t constant_count;
-    void *constants;         // zval_t array
-    uint32_t function_count;
-    void *functions;         // function_t array
-    uint32_t main_offset;    // Main function offset
-} bytecode_t;
+    symbol_t *symbols;
+    size_t symbol_count;
+    size_t symbol_capacity;
+    uint16_t slot_count;     // Dense slots handed out so far
+} scope_t;
+
+// Function being compiled
+typedef struct {
+    char *name;
+    ast_node_t *definition;  // NULL for the top-level script
+    scope_t scope;
+    size_t param_count;
+    uint8_t return_type;     // Inferred return type (value_type_t)
+    instruction_t *code;
+    size_t code_size;
+    size_t code_capacity;
+} compiler_function_t;
+
+struct loop_context;
+
+// One caller/callee pair expanded by the inliner
+typedef struct {
+    size_t caller;
+    size_t callee;
+    size_t sites;
+} inline_record_t;
+
+// Optimization levels (-O0 .. -O2)
+#define COMPILER_OPT_NONE    0
+#define COMPILER_OPT_DEFAULT 1
+#define COMPILER_OPT_SPEED   2
 
 // Compiler context
 typedef struct {
@@ -167,7 +260,40 @@ typedef struct {
     token_t *tokens;
     size_t token_count;
     size_t token_capacity;
+    size_t current_token;
     ast_node_t *ast_root;
+    
+    // Code generation
+    compiler_function_t *functions;
+    size_t function_count;
+    size_t function_capacity;
+    size_t current_function;
+    scope_t globals;
+    zval_t *constants;
+    size_t constant_count;
+    size_t constant_capacity;
+    struct loop_context *loop;
+    size_t typed_op_count;   // Type-specialized opcodes emitted
+    size_t append_count;     // String assignments emitted as in-place appends
+    size_t format_count;     // printf/sprintf calls lowered to echo or concatenation
+    size_t code_size_before; // Instructions before control-flow optimization
+    size_t code_size_after;  // Instructions after control-flow optimization
+    
+    bool fixed_point;        // Float literals and (float) casts become Q16.16
+    bool int32;              // Target ints are 32-bit (MICROPHP_INT32_FAST)
+    
+    // Inlining
+    int opt_level;
+    inline_record_t *inlines;
+    size_t inline_count;
+    size_t inline_capacity;
+    long inline_size_delta;  // Instructions added (or saved) by inlining
+    
+    // Loop optimization
+    size_t hoisted_count;    // Invariant expressions moved ahead of loops
+    size_t reduced_count;    // Induction multiplies turned into additions
+    size_t fused_loop_count; // Back-edges fused into INC_JLT
+    
     char *error_msg;
     bool has_error;
 } compiler_context_t;
@@ -197,6 +323,12 @@ ast_node_t* ast_create_identifier(const char *name, size_t len);
 ast_node_t* ast_create_binary_op(ast_node_type_t op, ast_node_t *left, ast_node_t *right);
 ast_node_t* ast_create_function_call(const char *name, size_t len, ast_node_t **args, size_t arg_count);
 
+// Scope analysis
+int compiler_resolve_scopes(compiler_context_t *ctx);
+
+// Type inference
+int compiler_infer_types(compiler_context_t *ctx);
+
 // Code generation
 int compiler_generate_bytecode(compiler_context_t *ctx, uint8_t **output, size_t *output_size);
 
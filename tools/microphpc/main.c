@@ -9,11 +9,16 @@ void print_usage(const char *program_name) {
     printf("Usage: %s [options] <input_file> -o <output_file>\n", program_name);
     printf("\nOptions:\n");
     printf("  -o <file>     Output bytecode file (required)\n");
+    printf("  -O<level>     Optimization level: 0 none, 1 default, 2 inline more\n");
+    printf("  --fixed       Compile float literals and (float) casts to Q16.16 fixed point\n");
+    printf("  --int32       Target a VM built with MICROPHP_INT32_FAST (32-bit ints)\n");
     printf("  -v            Verbose output\n");
     printf("  -h, --help    Show this help message\n");
     printf("\nExamples:\n");
     printf("  %s script.php -o script.mbc\n", program_name);
     printf("  %s -v main.php -o main.mbc\n", program_name);
+    printf("  %s -O2 main.php -o main.mbc\n", program_name);
+    printf("  %s --fixed pico.php -o pico.mbc\n", program_name);
 }
 
 int read_file(const char *filename, char **content, size_t *size) {
@@ -72,6 +77,9 @@ int main(int argc, char *argv[]) {
     const char *input_file = NULL;
     const char *output_file = NULL;
     bool verbose = false;
+    int opt_level = COMPILER_OPT_DEFAULT;
+    bool fixed_point = false;
+    bool int32 = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -80,6 +88,18 @@ int main(int argc, char *argv[]) {
             return 0;
         } else if (strcmp(argv[i], "-v") == 0) {
             verbose = true;
+        } else if (strcmp(argv[i], "--fixed") == 0) {
+            fixed_point = true;
+        } else if (strcmp(argv[i], "--int32") == 0) {
+            int32 = true;
+        } else if (strncmp(argv[i], "-O", 2) == 0) {
+            const char *level = argv[i] + 2;
+            if (level[0] < '0' || level[0] > '9' || level[1] != '\0') {
+                fprintf(stderr, "Error: Invalid optimization level '%s'\n", argv[i]);
+                return 1;
+            }
+            opt_level = level[0] - '0';
+            if (opt_level > COMPILER_OPT_SPEED) opt_level = COMPILER_OPT_SPEED;
         } else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
                 output_file = argv[++i];
@@ -143,6 +163,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    ctx->opt_level = opt_level;
+    ctx->fixed_point = fixed_point;
+    ctx->int32 = int32;
+    
     // Perform lexical analysis
     if (verbose) printf("Phase 1: Lexical analysis...\n");
     if (compiler_lex(ctx) != 0) {
@@ -167,8 +191,25 @@ int main(int argc, char *argv[]) {
     
     if (verbose) printf("  AST created successfully\n");
     
+    // Resolve variables to slots
+    if (verbose) printf("Phase 3: Scope analysis...\n");
+    if (compiler_resolve_scopes(ctx) != 0) {
+        fprintf(stderr, "Error: Scope analysis failed: %s\n", compiler_get_error(ctx));
+        compiler_destroy(ctx);
+        free(source_code);
+        return 1;
+    }
+    
+    if (verbose) {
+        printf("  %u global slot(s)\n", ctx->globals.slot_count);
+        for (size_t i = 0; i < ctx->function_count; i++) {
+            printf("  %s: %zu param(s), %u local slot(s)\n", ctx->functions[i].name,
+                   ctx->functions[i].param_count, ctx->functions[i].scope.slot_count);
+        }
+    }
+    
     // Generate bytecode
-    if (verbose) printf("Phase 3: Code generation...\n");
+    if (verbose) printf("Phase 4: Code generation...\n");
     uint8_t *bytecode;
     size_t bytecode_size;
     
@@ -181,10 +222,26 @@ int main(int argc, char *argv[]) {
     
     if (verbose) {
         printf("  Generated %zu bytes of bytecode\n", bytecode_size);
+        printf("  Type-specialized operations: %zu\n", ctx->typed_op_count);
+        printf("  In-place string appends: %zu\n", ctx->append_count);
+        printf("  Formats lowered: %zu\n", ctx->format_count);
+        printf("  Optimization level: -O%d\n", ctx->opt_level);
+        for (size_t i = 0; i < ctx->inline_count; i++) {
+            const inline_record_t *record = &ctx->inlines[i];
+            printf("  Inlined %s into %s (%zu call site%s)\n", ctx->functions[record->callee].name,
+                   ctx->functions[record->caller].name, record->sites, record->sites == 1 ? "" : "s");
+        }
+        if (ctx->inline_count > 0) {
+            printf("  Inlining code size delta: %+ld instructions\n", ctx->inline_size_delta);
+        }
+        printf("  Loops: %zu invariant(s) hoisted, %zu multiply(s) strength-reduced, %zu counted loop(s) fused\n",
+               ctx->hoisted_count, ctx->reduced_count, ctx->fused_loop_count);
+        printf("  Optimized code: %zu -> %zu instructions\n",
+               ctx->code_size_before, ctx->code_size_after);
     }
     
     // Write output file
-    if (verbose) printf("Phase 4: Writing output...\n");
+    if (verbose) printf("Phase 5: Writing output...\n");
     if (write_file(output_file, bytecode, bytecode_size) != 0) {
         fprintf(stderr, "Error: Failed to write output file\n");
         free(bytecode);
@@ -13,7 +13,7 @@ from pathlib import Path
 
 # MBC file format constants
 MBC_MAGIC = b'MBC\0'
-MBC_VERSION = 1
+MBC_VERSION = 2
 
 def read_mbc_header(file):
     """Read and validate MBC file header."""
@@ -28,14 +28,24 @@ def read_mbc_header(file):
     constant_count = struct.unpack('<I', file.read(4))[0]
     function_count = struct.unpack('<I', file.read(4))[0]
     main_offset = struct.unpack('<I', file.read(4))[0]
+    global_count = struct.unpack('<I', file.read(4))[0]
     
     return {
         'version': version,
         'constant_count': constant_count,
         'function_count': function_count,
-        'main_offset': main_offset
+        'main_offset': main_offset,
+        'global_count': global_count
     }
 
+def read_globals(file, count):
+    """Read the global slot map (slot index -> variable name)."""
+    names = []
+    for _ in range(count):
+        name_len = struct.unpack('<I', file.read(4))[0]
+        names.append(file.read(name_len).decode('utf-8', errors='replace'))
+    return names
+
 def read_zval(file):
     """Read a zval from the file."""
     zval_type = struct.unpack('<B', file.read(1))[0]
@@ -62,6 +72,9 @@ def read_zval(file):
     elif zval_type == 8:  # RESOURCE
         ptr_type = struct.unpack('<I', file.read(4))[0]
         return f"{{ZVAL_RESOURCE, {{.resource_val = {{NULL, {ptr_type}}}}}}}"
+    elif zval_type == 9:  # FIXED (Q16.16)
+        value = struct.unpack('<i', file.read(4))[0]
+        return f"{{ZVAL_FIXED, {{.int_val = {value}}}}}"
     else:  # NULL or other types
         return "{ZVAL_NULL, {0}}"
 
@@ -89,6 +102,7 @@ def read_function(file):
     
     return {
         'name': name,
+        'name_len': name_len,
         'code_size': code_size,
         'local_count': local_count,
         'param_count': param_count,
@@ -112,6 +126,9 @@ def generate_c_source(mbc_file, output_file=None):
             for i in range(header['function_count']):
                 functions.append(read_function(file))
             
+            # Read global slot map
+            global_names = read_globals(file, header['global_count'])
+            
             # Generate C source
             c_source = f"""// Auto-generated by micro-PHP objgen
 // Source: {mbc_file}
@@ -153,15 +170,25 @@ static const function_t embedded_functions[] = {
             
             c_source += """};
 
+// Global slot map
+"""
+            if global_names:
+                c_source += "static char *embedded_global_names[] = {\n"
+                c_source += "".join(f'    "{name}",\n' for name in global_names)
+                c_source += "};\n"
+            
+            c_source += """
 // Main bytecode structure
 const bytecode_t embedded_program = {
     .magic = "MBC\\0",
-    .version = 1,
+    .version = 2,
     .constant_count = """ + str(header['constant_count']) + """,
     .constants = (zval_t*)embedded_constants,
     .function_count = """ + str(header['function_count']) + """,
     .functions = (function_t*)embedded_functions,
-    .main_offset = """ + str(header['main_offset']) + """
+    .main_offset = """ + str(header['main_offset']) + """,
+    .global_count = """ + str(header['global_count']) + """,
+    .global_names = """ + ("embedded_global_names" if global_names else "NULL") + """
 };
 
 // Function to get the embedded program